@@ -0,0 +1,798 @@
+// Host benchmark of the native copy, conversion (with image statistics), export, scaling, fan-out, output graph,
+// crop, motion, queue, feeder and pre-roll paths.
+//
+//   yuv_bench [--format=table|csv|json] [--filter=SUBSTRING] [--min-time-ms=N] [--threads=N] [--simd=NAME]
+//             [--capture=FILE]
+//
+// Every case runs at 720p, 1080p and 4K with row strides padded by 0, 64 and 256 bytes, over planar
+// (pixel stride 1) and semi-planar (pixel stride 2) layouts. Reports mean ns/frame, p50/p99 and the
+// throughput in GB/s of source frame bytes, plus the compression ratio for the pre-roll codec. csv and json
+// print one record per case for diffing runs.
+// --simd picks the kernel backend (scalar, sse2, avx2, neon) instead of the best one for the CPU.
+// --capture adds replay_* cases that run the queue and feeder paths on a device capture (frame_capture.h)
+// instead of synthetic frames, with the device's strides, chroma layout and plane alignment.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "delta_codec.h"
+#include "frame_capture.h"
+#include "frame_feeder.h"
+#include "frame_ring.h"
+#include "frame_sink.h"
+#include "frame_source.h"
+#include "image_stats.h"
+#include "motion_detector.h"
+#include "worker_pool.h"
+#include "yuv_convert.h"
+#include "yuv_crop.h"
+#include "yuv_fanout.h"
+#include "yuv_scaler.h"
+#include "yuv_simd.h"
+
+namespace {
+
+struct Options {
+    std::string format = "table";
+    std::string filter;
+    int minTimeMs = 100;
+    int threads = 0;
+    std::string simd;
+    std::string capture;
+};
+
+struct Result {
+    std::string path;
+    std::string srcLayout;
+    std::string dstLayout;
+    int width = 0;
+    int height = 0;
+    int padding = 0;
+    // Filled in by Bench::run
+    int iterations = 0;
+    double meanNs = 0;
+    double p50Ns = 0;
+    double p99Ns = 0;
+    double gbPerSecond = 0;
+    // Raw over compressed bytes, 0 where nothing is compressed
+    double ratio = 0;
+};
+
+struct Resolution {
+    int width;
+    int height;
+};
+
+constexpr Resolution kResolutions[] = {{1280, 720}, {1920, 1080}, {3840, 2160}};
+constexpr int kPaddings[] = {0, 64, 256};
+constexpr YUVLayout kLayouts[] = {YUVLayout::I420, YUVLayout::NV12, YUVLayout::NV21};
+constexpr int kMinIterations = 10;
+constexpr int kMaxIterations = 5000;
+
+size_t frameBytes(int width, int height) {
+    return (size_t) width * height * 3 / 2;
+}
+
+// A YUV 4:2:0 image in one of the layouts, rows padded by padding bytes
+class TestImage {
+public:
+    TestImage(int width, int height, YUVLayout layout, int padding) {
+        bool planar = layout == YUVLayout::I420;
+        int lumaStride = width + padding;
+        int chromaStride = (planar ? width / 2 : width) + padding;
+        size_t lumaSize = (size_t) lumaStride * height;
+        size_t chromaSize = (size_t) chromaStride * (height / 2);
+        buffer.resize(lumaSize + chromaSize * (planar ? 2 : 1));
+
+        std::mt19937 random(width * 31 + height);
+        for (uint8_t &byte : buffer) {
+            byte = (uint8_t) random();
+        }
+
+        uint8_t *chroma = buffer.data() + lumaSize;
+        view.width = width;
+        view.height = height;
+        view.data[0] = buffer.data();
+        view.rowStride[0] = lumaStride;
+        view.pixelStride[0] = 1;
+        view.rowStride[1] = chromaStride;
+        view.rowStride[2] = chromaStride;
+        if (planar) {
+            view.data[1] = chroma;
+            view.data[2] = chroma + chromaSize;
+            view.pixelStride[1] = view.pixelStride[2] = 1;
+        } else {
+            int uOffset = layout == YUVLayout::NV12 ? 0 : 1;
+            view.data[1] = chroma + uOffset;
+            view.data[2] = chroma + 1 - uOffset;
+            view.pixelStride[1] = view.pixelStride[2] = 2;
+        }
+    }
+
+    YUVImageView view{};
+
+private:
+    std::vector<uint8_t> buffer;
+};
+
+class NoopReleaser : public FrameReleaser {
+public:
+    void releaseFrame(void *) override {}
+};
+
+class Bench {
+public:
+    explicit Bench(const Options &options) : options(options) {}
+
+    bool wants(const std::string &name) const {
+        return options.filter.empty() || name.find(options.filter) != std::string::npos;
+    }
+
+    // Times body until minTimeMs has passed (and at least kMinIterations ran)
+    void run(Result result, size_t bytesPerFrame, const std::function<void()> &body) {
+        body();  // warm caches and lazily built plans
+
+        std::vector<double> samples;
+        auto begin = std::chrono::steady_clock::now();
+        auto minTime = std::chrono::milliseconds(options.minTimeMs);
+        while ((int) samples.size() < kMaxIterations &&
+               ((int) samples.size() < kMinIterations || std::chrono::steady_clock::now() - begin < minTime)) {
+            auto start = std::chrono::steady_clock::now();
+            body();
+            auto end = std::chrono::steady_clock::now();
+            samples.push_back((double) std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+        }
+
+        double total = 0;
+        for (double sample : samples) {
+            total += sample;
+        }
+        std::sort(samples.begin(), samples.end());
+        result.iterations = (int) samples.size();
+        result.meanNs = total / samples.size();
+        result.p50Ns = samples[samples.size() / 2];
+        result.p99Ns = samples[std::min(samples.size() - 1, samples.size() * 99 / 100)];
+        result.gbPerSecond = bytesPerFrame / result.meanNs;  // bytes per ns == GB/s
+        results.push_back(result);
+
+        if (options.format == "table") {
+            printRow(result);
+        }
+    }
+
+    void printHeader() const {
+        if (options.format == "table") {
+            printf("simd backend: %s\n", simdKernels().name);
+            printf("%-34s %-5s %-5s %11s %4s %6s %12s %12s %12s %8s %6s\n", "path", "src", "dst", "size", "pad",
+                   "iters", "ns/frame", "p50 ns", "p99 ns", "GB/s", "ratio");
+        }
+    }
+
+    void printRow(const Result &r) const {
+        char size[32];
+        snprintf(size, sizeof(size), "%dx%d", r.width, r.height);
+        char ratio[16] = "-";
+        if (r.ratio > 0) {
+            snprintf(ratio, sizeof(ratio), "%.2f", r.ratio);
+        }
+        printf("%-34s %-5s %-5s %11s %4d %6d %12.0f %12.0f %12.0f %8.2f %6s\n", r.path.c_str(), r.srcLayout.c_str(),
+               r.dstLayout.c_str(), size, r.padding, r.iterations, r.meanNs, r.p50Ns, r.p99Ns, r.gbPerSecond, ratio);
+        fflush(stdout);
+    }
+
+    void printReport(int threadCount) const {
+        if (options.format == "csv") {
+            printf("simd,path,src_layout,dst_layout,width,height,padding,iterations,ns_per_frame,p50_ns,p99_ns,gb_per_s,ratio\n");
+            for (const Result &r : results) {
+                printf("%s,%s,%s,%s,%d,%d,%d,%d,%.0f,%.0f,%.0f,%.3f,%.3f\n", simdKernels().name, r.path.c_str(),
+                       r.srcLayout.c_str(), r.dstLayout.c_str(), r.width, r.height, r.padding, r.iterations,
+                       r.meanNs, r.p50Ns, r.p99Ns, r.gbPerSecond, r.ratio);
+            }
+        } else if (options.format == "json") {
+            printf("{\n  \"simd\": \"%s\",\n  \"threads\": %d,\n  \"results\": [\n", simdKernels().name, threadCount);
+            for (size_t i = 0; i < results.size(); i++) {
+                const Result &r = results[i];
+                printf("    {\"path\": \"%s\", \"src_layout\": \"%s\", \"dst_layout\": \"%s\", \"width\": %d, "
+                       "\"height\": %d, \"padding\": %d, \"iterations\": %d, \"ns_per_frame\": %.0f, "
+                       "\"p50_ns\": %.0f, \"p99_ns\": %.0f, \"gb_per_s\": %.3f, \"ratio\": %.3f}%s\n",
+                       r.path.c_str(), r.srcLayout.c_str(), r.dstLayout.c_str(), r.width, r.height, r.padding,
+                       r.iterations, r.meanNs, r.p50Ns, r.p99Ns, r.gbPerSecond, r.ratio,
+                       i + 1 < results.size() ? "," : "");
+            }
+            printf("  ]\n}\n");
+        }
+    }
+
+private:
+    const Options &options;
+    std::vector<Result> results;
+};
+
+std::string caseName(const std::string &path, const std::string &src, const std::string &dst,
+                     const Resolution &size, int padding) {
+    return path + "/" + src + "->" + dst + "/" + std::to_string(size.width) + "x" + std::to_string(size.height) +
+           "/pad" + std::to_string(padding);
+}
+
+void benchConvert(Bench &bench, WorkerPool &pool) {
+    for (const Resolution &size : kResolutions) {
+        for (int padding : kPaddings) {
+            for (YUVLayout srcLayout : kLayouts) {
+                TestImage src(size.width, size.height, srcLayout, padding);
+                for (YUVLayout dstLayout : kLayouts) {
+                    TestImage dst(size.width, size.height, dstLayout, padding);
+                    // Plain, over the pool, and gathering ImageStats on the way ("convert_stats")
+                    for (int variant = 0; variant < 3; variant++) {
+                        std::string path = variant == 1 ? "convert_pool" : variant == 2 ? "convert_stats" : "convert";
+                        if (!bench.wants(caseName(path, layoutName(srcLayout), layoutName(dstLayout), size, padding))) {
+                            continue;
+                        }
+                        YUVConverter converter;
+                        WorkerPool *workers = variant == 1 ? &pool : nullptr;
+                        ImageStats imageStats;
+                        ImageStats *gathered = variant == 2 ? &imageStats : nullptr;
+                        bench.run({path, layoutName(srcLayout), layoutName(dstLayout), size.width, size.height, padding},
+                                  frameBytes(size.width, size.height),
+                                  [&] { converter.convert(src.view, dst.view, workers, YUVConverter::kDefaultBandBytes,
+                                                          gathered); });
+                    }
+                }
+            }
+        }
+    }
+}
+
+// Frame grab of a padded camera frame into one reusable, tightly packed buffer (I420 or NV12)
+void benchExport(Bench &bench) {
+    const YUVLayout packedLayouts[] = {YUVLayout::I420, YUVLayout::NV12};
+    for (const Resolution &size : kResolutions) {
+        for (int padding : kPaddings) {
+            for (YUVLayout srcLayout : kLayouts) {
+                TestImage src(size.width, size.height, srcLayout, padding);
+                std::vector<uint8_t> packed(packedSize(size.width, size.height));
+                for (YUVLayout dstLayout : packedLayouts) {
+                    if (!bench.wants(caseName("export", layoutName(srcLayout), layoutName(dstLayout), size, padding))) {
+                        continue;
+                    }
+                    YUVConverter converter;
+                    bench.run({"export", layoutName(srcLayout), layoutName(dstLayout), size.width, size.height, padding},
+                              frameBytes(size.width, size.height),
+                              [&] { converter.exportPacked(src.view, packed.data(), packed.size(), dstLayout); });
+                }
+            }
+        }
+    }
+}
+
+void benchScale(Bench &bench) {
+    struct FilterCase {
+        const char *name;
+        ScaleFilter filter;
+    };
+    const FilterCase filters[] = {{"scale_box", ScaleFilter::Box},
+                                  {"scale_bilinear", ScaleFilter::Bilinear},
+                                  {"scale_area", ScaleFilter::Area}};
+
+    for (const Resolution &size : kResolutions) {
+        for (int padding : kPaddings) {
+            for (YUVLayout srcLayout : kLayouts) {
+                TestImage src(size.width, size.height, srcLayout, padding);
+                for (const FilterCase &filterCase : filters) {
+                    // Box needs an exact 2:1 ratio, the others go to the LQ stream's 360p
+                    Resolution out = filterCase.filter == ScaleFilter::Box
+                                     ? Resolution{size.width / 2, size.height / 2}
+                                     : Resolution{640, 360};
+                    if (!bench.wants(caseName(filterCase.name, layoutName(srcLayout), "NV12", size, padding))) {
+                        continue;
+                    }
+                    TestImage dst(out.width, out.height, YUVLayout::NV12, padding);
+                    YUVScaler scaler;
+                    scaler.configure(size.width, size.height, out.width, out.height, filterCase.filter);
+                    bench.run({filterCase.name, layoutName(srcLayout), "NV12", size.width, size.height, padding},
+                              frameBytes(size.width, size.height),
+                              [&] { scaler.scale(src.view, dst.view); });
+                }
+            }
+        }
+    }
+}
+
+// HQ copy plus LQ 640x360 area scale of one frame: one after the other ("copy_scale") and fused into one
+// pass over the source ("fanout"), both on one thread
+void benchFanOut(Bench &bench) {
+    for (const Resolution &size : kResolutions) {
+        for (int padding : kPaddings) {
+            for (YUVLayout srcLayout : kLayouts) {
+                TestImage src(size.width, size.height, srcLayout, padding);
+                TestImage hq(size.width, size.height, YUVLayout::NV12, padding);
+                TestImage lq(640, 360, YUVLayout::NV12, padding);
+                for (int fused = 0; fused < 2; fused++) {
+                    std::string path = fused ? "fanout" : "copy_scale";
+                    if (!bench.wants(caseName(path, layoutName(srcLayout), "NV12", size, padding))) {
+                        continue;
+                    }
+                    YUVConverter converter;
+                    YUVScaler scaler;
+                    scaler.configure(size.width, size.height, 640, 360, ScaleFilter::Area);
+                    YUVFanOut fanOut;
+                    bench.run({path, layoutName(srcLayout), "NV12", size.width, size.height, padding},
+                              frameBytes(size.width, size.height), [&] {
+                                  if (fused) {
+                                      fanOut.fanOut(src.view, hq.view, lq.view, ScaleFilter::Area);
+                                  } else {
+                                      converter.convert(src.view, hq.view);
+                                      scaler.scale(src.view, lq.view);
+                                  }
+                              });
+                }
+            }
+        }
+    }
+}
+
+// Archive copy, 640x360 area live stream, 320x180 I420 thumbnail and 640x360 bilinear analytics frame of one
+// frame: one pass per output ("graph_separate") and all four in one pass over the source ("graph"), as an
+// OutputGraph writes them
+void benchOutputGraph(Bench &bench) {
+    for (const Resolution &size : kResolutions) {
+        for (int padding : kPaddings) {
+            for (YUVLayout srcLayout : kLayouts) {
+                TestImage src(size.width, size.height, srcLayout, padding);
+                TestImage hq(size.width, size.height, YUVLayout::NV12, padding);
+                TestImage lq(640, 360, YUVLayout::NV12, padding);
+                TestImage thumbnail(320, 180, YUVLayout::I420, 0);
+                TestImage analytics(640, 360, YUVLayout::NV12, 0);
+                YUVMultiOut::Target targets[4];
+                targets[0].view = hq.view;
+                targets[1].view = lq.view;
+                targets[2].view = thumbnail.view;
+                targets[3].view = analytics.view;
+                targets[3].filter = ScaleFilter::Bilinear;
+                for (int fused = 0; fused < 2; fused++) {
+                    std::string path = fused ? "graph" : "graph_separate";
+                    if (!bench.wants(caseName(path, layoutName(srcLayout), "NV12", size, padding))) {
+                        continue;
+                    }
+                    YUVConverter converter;
+                    YUVScaler scalers[3];
+                    for (int i = 0; i < 3; i++) {
+                        const YUVImageView &dst = targets[i + 1].view;
+                        scalers[i].configure(size.width, size.height, dst.width, dst.height, targets[i + 1].filter);
+                    }
+                    YUVMultiOut multiOut;
+                    bool written[4];
+                    bench.run({path, layoutName(srcLayout), "NV12", size.width, size.height, padding},
+                              frameBytes(size.width, size.height), [&] {
+                                  if (fused) {
+                                      multiOut.fanOut(src.view, targets, 4, written);
+                                  } else {
+                                      converter.convert(src.view, hq.view);
+                                      for (int i = 0; i < 3; i++) {
+                                          scalers[i].scale(src.view, targets[i + 1].view);
+                                      }
+                                  }
+                              });
+                }
+            }
+        }
+    }
+}
+
+// A 2x digital zoom of the frame centre back to the full size, as the HQ stream gets it: on the pixel grid
+// ("crop_aligned", a strided view scaled up) and between pixels ("crop_subpixel", a windowed resample), each
+// alone and over the pool ("_pool")
+void benchCrop(Bench &bench, WorkerPool &pool) {
+    for (const Resolution &size : kResolutions) {
+        for (int padding : kPaddings) {
+            for (YUVLayout srcLayout : kLayouts) {
+                TestImage src(size.width, size.height, srcLayout, padding);
+                TestImage dst(size.width, size.height, YUVLayout::NV12, padding);
+                for (int variant = 0; variant < 4; variant++) {
+                    bool subPixel = variant & 1;
+                    std::string path = subPixel ? "crop_subpixel" : "crop_aligned";
+                    WorkerPool *workers = nullptr;
+                    if (variant & 2) {
+                        path += "_pool";
+                        workers = &pool;
+                    }
+                    if (!bench.wants(caseName(path, layoutName(srcLayout), "NV12", size, padding))) {
+                        continue;
+                    }
+                    CropRect region{size.width / 4 * CropRect::kOne, size.height / 4 * CropRect::kOne,
+                                    size.width / 2 * CropRect::kOne, size.height / 2 * CropRect::kOne};
+                    if (subPixel) {
+                        region.x += CropRect::kOne / 3;
+                        region.y += CropRect::kOne / 3;
+                    }
+                    YUVCropper cropper;
+                    bench.run({path, layoutName(srcLayout), "NV12", size.width, size.height, padding},
+                              frameBytes(size.width, size.height),
+                              [&] { cropper.crop(src.view, region, dst.view, ScaleFilter::Area, workers); });
+                }
+            }
+        }
+    }
+}
+
+// Producer enqueue plus acquire/release by the HQ and LQ consumers, without the copy-out
+void benchQueue(Bench &bench) {
+    for (const Resolution &size : kResolutions) {
+        for (int padding : kPaddings) {
+            for (YUVLayout srcLayout : kLayouts) {
+                if (!bench.wants(caseName("queue_copy", layoutName(srcLayout), "ring", size, padding))) {
+                    continue;
+                }
+                TestImage src(size.width, size.height, srcLayout, padding);
+                FrameRing ring(4, size.width, size.height);
+                int consumers[] = {ring.registerConsumer(), ring.registerConsumer()};
+                const YUVImageView &v = src.view;
+                long long timestamp = 0;
+                bench.run({"queue_copy", layoutName(srcLayout), "ring", size.width, size.height, padding},
+                          frameBytes(size.width, size.height), [&] {
+                              ring.enqueue(v.width, v.height, timestamp++,
+                                           v.data[0], v.rowStride[0], v.pixelStride[0],
+                                           v.data[1], v.rowStride[1], v.pixelStride[1],
+                                           v.data[2], v.rowStride[2], v.pixelStride[2]);
+                              for (int consumer : consumers) {
+                                  if (ring.acquire(consumer) != nullptr) {
+                                      ring.release(consumer);
+                                  }
+                              }
+                          });
+            }
+        }
+
+        // Borrowed frames move no pixel data, only the bookkeeping is timed
+        if (!bench.wants(caseName("queue_borrowed", "NV12", "ring", size, 0))) {
+            continue;
+        }
+        TestImage src(size.width, size.height, YUVLayout::NV12, 0);
+        FrameRing ring(4, 0, 0);
+        NoopReleaser releaser;
+        int consumers[] = {ring.registerConsumer(), ring.registerConsumer()};
+        BorrowedFrame frame{};
+        frame.width = size.width;
+        frame.height = size.height;
+        for (int i = 0; i < 3; i++) {
+            frame.planeData[i] = src.view.data[i];
+            frame.rowStride[i] = src.view.rowStride[i];
+            frame.pixelStride[i] = src.view.pixelStride[i];
+        }
+        bench.run({"queue_borrowed", "NV12", "ring", size.width, size.height, 0}, 0, [&] {
+            frame.timestampNs++;
+            ring.enqueueBorrowed(frame, &releaser);
+            for (int consumer : consumers) {
+                if (ring.acquire(consumer) != nullptr) {
+                    ring.release(consumer);
+                }
+            }
+        });
+    }
+}
+
+// Enqueue until both native feeders (HQ copy, LQ 640x360 area scale) delivered the frame to their sink
+void benchFeeder(Bench &bench, WorkerPool &pool) {
+    for (const Resolution &size : kResolutions) {
+        if (!bench.wants(caseName("feeder", "NV12", "NV12", size, 0))) {
+            continue;
+        }
+        TestImage src(size.width, size.height, YUVLayout::NV12, 0);
+        FrameRing ring(4, size.width, size.height);
+        ring.setDropPolicy(DropPolicy::Block, 100 * 1000000LL);
+        MemorySink hqSink(size.width, size.height, YUVLayout::NV12, 2);
+        MemorySink lqSink(640, 360, YUVLayout::NV12, 2);
+        FrameFeeder hqFeeder(&ring, ring.registerConsumer(), &hqSink);
+        FrameFeeder lqFeeder(&ring, ring.registerConsumer(true), &lqSink);
+        hqFeeder.setWorkers(&pool, YUVConverter::kDefaultBandBytes);
+        lqFeeder.setScaling(ScaleFilter::Area);
+        hqFeeder.start();
+        lqFeeder.start();
+
+        const YUVImageView &v = src.view;
+        long long timestamp = 0;
+        bench.run({"feeder", "NV12", "NV12", size.width, size.height, 0}, frameBytes(size.width, size.height), [&] {
+            ring.enqueue(v.width, v.height, ++timestamp,
+                         v.data[0], v.rowStride[0], v.pixelStride[0],
+                         v.data[1], v.rowStride[1], v.pixelStride[1],
+                         v.data[2], v.rowStride[2], v.pixelStride[2]);
+            while (hqSink.getFrameCount() < (uint64_t) timestamp || lqSink.getFrameCount() < (uint64_t) timestamp) {
+                std::this_thread::yield();
+            }
+        });
+        hqFeeder.stop();
+        lqFeeder.stop();
+    }
+
+    // The same two streams off one consumer, the LQ downscale fused into the HQ copy
+    for (const Resolution &size : kResolutions) {
+        if (!bench.wants(caseName("feeder_fanout", "NV12", "NV12", size, 0))) {
+            continue;
+        }
+        TestImage src(size.width, size.height, YUVLayout::NV12, 0);
+        FrameRing ring(4, size.width, size.height);
+        ring.setDropPolicy(DropPolicy::Block, 100 * 1000000LL);
+        MemorySink hqSink(size.width, size.height, YUVLayout::NV12, 2);
+        MemorySink lqSink(640, 360, YUVLayout::NV12, 2);
+        FrameFeeder feeder(&ring, ring.registerConsumer(), &hqSink);
+        feeder.setFanOut(&lqSink, ScaleFilter::Area, 0);
+        feeder.start();
+
+        const YUVImageView &v = src.view;
+        long long timestamp = 0;
+        bench.run({"feeder_fanout", "NV12", "NV12", size.width, size.height, 0}, frameBytes(size.width, size.height),
+                  [&] {
+                      ring.enqueue(v.width, v.height, ++timestamp,
+                                   v.data[0], v.rowStride[0], v.pixelStride[0],
+                                   v.data[1], v.rowStride[1], v.pixelStride[1],
+                                   v.data[2], v.rowStride[2], v.pixelStride[2]);
+                      while (hqSink.getFrameCount() < (uint64_t) timestamp ||
+                             lqSink.getFrameCount() < (uint64_t) timestamp) {
+                          std::this_thread::yield();
+                      }
+                  });
+        feeder.stop();
+    }
+}
+
+// A camera-like NV12 clip: a gradient panning 2 pixels a frame under a few levels of sensor noise
+std::vector<std::vector<uint8_t>> cameraClip(int width, int height, int frames) {
+    std::mt19937 random(width + height);
+    std::uniform_int_distribution<int> noise(-2, 2);
+    auto level = [&](int value) {
+        return (uint8_t) std::min(255, std::max(0, value + noise(random)));
+    };
+    std::vector<std::vector<uint8_t>> clip(frames, std::vector<uint8_t>(frameBytes(width, height)));
+    for (int f = 0; f < frames; f++) {
+        uint8_t *luma = clip[f].data();
+        uint8_t *chroma = luma + (size_t) width * height;
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++) {
+                luma[(size_t) y * width + x] = level(((x + 2 * f) * 255 / width + y * 64 / height) & 0xff);
+            }
+        }
+        for (int y = 0; y < height / 2; y++) {
+            for (int x = 0; x < width; x += 2) {
+                chroma[(size_t) y * width + x] = level(96 + x * 32 / width);
+                chroma[(size_t) y * width + x + 1] = level(160 - y * 64 / height);
+            }
+        }
+    }
+    return clip;
+}
+
+// Pre-roll codec on a camera-like clip: "delta" frames predicted from the previous one, "key" frames alone
+void benchPreRoll(Bench &bench) {
+    constexpr int kClipFrames = 8;
+    for (const Resolution &size : kResolutions) {
+        size_t lumaBytes = (size_t) size.width * size.height;
+        size_t chromaBytes = frameBytes(size.width, size.height) - lumaBytes;
+        std::vector<std::vector<uint8_t>> clip;
+
+        for (bool key : {false, true}) {
+            const char *mode = key ? "key" : "delta";
+            bool encodeWanted = bench.wants(caseName("preroll_encode", "NV12", mode, size, 0));
+            bool decodeWanted = bench.wants(caseName("preroll_decode", "NV12", mode, size, 0));
+            if (!encodeWanted && !decodeWanted) {
+                continue;
+            }
+            if (clip.empty()) {
+                clip = cameraClip(size.width, size.height, kClipFrames);
+            }
+            auto reference = [&](int index) -> const uint8_t * {
+                return key ? nullptr : clip[(index + kClipFrames - 1) % kClipFrames].data();
+            };
+
+            // Every frame of the clip encoded once, for the ratio and as the decode input
+            std::vector<std::vector<uint8_t>> packed(kClipFrames);
+            std::vector<size_t> lumaSizes(kClipFrames);
+            size_t packedBytes = 0;
+            for (int i = 0; i < kClipFrames; i++) {
+                packed[i].resize(maxDeltaEncodedSize(lumaBytes) + maxDeltaEncodedSize(chromaBytes));
+                const uint8_t *previous = reference(i);
+                lumaSizes[i] = encodeDeltaPlane(clip[i].data(), previous, lumaBytes, 1, packed[i].data());
+                size_t chromaSize = encodeDeltaPlane(clip[i].data() + lumaBytes, key ? nullptr : previous + lumaBytes,
+                                                     chromaBytes, 2, packed[i].data() + lumaSizes[i]);
+                packed[i].resize(lumaSizes[i] + chromaSize);
+                packedBytes += packed[i].size();
+            }
+            double ratio = (double) frameBytes(size.width, size.height) * kClipFrames / packedBytes;
+
+            int frame = 0;
+            if (encodeWanted) {
+                std::vector<uint8_t> out(maxDeltaEncodedSize(lumaBytes) + maxDeltaEncodedSize(chromaBytes));
+                Result result{"preroll_encode", "NV12", mode, size.width, size.height, 0};
+                result.ratio = ratio;
+                bench.run(result, frameBytes(size.width, size.height), [&] {
+                    frame = (frame + 1) % kClipFrames;
+                    const uint8_t *previous = reference(frame);
+                    size_t lumaSize = encodeDeltaPlane(clip[frame].data(), previous, lumaBytes, 1, out.data());
+                    encodeDeltaPlane(clip[frame].data() + lumaBytes, key ? nullptr : previous + lumaBytes,
+                                     chromaBytes, 2, out.data() + lumaSize);
+                });
+            }
+            if (decodeWanted) {
+                std::vector<uint8_t> decoded(frameBytes(size.width, size.height));
+                Result result{"preroll_decode", "NV12", mode, size.width, size.height, 0};
+                result.ratio = ratio;
+                bench.run(result, frameBytes(size.width, size.height), [&] {
+                    frame = (frame + 1) % kClipFrames;
+                    const std::vector<uint8_t> &in = packed[frame];
+                    const uint8_t *previous = reference(frame);
+                    decodeDeltaPlane(in.data(), lumaSizes[frame], previous, lumaBytes, 1, decoded.data());
+                    decodeDeltaPlane(in.data() + lumaSizes[frame], in.size() - lumaSizes[frame],
+                                     key ? nullptr : previous + lumaBytes, chromaBytes, 2,
+                                     decoded.data() + lumaBytes);
+                });
+            }
+        }
+    }
+}
+
+// Motion analysis of the luma of consecutive camera-like frames; the throughput counts the whole frame,
+// of which only the sampled rows are read
+void benchMotion(Bench &bench) {
+    for (const Resolution &size : kResolutions) {
+        if (!bench.wants(caseName("motion", "NV12", "blocks", size, 0))) {
+            continue;
+        }
+        std::vector<std::vector<uint8_t>> clip = cameraClip(size.width, size.height, 2);
+        YUVImageView frames[] = {packedView(clip[0].data(), size.width, size.height, YUVLayout::NV12),
+                                 packedView(clip[1].data(), size.width, size.height, YUVLayout::NV12)};
+        MotionDetector detector;
+        int next = 0;
+        bench.run({"motion", "NV12", "blocks", size.width, size.height, 0}, frameBytes(size.width, size.height), [&] {
+            detector.analyze(frames[next]);
+            next ^= 1;
+        });
+    }
+}
+
+// The queue and feeder cases on a device capture, cycling through its frames
+void benchReplay(Bench &bench, WorkerPool &pool, const std::string &path) {
+    CaptureReader capture;
+    BorrowedFrame first{};
+    if (!capture.open(path.c_str()) || !capture.getFrame(0, first)) {
+        fprintf(stderr, "%s is not a readable capture\n", path.c_str());
+        return;
+    }
+    YUVImageView firstView;
+    firstView.width = first.width;
+    firstView.height = first.height;
+    for (int i = 0; i < 3; i++) {
+        firstView.data[i] = const_cast<uint8_t *>(first.planeData[i]);
+        firstView.rowStride[i] = first.rowStride[i];
+        firstView.pixelStride[i] = first.pixelStride[i];
+    }
+    Resolution size{first.width, first.height};
+    std::string layout = layoutName(detectLayout(firstView));
+    int padding = first.rowStride[0] - first.width;
+
+    int next = 0;
+    long long timestamp = 0;
+    // Frames that do not map (a damaged capture) are passed over; false when the ring refused the frame
+    auto enqueueNext = [&](FrameRing &ring) {
+        BorrowedFrame frame{};
+        for (int tries = 0; tries < capture.getFrameCount(); tries++) {
+            bool valid = capture.getFrame(next, frame);
+            next = (next + 1) % capture.getFrameCount();
+            if (valid) {
+                return ring.enqueue(frame.width, frame.height, ++timestamp,
+                                    frame.planeData[0], frame.rowStride[0], frame.pixelStride[0],
+                                    frame.planeData[1], frame.rowStride[1], frame.pixelStride[1],
+                                    frame.planeData[2], frame.rowStride[2], frame.pixelStride[2]);
+            }
+        }
+        return false;
+    };
+
+    if (bench.wants(caseName("replay_queue", layout, "ring", size, padding))) {
+        FrameRing ring(4, size.width, size.height);
+        int consumers[] = {ring.registerConsumer(), ring.registerConsumer()};
+        bench.run({"replay_queue", layout, "ring", size.width, size.height, padding},
+                  frameBytes(size.width, size.height), [&] {
+                      enqueueNext(ring);
+                      for (int consumer : consumers) {
+                          if (ring.acquire(consumer) != nullptr) {
+                              ring.release(consumer);
+                          }
+                      }
+                  });
+    }
+
+    if (bench.wants(caseName("replay_feeder", layout, "NV12", size, padding))) {
+        FrameRing ring(4, size.width, size.height);
+        ring.setDropPolicy(DropPolicy::Block, 100 * 1000000LL);
+        MemorySink hqSink(size.width, size.height, YUVLayout::NV12, 2);
+        // The LQ stream's 360p at the capture's aspect ratio, or half size for captures that small
+        Resolution lq = size.height > 360 ? Resolution{size.width * 360 / size.height / 2 * 2, 360}
+                                              : Resolution{size.width / 4 * 2, size.height / 4 * 2};
+        MemorySink lqSink(lq.width, lq.height, YUVLayout::NV12, 2);
+        FrameFeeder hqFeeder(&ring, ring.registerConsumer(), &hqSink);
+        FrameFeeder lqFeeder(&ring, ring.registerConsumer(true), &lqSink);
+        hqFeeder.setWorkers(&pool, YUVConverter::kDefaultBandBytes);
+        lqFeeder.setScaling(ScaleFilter::Area);
+        hqFeeder.start();
+        lqFeeder.start();
+        uint64_t target = 0;
+        bench.run({"replay_feeder", layout, "NV12", size.width, size.height, padding},
+                  frameBytes(size.width, size.height), [&] {
+                      if (enqueueNext(ring)) {
+                          target++;
+                      }
+                      while (hqSink.getFrameCount() < target || lqSink.getFrameCount() < target) {
+                          std::this_thread::yield();
+                      }
+                  });
+        hqFeeder.stop();
+        lqFeeder.stop();
+    }
+}
+
+bool parseOptions(int argc, char **argv, Options &options) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        auto value = [&](const char *prefix) -> const char * {
+            size_t length = strlen(prefix);
+            return arg.compare(0, length, prefix) == 0 ? arg.c_str() + length : nullptr;
+        };
+        if (const char *format = value("--format=")) {
+            options.format = format;
+        } else if (const char *filter = value("--filter=")) {
+            options.filter = filter;
+        } else if (const char *minTime = value("--min-time-ms=")) {
+            options.minTimeMs = atoi(minTime);
+        } else if (const char *threads = value("--threads=")) {
+            options.threads = atoi(threads);
+        } else if (const char *simd = value("--simd=")) {
+            options.simd = simd;
+        } else if (const char *capture = value("--capture=")) {
+            options.capture = capture;
+        } else {
+            return false;
+        }
+    }
+    return options.format == "table" || options.format == "csv" || options.format == "json";
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        fprintf(stderr, "usage: %s [--format=table|csv|json] [--filter=SUBSTRING] [--min-time-ms=N] [--threads=N] "
+                        "[--simd=NAME] [--capture=FILE]\n", argv[0]);
+        return 2;
+    }
+    if (!options.simd.empty() && !selectSimdKernels(options.simd.c_str())) {
+        fprintf(stderr, "simd backend %s is not available on this CPU\n", options.simd.c_str());
+        return 2;
+    }
+
+    WorkerPool pool(options.threads);
+    Bench bench(options);
+    bench.printHeader();
+    benchConvert(bench, pool);
+    benchExport(bench);
+    benchScale(bench);
+    benchFanOut(bench);
+    benchOutputGraph(bench);
+    benchCrop(bench, pool);
+    benchQueue(bench);
+    benchFeeder(bench, pool);
+    benchPreRoll(bench);
+    benchMotion(bench);
+    if (!options.capture.empty()) {
+        benchReplay(bench, pool, options.capture);
+    }
+    bench.printReport(pool.getThreadCount());
+    return 0;
+}
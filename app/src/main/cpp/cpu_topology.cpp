@@ -0,0 +1,218 @@
+#include "cpu_topology.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <thread>
+
+#include <sched.h>
+#include <sys/resource.h>
+
+namespace {
+
+// First line of a sysfs file as a number; fallback when it is missing or not a number
+long long readNumber(const std::string &path, long long fallback) {
+    FILE *file = fopen(path.c_str(), "r");
+    if (file == nullptr) {
+        return fallback;
+    }
+    long long value;
+    if (fscanf(file, "%lld", &value) != 1) {
+        value = fallback;
+    }
+    fclose(file);
+    return value;
+}
+
+// A sysfs CPU list such as "0-3,6,7-9"
+std::vector<int> readCpuList(const std::string &path) {
+    std::vector<int> cpus;
+    FILE *file = fopen(path.c_str(), "r");
+    if (file == nullptr) {
+        return cpus;
+    }
+    int first;
+    while (fscanf(file, "%d", &first) == 1) {
+        int last = first;
+        int separator = fgetc(file);
+        if (separator == '-') {
+            if (fscanf(file, "%d", &last) != 1) {
+                break;
+            }
+            separator = fgetc(file);
+        }
+        for (int cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++) {
+            cpus.push_back(cpu);
+        }
+        if (separator != ',') {
+            break;
+        }
+    }
+    fclose(file);
+    return cpus;
+}
+
+// What the calling thread has applied, so enter() only goes to the kernel when the placement changed
+struct AppliedPlacement {
+    const ThreadPlacer *placer = nullptr;
+    ThreadRole role = ThreadRole::Count;
+    uint32_t generation = 0;
+    uint32_t clusterMask = 0;
+};
+
+thread_local AppliedPlacement applied;
+
+}  // namespace
+
+bool CpuTopology::read(const char *root) {
+    std::string base = root;
+    std::vector<int> ids = readCpuList(base + "/present");
+    if (ids.empty()) {
+        ids = readCpuList(base + "/possible");
+    }
+    bool found = !ids.empty();
+    if (!found) {
+        for (int cpu = 0; cpu < (int) std::max(1u, std::thread::hardware_concurrency()); cpu++) {
+            ids.push_back(cpu);
+        }
+    }
+
+    cores.clear();
+    bool haveCapacity = false;
+    for (int id : ids) {
+        std::string dir = base + "/cpu" + std::to_string(id);
+        CpuCore core;
+        core.id = id;
+        core.capacity = (int) readNumber(dir + "/cpu_capacity", 0);
+        core.maxFreqKhz = readNumber(dir + "/cpufreq/cpuinfo_max_freq", 0);
+        haveCapacity = haveCapacity || core.capacity > 0;
+        cores.push_back(core);
+    }
+
+    // Distinct speeds, slowest first; one cluster each, the fastest ones merged past kMaxClusters
+    auto speed = [&](const CpuCore &core) {
+        return haveCapacity ? (long long) core.capacity : core.maxFreqKhz;
+    };
+    std::vector<long long> speeds;
+    for (const CpuCore &core : cores) {
+        speeds.push_back(speed(core));
+    }
+    std::sort(speeds.begin(), speeds.end());
+    speeds.erase(std::unique(speeds.begin(), speeds.end()), speeds.end());
+    for (CpuCore &core : cores) {
+        int cluster = (int) (std::lower_bound(speeds.begin(), speeds.end(), speed(core)) - speeds.begin());
+        core.cluster = std::min(cluster, kMaxClusters - 1);
+    }
+    clusterCount = std::min((int) speeds.size(), kMaxClusters);
+    return found;
+}
+
+int CpuTopology::clusterOf(int cpu) const {
+    for (const CpuCore &core : cores) {
+        if (core.id == cpu) {
+            return core.cluster;
+        }
+    }
+    return -1;
+}
+
+uint32_t CpuTopology::fastestClusters(int count) const {
+    uint32_t mask = 0;
+    for (int cluster = clusterCount - 1; cluster >= 0 && cluster >= clusterCount - count; cluster--) {
+        mask |= 1u << cluster;
+    }
+    return mask;
+}
+
+std::vector<int> CpuTopology::cpusOf(uint32_t clusterMask) const {
+    std::vector<int> cpus;
+    for (const CpuCore &core : cores) {
+        if (clusterMask & (1u << core.cluster)) {
+            cpus.push_back(core.id);
+        }
+    }
+    return cpus;
+}
+
+ThreadPlacer::ThreadPlacer() {
+    topology.read();
+}
+
+ThreadPlacer::ThreadPlacer(const CpuTopology &topology) : topology(topology) {}
+
+void ThreadPlacer::configure(ThreadRole role, const ThreadPlacement &placement) {
+    std::lock_guard<std::mutex> lock(mutex);
+    placements[(int) role] = placement;
+    generation.fetch_add(1, std::memory_order_release);
+}
+
+ThreadPlacement ThreadPlacer::getPlacement(ThreadRole role) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return placements[(int) role];
+}
+
+void ThreadPlacer::enter(ThreadRole role) {
+    uint32_t current = generation.load(std::memory_order_acquire);
+    if (current != 0 && (applied.placer != this || applied.role != role || applied.generation != current)) {
+        ThreadPlacement placement = getPlacement(role);
+        if (!apply(placement)) {
+            failures[(int) role].fetch_add(1, std::memory_order_relaxed);
+        }
+        applied.placer = this;
+        applied.role = role;
+        applied.generation = current;
+        applied.clusterMask = placement.clusterMask;
+    }
+
+    int cluster = topology.clusterOf(sched_getcpu());
+    if (cluster < 0) {
+        return;
+    }
+    runs[(int) role][cluster].fetch_add(1, std::memory_order_relaxed);
+    if (applied.placer == this && applied.clusterMask != 0 && !(applied.clusterMask & (1u << cluster))) {
+        misplaced[(int) role].fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+bool ThreadPlacer::apply(const ThreadPlacement &placement) const {
+    bool ok = true;
+    // Without a mask the thread goes back to every core, it may have been pinned before
+    std::vector<int> cpus = topology.cpusOf(placement.clusterMask != 0 ? placement.clusterMask : ~0u);
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus) {
+        CPU_SET(cpu, &set);
+    }
+    // pid 0 is the calling thread for both calls on Linux, nice and affinity are per thread
+    if (cpus.empty() || sched_setaffinity(0, sizeof(set), &set) != 0) {
+        ok = false;
+    }
+    if (placement.nice != ThreadPlacement::kKeepNice &&
+        setpriority(PRIO_PROCESS, 0, std::max(-20, std::min(19, placement.nice))) != 0) {
+        ok = false;
+    }
+    return ok;
+}
+
+ThreadPlacer::Summary ThreadPlacer::getSummary() const {
+    Summary summary;
+    summary.clusterCount = topology.getClusterCount();
+    for (int role = 0; role < (int) ThreadRole::Count; role++) {
+        for (int cluster = 0; cluster < CpuTopology::kMaxClusters; cluster++) {
+            summary.runs[role][cluster] = runs[role][cluster].load(std::memory_order_relaxed);
+        }
+        summary.misplaced[role] = misplaced[role].load(std::memory_order_relaxed);
+        summary.failures[role] = failures[role].load(std::memory_order_relaxed);
+    }
+    return summary;
+}
+
+void ThreadPlacer::resetCounters() {
+    for (int role = 0; role < (int) ThreadRole::Count; role++) {
+        for (int cluster = 0; cluster < CpuTopology::kMaxClusters; cluster++) {
+            runs[role][cluster].store(0, std::memory_order_relaxed);
+        }
+        misplaced[role].store(0, std::memory_order_relaxed);
+        failures[role].store(0, std::memory_order_relaxed);
+    }
+}
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <atomic>
+#include <climits>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// One CPU as sysfs describes it
+struct CpuCore {
+    int id = 0;
+    // Index into the clusters, 0 = the slowest
+    int cluster = 0;
+    // Relative compute capacity (cpu_capacity, 1024 = the biggest core), 0 when the kernel does not report it
+    int capacity = 0;
+    // cpufreq/cpuinfo_max_freq, 0 when unknown
+    long long maxFreqKhz = 0;
+};
+
+/**
+ * The CPUs of the device grouped into clusters of equal cores, e.g. little, big and prime on an
+ * ARM big.LITTLE (DynamIQ) phone, read from /sys/devices/system/cpu.
+ *
+ * Cores are grouped by cpu_capacity where the kernel reports it (energy-aware scheduling kernels do),
+ * else by their maximum frequency; clusters are ordered slowest first. Without either, every core lands
+ * in one cluster. Offline cores are included, an affinity mask may name them.
+ */
+class CpuTopology {
+public:
+    static constexpr int kMaxClusters = 8;
+    static constexpr const char *kSysfsRoot = "/sys/devices/system/cpu";
+
+    // Replaces what was read before; false when root lists no CPU, leaving one cluster of
+    // hardware_concurrency cores
+    bool read(const char *root = kSysfsRoot);
+
+    const std::vector<CpuCore> &getCores() const {
+        return cores;
+    }
+
+    int getClusterCount() const {
+        return clusterCount;
+    }
+
+    // Cluster of a CPU id (e.g. from sched_getcpu()), -1 for one not read
+    int clusterOf(int cpu) const;
+
+    // The count fastest clusters as a cluster mask (bit i = cluster i)
+    uint32_t fastestClusters(int count) const;
+
+    // CPU ids of the clusters in clusterMask
+    std::vector<int> cpusOf(uint32_t clusterMask) const;
+
+private:
+    std::vector<CpuCore> cores;
+    int clusterCount = 0;
+};
+
+// Threads whose placement is configured separately
+enum class ThreadRole {
+    // Hands camera frames to the ring (addToNativeQueue, the zero-copy ImageReader callback)
+    Ingest,
+    // WorkerPool threads splitting a copy into bands
+    CopyWorker,
+    // FrameFeeder and OutputGraph threads feeding encoders
+    Feeder,
+    Count
+};
+
+struct ThreadPlacement {
+    static constexpr int kKeepNice = INT_MIN;
+
+    // Clusters the thread may run on (bit i = cluster i of the CpuTopology); 0 = any CPU
+    uint32_t clusterMask = 0;
+    // Nice value, -20 (most favoured) to 19, e.g. -10 for Android's THREAD_PRIORITY_VIDEO; kKeepNice leaves it
+    int nice = kKeepNice;
+};
+
+/**
+ * Pins the native threads of each ThreadRole to chosen clusters (sched_setaffinity) and sets their nice
+ * value, and counts on which cluster their work actually ran.
+ *
+ * The threads apply it themselves: each calls enter() once per unit of work (a frame, a band), which
+ * applies the role's placement when it changed since that thread last applied it and samples
+ * sched_getcpu(). A configure() so reaches running threads at their next frame, and a thread the kernel
+ * would not move (e.g. a cpuset that excludes the cluster) is counted rather than failing the frame.
+ * Thread-safe.
+ */
+class ThreadPlacer {
+public:
+    struct Summary {
+        int clusterCount = 0;
+        // Units of work per role and cluster they ran on
+        uint64_t runs[(int) ThreadRole::Count][CpuTopology::kMaxClusters] = {};
+        // Units of work that ran outside the role's clusters
+        uint64_t misplaced[(int) ThreadRole::Count] = {};
+        // sched_setaffinity or setpriority calls the kernel refused
+        uint64_t failures[(int) ThreadRole::Count] = {};
+    };
+
+    // Reads the topology of this device
+    ThreadPlacer();
+
+    explicit ThreadPlacer(const CpuTopology &topology);
+
+    ThreadPlacer(const ThreadPlacer &) = delete;
+    ThreadPlacer &operator=(const ThreadPlacer &) = delete;
+
+    const CpuTopology &getTopology() const {
+        return topology;
+    }
+
+    // Takes effect on each thread of the role at its next enter()
+    void configure(ThreadRole role, const ThreadPlacement &placement);
+
+    ThreadPlacement getPlacement(ThreadRole role) const;
+
+    // On the thread doing role's work, once per unit of work
+    void enter(ThreadRole role);
+
+    Summary getSummary() const;
+
+    void resetCounters();
+
+private:
+    // Moves the calling thread; false when the kernel refused any part of it
+    bool apply(const ThreadPlacement &placement) const;
+
+    CpuTopology topology;
+    mutable std::mutex mutex;
+    ThreadPlacement placements[(int) ThreadRole::Count];
+    // Bumped by configure(), so threads notice; 0 = never configured, threads are left alone
+    std::atomic<uint32_t> generation{0};
+
+    std::atomic<uint64_t> runs[(int) ThreadRole::Count][CpuTopology::kMaxClusters] = {};
+    std::atomic<uint64_t> misplaced[(int) ThreadRole::Count] = {};
+    std::atomic<uint64_t> failures[(int) ThreadRole::Count] = {};
+};
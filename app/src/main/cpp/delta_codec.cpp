@@ -0,0 +1,242 @@
+#include "delta_codec.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+constexpr int kBlock = 16;
+constexpr uint8_t kRunFlag = 0x80;
+constexpr int kMaxRun = 128;
+
+// Full blocks are processed as two 64-bit words of 8 byte lanes (SWAR), which needs no SIMD intrinsics
+// and keeps residuals in registers from prediction to packing
+constexpr uint64_t kLow = 0x0101010101010101ULL;
+constexpr uint64_t kHigh = 0x8080808080808080ULL;
+
+inline uint64_t load64(const uint8_t *p) {
+    uint64_t word;
+    memcpy(&word, p, sizeof(word));
+    return word;
+}
+
+inline void store64(uint8_t *p, uint64_t word) {
+    memcpy(p, &word, sizeof(word));
+}
+
+// Lane-wise a - b and a + b modulo 256
+inline uint64_t laneSub(uint64_t a, uint64_t b) {
+    return ((a | kHigh) - (b & ~kHigh)) ^ ((a ^ ~b) & kHigh);
+}
+
+inline uint64_t laneAdd(uint64_t a, uint64_t b) {
+    return ((a & ~kHigh) + (b & ~kHigh)) ^ ((a ^ b) & kHigh);
+}
+
+// Maps residuals 0, -1, 1, -2, ... to 0, 1, 2, 3, ... so small changes of either sign need few bits
+inline uint64_t laneZigzag(uint64_t r) {
+    return ((r << 1) & ~kLow) ^ (((r >> 7) & kLow) * 0xff);
+}
+
+inline uint64_t laneUnzigzag(uint64_t z) {
+    return ((z >> 1) & ~kHigh) ^ ((z & kLow) * 0xff);
+}
+
+inline uint8_t zigzag(uint8_t residual) {
+    return (uint8_t) ((residual << 1) ^ (uint8_t) ((int8_t) residual >> 7));
+}
+
+inline uint8_t unzigzag(uint8_t value) {
+    return (uint8_t) ((value >> 1) ^ (uint8_t) -(value & 1));
+}
+
+inline int bitWidth(uint64_t any) {
+    any |= any >> 32;
+    any |= any >> 16;
+    any |= any >> 8;
+    uint32_t value = (uint8_t) any;
+    return value == 0 ? 0 : 32 - __builtin_clz(value);
+}
+
+// 8 lanes of at most Width bits each into the low 8 * Width bits, lane k at bit k * Width
+template<int Width>
+inline uint64_t packLanes(uint64_t z) {
+    z = (z & 0x00ff00ff00ff00ffULL) | ((z >> 8) & 0x00ff00ff00ff00ffULL) << Width;
+    z = (z & 0x0000ffff0000ffffULL) | ((z >> 16) & 0x0000ffff0000ffffULL) << (2 * Width);
+    return (z & 0xffffffffULL) | (z >> 32) << (4 * Width);
+}
+
+template<int Width>
+inline uint64_t unpackLanes(uint64_t bits) {
+    constexpr uint64_t quad = (1ULL << (4 * Width)) - 1;
+    constexpr uint64_t pair = ((1ULL << (2 * Width)) - 1) * 0x0000000100000001ULL;
+    constexpr uint64_t single = ((1ULL << Width) - 1) * 0x0001000100010001ULL;
+    bits = (bits & quad) | ((bits >> (4 * Width)) & quad) << 32;
+    bits = (bits & pair) | ((bits >> (2 * Width)) & pair) << 16;
+    return (bits & single) | ((bits >> Width) & single) << 8;
+}
+
+// Whole-word stores: the bytes written past 2 * Width are overwritten by what follows and stay within
+// the block's share of maxDeltaEncodedSize
+template<int Width>
+inline uint8_t *packBlock(uint64_t z0, uint64_t z1, uint8_t *out) {
+    store64(out, packLanes<Width>(z0));
+    store64(out + Width, packLanes<Width>(z1));
+    return out + 2 * Width;
+}
+
+template<int Width>
+inline const uint8_t *unpackBlock(const uint8_t *in, const uint8_t *end, uint64_t &z0, uint64_t &z1) {
+    constexpr uint64_t mask = Width == 8 ? ~0ULL : (1ULL << (8 * Width)) - 1;
+    uint64_t first;
+    uint64_t second;
+    if (end - in >= 8 + Width) {
+        // Whole-word loads, the bytes past the block are masked off
+        first = load64(in);
+        second = load64(in + Width);
+    } else {
+        first = second = 0;
+        memcpy(&first, in, Width);
+        memcpy(&second, in + Width, Width);
+    }
+    z0 = unpackLanes<Width>(first & mask);
+    z1 = unpackLanes<Width>(second & mask);
+    return in + 2 * Width;
+}
+
+// Constant widths let the compiler turn the lane shuffles into straight-line code
+inline uint8_t *pack(uint64_t z0, uint64_t z1, int width, uint8_t *out) {
+    switch (width) {
+        case 1: return packBlock<1>(z0, z1, out);
+        case 2: return packBlock<2>(z0, z1, out);
+        case 3: return packBlock<3>(z0, z1, out);
+        case 4: return packBlock<4>(z0, z1, out);
+        case 5: return packBlock<5>(z0, z1, out);
+        case 6: return packBlock<6>(z0, z1, out);
+        case 7: return packBlock<7>(z0, z1, out);
+        default: return packBlock<8>(z0, z1, out);
+    }
+}
+
+inline const uint8_t *unpack(const uint8_t *in, const uint8_t *end, int width, uint64_t &z0, uint64_t &z1) {
+    switch (width) {
+        case 1: return unpackBlock<1>(in, end, z0, z1);
+        case 2: return unpackBlock<2>(in, end, z0, z1);
+        case 3: return unpackBlock<3>(in, end, z0, z1);
+        case 4: return unpackBlock<4>(in, end, z0, z1);
+        case 5: return unpackBlock<5>(in, end, z0, z1);
+        case 6: return unpackBlock<6>(in, end, z0, z1);
+        case 7: return unpackBlock<7>(in, end, z0, z1);
+        default: return unpackBlock<8>(in, end, z0, z1);
+    }
+}
+
+// Zigzagged residuals of the n <= kBlock bytes at i as two words, zero past n
+inline void blockResiduals(const uint8_t *plane, const uint8_t *reference, size_t i, int n, int distance,
+                           uint64_t &z0, uint64_t &z1) {
+    if (n == kBlock && (reference != nullptr || i >= (size_t) distance)) {
+        const uint8_t *prediction = reference != nullptr ? reference + i : plane + i - distance;
+        z0 = laneZigzag(laneSub(load64(plane + i), load64(prediction)));
+        z1 = laneZigzag(laneSub(load64(plane + i + 8), load64(prediction + 8)));
+        return;
+    }
+    // Tail of the plane, or its first distance bytes that have nothing to predict from
+    uint8_t residuals[kBlock] = {};
+    for (int k = 0; k < n; k++) {
+        size_t at = i + k;
+        uint8_t prediction = reference != nullptr ? reference[at] : at >= (size_t) distance ? plane[at - distance] : 0;
+        residuals[k] = zigzag((uint8_t) (plane[at] - prediction));
+    }
+    z0 = load64(residuals);
+    z1 = load64(residuals + 8);
+}
+
+// Reconstructs the n bytes at i from their zigzagged residuals
+inline void applyResiduals(uint64_t z0, uint64_t z1, const uint8_t *reference, size_t i, int n, int distance,
+                           uint8_t *plane) {
+    if (n == kBlock && reference != nullptr) {
+        store64(plane + i, laneAdd(load64(reference + i), laneUnzigzag(z0)));
+        store64(plane + i + 8, laneAdd(load64(reference + i + 8), laneUnzigzag(z1)));
+        return;
+    }
+    // Spatial prediction depends on the bytes just decoded, so it goes byte by byte
+    uint8_t residuals[kBlock];
+    store64(residuals, z0);
+    store64(residuals + 8, z1);
+    for (int k = 0; k < n; k++) {
+        size_t at = i + k;
+        uint8_t prediction = reference != nullptr ? reference[at] : at >= (size_t) distance ? plane[at - distance] : 0;
+        plane[at] = (uint8_t) (prediction + unzigzag(residuals[k]));
+    }
+}
+
+}  // namespace
+
+size_t maxDeltaEncodedSize(size_t bytes) {
+    size_t blocks = (bytes + kBlock - 1) / kBlock;
+    return blocks * (1 + kBlock);
+}
+
+size_t encodeDeltaPlane(const uint8_t *plane, const uint8_t *reference, size_t bytes, int distance, uint8_t *out) {
+    distance = std::max(distance, 1);
+    uint8_t *start = out;
+    int run = 0;
+    for (size_t i = 0; i < bytes; i += kBlock) {
+        int n = (int) std::min<size_t>(kBlock, bytes - i);
+        uint64_t z0, z1;
+        blockResiduals(plane, reference, i, n, distance, z0, z1);
+        int width = bitWidth(z0 | z1);
+        if (width == 0) {
+            if (++run == kMaxRun) {
+                *out++ = (uint8_t) (kRunFlag | (run - 1));
+                run = 0;
+            }
+            continue;
+        }
+        if (run > 0) {
+            *out++ = (uint8_t) (kRunFlag | (run - 1));
+            run = 0;
+        }
+        *out++ = (uint8_t) width;
+        out = pack(z0, z1, width, out);
+    }
+    if (run > 0) {
+        *out++ = (uint8_t) (kRunFlag | (run - 1));
+    }
+    return out - start;
+}
+
+bool decodeDeltaPlane(const uint8_t *in, size_t inBytes, const uint8_t *reference, size_t bytes, int distance,
+                      uint8_t *plane) {
+    distance = std::max(distance, 1);
+    const uint8_t *end = in + inBytes;
+    size_t i = 0;
+    while (i < bytes) {
+        if (in >= end) {
+            return false;
+        }
+        uint8_t header = *in++;
+        if (header & kRunFlag) {
+            size_t runBytes = std::min<size_t>((size_t) ((header & ~kRunFlag) + 1) * kBlock, bytes - i);
+            if (reference != nullptr) {
+                memcpy(plane + i, reference + i, runBytes);
+            } else {
+                for (size_t k = i; k < i + runBytes; k++) {
+                    plane[k] = k >= (size_t) distance ? plane[k - distance] : 0;
+                }
+            }
+            i += runBytes;
+            continue;
+        }
+        int width = header;
+        if (width < 1 || width > 8 || end - in < 2 * width) {
+            return false;
+        }
+        uint64_t z0, z1;
+        in = unpack(in, end, width, z0, z1);
+        int n = (int) std::min<size_t>(kBlock, bytes - i);
+        applyResiduals(z0, z1, reference, i, n, distance, plane);
+        i += n;
+    }
+    return in == end;
+}
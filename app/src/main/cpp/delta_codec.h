@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Fast lossless compression of one image plane, for keeping raw frames in memory (pre-roll).
+ *
+ * Each byte is predicted, from the same byte of a reference plane (temporal, the previous frame) or from
+ * the byte distance bytes back in the same plane (spatial, 1 for luma, 2 for interleaved chroma). The
+ * residuals are zigzag mapped so small changes of either sign become small numbers, then stored in
+ * blocks of 16: a header byte with the bit width of the block's largest residual followed by the 16
+ * residuals bit-packed at that width, or one header byte for a run of up to 128 all-zero blocks. A still
+ * scene costs next to nothing and sensor noise of a few levels costs 2-4 bits per pixel; full blocks
+ * are predicted and packed 8 bytes at a time in 64-bit words.
+ */
+
+// Upper bound of encodeDeltaPlane's output for a plane of the given size
+size_t maxDeltaEncodedSize(size_t bytes);
+
+// Encodes bytes of plane, predicted from reference (same size) or, when reference is null, spatially.
+// Returns the number of bytes written to out, which must hold maxDeltaEncodedSize(bytes).
+size_t encodeDeltaPlane(const uint8_t *plane, const uint8_t *reference, size_t bytes, int distance, uint8_t *out);
+
+// Inverse of encodeDeltaPlane with the same reference / distance; false on truncated or corrupt input
+bool decodeDeltaPlane(const uint8_t *in, size_t inBytes, const uint8_t *reference, size_t bytes, int distance,
+                      uint8_t *plane);
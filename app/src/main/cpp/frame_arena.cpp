@@ -0,0 +1,93 @@
+#include "frame_arena.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+namespace {
+
+size_t alignUp(size_t value, size_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+}  // namespace
+
+FrameArena::FrameArena(int frameCount, int width, int height, int maxWidth, int maxHeight) {
+    if (frameCount <= 0 || width <= 0 || height <= 0) {
+        return;
+    }
+    size_t offset[3];
+    size_t capacity[3];
+    int rowStride[3];
+    size_t budgetBytes = layout(std::max(width, maxWidth), std::max(height, maxHeight), offset, capacity, rowStride);
+
+    void *memory = nullptr;
+    if (posix_memalign(&memory, kPlaneAlignment, budgetBytes * frameCount) != 0) {
+        return;
+    }
+    slab = static_cast<uint8_t *>(memory);
+    slabBytes = budgetBytes * frameCount;
+    this->frameCount = frameCount;
+    reshape(width, height);
+}
+
+FrameArena::~FrameArena() {
+    free(slab);
+}
+
+size_t FrameArena::layout(int width, int height, size_t offset[3], size_t capacity[3], int rowStride[3]) {
+    int chromaWidth = (width + 1) / 2;
+    int chromaHeight = (height + 1) / 2;
+    rowStride[0] = (int) alignUp(width, kRowAlignment);
+    // Room for two bytes per chroma sample: interleaved UV, or a pixel stride 2 plane
+    rowStride[1] = (int) alignUp(2 * chromaWidth, kRowAlignment);
+    rowStride[2] = rowStride[1];
+    capacity[0] = (size_t) rowStride[0] * height;
+    capacity[1] = (size_t) rowStride[1] * chromaHeight;
+    capacity[2] = capacity[1];
+
+    size_t bytes = 0;
+    for (int i = 0; i < 3; i++) {
+        offset[i] = bytes;
+        bytes += alignUp(capacity[i], kPlaneAlignment);
+    }
+    return bytes;
+}
+
+bool FrameArena::reshape(int width, int height) {
+    if (frameCount <= 0 || width <= 0 || height <= 0) {
+        return false;
+    }
+    size_t offset[3];
+    size_t capacity[3];
+    int rowStride[3];
+    size_t bytes = layout(width, height, offset, capacity, rowStride);
+    if (bytes * frameCount > slabBytes) {
+        void *memory = nullptr;
+        if (posix_memalign(&memory, kPlaneAlignment, bytes * frameCount) != 0) {
+            return false;
+        }
+        free(slab);
+        slab = static_cast<uint8_t *>(memory);
+        slabBytes = bytes * frameCount;
+    }
+
+    this->width = width;
+    this->height = height;
+    frameBytes = bytes;
+    for (int i = 0; i < 3; i++) {
+        planeOffset[i] = offset[i];
+        planeCapacity[i] = capacity[i];
+        planeRowStride[i] = rowStride[i];
+    }
+    return true;
+}
+
+void FrameArena::attach(int index, YUV420 &frame) const {
+    if (slab == nullptr || index < 0 || index >= frameCount) {
+        return;
+    }
+    uint8_t *base = slab + (size_t) index * frameBytes;
+    for (int i = 0; i < 3; i++) {
+        frame.attachStorage(i, base + planeOffset[i], planeCapacity[i], planeRowStride[i]);
+    }
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "yuv_frame.h"
+
+/**
+ * Pixel storage for a fixed number of frames in one page-aligned slab, allocated once at setup.
+ *
+ * Every plane of every frame starts on its own page and its rows are padded to a cache line, so
+ * copies into one plane never share a line or a page with another plane or frame. Chroma planes are
+ * sized for a pixel stride of 2, which covers planar, semi-planar and interleaved camera layouts.
+ */
+class FrameArena {
+public:
+    static constexpr size_t kPlaneAlignment = 4096;
+    static constexpr int kRowAlignment = 64;
+
+    // width/height of 0 (or a failed allocation) leave the arena empty, see isValid(). The slab is sized
+    // for maxWidth x maxHeight when larger, so reshape() up to that size never allocates.
+    FrameArena(int frameCount, int width, int height, int maxWidth = 0, int maxHeight = 0);
+
+    ~FrameArena();
+
+    FrameArena(const FrameArena &) = delete;
+    FrameArena &operator=(const FrameArena &) = delete;
+
+    bool isValid() const {
+        return slab != nullptr;
+    }
+
+    // Lays the frames out for a new size, reusing the slab when it is big enough and allocating a new
+    // one otherwise. Nobody may use the attached storage meanwhile; re-attach every frame afterwards.
+    // On failure the arena keeps its previous size.
+    bool reshape(int width, int height);
+
+    // Points the frame's planes at the storage of frame index; the frame must not outlive the arena
+    void attach(int index, YUV420 &frame) const;
+
+    int getWidth() const {
+        return width;
+    }
+
+    int getHeight() const {
+        return height;
+    }
+
+    size_t getFrameBytes() const {
+        return frameBytes;
+    }
+
+    size_t getSlabBytes() const {
+        return slabBytes;
+    }
+
+private:
+    // Fills the plane layout for a size, returns the bytes per frame
+    static size_t layout(int width, int height, size_t offset[3], size_t capacity[3], int rowStride[3]);
+
+    uint8_t *slab = nullptr;
+    size_t slabBytes = 0;
+    int frameCount = 0;
+    int width = 0;
+    int height = 0;
+    // Per plane, relative to the start of a frame
+    size_t planeOffset[3] = {0, 0, 0};
+    size_t planeCapacity[3] = {0, 0, 0};
+    int planeRowStride[3] = {0, 0, 0};
+    size_t frameBytes = 0;
+};
@@ -0,0 +1,375 @@
+#include "frame_capture.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "frame_stats.h"
+
+namespace {
+
+constexpr char kCaptureMagic[8] = {'Y', 'U', 'V', 'C', 'A', 'P', 'T', 'R'};
+constexpr uint32_t kCaptureVersion = 1;
+constexpr size_t kPageBytes = 4096;
+
+// Longest single sleep of a paced replay, so stop() is noticed promptly
+constexpr long long kMaxReplaySleepNs = 20 * 1000000LL;
+
+// Bytes spanned by plane i of a frame, chroma subsampled 2x2
+size_t captureExtent(int plane, int width, int height, int rowStride, int pixelStride) {
+    if (plane > 0) {
+        width = (width + 1) / 2;
+        height = (height + 1) / 2;
+    }
+    return planeExtent(width, height, rowStride, pixelStride);
+}
+
+}  // namespace
+
+CaptureRecorder::~CaptureRecorder() {
+    stop();
+}
+
+bool CaptureRecorder::start(const char *path, int bufferCount) {
+    stop();
+    fd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    // Placeholder until stop() knows where the index went
+    CaptureHeader header{};
+    memcpy(header.magic, kCaptureMagic, sizeof(header.magic));
+    header.version = kCaptureVersion;
+    fileOffset = 0;
+    index.clear();
+    failed.store(false, std::memory_order_relaxed);
+    recordedFrames.store(0, std::memory_order_relaxed);
+    missedFrames.store(0, std::memory_order_relaxed);
+    if (!writeAll(&header, sizeof(header))) {
+        ::close(fd);
+        fd = -1;
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    // Frame buffers keep their memory from one recording to the next
+    buffers.resize(std::max(bufferCount, 1));
+    writeIndex = 0;
+    filled = 0;
+    stopping = false;
+    recording = true;
+    writer = std::thread(&CaptureRecorder::run, this);
+    return true;
+}
+
+bool CaptureRecorder::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!recording) {
+            return false;
+        }
+        recording = false;
+        stopping = true;
+    }
+    filledCondition.notify_one();
+    writer.join();
+
+    bool written = !failed.load(std::memory_order_relaxed);
+    // The index goes after the last frame, 64-byte aligned for whoever maps it
+    static const uint8_t zeros[64] = {};
+    size_t padding = (64 - fileOffset % 64) % 64;
+    written = written && writeAll(zeros, padding);
+    uint64_t indexOffset = fileOffset;
+    written = written && writeAll(index.data(), index.size() * sizeof(CaptureIndexEntry));
+
+    CaptureHeader header{};
+    memcpy(header.magic, kCaptureMagic, sizeof(header.magic));
+    header.version = kCaptureVersion;
+    header.frameCount = (uint32_t) index.size();
+    header.indexOffset = indexOffset;
+    written = written && pwrite(fd, &header, sizeof(header), 0) == (ssize_t) sizeof(header);
+    ::close(fd);
+    fd = -1;
+    return written;
+}
+
+bool CaptureRecorder::record(int width, int height, long long timestampNs,
+                             const uint8_t *yData, int yRowStride, int yPixelStride,
+                             const uint8_t *uData, int uRowStride, int uPixelStride,
+                             const uint8_t *vData, int vRowStride, int vPixelStride) {
+    const uint8_t *data[] = {yData, uData, vData};
+    int rowStride[] = {yRowStride, uRowStride, vRowStride};
+    int pixelStride[] = {yPixelStride, uPixelStride, vPixelStride};
+
+    // The copy runs under the lock: the writer only takes it to pick up and return a buffer, never for I/O
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!recording) {
+        return false;
+    }
+    if (filled == (int) buffers.size()) {
+        missedFrames.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    Pending &pending = buffers[(writeIndex + filled) % buffers.size()];
+
+    // Planes whose bytes overlap (interleaved chroma) share a span, in their original relative layout
+    uintptr_t begin[3];
+    uintptr_t end[3];
+    for (int i = 0; i < 3; i++) {
+        begin[i] = (uintptr_t) data[i];
+        end[i] = begin[i] + captureExtent(i, width, height, rowStride[i], pixelStride[i]);
+    }
+    uintptr_t spanBegin[3];
+    uintptr_t spanEnd[3];
+    pending.spanCount = 0;
+    for (int i = 0; i < 3; i++) {
+        int span = 0;
+        while (span < pending.spanCount && (begin[i] >= spanEnd[span] || end[i] <= spanBegin[span])) {
+            span++;
+        }
+        if (span == pending.spanCount) {
+            spanBegin[span] = begin[i];
+            spanEnd[span] = end[i];
+            pending.spanCount++;
+        } else {
+            spanBegin[span] = std::min(spanBegin[span], begin[i]);
+            spanEnd[span] = std::max(spanEnd[span], end[i]);
+        }
+        pending.planeSpan[i] = span;
+    }
+
+    size_t total = 0;
+    for (int span = 0; span < pending.spanCount; span++) {
+        pending.spanSize[span] = spanEnd[span] - spanBegin[span];
+        pending.spanAlignment[span] = spanBegin[span] % kPageBytes;
+        total += pending.spanSize[span];
+    }
+    // Grows to the frame size on the first frames only
+    pending.bytes.resize(total);
+    size_t offset = 0;
+    for (int span = 0; span < pending.spanCount; span++) {
+        memcpy(pending.bytes.data() + offset, (const uint8_t *) spanBegin[span], pending.spanSize[span]);
+        offset += pending.spanSize[span];
+    }
+    for (int i = 0; i < 3; i++) {
+        pending.planeOffset[i] = begin[i] - spanBegin[pending.planeSpan[i]];
+        pending.entry.rowStride[i] = rowStride[i];
+        pending.entry.pixelStride[i] = pixelStride[i];
+    }
+    pending.entry.timestampNs = timestampNs;
+    pending.entry.width = width;
+    pending.entry.height = height;
+
+    filled++;
+    recordedFrames.fetch_add(1, std::memory_order_relaxed);
+    filledCondition.notify_one();
+    return true;
+}
+
+void CaptureRecorder::run() {
+    for (;;) {
+        Pending *pending;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            filledCondition.wait(lock, [this] { return filled > 0 || stopping; });
+            if (filled == 0) {
+                return;
+            }
+            pending = &buffers[writeIndex];
+        }
+        if (!failed.load(std::memory_order_relaxed) && !writeFrame(*pending)) {
+            failed.store(true, std::memory_order_relaxed);
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        writeIndex = (writeIndex + 1) % (int) buffers.size();
+        filled--;
+    }
+}
+
+bool CaptureRecorder::writeFrame(Pending &pending) {
+    static const uint8_t zeros[kPageBytes] = {};
+    uint64_t spanOffset[3];
+    size_t offset = 0;
+    for (int span = 0; span < pending.spanCount; span++) {
+        size_t padding = (pending.spanAlignment[span] + kPageBytes - fileOffset % kPageBytes) % kPageBytes;
+        if (!writeAll(zeros, padding)) {
+            return false;
+        }
+        spanOffset[span] = fileOffset;
+        if (!writeAll(pending.bytes.data() + offset, pending.spanSize[span])) {
+            return false;
+        }
+        offset += pending.spanSize[span];
+    }
+    for (int i = 0; i < 3; i++) {
+        pending.entry.planeOffset[i] = spanOffset[pending.planeSpan[i]] + pending.planeOffset[i];
+    }
+    index.push_back(pending.entry);
+    return true;
+}
+
+bool CaptureRecorder::writeAll(const void *data, size_t bytes) {
+    const uint8_t *next = static_cast<const uint8_t *>(data);
+    while (bytes > 0) {
+        ssize_t written = ::write(fd, next, bytes);
+        if (written <= 0) {
+            return false;
+        }
+        next += written;
+        bytes -= written;
+        fileOffset += written;
+    }
+    return true;
+}
+
+CaptureReader::~CaptureReader() {
+    close();
+}
+
+bool CaptureReader::open(const char *path) {
+    close();
+    int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat info{};
+    void *address = MAP_FAILED;
+    if (fstat(fd, &info) == 0 && info.st_size >= (off_t) sizeof(CaptureHeader)) {
+        address = mmap(nullptr, (size_t) info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    // The mapping keeps the file alive
+    ::close(fd);
+    if (address == MAP_FAILED) {
+        return false;
+    }
+    mapping = static_cast<uint8_t *>(address);
+    mappingBytes = (size_t) info.st_size;
+
+    const CaptureHeader *header = reinterpret_cast<const CaptureHeader *>(mapping);
+    uint64_t indexBytes = (uint64_t) header->frameCount * sizeof(CaptureIndexEntry);
+    if (memcmp(header->magic, kCaptureMagic, sizeof(kCaptureMagic)) != 0 || header->version != kCaptureVersion ||
+        header->indexOffset < sizeof(CaptureHeader) || header->indexOffset % 64 != 0 ||
+        header->indexOffset > mappingBytes || indexBytes > mappingBytes - header->indexOffset) {
+        close();
+        return false;
+    }
+    entries = reinterpret_cast<const CaptureIndexEntry *>(mapping + header->indexOffset);
+    frameCount = (int) header->frameCount;
+    // Replays read the frames front to back
+    madvise(mapping, mappingBytes, MADV_SEQUENTIAL);
+    return true;
+}
+
+void CaptureReader::close() {
+    if (mapping != nullptr) {
+        munmap(mapping, mappingBytes);
+        mapping = nullptr;
+        mappingBytes = 0;
+    }
+    entries = nullptr;
+    frameCount = 0;
+}
+
+bool CaptureReader::getFrame(int index, BorrowedFrame &frame) const {
+    if (index < 0 || index >= frameCount) {
+        return false;
+    }
+    const CaptureIndexEntry &entry = entries[index];
+    if (entry.width <= 0 || entry.height <= 0) {
+        return false;
+    }
+    for (int i = 0; i < 3; i++) {
+        size_t extent = captureExtent(i, entry.width, entry.height, entry.rowStride[i], entry.pixelStride[i]);
+        if (entry.rowStride[i] <= 0 || entry.pixelStride[i] <= 0 || entry.planeOffset[i] > mappingBytes ||
+            extent > mappingBytes - entry.planeOffset[i]) {
+            return false;
+        }
+        frame.planeData[i] = mapping + entry.planeOffset[i];
+        frame.rowStride[i] = entry.rowStride[i];
+        frame.pixelStride[i] = entry.pixelStride[i];
+    }
+    frame.width = entry.width;
+    frame.height = entry.height;
+    frame.timestampNs = entry.timestampNs;
+    frame.handle = nullptr;
+    return true;
+}
+
+long long CaptureReader::getDurationNs() const {
+    return frameCount > 1 ? entries[frameCount - 1].timestampNs - entries[0].timestampNs : 0;
+}
+
+CaptureReplayer::CaptureReplayer(const CaptureReader &reader, FrameRing *ring) : reader(reader), ring(ring) {}
+
+CaptureReplayer::~CaptureReplayer() {
+    stop();
+}
+
+bool CaptureReplayer::start(double speed, int loops) {
+    stop();
+    if (ring == nullptr || reader.getFrameCount() == 0 || speed < 0) {
+        return false;
+    }
+    stopping.store(false);
+    running.store(true);
+    thread = std::thread(&CaptureReplayer::run, this, speed, loops);
+    return true;
+}
+
+void CaptureReplayer::stop() {
+    if (!thread.joinable()) {
+        return;
+    }
+    stopping.store(true);
+    thread.join();
+}
+
+void CaptureReplayer::run(double speed, int loops) {
+    int frameCount = reader.getFrameCount();
+    // Each loop continues one frame interval after the last frame of the previous one
+    long long intervalNs = frameCount > 1 ? reader.getDurationNs() / (frameCount - 1) : 33333333LL;
+    long long loopNs = reader.getDurationNs() + intervalNs;
+    long long startNs = steadyNowNs();
+    long long firstTimestampNs = -1;
+
+    BorrowedFrame frame{};
+    for (int loop = 0; loops == 0 || loop < loops; loop++) {
+        for (int i = 0; i < frameCount; i++) {
+            if (stopping.load(std::memory_order_relaxed)) {
+                running.store(false, std::memory_order_release);
+                return;
+            }
+            if (!reader.getFrame(i, frame)) {
+                continue;
+            }
+            long long timestampNs = frame.timestampNs + loop * loopNs;
+            if (firstTimestampNs < 0) {
+                firstTimestampNs = timestampNs;
+            }
+            if (speed > 0) {
+                long long dueNs = startNs + (long long) ((timestampNs - firstTimestampNs) / speed);
+                long long waitNs;
+                while ((waitNs = dueNs - steadyNowNs()) > 0 && !stopping.load(std::memory_order_relaxed)) {
+                    std::this_thread::sleep_for(std::chrono::nanoseconds(std::min(waitNs, kMaxReplaySleepNs)));
+                }
+            }
+
+            // Timed like addToNativeQueue, so replayed ingest compares with the device's
+            ScopedStageTimer timer(ring->getStats(), FrameStage::Ingest);
+            bool accepted = ring->enqueue(frame.width, frame.height, timestampNs,
+                                          frame.planeData[0], frame.rowStride[0], frame.pixelStride[0],
+                                          frame.planeData[1], frame.rowStride[1], frame.pixelStride[1],
+                                          frame.planeData[2], frame.rowStride[2], frame.pixelStride[2]);
+            pushedFrames.fetch_add(1, std::memory_order_relaxed);
+            if (!accepted) {
+                refusedFrames.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+    }
+    running.store(false, std::memory_order_release);
+}
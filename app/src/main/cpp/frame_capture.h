@@ -0,0 +1,214 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "frame_ring.h"
+#include "frame_source.h"
+
+/**
+ * Capture file: raw camera frames exactly as the native queue received them, to replay the copy and queue
+ * path offline (a Linux box, yuv_bench --capture) with a device's real strides and layouts.
+ *
+ *   header (64 bytes) | frame data ... | index (CaptureIndexEntry per frame)
+ *
+ * Every plane keeps its row stride, pixel stride and padding. Planes whose bytes overlap, like the U and V
+ * planes of semi-planar chroma, are stored once and keep their relative position, and every stored span
+ * starts at the same offset within a 4 KiB page as it had in memory, so a mapped capture hands the
+ * converters the pointer layout and alignment they saw on the device. The index is written last; a capture
+ * that was not closed has none and does not open. All fields are little-endian, as on every supported ABI.
+ */
+struct CaptureHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t frameCount;
+    uint64_t indexOffset;
+    uint8_t reserved[40];
+};
+
+struct CaptureIndexEntry {
+    int64_t timestampNs;
+    int32_t width;
+    int32_t height;
+    // File offset of each plane's first sample
+    uint64_t planeOffset[3];
+    int32_t rowStride[3];
+    int32_t pixelStride[3];
+};
+
+static_assert(sizeof(CaptureHeader) == 64, "capture header layout");
+static_assert(sizeof(CaptureIndexEntry) == 64, "capture index layout");
+
+/**
+ * Writes the frames handed to the native queue into a capture file. record() runs on the camera thread: it
+ * copies the frame into one of a few buffers, sized by the first frames and reused after that, and a writer
+ * thread of its own does the file I/O, so a slow disk costs skipped frames (getMissedFrames), never a late
+ * camera callback.
+ */
+class CaptureRecorder {
+public:
+    static constexpr int kDefaultBufferCount = 4;
+
+    CaptureRecorder() = default;
+
+    // Stops if still recording
+    ~CaptureRecorder();
+
+    CaptureRecorder(const CaptureRecorder &) = delete;
+    CaptureRecorder &operator=(const CaptureRecorder &) = delete;
+
+    // Creates path, replacing it, and starts the writer thread; bufferCount frames can wait for the disk
+    bool start(const char *path, int bufferCount = kDefaultBufferCount);
+
+    // Writes what is still buffered and the index; the capture is only readable after this
+    bool stop();
+
+    bool isRecording() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return recording;
+    }
+
+    // Camera thread: queues one frame for writing; false when every buffer is still waiting for the disk
+    bool record(int width, int height, long long timestampNs,
+                const uint8_t *yData, int yRowStride, int yPixelStride,
+                const uint8_t *uData, int uRowStride, int uPixelStride,
+                const uint8_t *vData, int vRowStride, int vPixelStride);
+
+    uint64_t getRecordedFrames() const {
+        return recordedFrames.load(std::memory_order_relaxed);
+    }
+
+    uint64_t getMissedFrames() const {
+        return missedFrames.load(std::memory_order_relaxed);
+    }
+
+    // Writes failed at some point, the capture is cut short there
+    bool hasFailed() const {
+        return failed.load(std::memory_order_relaxed);
+    }
+
+private:
+    // A frame's bytes: up to three non-overlapping spans and where each plane lies in them
+    struct Pending {
+        std::vector<uint8_t> bytes;
+        int spanCount = 0;
+        size_t spanSize[3] = {0, 0, 0};
+        // Offset of each span's first byte within its 4 KiB page in memory
+        size_t spanAlignment[3] = {0, 0, 0};
+        int planeSpan[3] = {0, 0, 0};
+        size_t planeOffset[3] = {0, 0, 0};
+        CaptureIndexEntry entry{};
+    };
+
+    void run();
+
+    // Appends a frame's spans at their page offsets and fills in the plane offsets; false on a write error
+    bool writeFrame(Pending &pending);
+
+    bool writeAll(const void *data, size_t bytes);
+
+    int fd = -1;
+    uint64_t fileOffset = 0;
+    std::vector<CaptureIndexEntry> index;
+    std::vector<Pending> buffers;
+
+    // Buffers [writeIndex, writeIndex + filled) wait for the writer thread, the camera fills the next free one
+    mutable std::mutex mutex;
+    std::condition_variable filledCondition;
+    bool recording = false;
+    int writeIndex = 0;
+    int filled = 0;
+    bool stopping = false;
+    std::thread writer;
+
+    std::atomic<uint64_t> recordedFrames{0};
+    std::atomic<uint64_t> missedFrames{0};
+    std::atomic<bool> failed{false};
+};
+
+// A capture file mapped read-only; frames point straight into the mapping
+class CaptureReader {
+public:
+    CaptureReader() = default;
+
+    ~CaptureReader();
+
+    CaptureReader(const CaptureReader &) = delete;
+    CaptureReader &operator=(const CaptureReader &) = delete;
+
+    // False when the file cannot be mapped, is not a capture or has no index (was never closed)
+    bool open(const char *path);
+
+    void close();
+
+    bool isOpen() const {
+        return mapping != nullptr;
+    }
+
+    int getFrameCount() const {
+        return frameCount;
+    }
+
+    // Frame index as a borrowed frame (no handle); false when it lies outside the file
+    bool getFrame(int index, BorrowedFrame &frame) const;
+
+    // Capture time from the first to the last frame
+    long long getDurationNs() const;
+
+private:
+    uint8_t *mapping = nullptr;
+    size_t mappingBytes = 0;
+    const CaptureIndexEntry *entries = nullptr;
+    int frameCount = 0;
+};
+
+/**
+ * Feeds a capture into a FrameRing from a thread of its own, through enqueue() like addToNativeQueue,
+ * at the captured pace scaled by speed (1 = as recorded) or, with speed 0, as fast as enqueue() returns.
+ * Loops are stitched together with timestamps that keep increasing by the capture's frame interval.
+ */
+class CaptureReplayer {
+public:
+    CaptureReplayer(const CaptureReader &reader, FrameRing *ring);
+
+    // Stops the thread if still running
+    ~CaptureReplayer();
+
+    CaptureReplayer(const CaptureReplayer &) = delete;
+    CaptureReplayer &operator=(const CaptureReplayer &) = delete;
+
+    // loops passes over the capture, 0 = until stop()
+    bool start(double speed, int loops);
+
+    void stop();
+
+    // True until the last loop was pushed or stop()
+    bool isRunning() const {
+        return running.load(std::memory_order_acquire);
+    }
+
+    uint64_t getPushedFrames() const {
+        return pushedFrames.load(std::memory_order_relaxed);
+    }
+
+    // Of the pushed frames, the ones the ring refused
+    uint64_t getRefusedFrames() const {
+        return refusedFrames.load(std::memory_order_relaxed);
+    }
+
+private:
+    void run(double speed, int loops);
+
+    const CaptureReader &reader;
+    FrameRing *ring;
+    std::thread thread;
+    std::atomic<bool> running{false};
+    std::atomic<bool> stopping{false};
+    std::atomic<uint64_t> pushedFrames{0};
+    std::atomic<uint64_t> refusedFrames{0};
+};
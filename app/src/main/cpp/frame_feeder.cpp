@@ -0,0 +1,232 @@
+#include "frame_feeder.h"
+
+FrameFeeder::FrameFeeder(FrameRing *ring, int consumerId, FrameSink *sink)
+        : ring(ring), consumerId(consumerId), sink(sink), stats(ring != nullptr ? ring->getStats() : nullptr) {}
+
+FrameFeeder::~FrameFeeder() {
+    stop();
+}
+
+bool FrameFeeder::start() {
+    if (running.load() || ring == nullptr || sink == nullptr || consumerId < 0) {
+        return false;
+    }
+    running.store(true);
+    thread = std::thread(&FrameFeeder::run, this);
+    return true;
+}
+
+void FrameFeeder::stop() {
+    if (!thread.joinable()) {
+        return;
+    }
+    running.store(false);
+    thread.join();
+    sink->finish();
+    if (scaledSink != nullptr) {
+        scaledSink->finish();
+    }
+}
+
+void FrameFeeder::run() {
+    if (preRoll != nullptr) {
+        replayPreRoll();
+    }
+
+    SinkBuffer buffer;
+    bool holding = false;
+    while (running.load(std::memory_order_relaxed)) {
+        if (!ring->waitForFrame(consumerId, kFrameWaitNs)) {
+            continue;
+        }
+        // Keep a buffer across iterations rather than handing the encoder an empty one
+        if (!holding && !sink->dequeueBuffer(kBufferWaitUs, buffer)) {
+            continue;
+        }
+        holding = true;
+        if (placer != nullptr) {
+            placer->enter(ThreadRole::Feeder);
+        }
+
+        long long timestampUs = 0;
+        if (feed(buffer, timestampUs)) {
+            sink->queueBuffer(buffer, timestampUs, true);
+            holding = false;
+            fedFrames.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    if (holding) {
+        sink->queueBuffer(buffer, 0, false);
+    }
+}
+
+void FrameFeeder::replayPreRoll() {
+    replaying = true;
+    PreRollReader reader(*preRoll);
+    // The live frames of a paced consumer are paced in the ring; replayed ones have to be paced here
+    FramePacer pacer;
+    pacer.setFrameRate(ring->getFrameRate(consumerId));
+    long long timestampUs = 0;
+    while (running.load(std::memory_order_relaxed)) {
+        skipStoredFrames();
+        if (!reader.next(timestampUs)) {
+            // Caught up with the store, the live frames take over
+            replaying = false;
+            break;
+        }
+        if (!pacer.accept(timestampUs * 1000)) {
+            continue;
+        }
+        if (placer != nullptr) {
+            placer->enter(ThreadRole::Feeder);
+        }
+        SinkBuffer buffer;
+        while (!sink->dequeueBuffer(kBufferWaitUs, buffer)) {
+            if (!running.load(std::memory_order_relaxed)) {
+                return;
+            }
+            skipStoredFrames();
+        }
+        bool filled = fill(reader.view(), buffer.view, timestampUs);
+        sink->queueBuffer(buffer, timestampUs, filled);
+        replayedUntilUs = timestampUs;
+        if (filled) {
+            fedFrames.fetch_add(1, std::memory_order_relaxed);
+            replayedFrames.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+}
+
+void FrameFeeder::skipStoredFrames() {
+    long long storedUntilUs = preRoll->getNewestTimestampUs();
+    YUV420 *frame;
+    while ((frame = ring->acquire(consumerId)) != nullptr &&
+           toPresentationTimeUs(frame->timestampNs) <= storedUntilUs) {
+        ring->release(consumerId);
+    }
+    // A frame the store does not have yet stays acquired and comes out of acquire() again
+}
+
+bool FrameFeeder::feed(const SinkBuffer &buffer, long long &timestampUs) {
+    YUV420 *frame = ring->acquire(consumerId);
+    if (frame == nullptr) {
+        return false;
+    }
+    timestampUs = toPresentationTimeUs(frame->timestampNs);
+    if (timestampUs <= replayedUntilUs) {
+        // Already went out in the replay
+        ring->release(consumerId);
+        return false;
+    }
+    if (stats != nullptr) {
+        stats->record(FrameStage::QueueWait, steadyNowNs() - frame->enqueuedNs);
+    }
+    if (scaledSink == nullptr && !passesMotionGate(frame->view(), timestampUs)) {
+        ring->release(consumerId);
+        if (stats != nullptr) {
+            stats->count(FrameCounter::Still);
+        }
+        return false;
+    }
+    bool filled = fill(frame->view(), buffer.view, timestampUs);
+    ring->release(consumerId);
+    if (filled && scaledSink == nullptr) {
+        gatedUntilUs = timestampUs;
+    }
+    return filled;
+}
+
+bool FrameFeeder::fill(const YUVImageView &src, const YUVImageView &dst, long long timestampUs) {
+    // The region is read once per frame, so both outputs of a fan-out show the same part
+    CropRect region;
+    bool cropping = crop != nullptr && !crop->isWhole();
+    if (cropping) {
+        region = crop->resolve(src.width, src.height);
+    }
+    if (scaledSink != nullptr && !scaling) {
+        return fillFanOut(src, dst, timestampUs, cropping ? &region : nullptr);
+    }
+    ScopedStageTimer timer(stats, scaling ? FrameStage::LqCopy : FrameStage::HqCopy);
+    if (cropping) {
+        return cropper.crop(src, region, dst, scaling ? filter : ScaleFilter::Bilinear, pool, bandBytes);
+    }
+    if (!scaling) {
+        converter.convert(src, dst, pool, bandBytes, imageStatsLog != nullptr ? &imageStats : nullptr);
+        recordImageStats(src, timestampUs);
+        return true;
+    }
+    bool ready = scaler.isConfiguredFor(src.width, src.height, dst.width, dst.height, filter) ||
+                 scaler.configure(src.width, src.height, dst.width, dst.height, filter);
+    if (ready) {
+        scaler.scale(src, dst);
+    }
+    return ready;
+}
+
+bool FrameFeeder::fillFanOut(const YUVImageView &src, const YUVImageView &dst, long long timestampUs,
+                             const CropRect *region) {
+    SinkBuffer scaled;
+    // Every frame goes through the detector, so the HQ stream gets its key frame on the cut itself
+    bool moving = replaying || passesMotionGate(src, timestampUs);
+    bool wanted = scaledPacer.accept(timestampUs * 1000);
+    if (wanted && !moving && stats != nullptr) {
+        stats->count(FrameCounter::Still);
+    }
+    wanted = wanted && moving && scaledSink->dequeueBuffer(0, scaled);
+    bool copied = true;
+    bool fused = false;
+    if (region != nullptr) {
+        // A crop resamples each output from its own window, there is no shared pass to fuse
+        {
+            ScopedStageTimer timer(stats, FrameStage::HqCopy);
+            copied = cropper.crop(src, *region, dst, ScaleFilter::Bilinear, pool, bandBytes);
+        }
+        ScopedStageTimer timer(stats, FrameStage::LqCopy);
+        fused = wanted && scaledCropper.crop(src, *region, scaled.view, filter, nullptr, bandBytes);
+    } else {
+        // The fused pass counts as the HQ copy, it is one walk over the source
+        ScopedStageTimer timer(stats, FrameStage::HqCopy);
+        ImageStats *gathered = imageStatsLog != nullptr ? &imageStats : nullptr;
+        fused = wanted && fanOut.fanOut(src, dst, scaled.view, filter, bandBytes, gathered);
+        if (!fused) {
+            fanOut.copy(src, dst, pool, bandBytes, gathered);
+        }
+        recordImageStats(src, timestampUs);
+    }
+    if (wanted) {
+        scaledSink->queueBuffer(scaled, timestampUs, fused);
+    }
+    if (fused) {
+        scaledFrames.fetch_add(1, std::memory_order_relaxed);
+        gatedUntilUs = timestampUs;
+    }
+    return copied;
+}
+
+void FrameFeeder::recordImageStats(const YUVImageView &src, long long timestampUs) {
+    if (imageStatsLog != nullptr) {
+        imageStatsLog->record(timestampUs, src.width, src.height, imageStats);
+    }
+}
+
+bool FrameFeeder::passesMotionGate(const YUVImageView &src, long long timestampUs) {
+    if (motion == nullptr) {
+        return true;
+    }
+    {
+        ScopedStageTimer timer(stats, FrameStage::Motion);
+        motion->analyze(src);
+    }
+    if (motion->isSceneCut()) {
+        sink->requestKeyFrame();
+        if (scaledSink != nullptr) {
+            scaledSink->requestKeyFrame();
+        }
+    }
+    if (!motion->hasCompared() || motion->getChangedBlocks() > 0) {
+        return true;
+    }
+    // Nothing moved: only the floor rate, and a stream that restarted after a timestamp jump, still get it
+    return gatedUntilUs < 0 || timestampUs < gatedUntilUs ||
+           (motionFloorUs > 0 && timestampUs - gatedUntilUs >= motionFloorUs);
+}
@@ -0,0 +1,180 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+
+#include "cpu_topology.h"
+#include "frame_ring.h"
+#include "frame_sink.h"
+#include "frame_stats.h"
+#include "image_stats.h"
+#include "motion_detector.h"
+#include "pre_roll_store.h"
+#include "worker_pool.h"
+#include "yuv_convert.h"
+#include "yuv_crop.h"
+#include "yuv_fanout.h"
+#include "yuv_scaler.h"
+
+/**
+ * Drives one output stream natively: a thread that waits for the stream's next frame in the ring,
+ * takes an input buffer from the sink, copies (or downscales) the frame into it and queues it, with
+ * no JVM call on the way.
+ *
+ * A frame is only acquired once the sink had a free buffer, so a stalled encoder leaves frames in
+ * the ring where the ring's drop policy deals with them. Each feeder keeps its own converter and
+ * scaler; feeders may share a WorkerPool, a busy pool just runs the copy on the feeder thread.
+ */
+class FrameFeeder {
+public:
+    FrameFeeder(FrameRing *ring, int consumerId, FrameSink *sink);
+
+    // Stops the thread if still running
+    ~FrameFeeder();
+
+    FrameFeeder(const FrameFeeder &) = delete;
+    FrameFeeder &operator=(const FrameFeeder &) = delete;
+
+    // Downscales into the sink's buffers instead of copying; set before start()
+    void setScaling(ScaleFilter filter) {
+        scaling = true;
+        this->filter = filter;
+    }
+
+    // Also downscales the frames a pacer at fps (0 = every frame) keeps into scaledSink's buffers, in the
+    // same pass over the source as the copy (YUVFanOut), so one consumer feeds two encoders. The copy
+    // never waits for scaledSink: a frame it has no free buffer for is left out of the scaled stream.
+    // Not with setScaling; set before start()
+    void setFanOut(FrameSink *scaledSink, ScaleFilter filter, double fps) {
+        this->scaledSink = scaledSink;
+        this->filter = filter;
+        scaledPacer.setFrameRate(fps);
+    }
+
+    // Leaves frames in which nothing moved out of the gated stream (the sink, or scaledSink with a fan-out)
+    // but still passes one at least every 1 / minFps seconds (0 = no floor), and asks every sink for a
+    // key frame at a scene cut. detector must outlive the feeder; set before start()
+    void setMotionGate(MotionDetector *detector, double minFps) {
+        motion = detector;
+        motionFloorUs = minFps > 0 ? (long long) (1e6 / minFps) : 0;
+    }
+
+    // Copies only the region control currently holds, scaled to the sink's size (and scaledSink's with a
+    // fan-out); control is read once per frame and must outlive the feeder. Set before start()
+    void setCrop(const CropControl *control) {
+        crop = control;
+    }
+
+    // Gathers the statistics of every frame copied whole (not cropped or scaled) during the copy and
+    // records them in log, which must outlive the feeder; set before start()
+    void setImageStats(ImageStatsLog *log) {
+        imageStatsLog = log;
+    }
+
+    // Runs the thread where the placer's ThreadRole::Feeder placement puts it; placer must outlive the
+    // feeder. Set before start()
+    void setPlacer(ThreadPlacer *placer) {
+        this->placer = placer;
+    }
+
+    // Where queue waits and copies are timed, the ring's stats by default; nullptr for none. Set before start()
+    void setStats(FrameStats *stats) {
+        this->stats = stats;
+    }
+
+    // Spreads copies over pool in bands of bandBytes; set before start()
+    void setWorkers(WorkerPool *pool, int bandBytes) {
+        this->pool = pool;
+        this->bandBytes = bandBytes;
+    }
+
+    // Replays the store's frames first, paced like the live ones, then goes on with the live frames
+    // newer than the last one replayed. The store may still be fed meanwhile; set before start()
+    void setPreRoll(const PreRollStore *store) {
+        preRoll = store;
+    }
+
+    bool start();
+
+    // Joins the thread, hands back a buffer it still held and finishes the sink
+    void stop();
+
+    uint64_t getFedFrames() const {
+        return fedFrames.load(std::memory_order_relaxed);
+    }
+
+    // Frames delivered to the fan-out's scaledSink
+    uint64_t getScaledFrames() const {
+        return scaledFrames.load(std::memory_order_relaxed);
+    }
+
+    // Of the fed frames, the ones that came from the pre-roll store
+    uint64_t getReplayedFrames() const {
+        return replayedFrames.load(std::memory_order_relaxed);
+    }
+
+private:
+    // Upper bounds on one wait, so stop() is noticed promptly
+    static constexpr long long kFrameWaitNs = 20 * 1000000LL;
+    static constexpr long long kBufferWaitUs = 10 * 1000;
+
+    void run();
+
+    // Fills buffer with the next frame; false when there was none after all or it could not be scaled
+    bool feed(const SinkBuffer &buffer, long long &timestampUs);
+
+    // Runs the motion detector on a live frame; true when the gated stream should take it
+    bool passesMotionGate(const YUVImageView &src, long long timestampUs);
+
+    // Copies or scales src into dst, fanning out to scaledSink when set; false when the scale is not supported
+    bool fill(const YUVImageView &src, const YUVImageView &dst, long long timestampUs);
+
+    // Copies src (or region of it) into dst and, when the pacer keeps the frame and scaledSink has a buffer,
+    // scales it there; false when the crop could not be scaled into dst
+    bool fillFanOut(const YUVImageView &src, const YUVImageView &dst, long long timestampUs, const CropRect *region);
+
+    // Hands the statistics the last whole copy gathered to the log
+    void recordImageStats(const YUVImageView &src, long long timestampUs);
+
+    void replayPreRoll();
+
+    // Releases queued frames the store already holds, so the ring does not fill up during the replay
+    void skipStoredFrames();
+
+    FrameRing *ring;
+    int consumerId;
+    FrameSink *sink;
+    FrameStats *stats;
+    bool scaling = false;
+    ScaleFilter filter = ScaleFilter::Area;
+    WorkerPool *pool = nullptr;
+    int bandBytes = YUVConverter::kDefaultBandBytes;
+    const PreRollStore *preRoll = nullptr;
+    ThreadPlacer *placer = nullptr;
+    const CropControl *crop = nullptr;
+    ImageStatsLog *imageStatsLog = nullptr;
+    ImageStats imageStats;
+    FrameSink *scaledSink = nullptr;
+    FramePacer scaledPacer;
+    MotionDetector *motion = nullptr;
+    long long motionFloorUs = 0;
+    // Last frame the gated stream took
+    long long gatedUntilUs = -1;
+    // Replayed frames bypass the gate
+    bool replaying = false;
+    // Live frames up to here were replayed from the store
+    long long replayedUntilUs = -1;
+
+    YUVConverter converter;
+    YUVScaler scaler;
+    YUVFanOut fanOut;
+    YUVCropper cropper;
+    YUVCropper scaledCropper;
+
+    std::thread thread;
+    std::atomic<bool> running{false};
+    std::atomic<uint64_t> fedFrames{0};
+    std::atomic<uint64_t> replayedFrames{0};
+    std::atomic<uint64_t> scaledFrames{0};
+};
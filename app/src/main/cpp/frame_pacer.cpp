@@ -0,0 +1,40 @@
+#include "frame_pacer.h"
+
+#include <algorithm>
+#include <cmath>
+
+void FramePacer::setFrameRate(double fps, double jitterTolerance) {
+    frameRate = fps > 0 ? fps : 0;
+    intervalNs = frameRate > 0 ? std::llround(1e9 / frameRate) : 0;
+    toleranceNs = (long long) (intervalNs * std::min(std::max(jitterTolerance, 0.0), 0.5));
+    anchorNs = -1;
+    nextTick = 0;
+    lastAcceptedNs = -1;
+}
+
+long long FramePacer::dueTimeNs(long long tick) const {
+    // From the anchor every time: rounding never accumulates
+    return anchorNs + std::llround(tick * 1e9 / frameRate);
+}
+
+bool FramePacer::accept(long long timestampNs) {
+    if (frameRate <= 0) {
+        return true;
+    }
+    if (anchorNs >= 0 && timestampNs >= lastAcceptedNs) {
+        long long dueNs = dueTimeNs(nextTick);
+        if (timestampNs < dueNs - toleranceNs) {
+            return false;
+        }
+        if (timestampNs - dueNs < intervalNs) {
+            nextTick++;
+            lastAcceptedNs = timestampNs;
+            return true;
+        }
+        // More than an interval late: a stall, not jitter
+    }
+    anchorNs = timestampNs;
+    nextTick = 1;
+    lastAcceptedNs = timestampNs;
+    return true;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+// Camera timestamps are ns, MediaCodec and MediaMuxer presentation times are us
+inline long long toPresentationTimeUs(long long timestampNs) {
+    return (timestampNs + 500) / 1000;
+}
+
+/**
+ * Thins a stream of capture timestamps down to a target frame rate, e.g. 15 fps for the LQ encoder off a
+ * 30 fps camera.
+ *
+ * Frames are picked against a grid of due times anchored at the first frame, one target interval apart,
+ * rather than by counting frames: a camera at 29.97 fps, varying exposure times or dropped frames still
+ * give the target rate on average, and the grid does not drift because due times are computed from the
+ * anchor, not accumulated. A frame up to jitterTolerance of an interval before its due time counts as on
+ * time. After a stall longer than an interval the grid re-anchors on the next frame instead of passing a
+ * burst of frames to catch up, and so it does when timestamps go backwards (a new capture session).
+ */
+class FramePacer {
+public:
+    static constexpr double kDefaultJitterTolerance = 0.25;
+
+    // 0 passes every frame; starts a new grid at the next frame
+    void setFrameRate(double fps, double jitterTolerance = kDefaultJitterTolerance);
+
+    double getFrameRate() const {
+        return frameRate;
+    }
+
+    // True when the frame taken at timestampNs is kept. Called once per frame, from one thread.
+    bool accept(long long timestampNs);
+
+private:
+    long long dueTimeNs(long long tick) const;
+
+    double frameRate = 0;
+    long long intervalNs = 0;
+    long long toleranceNs = 0;
+    // Grid origin and the index of the next due time on it; anchorNs < 0 until the first frame
+    long long anchorNs = -1;
+    long long nextTick = 0;
+    long long lastAcceptedNs = -1;
+};
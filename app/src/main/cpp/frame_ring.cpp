@@ -0,0 +1,637 @@
+#include "frame_ring.h"
+
+#include <chrono>
+#include <thread>
+
+#ifdef __linux__
+#include <sys/eventfd.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+// Upper bounds on one wait of the spill thread, so stopSpillThread() is noticed promptly
+constexpr long long kSpillIdleWaitNs = 20 * 1000000LL;
+constexpr long long kSpillRoomWaitNs = 20 * 1000000LL;
+
+}  // namespace
+
+FrameRing::FrameRing(int capacity, int width, int height, int maxWidth, int maxHeight)
+        : arena(capacity, width, height, maxWidth, maxHeight), slots(new Slot[capacity]), capacity(capacity) {
+    for (int i = 0; i < capacity; i++) {
+        arena.attach(i, slots[i].frame);
+    }
+}
+
+FrameRing::~FrameRing() {
+    stopSpillThread();
+
+    // Let waitForFrame() callers leave before the condition variable goes away
+    closing.store(true);
+    {
+        std::lock_guard<std::mutex> lock(frameMutex);
+        frameAvailable.notify_all();
+    }
+    while (frameWaiters.load() > 0) {
+        std::this_thread::yield();
+    }
+    { std::lock_guard<std::mutex> lock(frameMutex); }
+#ifdef __linux__
+    if (eventFd.load() >= 0) {
+        ::close(eventFd.load());
+    }
+#endif
+
+    // Hand back borrowed frames nobody released, consumers are expected to be stopped by now
+    for (int i = 0; i < capacity; i++) {
+        Slot &slot = slots[i];
+        FrameReleaser *releaser = slot.releaser.load(std::memory_order_relaxed);
+        if (slot.pendingReaders.exchange(0) != 0 && releaser != nullptr) {
+            releaser->releaseFrame(slot.borrowedHandle.load(std::memory_order_relaxed));
+        }
+    }
+}
+
+int FrameRing::registerConsumer(bool latestOnly) {
+    std::lock_guard<std::mutex> guard(registrationMutex);
+    uint32_t mask = activeMask.load(std::memory_order_relaxed);
+    for (int i = 0; i < kMaxConsumers; i++) {
+        uint32_t bit = 1u << i;
+        if (mask & bit) {
+            continue;
+        }
+        Cursor &cursor = cursors[i];
+        // Set before the bit, the producer reads it as soon as it sees the bit. Frames published from here
+        // on with a mask sampled before the bit do not count us as a reader; acquire() passes over them
+        // instead of moving readSeq past the producer's back.
+        cursor.readSeq.store(writeSeq.load());
+        cursor.pinnedSeq.store(kNoSeq, std::memory_order_relaxed);
+        cursor.latestOnly = latestOnly;
+        cursor.lastTimestampNs = -1;
+        cursor.pacer.setFrameRate(0);
+        activeMask.fetch_or(bit);
+        return i;
+    }
+    return -1;
+}
+
+void FrameRing::unregisterConsumer(int consumerId) {
+    if (consumerId < 0 || consumerId >= kMaxConsumers) {
+        return;
+    }
+    std::lock_guard<std::mutex> guard(registrationMutex);
+    uint32_t bit = 1u << consumerId;
+    activeMask.fetch_and(~bit);
+    cursors[consumerId].pinnedSeq.store(kNoSeq);
+    // A blocked producer may have been waiting on this consumer
+    wakeProducer();
+
+    // A publish begun before the fetch_and may still count us as a reader; once it is done, no slot gets
+    // our bit any more and the id can be handed out again without inheriting references
+    uint64_t begun = publishesBegun.load();
+    while (publishesDone.load() < begun) {
+        std::this_thread::yield();
+    }
+    // Give up this consumer's references on borrowed frames it never got to
+    for (int i = 0; i < capacity; i++) {
+        dropReaders(slots[i], bit);
+    }
+}
+
+void FrameRing::setFrameRate(int consumerId, double fps) {
+    if (consumerId >= 0 && consumerId < kMaxConsumers) {
+        cursors[consumerId].pacer.setFrameRate(fps);
+    }
+}
+
+void FrameRing::wakeProducer() {
+    // Loaded after the readSeq store that made room, pairs with waitForRoom storing it before hasRoomFor
+    if (producerWaiting.load()) {
+        { std::lock_guard<std::mutex> lock(roomMutex); }
+        roomAvailable.notify_one();
+    }
+}
+
+bool FrameRing::hasRoomFor(uint64_t seq, uint32_t mask) {
+    // The slot for seq was last used by seq - capacity; it is free once every consumer moved past it
+    // Sequentially consistent loads: waitForRoom relies on them being ordered after producerWaiting
+    for (int i = 0; mask != 0; i++, mask >>= 1) {
+        if ((mask & 1u) && seq - cursors[i].readSeq.load() >= (uint64_t) capacity) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void FrameRing::wakeConsumers() {
+    // Sequentially consistent like the writeSeq store before it: either a waiter that counted itself
+    // sees the new frame, or we see the waiter
+    if (frameWaiters.load() > 0) {
+        { std::lock_guard<std::mutex> lock(frameMutex); }
+        frameAvailable.notify_all();
+    }
+#ifdef __linux__
+    int fd = eventFd.load(std::memory_order_relaxed);
+    if (fd >= 0) {
+        uint64_t one = 1;
+        // Only fails when the counter would overflow, i.e. nobody has read it in ages
+        (void) ::write(fd, &one, sizeof(one));
+    }
+#endif
+}
+
+bool FrameRing::makeRoom(uint64_t seq, uint32_t mask) {
+    if (hasRoomFor(seq, mask)) {
+        return true;
+    }
+    switch (dropPolicy) {
+        case DropPolicy::DropOldest:
+            if (evictOldest(seq, mask)) {
+                return true;
+            }
+            // A consumer is reading the frame in that slot, fall back to refusing this one
+            break;
+        case DropPolicy::Block:
+            if (waitForRoom(seq, mask, blockTimeoutNs)) {
+                return true;
+            }
+            droppedFrames.fetch_add(1, std::memory_order_relaxed);
+            countFrame(FrameCounter::TimedOut);
+            return false;
+        case DropPolicy::DropNewest:
+            break;
+    }
+    droppedFrames.fetch_add(1, std::memory_order_relaxed);
+    countFrame(FrameCounter::Dropped);
+    return false;
+}
+
+bool FrameRing::tryEvict(int consumerId, uint64_t seq, FrameCounter counter) {
+    Cursor &cursor = cursors[consumerId];
+    // Announce first, then look for a pin: the consumer pins first, then looks for the announcement
+    cursor.evictSeq.store(seq);
+    bool pinned = cursor.pinnedSeq.load() == seq;
+    if (!pinned) {
+        uint64_t expected = seq;
+        // Losing the race means the consumer released or skipped the frame itself
+        if (cursor.readSeq.compare_exchange_strong(expected, seq + 1)) {
+            dropReaders(slots[seq % capacity], 1u << consumerId);
+            countFrame(counter);
+        }
+    }
+    cursor.evictSeq.store(kNoSeq, std::memory_order_release);
+    return !pinned;
+}
+
+bool FrameRing::evictOldest(uint64_t seq, uint32_t mask) {
+    uint64_t oldest = seq - capacity;
+    bool freed = true;
+    for (int i = 0; mask != 0; i++, mask >>= 1) {
+        if ((mask & 1u) && cursors[i].readSeq.load(std::memory_order_acquire) == oldest &&
+            !tryEvict(i, oldest, FrameCounter::Overwritten)) {
+            freed = false;
+        }
+    }
+    return freed;
+}
+
+bool FrameRing::drain(long long timeoutNs) {
+    uint64_t published = writeSeq.load(std::memory_order_acquire);
+    long long deadlineNs = steadyNowNs() + timeoutNs;
+    uint32_t mask = activeMask.load();
+    for (int i = 0; mask != 0; i++, mask >>= 1) {
+        if (!(mask & 1u)) {
+            continue;
+        }
+        for (;;) {
+            uint64_t seq = cursors[i].readSeq.load(std::memory_order_acquire);
+            if (seq == published) {
+                break;
+            }
+            if (!tryEvict(i, seq, FrameCounter::Flushed)) {
+                // Being copied right now, it is released within a frame time
+                if (steadyNowNs() > deadlineNs) {
+                    return false;
+                }
+                std::this_thread::yield();
+            }
+        }
+    }
+    return true;
+}
+
+bool FrameRing::reconfigure(int width, int height, long long drainTimeoutNs) {
+    std::lock_guard<std::mutex> guard(registrationMutex);
+    // The spill thread publishes too, keep it out until the storage is reshaped
+    stopSpillThread();
+    bool reconfigured = drain(drainTimeoutNs) && reshapeStorage(width, height);
+    startSpillThread();
+    return reconfigured;
+}
+
+bool FrameRing::reshapeStorage(int width, int height) {
+    if (spill != nullptr) {
+        // Every consumer would have got the spilled frames the ring never saw
+        int discarded = spill->discardPending();
+        if (stats != nullptr && discarded > 0) {
+            stats->count(FrameCounter::Flushed, (uint64_t) discarded * __builtin_popcount(activeMask.load()));
+        }
+        // A spill that cannot be resized closes and the ring drops as if it had none
+        if (spill->getFrameWidth() != width || spill->getFrameHeight() != height) {
+            spill->reshape(width, height);
+        }
+    }
+    if (!arena.isValid() || (width == arena.getWidth() && height == arena.getHeight())) {
+        return true;
+    }
+    // Nothing is queued or pinned any more and the producer is stopped, so no one touches the storage
+    if (!arena.reshape(width, height)) {
+        return false;
+    }
+    for (int i = 0; i < capacity; i++) {
+        arena.attach(i, slots[i].frame);
+    }
+    return true;
+}
+
+bool FrameRing::waitForRoom(uint64_t seq, uint32_t mask, long long timeoutNs) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::nanoseconds(timeoutNs);
+    std::unique_lock<std::mutex> lock(roomMutex);
+    producerWaiting.store(true);
+    // Consumers that unregister while we wait no longer count
+    bool room;
+    while (!(room = hasRoomFor(seq, mask & activeMask.load()))) {
+        if (roomAvailable.wait_until(lock, deadline) == std::cv_status::timeout) {
+            room = hasRoomFor(seq, mask & activeMask.load());
+            break;
+        }
+    }
+    producerWaiting.store(false);
+    return room;
+}
+
+void FrameRing::dropReaders(Slot &slot, uint32_t readers) {
+    // Read before dropping: once the last reference is gone the producer may reuse the slot
+    FrameReleaser *releaser = slot.releaser.load(std::memory_order_relaxed);
+    void *handle = slot.borrowedHandle.load(std::memory_order_relaxed);
+    uint32_t previous = slot.pendingReaders.fetch_and(~readers, std::memory_order_acq_rel);
+    if ((previous & readers) != 0 && (previous & ~readers) == 0 && releaser != nullptr) {
+        releaser->releaseFrame(handle);
+    }
+}
+
+void FrameRing::reclaim(Slot &slot) {
+    uint32_t stale = slot.pendingReaders.load(std::memory_order_acquire);
+    if (stale != 0) {
+        dropReaders(slot, stale);
+    }
+}
+
+uint32_t FrameRing::beginPublish() {
+    // Sequentially consistent: a publish whose mask still has a departing consumer's bit was begun before
+    // unregisterConsumer() cleared it
+    publishesBegun.fetch_add(1);
+    return activeMask.load();
+}
+
+void FrameRing::endPublish() {
+    publishesDone.fetch_add(1, std::memory_order_release);
+}
+
+void FrameRing::countFrame(FrameCounter counter) {
+    if (stats != nullptr) {
+        stats->count(counter);
+    }
+}
+
+bool FrameRing::enqueue(int width, int height, long long timestampNs,
+                        const uint8_t *yData, int yRowStride, int yPixelStride,
+                        const uint8_t *uData, int uRowStride, int uPixelStride,
+                        const uint8_t *vData, int vRowStride, int vPixelStride) {
+    if (spill != nullptr && mustSpill()) {
+        YUVImageView view;
+        view.width = width;
+        view.height = height;
+        const uint8_t *data[] = {yData, uData, vData};
+        int rowStride[] = {yRowStride, uRowStride, vRowStride};
+        int pixelStride[] = {yPixelStride, uPixelStride, vPixelStride};
+        for (int i = 0; i < 3; i++) {
+            view.data[i] = const_cast<uint8_t *>(data[i]);
+            view.rowStride[i] = rowStride[i];
+            view.pixelStride[i] = pixelStride[i];
+        }
+        return spillFrame(view, timestampNs);
+    }
+
+    uint64_t seq = writeSeq.load(std::memory_order_relaxed);
+    Slot &slot = slots[seq % capacity];
+    // Every slot has the same storage, set up in the constructor
+    if (!slot.frame.fits(width, height)) {
+        droppedFrames.fetch_add(1, std::memory_order_relaxed);
+        countFrame(FrameCounter::Dropped);
+        return false;
+    }
+    uint32_t mask = beginPublish();
+    if (!makeRoom(seq, mask)) {
+        endPublish();
+        return false;
+    }
+
+    reclaim(slot);
+    slot.frame.update(width, height, timestampNs,
+                      yData, yRowStride, yPixelStride,
+                      uData, uRowStride, uPixelStride,
+                      vData, vRowStride, vPixelStride);
+    slot.frame.enqueuedNs = steadyNowNs();
+    slot.borrowedHandle.store(nullptr, std::memory_order_relaxed);
+    slot.releaser.store(nullptr, std::memory_order_relaxed);
+    slot.pendingReaders.store(0, std::memory_order_relaxed);
+    slot.readers.store(mask, std::memory_order_relaxed);
+
+    writeSeq.store(seq + 1);
+    endPublish();
+    countFrame(FrameCounter::Frames);
+    wakeConsumers();
+    return true;
+}
+
+bool FrameRing::enqueueBorrowed(const BorrowedFrame &frame, FrameReleaser *releaser) {
+    if (activeMask.load() == 0) {
+        // Nobody is reading, the frame can go back straight away
+        releaser->releaseFrame(frame.handle);
+        return true;
+    }
+    if (spill != nullptr && mustSpill()) {
+        YUVImageView view;
+        view.width = frame.width;
+        view.height = frame.height;
+        for (int i = 0; i < 3; i++) {
+            view.data[i] = const_cast<uint8_t *>(frame.planeData[i]);
+            view.rowStride[i] = frame.rowStride[i];
+            view.pixelStride[i] = frame.pixelStride[i];
+        }
+        // Spilled as a copy, so the source gets its buffer back right away
+        bool spilled = spillFrame(view, frame.timestampNs);
+        releaser->releaseFrame(frame.handle);
+        return spilled;
+    }
+    uint64_t seq = writeSeq.load(std::memory_order_relaxed);
+    uint32_t mask = beginPublish();
+    if (mask == 0) {
+        // The last consumer left in the meantime
+        endPublish();
+        releaser->releaseFrame(frame.handle);
+        return true;
+    }
+    if (!makeRoom(seq, mask)) {
+        endPublish();
+        releaser->releaseFrame(frame.handle);
+        return false;
+    }
+    publishBorrowed(seq, mask, frame, releaser, steadyNowNs());
+    endPublish();
+    return true;
+}
+
+void FrameRing::publishBorrowed(uint64_t seq, uint32_t mask, const BorrowedFrame &frame, FrameReleaser *releaser,
+                                long long enqueuedNs) {
+    Slot &slot = slots[seq % capacity];
+    reclaim(slot);
+    slot.frame.borrow(frame.width, frame.height, frame.timestampNs,
+                      frame.planeData[0], frame.rowStride[0], frame.pixelStride[0],
+                      frame.planeData[1], frame.rowStride[1], frame.pixelStride[1],
+                      frame.planeData[2], frame.rowStride[2], frame.pixelStride[2]);
+    slot.frame.enqueuedNs = enqueuedNs;
+    slot.borrowedHandle.store(frame.handle, std::memory_order_relaxed);
+    slot.releaser.store(releaser, std::memory_order_relaxed);
+    slot.pendingReaders.store(mask, std::memory_order_release);
+    slot.readers.store(mask, std::memory_order_relaxed);
+
+    writeSeq.store(seq + 1);
+    countFrame(FrameCounter::Frames);
+    wakeConsumers();
+    // A consumer that unregistered after we sampled the mask drops its reference once we are done
+}
+
+bool FrameRing::enableSpill(const char *path, int frameCount, int width, int height) {
+    stopSpillThread();
+    spill.reset(new FrameSpill());
+    if (!spill->open(path, frameCount, width, height)) {
+        spill.reset();
+        return false;
+    }
+    startSpillThread();
+    return true;
+}
+
+bool FrameRing::mustSpill() {
+    if (!spill->isOpen()) {
+        return false;
+    }
+    // The spill thread is the producer while spilled frames are pending; once it published the last
+    // one, getPending() returning 0 makes its writeSeq visible here
+    return spill->getPending() > 0 || !hasRoomFor(writeSeq.load(std::memory_order_relaxed), activeMask.load());
+}
+
+bool FrameRing::spillFrame(const YUVImageView &frame, long long timestampNs) {
+    if (!spill->push(frame, timestampNs)) {
+        // The ring is not ours to make room in while spilled frames wait, so no drop policy applies
+        droppedFrames.fetch_add(1, std::memory_order_relaxed);
+        countFrame(FrameCounter::Dropped);
+        return false;
+    }
+    countFrame(FrameCounter::Spilled);
+    // Sequentially consistent after push(), pairs with runSpill() setting spillIdle before looking
+    if (spillIdle.load()) {
+        { std::lock_guard<std::mutex> lock(spillMutex); }
+        spillReady.notify_one();
+    }
+    return true;
+}
+
+void FrameRing::runSpill() {
+    BorrowedFrame frame{};
+    long long spilledNs = 0;
+    while (!spillStopping.load(std::memory_order_relaxed)) {
+        if (!spill->front(frame, spilledNs)) {
+            std::unique_lock<std::mutex> lock(spillMutex);
+            spillIdle.store(true);
+            if (spill->getPending() == 0 && !spillStopping.load()) {
+                spillReady.wait_for(lock, std::chrono::nanoseconds(kSpillIdleWaitNs));
+            }
+            spillIdle.store(false);
+            continue;
+        }
+        spill->prefetch();
+
+        uint64_t seq = writeSeq.load(std::memory_order_relaxed);
+        uint32_t mask = beginPublish();
+        if (mask == 0) {
+            // Nobody to hand it to
+            endPublish();
+            spill->markPublished();
+            spill->releaseFrame(frame.handle);
+            continue;
+        }
+        if (!hasRoomFor(seq, mask) && !waitForRoom(seq, mask, kSpillRoomWaitNs)) {
+            endPublish();
+            continue;
+        }
+        // Queue wait counts from the spill, SpillWait tells how much of it was spent there
+        publishBorrowed(seq, mask, frame, spill.get(), spilledNs);
+        endPublish();
+        // The producer may publish again from here on, unless more frames are pending
+        spill->markPublished();
+        if (stats != nullptr) {
+            stats->record(FrameStage::SpillWait, steadyNowNs() - spilledNs);
+        }
+    }
+}
+
+void FrameRing::startSpillThread() {
+    if (spill == nullptr || !spill->isOpen() || spillThread.joinable()) {
+        return;
+    }
+    spillStopping.store(false);
+    spillThread = std::thread(&FrameRing::runSpill, this);
+}
+
+void FrameRing::stopSpillThread() {
+    if (!spillThread.joinable()) {
+        return;
+    }
+    spillStopping.store(true);
+    {
+        std::lock_guard<std::mutex> lock(spillMutex);
+        spillReady.notify_one();
+    }
+    spillThread.join();
+}
+
+YUV420 *FrameRing::acquire(int consumerId) {
+    if (consumerId < 0 || consumerId >= kMaxConsumers) {
+        return nullptr;
+    }
+    Cursor &cursor = cursors[consumerId];
+    uint32_t bit = 1u << consumerId;
+    for (;;) {
+        uint64_t seq = cursor.readSeq.load(std::memory_order_acquire);
+        uint64_t published = writeSeq.load(std::memory_order_acquire);
+        if (seq == published) {
+            return nullptr;
+        }
+        if (cursor.pinnedSeq.load(std::memory_order_relaxed) == seq) {
+            // Acquired before without a release, e.g. peeked at; the producer cannot have moved it
+            return &slots[seq % capacity].frame;
+        }
+        cursor.pinnedSeq.store(seq);
+        if (cursor.evictSeq.load() == seq || cursor.readSeq.load() != seq) {
+            // The producer is evicting or just evicted this frame, retry on the next one
+            cursor.pinnedSeq.store(kNoSeq, std::memory_order_relaxed);
+            continue;
+        }
+        Slot &slot = slots[seq % capacity];
+        if (!(slot.readers.load(std::memory_order_relaxed) & bit)) {
+            // Published with a mask sampled before we registered, so it holds no reference of ours. Every
+            // later publish counts us, so the producer cannot have recycled a slot we still had to read
+            cursor.readSeq.store(seq + 1);
+            cursor.pinnedSeq.store(kNoSeq, std::memory_order_release);
+            continue;
+        }
+        bool skipped = cursor.latestOnly && published - seq > 1;
+        if (skipped || !cursor.pacer.accept(slot.frame.timestampNs)) {
+            // Passed over like a release: pinned, so the slot cannot be recycled before our reference is gone
+            dropReaders(slot, bit);
+            cursor.readSeq.store(seq + 1);
+            cursor.pinnedSeq.store(kNoSeq, std::memory_order_release);
+            countFrame(skipped ? FrameCounter::Skipped : FrameCounter::Decimated);
+            wakeProducer();
+            continue;
+        }
+        return &slot.frame;
+    }
+}
+
+void FrameRing::release(int consumerId) {
+    if (consumerId < 0 || consumerId >= kMaxConsumers) {
+        return;
+    }
+    Cursor &cursor = cursors[consumerId];
+    uint64_t seq = cursor.readSeq.load(std::memory_order_relaxed);
+    if (cursor.pinnedSeq.load(std::memory_order_relaxed) != seq) {
+        // Nothing acquired
+        return;
+    }
+    Slot &slot = slots[seq % capacity];
+    long long timestampNs = slot.frame.timestampNs;
+    if (stats != nullptr && cursor.lastTimestampNs >= 0 && timestampNs > cursor.lastTimestampNs) {
+        stats->record(FrameStage::FrameGap, timestampNs - cursor.lastTimestampNs);
+    }
+    cursor.lastTimestampNs = timestampNs;
+
+    dropReaders(slot, 1u << consumerId);
+    // Pinned, so the producer leaves readSeq alone until after this store
+    cursor.readSeq.store(seq + 1);
+    cursor.pinnedSeq.store(kNoSeq, std::memory_order_release);
+    wakeProducer();
+}
+
+bool FrameRing::isEmpty() const {
+    // Sequentially consistent so waitForFrame() is ordered against wakeConsumers()
+    uint64_t seq = writeSeq.load();
+    uint32_t mask = activeMask.load(std::memory_order_acquire);
+    for (int i = 0; mask != 0; i++, mask >>= 1) {
+        if ((mask & 1u) && cursors[i].readSeq.load(std::memory_order_acquire) != seq) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool FrameRing::hasFrameFor(int consumerId) const {
+    if (consumerId < 0) {
+        return !isEmpty();
+    }
+    return cursors[consumerId].readSeq.load() != writeSeq.load();
+}
+
+bool FrameRing::waitForFrame(int consumerId, long long timeoutNs) {
+    if (consumerId >= kMaxConsumers) {
+        return false;
+    }
+    if (hasFrameFor(consumerId)) {
+        return true;
+    }
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::nanoseconds(timeoutNs);
+    std::unique_lock<std::mutex> lock(frameMutex);
+    frameWaiters.fetch_add(1);
+    bool ready;
+    while (!(ready = hasFrameFor(consumerId)) && !closing.load()) {
+        if (frameAvailable.wait_until(lock, deadline) == std::cv_status::timeout) {
+            ready = hasFrameFor(consumerId);
+            break;
+        }
+    }
+    frameWaiters.fetch_sub(1);
+    return ready && !closing.load();
+}
+
+int FrameRing::getEventFd() {
+#ifdef __linux__
+    std::lock_guard<std::mutex> guard(registrationMutex);
+    if (eventFd.load() < 0) {
+        eventFd.store(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC));
+    }
+    return eventFd.load();
+#else
+    return -1;
+#endif
+}
+
+int FrameRing::getSize(int consumerId) const {
+    if (consumerId < 0 || consumerId >= kMaxConsumers) {
+        return 0;
+    }
+    return (int) (writeSeq.load(std::memory_order_acquire) -
+                  cursors[consumerId].readSeq.load(std::memory_order_acquire));
+}
@@ -0,0 +1,296 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "frame_arena.h"
+#include "frame_pacer.h"
+#include "frame_source.h"
+#include "frame_spill.h"
+#include "frame_stats.h"
+#include "yuv_frame.h"
+
+// What the producer does when the slowest consumer is a full ring behind
+enum class DropPolicy {
+    DropNewest,  // refuse the incoming frame
+    DropOldest,  // evict the lagging consumers' oldest queued frame to make room
+    Block,       // wait for the slowest consumer up to the block timeout, then refuse the incoming frame
+};
+
+/**
+ * Single-producer, multi-consumer broadcast ring of YUV420 frames.
+ *
+ * The camera callback is the only producer. Every registered consumer (HQ encoder, LQ encoder, ...)
+ * owns its own read cursor and sees every published frame in order. A slot is only recycled once all
+ * registered consumers have released or been evicted from it; what happens when the slowest consumer is
+ * a full ring behind is the DropPolicy. A consumer registered as latest-only jumps to the newest frame
+ * on every acquire, handing back the ones in between, e.g. a preview or LQ encoder that prefers fresh
+ * frames over complete ones. A consumer given a frame rate is paced by capture timestamp (FramePacer) and
+ * passes over the frames in between the same way, so it never copies or encodes them.
+ *
+ * No locks are taken on the frame path: the producer publishes with a release store of writeSeq and each
+ * consumer publishes its progress with a release store of its own readSeq. Between acquire and release
+ * a consumer pins its frame; DropOldest never evicts a pinned frame and refuses the incoming one instead,
+ * so a frame being read is never overwritten. Block is the only policy that sleeps, on a condition
+ * variable consumers only touch while the producer is actually waiting.
+ *
+ * Consumers can sleep until a frame lands, either in waitForFrame() or by polling getEventFd() alongside
+ * other fds. The producer only pays for a wake-up when someone is waiting or an eventfd was asked for.
+ *
+ * Frames can either be copied into ring-owned storage (enqueue) or borrowed from their source without
+ * a copy (enqueueBorrowed). A borrowed frame is handed back to its FrameReleaser as soon as the last
+ * consumer that was registered when it was published releases it.
+ *
+ * With a spill (enableSpill), a frame that finds the ring full is copied into a file-backed FrameSpill
+ * instead of meeting the drop policy, and so is every frame after it until the spill is empty again, so
+ * order holds. A spill thread of the ring's own lends the spilled frames back to the ring as room comes
+ * free; while any are pending it is the ring's producer, the camera thread never waits for it.
+ */
+class FrameRing {
+public:
+    static constexpr int kMaxConsumers = 8;
+
+    // width/height size the ring-owned frame storage, one FrameArena allocated here and only grown by
+    // reconfigure() beyond maxWidth x maxHeight; pass 0 for a ring that only holds borrowed frames
+    FrameRing(int capacity, int width, int height, int maxWidth = 0, int maxHeight = 0);
+
+    ~FrameRing();
+
+    FrameRing(const FrameRing &) = delete;
+    FrameRing &operator=(const FrameRing &) = delete;
+
+    // Returns a consumer id in [0, kMaxConsumers) or -1 when all cursors are taken.
+    // A new consumer starts at the next frame to be published; a latestOnly one skips to the newest
+    // published frame on every acquire.
+    int registerConsumer(bool latestOnly = false);
+
+    // Hands back the consumer's references. Waits for a publish in progress, which may still count the
+    // consumer, to finish; never call it from the producer's thread.
+    void unregisterConsumer(int consumerId);
+
+    // Caps what acquire() returns to about fps frames per second of capture time (0 = every frame).
+    // From the consumer's thread, or before frames flow.
+    void setFrameRate(int consumerId, double fps);
+
+    double getFrameRate(int consumerId) const {
+        return consumerId >= 0 && consumerId < kMaxConsumers ? cursors[consumerId].pacer.getFrameRate() : 0;
+    }
+
+    // Switches the ring-owned storage to a new frame size without recreating the ring. The producer must
+    // be stopped. Waits up to drainTimeoutNs for consumers to release the frames they are reading, then
+    // discards everything still queued (borrowed frames go back to their source) and reshapes the arena.
+    // Consumers stay registered. Returns false when a consumer kept its frame or the storage could not
+    // grow; the ring is still usable at its previous size then.
+    bool reconfigure(int width, int height, long long drainTimeoutNs);
+
+    // Size of the ring-owned storage, 0 for a borrow-only ring
+    int getFrameWidth() const {
+        return arena.getWidth();
+    }
+
+    int getFrameHeight() const {
+        return arena.getHeight();
+    }
+
+    // Lets frames that find the ring full overflow into frameCount frames of width x height in a file
+    // created at path, see FrameSpill. The drop policy then no longer applies: with the spill full as
+    // well the incoming frame is refused. Set before the producer starts; false when the file could not
+    // be set up, the ring then drops as before. reconfigure() resizes the spill to the new frame size.
+    bool enableSpill(const char *path, int frameCount, int width, int height);
+
+    // Null without a spill
+    const FrameSpill *getSpill() const {
+        return spill.get();
+    }
+
+    // Set before the producer starts. blockTimeoutNs only applies to DropPolicy::Block.
+    void setDropPolicy(DropPolicy policy, long long blockTimeoutNs) {
+        dropPolicy = policy;
+        this->blockTimeoutNs = blockTimeoutNs;
+    }
+
+    DropPolicy getDropPolicy() const {
+        return dropPolicy;
+    }
+
+    // Producer side, camera thread only. Returns false when the frame was dropped because
+    // the slowest consumer still holds every slot, or because it is larger than the ring's storage.
+    bool enqueue(int width, int height, long long timestampNs,
+                 const uint8_t *yData, int yRowStride, int yPixelStride,
+                 const uint8_t *uData, int uRowStride, int uPixelStride,
+                 const uint8_t *vData, int vRowStride, int vPixelStride);
+
+    // Producer side, zero-copy. The frame's memory is returned through releaser->releaseFrame() once
+    // every consumer released it, or right away when the frame is dropped.
+    bool enqueueBorrowed(const BorrowedFrame &frame, FrameReleaser *releaser);
+
+    // Consumer side. acquire() returns the oldest frame this consumer has not seen yet (the newest for
+    // a latest-only consumer) that its pacing keeps, or nullptr when it is caught up. The frame stays valid until the matching
+    // release(); acquiring again before that returns the same frame.
+    YUV420 *acquire(int consumerId);
+
+    void release(int consumerId);
+
+    // True when no registered consumer has a pending frame
+    bool isEmpty() const;
+
+    // Sleeps until the consumer (any consumer for -1) has a frame to acquire, up to timeoutNs.
+    // Returns false on timeout or when the ring is being destroyed.
+    bool waitForFrame(int consumerId, long long timeoutNs);
+
+    // eventfd that becomes readable whenever a frame is published, created on first call; read its
+    // 8-byte counter to reset it. The ring owns it. -1 where eventfd is not available.
+    int getEventFd();
+
+    // Number of frames published but not yet released by the given consumer
+    int getSize(int consumerId) const;
+
+    int getCapacity() const {
+        return capacity;
+    }
+
+    // Incoming frames refused for any reason; evictions and skips are only in stats
+    uint64_t getDroppedFrames() const {
+        return droppedFrames.load(std::memory_order_relaxed);
+    }
+
+    // Published and dropped frames and consumers' frame gaps are counted into stats; set before the
+    // producer starts
+    void setStats(FrameStats *stats) {
+        this->stats = stats;
+    }
+
+    FrameStats *getStats() const {
+        return stats;
+    }
+
+private:
+    static constexpr uint64_t kNoSeq = UINT64_MAX;
+
+    struct alignas(64) Cursor {
+        std::atomic<uint64_t> readSeq{0};
+        // Frame between acquire and release; the producer announces an eviction in evictSeq before
+        // checking it, the consumer sets it before checking evictSeq, so at most one of them proceeds
+        std::atomic<uint64_t> pinnedSeq{kNoSeq};
+        std::atomic<uint64_t> evictSeq{kNoSeq};
+        bool latestOnly = false;
+        // Consumer thread only
+        long long lastTimestampNs = -1;
+        FramePacer pacer;
+    };
+
+    struct Slot {
+        YUV420 frame;
+        // Consumers the frame was published for; one that registered while it was being published is not
+        // among them and passes over it
+        std::atomic<uint32_t> readers{0};
+        // Consumers that still have to release this slot's borrowed frame
+        std::atomic<uint32_t> pendingReaders{0};
+        // Atomic because a consumer unregistering reads them while the producer may be reusing the slot
+        std::atomic<void *> borrowedHandle{nullptr};
+        std::atomic<FrameReleaser *> releaser{nullptr};
+    };
+
+    bool hasRoomFor(uint64_t seq, uint32_t mask);
+
+    // Applies the drop policy when seq's slot is still in use; false means the incoming frame is refused
+    bool makeRoom(uint64_t seq, uint32_t mask);
+
+    // DropOldest: moves every consumer still on seq's previous frame past it, false if one has it pinned
+    bool evictOldest(uint64_t seq, uint32_t mask);
+
+    // Moves one consumer past seq unless it has seq pinned, counting the frame it lost; false when pinned
+    bool tryEvict(int consumerId, uint64_t seq, FrameCounter counter);
+
+    // Evicts every queued frame from every consumer, false when one stayed pinned past the timeout
+    bool drain(long long timeoutNs);
+
+    // reconfigure() once drained: discards spilled frames and resizes the spill and the arena
+    bool reshapeStorage(int width, int height);
+
+    // Waits for room until timeoutNs passed, for Block and for the spill thread
+    bool waitForRoom(uint64_t seq, uint32_t mask, long long timeoutNs);
+
+    // Producer side, around everything from sampling activeMask to publishing with that mask (or giving up)
+    uint32_t beginPublish();
+    void endPublish();
+
+    // Publishes a borrowed frame into seq's slot, which must have room
+    void publishBorrowed(uint64_t seq, uint32_t mask, const BorrowedFrame &frame, FrameReleaser *releaser,
+                         long long enqueuedNs);
+
+    // Producer side: true while the frame has to go to the spill, i.e. spilled frames are pending or
+    // the ring is full
+    bool mustSpill();
+
+    // Producer side: copies the frame into the spill; false (a drop) when the spill is full too
+    bool spillFrame(const YUVImageView &frame, long long timestampNs);
+
+    // Spill thread: hands spilled frames to the ring in order as room comes free
+    void runSpill();
+
+    void startSpillThread();
+
+    void stopSpillThread();
+
+    // Consumer side, after moving readSeq: wakes a producer blocked in waitForRoom
+    void wakeProducer();
+
+    // Producer side, after publishing: wakes waitForFrame() callers and signals the eventfd
+    void wakeConsumers();
+
+    bool hasFrameFor(int consumerId) const;
+
+    // Drops the given consumers' references on a slot, returning its borrowed frame when it was the last one
+    void dropReaders(Slot &slot, uint32_t readers);
+
+    // Producer side, before reusing a slot: drops the references consumers that unregistered since it was
+    // published still hold, the room check no longer waits for them
+    void reclaim(Slot &slot);
+
+    void countFrame(FrameCounter counter);
+
+    FrameArena arena;
+    std::unique_ptr<Slot[]> slots;
+    const int capacity;
+
+    alignas(64) std::atomic<uint64_t> writeSeq{0};
+    alignas(64) std::atomic<uint32_t> activeMask{0};
+    // Publishes begun and finished. They never overlap (the spill thread and the camera thread take turns),
+    // so unregisterConsumer() can wait for those that may still carry its bit to finish
+    std::atomic<uint64_t> publishesBegun{0};
+    std::atomic<uint64_t> publishesDone{0};
+    std::atomic<uint64_t> droppedFrames{0};
+    FrameStats *stats = nullptr;
+    DropPolicy dropPolicy = DropPolicy::DropNewest;
+    long long blockTimeoutNs = 0;
+
+    Cursor cursors[kMaxConsumers];
+
+    // Serialises register/unregister only, never taken by enqueue/acquire/release
+    std::mutex registrationMutex;
+
+    // Block policy only: release() notifies when producerWaiting is set
+    std::atomic<bool> producerWaiting{false};
+    std::mutex roomMutex;
+    std::condition_variable roomAvailable;
+
+    // waitForFrame(): the producer notifies only while frameWaiters is non-zero
+    std::atomic<int> frameWaiters{0};
+    std::atomic<bool> closing{false};
+    std::mutex frameMutex;
+    std::condition_variable frameAvailable;
+    std::atomic<int> eventFd{-1};
+
+    // Overflow tier; the producer wakes the spill thread only while spillIdle is set
+    std::unique_ptr<FrameSpill> spill;
+    std::thread spillThread;
+    std::atomic<bool> spillStopping{false};
+    std::atomic<bool> spillIdle{false};
+    std::mutex spillMutex;
+    std::condition_variable spillReady;
+};
@@ -0,0 +1,104 @@
+#include "frame_sink.h"
+
+#include <cstring>
+
+MemorySink::MemorySink(int width, int height, YUVLayout layout, int bufferCount)
+        : width(width), height(height), layout(layout), bufferCount(bufferCount > 0 ? bufferCount : 1),
+          bufferBytes(packedSize(width, height)), storage(bufferBytes * this->bufferCount) {}
+
+bool MemorySink::dequeueBuffer(long long /* timeoutUs */, SinkBuffer &buffer) {
+    buffer.index = nextBuffer;
+    buffer.view = packedView(storage.data() + (size_t) nextBuffer * bufferBytes, width, height, layout);
+    buffer.payloadSize = (int) bufferBytes;
+    nextBuffer = (nextBuffer + 1) % bufferCount;
+    return true;
+}
+
+void MemorySink::queueBuffer(const SinkBuffer &buffer, long long timestampUs, bool filled) {
+    if (!filled) {
+        return;
+    }
+    byteCount.fetch_add(buffer.payloadSize, std::memory_order_relaxed);
+    lastTimestampUs.store(timestampUs, std::memory_order_relaxed);
+    // Release: a reader that sees the count also sees the buffer contents
+    frameCount.fetch_add(1, std::memory_order_release);
+}
+
+FileSink::FileSink(int width, int height, YUVLayout layout)
+        : width(width), height(height), layout(layout), frame(packedSize(width, height)) {}
+
+FileSink::~FileSink() {
+    close();
+}
+
+bool FileSink::open(const char *path) {
+    close();
+    file = fopen(path, "wb");
+    return file != nullptr;
+}
+
+void FileSink::close() {
+    if (file != nullptr) {
+        fclose(file);
+        file = nullptr;
+    }
+}
+
+bool FileSink::dequeueBuffer(long long /* timeoutUs */, SinkBuffer &buffer) {
+    if (file == nullptr) {
+        return false;
+    }
+    buffer.index = 0;
+    buffer.view = packedView(frame.data(), width, height, layout);
+    buffer.payloadSize = (int) frame.size();
+    return true;
+}
+
+void FileSink::queueBuffer(const SinkBuffer & /* buffer */, long long /* timestampUs */, bool filled) {
+    if (filled && file != nullptr && fwrite(frame.data(), 1, frame.size(), file) == frame.size()) {
+        frameCount.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void FileSink::finish() {
+    if (file != nullptr) {
+        fflush(file);
+    }
+}
+
+LatestFrameSink::LatestFrameSink(int width, int height, YUVLayout layout)
+        : width(width), height(height), layout(layout), bufferBytes(packedSize(width, height)),
+          storage(bufferBytes * 2) {}
+
+bool LatestFrameSink::dequeueBuffer(long long /* timeoutUs */, SinkBuffer &buffer) {
+    std::lock_guard<std::mutex> lock(mutex);
+    buffer.index = 1 - latest;
+    buffer.view = packedView(storage.data() + (size_t) buffer.index * bufferBytes, width, height, layout);
+    buffer.payloadSize = (int) bufferBytes;
+    return true;
+}
+
+void LatestFrameSink::queueBuffer(const SinkBuffer &buffer, long long timestampUs, bool filled) {
+    if (!filled) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        latest = buffer.index;
+        latestTimestampUs = timestampUs;
+    }
+    frameCount.fetch_add(1, std::memory_order_relaxed);
+}
+
+bool LatestFrameSink::copyLatest(uint8_t *dst, size_t capacity, long long &timestampUs) const {
+    if (dst == nullptr || capacity < bufferBytes) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    if (latestTimestampUs < 0) {
+        return false;
+    }
+    memcpy(dst, storage.data() + (size_t) latest * bufferBytes, bufferBytes);
+    timestampUs = latestTimestampUs;
+    return true;
+}
@@ -0,0 +1,152 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <vector>
+
+#include "yuv_convert.h"
+#include "yuv_frame.h"
+
+// One input buffer handed out by a FrameSink
+struct SinkBuffer {
+    int index = -1;
+    // Where the frame goes; its size is the size the sink wants
+    YUVImageView view;
+    // Bytes to hand back once view is filled
+    int payloadSize = 0;
+};
+
+/**
+ * Where a FrameFeeder delivers frames: an encoder's input buffers on device, or a stand-in that
+ * keeps or writes the frames on a host. Only the feeder's thread calls it.
+ */
+class FrameSink {
+public:
+    virtual ~FrameSink() = default;
+
+    // Waits up to timeoutUs for a free input buffer; false when none came free in time
+    virtual bool dequeueBuffer(long long timeoutUs, SinkBuffer &buffer) = 0;
+
+    // Hands back a buffer from dequeueBuffer, filled with the frame taken at timestampUs, or unused
+    virtual void queueBuffer(const SinkBuffer &buffer, long long timestampUs, bool filled) = 0;
+
+    // No more frames will come: flush what is still pending (end of stream for an encoder)
+    virtual void finish() {}
+
+    // The next frame starts something new (a scene cut): encode it as a key frame where that applies
+    virtual void requestKeyFrame() {}
+};
+
+/**
+ * Host stand-in for an encoder: a few packed buffers that are always free, so a feeder runs at the
+ * speed of its copies. Counts what it receives; the counters can be read from any thread.
+ */
+class MemorySink : public FrameSink {
+public:
+    MemorySink(int width, int height, YUVLayout layout, int bufferCount);
+
+    bool dequeueBuffer(long long timeoutUs, SinkBuffer &buffer) override;
+
+    void queueBuffer(const SinkBuffer &buffer, long long timestampUs, bool filled) override;
+
+    uint64_t getFrameCount() const {
+        return frameCount.load(std::memory_order_acquire);
+    }
+
+    uint64_t getByteCount() const {
+        return byteCount.load(std::memory_order_relaxed);
+    }
+
+    long long getLastTimestampUs() const {
+        return lastTimestampUs.load(std::memory_order_relaxed);
+    }
+
+    // Contents of a buffer, valid until the feeder fills it again
+    const uint8_t *getBuffer(int index) const {
+        return storage.data() + (size_t) index * bufferBytes;
+    }
+
+private:
+    int width;
+    int height;
+    YUVLayout layout;
+    int bufferCount;
+    size_t bufferBytes;
+    std::vector<uint8_t> storage;
+    int nextBuffer = 0;
+    std::atomic<uint64_t> frameCount{0};
+    std::atomic<uint64_t> byteCount{0};
+    std::atomic<long long> lastTimestampUs{-1};
+};
+
+// Appends every frame packed to a raw .yuv file, e.g. to inspect a stream with ffplay
+class FileSink : public FrameSink {
+public:
+    FileSink(int width, int height, YUVLayout layout);
+
+    ~FileSink() override;
+
+    bool open(const char *path);
+
+    void close();
+
+    bool dequeueBuffer(long long timeoutUs, SinkBuffer &buffer) override;
+
+    void queueBuffer(const SinkBuffer &buffer, long long timestampUs, bool filled) override;
+
+    void finish() override;
+
+    uint64_t getFrameCount() const {
+        return frameCount.load(std::memory_order_relaxed);
+    }
+
+private:
+    int width;
+    int height;
+    YUVLayout layout;
+    std::vector<uint8_t> frame;
+    FILE *file = nullptr;
+    std::atomic<uint64_t> frameCount{0};
+};
+
+/**
+ * Keeps only the newest frame, packed in a layout of its own, for a reader that polls rather than takes
+ * every frame, e.g. a thumbnail or a frame analyser on another thread. Two buffers: the feeder fills one
+ * while the other holds the newest frame, so copyLatest() never sees a frame half written and never
+ * makes the feeder wait longer than one copy takes.
+ */
+class LatestFrameSink : public FrameSink {
+public:
+    LatestFrameSink(int width, int height, YUVLayout layout);
+
+    bool dequeueBuffer(long long timeoutUs, SinkBuffer &buffer) override;
+
+    void queueBuffer(const SinkBuffer &buffer, long long timestampUs, bool filled) override;
+
+    // Bytes copyLatest() writes
+    size_t getFrameSize() const {
+        return bufferBytes;
+    }
+
+    // Copies the newest frame into dst, packed (packedView); false when none arrived yet or capacity is
+    // below getFrameSize(). Any thread.
+    bool copyLatest(uint8_t *dst, size_t capacity, long long &timestampUs) const;
+
+    uint64_t getFrameCount() const {
+        return frameCount.load(std::memory_order_relaxed);
+    }
+
+private:
+    int width;
+    int height;
+    YUVLayout layout;
+    size_t bufferBytes;
+    std::vector<uint8_t> storage;
+    mutable std::mutex mutex;
+    // Buffer holding the newest frame, the feeder fills the other one
+    int latest = 0;
+    long long latestTimestampUs = -1;
+    std::atomic<uint64_t> frameCount{0};
+};
@@ -0,0 +1,58 @@
+#include "frame_source.h"
+
+#include <cstring>
+
+#include "frame_ring.h"
+
+FakeImageSource::FakeImageSource(int width, int height, int maxImages)
+        : width(width), height(height), maxImages(maxImages),
+          buffers(maxImages, std::vector<uint8_t>(width * height * 3 / 2)), inUse(maxImages) {}
+
+bool FakeImageSource::produce(FrameRing &ring, long long timestampNs) {
+    int index = -1;
+    for (int i = 0; i < maxImages; i++) {
+        bool expected = false;
+        if (inUse[i].compare_exchange_strong(expected, true, std::memory_order_acq_rel)) {
+            index = i;
+            break;
+        }
+    }
+    if (index < 0) {
+        return false;
+    }
+    outstanding.fetch_add(1, std::memory_order_acq_rel);
+
+    // Stamp the luma with the timestamp so readers can tell frames apart
+    uint8_t *y = buffers[index].data();
+    uint8_t *uv = y + width * height;
+    memset(y, (int) (timestampNs & 0xff), width * height);
+    memset(uv, 128, width * height / 2);
+
+    BorrowedFrame frame{};
+    frame.width = width;
+    frame.height = height;
+    frame.timestampNs = timestampNs;
+    frame.planeData[0] = y;
+    frame.planeData[1] = uv;
+    frame.planeData[2] = uv + 1;
+    frame.rowStride[0] = width;
+    frame.rowStride[1] = width;
+    frame.rowStride[2] = width;
+    frame.pixelStride[0] = 1;
+    frame.pixelStride[1] = 2;
+    frame.pixelStride[2] = 2;
+    frame.handle = reinterpret_cast<void *>((intptr_t) index);
+
+    return ring.enqueueBorrowed(frame, this);
+}
+
+void FakeImageSource::releaseFrame(void *handle) {
+    auto index = (int) reinterpret_cast<intptr_t>(handle);
+    if (index < 0 || index >= maxImages) {
+        return;
+    }
+    if (inUse[index].exchange(false, std::memory_order_acq_rel)) {
+        outstanding.fetch_sub(1, std::memory_order_acq_rel);
+        releasedCount.fetch_add(1, std::memory_order_relaxed);
+    }
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+class FrameRing;
+
+// A camera frame whose planes live in memory owned by the frame's source
+struct BorrowedFrame {
+    int width;
+    int height;
+    long long timestampNs;
+    const uint8_t *planeData[3];
+    int rowStride[3];
+    int pixelStride[3];
+    // Opaque source handle (AImage *, fake buffer index, ...) passed back on release
+    void *handle;
+};
+
+// Gets borrowed frames back once the last reader of the native queue is done with them
+class FrameReleaser {
+public:
+    virtual ~FrameReleaser() = default;
+
+    virtual void releaseFrame(void *handle) = 0;
+};
+
+/**
+ * Host-side stand-in for the camera's AImageReader: owns a fixed pool of YUV420 semi-planar buffers,
+ * lends them to the ring and tracks how many are still out so buffer lifetime can be checked
+ * without a device.
+ */
+class FakeImageSource : public FrameReleaser {
+public:
+    FakeImageSource(int width, int height, int maxImages);
+
+    // Fills a free buffer and enqueues it without copying. Returns false when every buffer is still
+    // held by the queue (the same situation AImageReader reports as MAX_IMAGES_ACQUIRED) or the
+    // ring dropped the frame.
+    bool produce(FrameRing &ring, long long timestampNs);
+
+    void releaseFrame(void *handle) override;
+
+    // Buffers currently lent to the queue
+    int getOutstanding() const {
+        return outstanding.load(std::memory_order_acquire);
+    }
+
+    uint64_t getReleasedCount() const {
+        return releasedCount.load(std::memory_order_acquire);
+    }
+
+private:
+    int width;
+    int height;
+    int maxImages;
+    std::vector<std::vector<uint8_t>> buffers;
+    std::vector<std::atomic<bool>> inUse;
+    std::atomic<int> outstanding{0};
+    std::atomic<uint64_t> releasedCount{0};
+};
@@ -0,0 +1,177 @@
+#include "frame_spill.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "frame_stats.h"
+
+FrameSpill::~FrameSpill() {
+    close();
+}
+
+bool FrameSpill::open(const char *path, int frameCount, int width, int height) {
+    close();
+    if (frameCount <= 0) {
+        return false;
+    }
+    fd = ::open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        return false;
+    }
+    // Only reachable through fd from here on, the file goes away with it
+    unlink(path);
+    this->frameCount = frameCount;
+    entries.reset(new Entry[frameCount]);
+    if (!map(width, height)) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void FrameSpill::close() {
+    unmap();
+    if (fd >= 0) {
+        ::close(fd);
+        fd = -1;
+    }
+    entries.reset();
+    frameCount = 0;
+    width = 0;
+    height = 0;
+}
+
+bool FrameSpill::map(int width, int height) {
+    slotBytes = (packedSize(width, height) + kSlotAlignment - 1) / kSlotAlignment * kSlotAlignment;
+    size_t bytes = slotBytes * frameCount;
+    // Reserve the blocks up front: a write into a mapped hole that finds the disk full is a SIGBUS
+    if (ftruncate(fd, 0) != 0 || posix_fallocate(fd, 0, (off_t) bytes) != 0) {
+        return false;
+    }
+    int flags = MAP_SHARED;
+#ifdef MAP_POPULATE
+    // Fault every page in now rather than on the camera thread's first pass over the slots
+    flags |= MAP_POPULATE;
+#endif
+    void *address = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, flags, fd, 0);
+    if (address == MAP_FAILED) {
+        return false;
+    }
+    mapping = static_cast<uint8_t *>(address);
+    mappingBytes = bytes;
+    this->width = width;
+    this->height = height;
+    // Slots are written and read front to back once each: read ahead, and drop pages soon after use
+    madvise(mapping, mappingBytes, MADV_SEQUENTIAL);
+
+    writeSeq.store(0);
+    publishSeq.store(0);
+    freeSeq.store(0);
+    peakPending.store(0, std::memory_order_relaxed);
+    return true;
+}
+
+void FrameSpill::unmap() {
+    if (mapping != nullptr) {
+        munmap(mapping, mappingBytes);
+        mapping = nullptr;
+        mappingBytes = 0;
+    }
+}
+
+bool FrameSpill::reshape(int width, int height) {
+    if (!isOpen() || writeSeq.load() != freeSeq.load()) {
+        return false;
+    }
+    unmap();
+    if (!map(width, height)) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+bool FrameSpill::push(const YUVImageView &frame, long long timestampNs) {
+    uint64_t seq = writeSeq.load(std::memory_order_relaxed);
+    if (!isOpen() || seq - freeSeq.load(std::memory_order_acquire) >= (uint64_t) frameCount ||
+        packedSize(frame.width, frame.height) > slotBytes) {
+        return false;
+    }
+    converter.convert(frame, packedView(slotData(seq), frame.width, frame.height, YUVLayout::NV12));
+    Entry &entry = entries[seq % frameCount];
+    entry.width = frame.width;
+    entry.height = frame.height;
+    entry.timestampNs = timestampNs;
+    entry.spilledNs = steadyNowNs();
+    // Sequentially consistent: pairs with the spill thread announcing it is idle before checking for frames
+    writeSeq.store(seq + 1);
+
+    int pending = (int) (seq + 1 - publishSeq.load(std::memory_order_acquire));
+    if (pending > peakPending.load(std::memory_order_relaxed)) {
+        peakPending.store(pending, std::memory_order_relaxed);
+    }
+    return true;
+}
+
+bool FrameSpill::front(BorrowedFrame &frame, long long &spilledNs) const {
+    uint64_t seq = publishSeq.load(std::memory_order_relaxed);
+    if (seq == writeSeq.load(std::memory_order_acquire)) {
+        return false;
+    }
+    Entry &entry = entries[seq % frameCount];
+    YUVImageView view = packedView(slotData(seq), entry.width, entry.height, YUVLayout::NV12);
+    frame.width = entry.width;
+    frame.height = entry.height;
+    frame.timestampNs = entry.timestampNs;
+    for (int i = 0; i < 3; i++) {
+        frame.planeData[i] = view.data[i];
+        frame.rowStride[i] = view.rowStride[i];
+        frame.pixelStride[i] = view.pixelStride[i];
+    }
+    frame.handle = &entry;
+    spilledNs = entry.spilledNs;
+    return true;
+}
+
+void FrameSpill::markPublished() {
+    publishSeq.store(publishSeq.load(std::memory_order_relaxed) + 1);
+    // Consumers may have been done with it before it counted as published
+    reclaim();
+}
+
+void FrameSpill::prefetch() {
+    uint64_t next[] = {writeSeq.load(std::memory_order_relaxed), publishSeq.load(std::memory_order_relaxed)};
+    for (uint64_t seq : next) {
+        madvise(slotData(seq), slotBytes, MADV_WILLNEED);
+    }
+}
+
+int FrameSpill::discardPending() {
+    uint64_t written = writeSeq.load();
+    int discarded = (int) (written - publishSeq.load());
+    publishSeq.store(written);
+    freeSeq.store(written);
+    return discarded;
+}
+
+void FrameSpill::releaseFrame(void *handle) {
+    static_cast<Entry *>(handle)->released.store(true, std::memory_order_release);
+    reclaim();
+}
+
+void FrameSpill::reclaim() {
+    std::lock_guard<std::mutex> lock(reclaimMutex);
+    uint64_t seq = freeSeq.load(std::memory_order_relaxed);
+    uint64_t published = publishSeq.load(std::memory_order_acquire);
+    while (seq < published) {
+        Entry &entry = entries[seq % frameCount];
+        if (!entry.released.load(std::memory_order_acquire)) {
+            break;
+        }
+        entry.released.store(false, std::memory_order_relaxed);
+        seq++;
+    }
+    // Release: the producer reuses the slot only after every reader's last access to it
+    freeSeq.store(seq, std::memory_order_release);
+}
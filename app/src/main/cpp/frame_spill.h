@@ -0,0 +1,128 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+#include "frame_source.h"
+#include "yuv_convert.h"
+#include "yuv_frame.h"
+
+/**
+ * File-backed overflow for FrameRing: a fixed number of packed NV12 frame slots in a memory-mapped file,
+ * filled and emptied strictly in order.
+ *
+ * The producer copies a frame in with push(), a plain copy into mapped pages with no system call and
+ * no lock. The ring's spill thread takes the oldest frame with front(), lends the slot to the ring as a
+ * borrowed frame and calls markPublished(); the slot is reused once every consumer released it, in any
+ * order. The file is unlinked as soon as it is mapped, so nothing outlives the spill, and the kernel can
+ * write cold slots back to it instead of keeping them resident.
+ */
+class FrameSpill : public FrameReleaser {
+public:
+    FrameSpill() = default;
+
+    ~FrameSpill() override;
+
+    FrameSpill(const FrameSpill &) = delete;
+    FrameSpill &operator=(const FrameSpill &) = delete;
+
+    // Creates the file at path (replacing one left over) with frameCount slots of width x height.
+    // False when the file cannot be created, reserved on disk or mapped.
+    bool open(const char *path, int frameCount, int width, int height);
+
+    void close();
+
+    bool isOpen() const {
+        return mapping != nullptr;
+    }
+
+    // Sizes the slots for another frame size. No frame may be held; closes the spill on failure
+    bool reshape(int width, int height);
+
+    // Producer: copies a frame of any layout into the next slot. False when every slot is taken
+    // or the frame is larger than a slot.
+    bool push(const YUVImageView &frame, long long timestampNs);
+
+    // Spilled frames not yet handed to the ring
+    int getPending() const {
+        return (int) (writeSeq.load() - publishSeq.load());
+    }
+
+    // Most frames pending at once since open()
+    int getPeakPending() const {
+        return peakPending.load(std::memory_order_relaxed);
+    }
+
+    int getCapacity() const {
+        return frameCount;
+    }
+
+    // Size the slots were made for
+    int getFrameWidth() const {
+        return width;
+    }
+
+    int getFrameHeight() const {
+        return height;
+    }
+
+    // Spill thread: the oldest pending frame, pointing into its slot, and when it was spilled.
+    // False when nothing is pending.
+    bool front(BorrowedFrame &frame, long long &spilledNs) const;
+
+    // Spill thread: the frame from front() went to the ring; its slot comes back through releaseFrame()
+    void markPublished();
+
+    // Spill thread: asks the kernel to bring in the pages the next push() and front() touch
+    void prefetch();
+
+    // Forgets the pending frames, returning how many there were. Nothing may be pushed or held meanwhile
+    int discardPending();
+
+    void releaseFrame(void *handle) override;
+
+private:
+    static constexpr size_t kSlotAlignment = 4096;
+
+    struct Entry {
+        int width = 0;
+        int height = 0;
+        long long timestampNs = 0;
+        // steady_clock time of push(), for spill wait stats
+        long long spilledNs = 0;
+        std::atomic<bool> released{false};
+    };
+
+    bool map(int width, int height);
+
+    void unmap();
+
+    uint8_t *slotData(uint64_t seq) const {
+        return mapping + (seq % frameCount) * slotBytes;
+    }
+
+    // Frees released slots oldest first
+    void reclaim();
+
+    int fd = -1;
+    uint8_t *mapping = nullptr;
+    size_t mappingBytes = 0;
+    size_t slotBytes = 0;
+    int frameCount = 0;
+    int width = 0;
+    int height = 0;
+    std::unique_ptr<Entry[]> entries;
+    // Producer only
+    YUVConverter converter;
+
+    // Slots [freeSeq, publishSeq) are in the ring, [publishSeq, writeSeq) are pending
+    alignas(64) std::atomic<uint64_t> writeSeq{0};
+    alignas(64) std::atomic<uint64_t> publishSeq{0};
+    alignas(64) std::atomic<uint64_t> freeSeq{0};
+    std::atomic<int> peakPending{0};
+    // Consumers release from their own threads; never taken by push()
+    std::mutex reclaimMutex;
+};
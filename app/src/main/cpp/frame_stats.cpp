@@ -0,0 +1,98 @@
+#include "frame_stats.h"
+
+namespace {
+
+std::atomic<int> nextThreadIndex{0};
+
+int threadIndex() {
+    thread_local int index = nextThreadIndex.fetch_add(1, std::memory_order_relaxed);
+    return index;
+}
+
+int highestBit(uint64_t value) {
+    return 63 - __builtin_clzll(value);
+}
+
+uint64_t takeOrLoad(std::atomic<uint64_t> &value, bool reset) {
+    return reset ? value.exchange(0, std::memory_order_relaxed) : value.load(std::memory_order_relaxed);
+}
+
+}  // namespace
+
+int FrameStats::bucketOf(uint64_t ns) {
+    if (ns < 32) {
+        return (int) ns;
+    }
+    int bit = highestBit(ns);
+    int bucket = 32 + (bit - 5) * 8 + (int) ((ns >> (bit - 3)) & 7);
+    return bucket < kBuckets ? bucket : kBuckets - 1;
+}
+
+uint64_t FrameStats::bucketUpperBound(int bucket) {
+    if (bucket < 32) {
+        return (uint64_t) bucket;
+    }
+    int bit = (bucket - 32) / 8 + 5;
+    uint64_t lower = (uint64_t) (8 + (bucket - 32) % 8) << (bit - 3);
+    return lower + ((uint64_t) 1 << (bit - 3)) - 1;
+}
+
+FrameStats::Shard &FrameStats::localShard() {
+    return shards[threadIndex() % kShards];
+}
+
+void FrameStats::record(FrameStage stage, long long durationNs) {
+    uint64_t ns = durationNs > 0 ? (uint64_t) durationNs : 0;
+    auto index = (int) stage;
+    Shard &shard = localShard();
+    shard.buckets[index][bucketOf(ns)].fetch_add(1, std::memory_order_relaxed);
+    shard.totalNs[index].fetch_add(ns, std::memory_order_relaxed);
+
+    // Only threads sharing this shard race here, so the loop practically never repeats
+    uint64_t max = shard.maxNs[index].load(std::memory_order_relaxed);
+    while (ns > max && !shard.maxNs[index].compare_exchange_weak(max, ns, std::memory_order_relaxed)) {
+    }
+}
+
+void FrameStats::count(FrameCounter counter, uint64_t amount) {
+    localShard().counters[(int) counter].fetch_add(amount, std::memory_order_relaxed);
+}
+
+FrameStats::Snapshot FrameStats::snapshot(bool reset) {
+    Snapshot result{};
+
+    for (int c = 0; c < (int) FrameCounter::Count; c++) {
+        for (Shard &shard : shards) {
+            result.counters[c] += takeOrLoad(shard.counters[c], reset);
+        }
+    }
+
+    for (int s = 0; s < (int) FrameStage::Count; s++) {
+        StageSummary &summary = result.stages[s];
+        uint64_t buckets[kBuckets] = {};
+        for (Shard &shard : shards) {
+            for (int b = 0; b < kBuckets; b++) {
+                uint64_t hits = takeOrLoad(shard.buckets[s][b], reset);
+                buckets[b] += hits;
+                summary.count += hits;
+            }
+            summary.totalNs += takeOrLoad(shard.totalNs[s], reset);
+            uint64_t max = takeOrLoad(shard.maxNs[s], reset);
+            summary.maxNs = max > summary.maxNs ? max : summary.maxNs;
+        }
+
+        // Smallest bucket whose cumulative count reaches each percentile
+        uint64_t targets[3] = {(summary.count * 50 + 99) / 100, (summary.count * 90 + 99) / 100,
+                               (summary.count * 99 + 99) / 100};
+        uint64_t *outputs[3] = {&summary.p50Ns, &summary.p90Ns, &summary.p99Ns};
+        uint64_t seen = 0;
+        int next = 0;
+        for (int b = 0; b < kBuckets && next < 3 && summary.count > 0; b++) {
+            seen += buckets[b];
+            while (next < 3 && seen >= targets[next]) {
+                *outputs[next++] = bucketUpperBound(b);
+            }
+        }
+    }
+    return result;
+}
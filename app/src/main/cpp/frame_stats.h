@@ -0,0 +1,113 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+inline long long steadyNowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Pipeline stages timed by FrameStats
+enum class FrameStage {
+    Ingest,         // camera frame into the ring
+    QueueWait,      // ring publish to consumer acquire
+    HqCopy,         // copy into the HQ codec's Image, with the LQ downscale when fused (YUVFanOut)
+    LqCopy,         // downscale into the LQ codec's Image
+    FrameGap,       // timestamp distance between consecutive frames a consumer got, grows with every drop
+    PreRollEncode,  // compressing a frame into the pre-roll store
+    PreRollDecode,  // decompressing a pre-roll frame for replay
+    SpillWait,      // spill push to the frame's publish into the ring
+    Motion,         // comparing a frame with the previous one for a motion-gated stream
+    Count,
+};
+
+enum class FrameCounter {
+    Frames,       // frames published to the ring
+    Dropped,      // incoming frames refused because the ring was full
+    TimedOut,     // incoming frames refused after blocking for the slowest consumer timed out
+    Overwritten,  // queued frames evicted for a newer one, once per consumer that lost them
+    Skipped,      // queued frames a latest-only consumer jumped over, once per consumer
+    Flushed,      // queued frames discarded by a reconfigure, once per consumer
+    Decimated,    // queued frames a paced consumer passed over to hold its frame rate, once per consumer
+    Spilled,      // incoming frames that went to the file-backed spill because the ring was full
+    Still,        // frames a motion-gated stream left out because nothing moved
+    Count,
+};
+
+/**
+ * Latency histograms per pipeline stage plus frame counters, cheap enough for every frame in release
+ * builds.
+ *
+ * Each thread takes the next thread index on first use and records into shard index % kShards, so
+ * recording is a handful of relaxed atomic adds on a cache line shared only with threads whose index is
+ * the same modulo 8. Indices are never reused: a ninth thread, or a new one after others exited, shares
+ * a shard and still counts correctly, only with contention. Buckets are log-linear: exact below 32 ns,
+ * then 8 buckets per power of two, i.e. percentiles are within 12.5%.
+ */
+class FrameStats {
+public:
+    static constexpr int kShards = 8;
+    static constexpr int kBuckets = 320;  // covers up to 2^41 ns, about 36 minutes
+
+    struct StageSummary {
+        uint64_t count;
+        uint64_t totalNs;
+        uint64_t maxNs;
+        // Upper bounds of the buckets holding the percentile
+        uint64_t p50Ns;
+        uint64_t p90Ns;
+        uint64_t p99Ns;
+    };
+
+    struct Snapshot {
+        uint64_t counters[(int) FrameCounter::Count];
+        StageSummary stages[(int) FrameStage::Count];
+    };
+
+    void record(FrameStage stage, long long durationNs);
+
+    void count(FrameCounter counter, uint64_t amount = 1);
+
+    // Sums every shard; with reset the returned values are cleared, so consecutive snapshots cover
+    // consecutive intervals. Samples recorded while the snapshot is taken land in one of the two.
+    Snapshot snapshot(bool reset);
+
+    static int bucketOf(uint64_t ns);
+
+    static uint64_t bucketUpperBound(int bucket);
+
+private:
+    struct alignas(64) Shard {
+        std::atomic<uint64_t> buckets[(int) FrameStage::Count][kBuckets];
+        std::atomic<uint64_t> totalNs[(int) FrameStage::Count];
+        std::atomic<uint64_t> maxNs[(int) FrameStage::Count];
+        std::atomic<uint64_t> counters[(int) FrameCounter::Count];
+    };
+
+    Shard &localShard();
+
+    Shard shards[kShards] = {};
+};
+
+// Records the time from construction to destruction into stats, if there is one
+class ScopedStageTimer {
+public:
+    ScopedStageTimer(FrameStats *stats, FrameStage stage)
+            : stats(stats), stage(stage), startNs(stats != nullptr ? steadyNowNs() : 0) {}
+
+    ~ScopedStageTimer() {
+        if (stats != nullptr) {
+            stats->record(stage, steadyNowNs() - startNs);
+        }
+    }
+
+    ScopedStageTimer(const ScopedStageTimer &) = delete;
+    ScopedStageTimer &operator=(const ScopedStageTimer &) = delete;
+
+private:
+    FrameStats *stats;
+    FrameStage stage;
+    long long startNs;
+};
@@ -0,0 +1,137 @@
+#include "image_binding.h"
+
+#include "yuv_log.h"
+
+namespace {
+
+jclass imageClass = nullptr;
+jclass planeClass = nullptr;
+jmethodID getPlanesMethod = nullptr;
+jmethodID getWidthMethod = nullptr;
+jmethodID getHeightMethod = nullptr;
+jmethodID getBufferMethod = nullptr;
+jmethodID getRowStrideMethod = nullptr;
+jmethodID getPixelStrideMethod = nullptr;
+
+jclass findGlobalClass(JNIEnv *env, const char *name) {
+    jclass local = env->FindClass(name);
+    if (local == nullptr) {
+        env->ExceptionClear();
+        LOGE("Class %s not found", name);
+        return nullptr;
+    }
+    auto global = (jclass) env->NewGlobalRef(local);
+    env->DeleteLocalRef(local);
+    return global;
+}
+
+// Whether image's planes still start where view's do; a codec may remap an index's buffer, e.g. after a
+// format change or a restart
+bool hasPlanesOf(JNIEnv *env, jobject image, const YUVImageView &view) {
+    if (image == nullptr) {
+        return false;
+    }
+    auto planes = (jobjectArray) env->CallObjectMethod(image, getPlanesMethod);
+    bool same = planes != nullptr && env->GetArrayLength(planes) == 3;
+    for (int i = 0; same && i < 3; i++) {
+        jobject planeObj = env->GetObjectArrayElement(planes, i);
+        jobject bufferObj = env->CallObjectMethod(planeObj, getBufferMethod);
+        same = env->GetDirectBufferAddress(bufferObj) == view.data[i];
+        env->DeleteLocalRef(bufferObj);
+        env->DeleteLocalRef(planeObj);
+    }
+    if (planes != nullptr) {
+        env->DeleteLocalRef(planes);
+    }
+    return same;
+}
+
+}  // namespace
+
+bool cacheImageBindings(JNIEnv *env) {
+    imageClass = findGlobalClass(env, "android/media/Image");
+    planeClass = findGlobalClass(env, "android/media/Image$Plane");
+    if (imageClass == nullptr || planeClass == nullptr) {
+        return false;
+    }
+
+    getPlanesMethod = env->GetMethodID(imageClass, "getPlanes", "()[Landroid/media/Image$Plane;");
+    getWidthMethod = env->GetMethodID(imageClass, "getWidth", "()I");
+    getHeightMethod = env->GetMethodID(imageClass, "getHeight", "()I");
+    getBufferMethod = env->GetMethodID(planeClass, "getBuffer", "()Ljava/nio/ByteBuffer;");
+    getRowStrideMethod = env->GetMethodID(planeClass, "getRowStride", "()I");
+    getPixelStrideMethod = env->GetMethodID(planeClass, "getPixelStride", "()I");
+    if (env->ExceptionCheck()) {
+        env->ExceptionClear();
+        LOGE("Failed to resolve android.media.Image methods");
+        return false;
+    }
+    return true;
+}
+
+void releaseImageBindings(JNIEnv *env) {
+    if (imageClass != nullptr) {
+        env->DeleteGlobalRef(imageClass);
+        imageClass = nullptr;
+    }
+    if (planeClass != nullptr) {
+        env->DeleteGlobalRef(planeClass);
+        planeClass = nullptr;
+    }
+}
+
+bool bindImage(JNIEnv *env, jobject image, YUVImageView &view, int &payloadSize) {
+    if (image == nullptr || getPlanesMethod == nullptr) {
+        return false;
+    }
+
+    auto planes = (jobjectArray) env->CallObjectMethod(image, getPlanesMethod);
+    bool valid = planes != nullptr && env->GetArrayLength(planes) == 3;
+
+    view.width = env->CallIntMethod(image, getWidthMethod);
+    view.height = env->CallIntMethod(image, getHeightMethod);
+    payloadSize = 0;
+
+    for (int i = 0; valid && i < 3; i++) {
+        jobject planeObj = env->GetObjectArrayElement(planes, i);
+        jobject bufferObj = env->CallObjectMethod(planeObj, getBufferMethod);
+        view.data[i] = (uint8_t *) env->GetDirectBufferAddress(bufferObj);
+        view.rowStride[i] = env->CallIntMethod(planeObj, getRowStrideMethod);
+        view.pixelStride[i] = env->CallIntMethod(planeObj, getPixelStrideMethod);
+        valid = view.data[i] != nullptr;
+        if (i == 0 && valid) {
+            payloadSize = (int) env->GetDirectBufferCapacity(bufferObj);
+        }
+
+        env->DeleteLocalRef(bufferObj);
+        env->DeleteLocalRef(planeObj);
+    }
+
+    if (planes != nullptr) {
+        env->DeleteLocalRef(planes);
+    }
+    return valid;
+}
+
+bool CodecImageCache::bind(JNIEnv *env, jobject image, int bufferIndex, YUVImageView &view, int &payloadSize) {
+    if (bufferIndex < 0 || bufferIndex >= kMaxBuffers) {
+        return bindImage(env, image, view, payloadSize);
+    }
+
+    Entry &entry = entries[bufferIndex];
+    if (!entry.valid || !hasPlanesOf(env, image, entry.view)) {
+        entry.valid = bindImage(env, image, entry.view, entry.payloadSize);
+        if (!entry.valid) {
+            return false;
+        }
+    }
+    view = entry.view;
+    payloadSize = entry.payloadSize;
+    return true;
+}
+
+void CodecImageCache::clear() {
+    for (Entry &entry : entries) {
+        entry.valid = false;
+    }
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <jni.h>
+
+#include "yuv_frame.h"
+
+// Resolves android.media.Image / Image.Plane and their getters once; call from JNI_OnLoad
+bool cacheImageBindings(JNIEnv *env);
+
+void releaseImageBindings(JNIEnv *env);
+
+/**
+ * Reads the size, plane pointers and strides of an android.media.Image in one native call using the
+ * IDs cached at load time. payloadSize receives the bytes from the start of plane 0 to the end of its
+ * buffer, the size MediaCodec expects in queueInputBuffer. Local refs are released before returning.
+ */
+bool bindImage(JNIEnv *env, jobject image, YUVImageView &view, int &payloadSize);
+
+/**
+ * Plane views of a codec's input Images keyed by buffer index. A codec usually hands out the same memory
+ * for an index from start() to stop(), but nothing promises it, so each bind still compares the Image's
+ * plane addresses with the cached view and binds afresh when they moved; only the strides, size and
+ * capacity are saved. Clear it whenever the codec is stopped or reconfigured. One cache per codec, used
+ * from its thread.
+ */
+class CodecImageCache {
+public:
+    static constexpr int kMaxBuffers = 32;
+
+    // Uses the cached view for bufferIndex while image's planes are where it says, binding image otherwise;
+    // bufferIndex < 0 always binds
+    bool bind(JNIEnv *env, jobject image, int bufferIndex, YUVImageView &view, int &payloadSize);
+
+    void clear();
+
+private:
+    struct Entry {
+        bool valid = false;
+        YUVImageView view{};
+        int payloadSize = 0;
+    };
+
+    Entry entries[kMaxBuffers];
+};
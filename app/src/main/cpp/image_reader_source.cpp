@@ -0,0 +1,103 @@
+#include "image_reader_source.h"
+
+#include <media/NdkImage.h>
+
+#include "frame_ring.h"
+#include "yuv_log.h"
+
+ImageReaderSource::ImageReaderSource(FrameRing *ring) : ring(ring) {}
+
+ImageReaderSource::~ImageReaderSource() {
+    close();
+}
+
+bool ImageReaderSource::open(int width, int height, int maxImages) {
+    media_status_t status = AImageReader_new(width, height, AIMAGE_FORMAT_YUV_420_888, maxImages, &imageReader);
+    if (status != AMEDIA_OK || imageReader == nullptr) {
+        LOGE("AImageReader_new failed: %d", status);
+        imageReader = nullptr;
+        return false;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(deliveryMutex);
+        stopped = false;
+    }
+    AImageReader_ImageListener listener{this, &ImageReaderSource::onImageAvailable};
+    AImageReader_setImageListener(imageReader, &listener);
+
+    status = AImageReader_getWindow(imageReader, &window);
+    if (status != AMEDIA_OK) {
+        LOGE("AImageReader_getWindow failed: %d", status);
+        close();
+        return false;
+    }
+    return true;
+}
+
+void ImageReaderSource::stop() {
+    if (imageReader != nullptr) {
+        AImageReader_setImageListener(imageReader, nullptr);
+    }
+    std::lock_guard<std::mutex> lock(deliveryMutex);
+    stopped = true;
+}
+
+void ImageReaderSource::close() {
+    if (imageReader != nullptr) {
+        stop();
+        // Also frees any AImage still acquired, so the ring must not hold borrowed frames any more
+        AImageReader_delete(imageReader);
+        imageReader = nullptr;
+        window = nullptr;
+    }
+}
+
+void ImageReaderSource::onImageAvailable(void *context, AImageReader *reader) {
+    static_cast<ImageReaderSource *>(context)->handleImage(reader);
+}
+
+void ImageReaderSource::handleImage(AImageReader *reader) {
+    std::lock_guard<std::mutex> lock(deliveryMutex);
+    if (stopped) {
+        return;
+    }
+    if (placer != nullptr) {
+        placer->enter(ThreadRole::Ingest);
+    }
+    ScopedStageTimer timer(ring->getStats(), FrameStage::Ingest);
+    AImage *image = nullptr;
+    media_status_t status = AImageReader_acquireNextImage(reader, &image);
+    if (status != AMEDIA_OK || image == nullptr) {
+        // AMEDIA_IMAGEREADER_MAX_IMAGES_ACQUIRED: consumers still hold every image
+        starvedFrames.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    BorrowedFrame frame{};
+    int64_t timestampNs = 0;
+    AImage_getWidth(image, &frame.width);
+    AImage_getHeight(image, &frame.height);
+    AImage_getTimestamp(image, &timestampNs);
+    frame.timestampNs = timestampNs;
+    frame.handle = image;
+
+    for (int i = 0; i < 3; i++) {
+        uint8_t *data = nullptr;
+        int length = 0;
+        if (AImage_getPlaneData(image, i, &data, &length) != AMEDIA_OK ||
+            AImage_getPlaneRowStride(image, i, &frame.rowStride[i]) != AMEDIA_OK ||
+            AImage_getPlanePixelStride(image, i, &frame.pixelStride[i]) != AMEDIA_OK) {
+            LOGE("Failed to read plane %d of camera image", i);
+            AImage_delete(image);
+            return;
+        }
+        frame.planeData[i] = data;
+    }
+
+    ring->enqueueBorrowed(frame, this);
+}
+
+void ImageReaderSource::releaseFrame(void *handle) {
+    AImage_delete(static_cast<AImage *>(handle));
+}
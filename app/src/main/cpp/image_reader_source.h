@@ -0,0 +1,66 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+
+#include <media/NdkImageReader.h>
+
+#include "cpu_topology.h"
+#include "frame_source.h"
+
+class FrameRing;
+
+/**
+ * Zero-copy camera ingest: owns an AImageReader whose window is handed to the capture session and
+ * enqueues every AImage into the ring as a borrowed frame. The AImage is deleted (returned to the
+ * reader) only once the last consumer released it, so maxImages has to cover the ring capacity plus
+ * the frames the camera itself keeps in flight.
+ */
+class ImageReaderSource : public FrameReleaser {
+public:
+    explicit ImageReaderSource(FrameRing *ring);
+
+    ~ImageReaderSource() override;
+
+    bool open(int width, int height, int maxImages);
+
+    // Stops delivering new camera frames and waits for a frame the callback is still enqueueing, so the ring
+    // gets nothing from the source once it returns; images already in the ring stay valid
+    void stop();
+
+    void close();
+
+    // Owned by the reader, valid until close()
+    ANativeWindow *getWindow() const {
+        return window;
+    }
+
+    // Runs the reader's callback thread where the placer's ThreadRole::Ingest placement puts it; placer
+    // must outlive the source
+    void setPlacer(ThreadPlacer *placer) {
+        this->placer = placer;
+    }
+
+    void releaseFrame(void *handle) override;
+
+    // Camera frames that could not be acquired because every image was still held by the queue
+    uint64_t getStarvedFrames() const {
+        return starvedFrames.load(std::memory_order_relaxed);
+    }
+
+private:
+    static void onImageAvailable(void *context, AImageReader *reader);
+
+    void handleImage(AImageReader *reader);
+
+    FrameRing *ring;
+    ThreadPlacer *placer = nullptr;
+    AImageReader *imageReader = nullptr;
+    ANativeWindow *window = nullptr;
+    std::atomic<uint64_t> starvedFrames{0};
+    // Held by the callback while it hands an image to the ring, so stop() can wait it out; a callback
+    // already under way when the listener went away finds stopped set
+    std::mutex deliveryMutex;
+    bool stopped = false;
+};
@@ -0,0 +1,127 @@
+#include "image_stats.h"
+
+#include <algorithm>
+#include <cstring>
+
+void ImageStats::clear() {
+    memset(histogram, 0, sizeof(histogram));
+    lumaSum = 0;
+    lumaSquares = 0;
+    lumaCount = 0;
+    chromaSum[0] = chromaSum[1] = 0;
+    chromaCount = 0;
+}
+
+void ImageStats::merge(const ImageStats &other) {
+    for (int i = 0; i < 256; i++) {
+        histogram[i] += other.histogram[i];
+    }
+    lumaSum += other.lumaSum;
+    lumaSquares += other.lumaSquares;
+    lumaCount += other.lumaCount;
+    chromaSum[0] += other.chromaSum[0];
+    chromaSum[1] += other.chromaSum[1];
+    chromaCount += other.chromaCount;
+}
+
+double ImageStats::lumaMean() const {
+    return lumaCount > 0 ? (double) lumaSum / lumaCount : 0;
+}
+
+double ImageStats::lumaVariance() const {
+    if (lumaCount == 0) {
+        return 0;
+    }
+    double mean = lumaMean();
+    return std::max(0.0, (double) lumaSquares / lumaCount - mean * mean);
+}
+
+double ImageStats::chromaMean(int plane) const {
+    return chromaCount > 0 ? (double) chromaSum[plane] / chromaCount : 0;
+}
+
+void ImageStats::addLumaRow(const uint8_t *row, int pixelStride, int width, const SimdKernels &simd) {
+    if (pixelStride == 1) {
+        uint64_t sums[2] = {0, 0};
+        simd.rowMoments(row, width, sums);
+        lumaSum += sums[0];
+        lumaSquares += sums[1];
+        for (int x = 0; x < width; x++) {
+            histogram[row[x]]++;
+        }
+    } else {
+        for (int x = 0; x < width; x++) {
+            uint32_t value = row[x * pixelStride];
+            lumaSum += value;
+            lumaSquares += value * value;
+            histogram[value]++;
+        }
+    }
+    lumaCount += width;
+}
+
+void ImageStats::addChromaRow(const uint8_t *row, int pixelStride, int width, int plane, const SimdKernels &simd) {
+    if (pixelStride == 1) {
+        // The pairs kernel sums a plane row two bytes at a time
+        uint64_t sums[2] = {0, 0};
+        simd.pairSums(row, width / 2, sums);
+        chromaSum[plane] += sums[0] + sums[1] + ((width & 1) ? row[width - 1] : 0);
+    } else {
+        uint64_t sum = 0;
+        for (int x = 0; x < width; x++) {
+            sum += row[x * pixelStride];
+        }
+        chromaSum[plane] += sum;
+    }
+    // Both planes count the same samples
+    if (plane == 0) {
+        chromaCount += width;
+    }
+}
+
+void ImageStats::addChromaPairs(const uint8_t *row, int width, int firstPlane, const SimdKernels &simd) {
+    uint64_t sums[2] = {0, 0};
+    simd.pairSums(row, width, sums);
+    chromaSum[firstPlane] += sums[0];
+    chromaSum[1 - firstPlane] += sums[1];
+    chromaCount += width;
+}
+
+ImageStatsLog::ImageStatsLog(int capacity) : records(std::max(1, capacity)) {}
+
+void ImageStatsLog::record(long long timestampUs, int width, int height, const ImageStats &stats) {
+    std::lock_guard<std::mutex> lock(mutex);
+    Record &slot = records[next];
+    slot.timestampUs = timestampUs;
+    slot.width = width;
+    slot.height = height;
+    slot.stats = stats;
+    next = (next + 1) % (int) records.size();
+}
+
+bool ImageStatsLog::find(long long timestampUs, Record &record) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (timestampUs < 0) {
+        const Record &newest = records[(next + records.size() - 1) % records.size()];
+        if (newest.timestampUs < 0) {
+            return false;
+        }
+        record = newest;
+        return true;
+    }
+    for (const Record &candidate : records) {
+        if (candidate.timestampUs == timestampUs) {
+            record = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+void ImageStatsLog::clear() {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (Record &record : records) {
+        record.timestampUs = -1;
+    }
+    next = 0;
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include "yuv_simd.h"
+
+/**
+ * Exposure and colour statistics of one frame: a 256-bin luma histogram, luma mean and variance and the
+ * mean of each chroma plane.
+ *
+ * YUVConverter gathers them from the rows it has just written, while they are still in L1, so they cost
+ * no extra pass over the frame in memory: sums and squares come from the SimdKernels widening adds, the
+ * histogram is a scalar count over the same cached row. A conversion spread over a WorkerPool gathers
+ * per band and merges.
+ */
+struct ImageStats {
+    uint32_t histogram[256];
+    uint64_t lumaSum;
+    uint64_t lumaSquares;
+    uint64_t lumaCount;
+    // U, V
+    uint64_t chromaSum[2];
+    uint64_t chromaCount;
+
+    ImageStats() {
+        clear();
+    }
+
+    void clear();
+
+    void merge(const ImageStats &other);
+
+    double lumaMean() const;
+
+    double lumaVariance() const;
+
+    // plane: 0 = U, 1 = V
+    double chromaMean(int plane) const;
+
+    void addLumaRow(const uint8_t *row, int pixelStride, int width, const SimdKernels &simd);
+
+    // One row of a single chroma plane (0 = U, 1 = V)
+    void addChromaRow(const uint8_t *row, int pixelStride, int width, int plane, const SimdKernels &simd);
+
+    // One row of interleaved chroma, width pairs starting with firstPlane
+    void addChromaPairs(const uint8_t *row, int width, int firstPlane, const SimdKernels &simd);
+};
+
+/**
+ * The statistics of the last few frames, looked up by presentation time (toPresentationTimeUs), for the
+ * UI to fetch what a copy gathered. Thread-safe; a copy records once per frame, so the mutex is not
+ * contended.
+ */
+class ImageStatsLog {
+public:
+    static constexpr int kDefaultCapacity = 32;
+
+    struct Record {
+        long long timestampUs = -1;
+        int width = 0;
+        int height = 0;
+        ImageStats stats;
+    };
+
+    explicit ImageStatsLog(int capacity = kDefaultCapacity);
+
+    // Replaces the oldest record
+    void record(long long timestampUs, int width, int height, const ImageStats &stats);
+
+    // The frame with this presentation time, or with timestampUs < 0 the newest; false when it is not kept
+    bool find(long long timestampUs, Record &record) const;
+
+    void clear();
+
+private:
+    mutable std::mutex mutex;
+    std::vector<Record> records;
+    int next = 0;
+};
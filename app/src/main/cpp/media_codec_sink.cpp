@@ -0,0 +1,226 @@
+#include "media_codec_sink.h"
+
+#include <unistd.h>
+
+#include "yuv_log.h"
+
+namespace {
+
+// MediaCodecInfo.CodecCapabilities color formats for ByteBuffer input
+constexpr int32_t kColorFormatYUV420Planar = 19;
+constexpr int32_t kColorFormatYUV420SemiPlanar = 21;
+
+media_status_t configureEncoder(AMediaCodec *codec, const char *mime, int width, int height, int bitRate,
+                                int frameRate, int iFrameIntervalSec, int32_t colorFormat) {
+    AMediaFormat *format = AMediaFormat_new();
+    AMediaFormat_setString(format, AMEDIAFORMAT_KEY_MIME, mime);
+    AMediaFormat_setInt32(format, AMEDIAFORMAT_KEY_WIDTH, width);
+    AMediaFormat_setInt32(format, AMEDIAFORMAT_KEY_HEIGHT, height);
+    AMediaFormat_setInt32(format, AMEDIAFORMAT_KEY_BIT_RATE, bitRate);
+    AMediaFormat_setInt32(format, AMEDIAFORMAT_KEY_FRAME_RATE, frameRate);
+    AMediaFormat_setInt32(format, AMEDIAFORMAT_KEY_I_FRAME_INTERVAL, iFrameIntervalSec);
+    AMediaFormat_setInt32(format, AMEDIAFORMAT_KEY_COLOR_FORMAT, colorFormat);
+    media_status_t status = AMediaCodec_configure(codec, format, nullptr, nullptr,
+                                                  AMEDIACODEC_CONFIGURE_FLAG_ENCODE);
+    AMediaFormat_delete(format);
+    return status;
+}
+
+}  // namespace
+
+MediaCodecSink::~MediaCodecSink() {
+    close();
+}
+
+bool MediaCodecSink::open(const char *mime, int width, int height, int bitRate, int frameRate,
+                          int iFrameIntervalSec, int outputFd) {
+    close();
+    fd = outputFd;
+    codec = AMediaCodec_createEncoderByType(mime);
+    if (codec == nullptr) {
+        LOGE("No encoder for %s", mime);
+        close();
+        return false;
+    }
+
+    // Semi-planar is what most encoders prefer; planar is the fallback every encoder takes
+    int32_t colorFormat = kColorFormatYUV420SemiPlanar;
+    media_status_t status = configureEncoder(codec, mime, width, height, bitRate, frameRate, iFrameIntervalSec,
+                                             colorFormat);
+    if (status != AMEDIA_OK) {
+        colorFormat = kColorFormatYUV420Planar;
+        status = configureEncoder(codec, mime, width, height, bitRate, frameRate, iFrameIntervalSec, colorFormat);
+    }
+    if (status != AMEDIA_OK) {
+        LOGE("AMediaCodec_configure failed for %dx%d: %d", width, height, status);
+        close();
+        return false;
+    }
+
+    this->width = width;
+    this->height = height;
+    inputLayout = colorFormat == kColorFormatYUV420SemiPlanar ? YUVLayout::NV12 : YUVLayout::I420;
+    inputRowStride = width;
+    inputSliceHeight = height;
+    // Encoders may pad rows and planes; the input format says by how much
+    AMediaFormat *inputFormat = AMediaCodec_getInputFormat(codec);
+    if (inputFormat != nullptr) {
+        int32_t value = 0;
+        if (AMediaFormat_getInt32(inputFormat, AMEDIAFORMAT_KEY_STRIDE, &value) && value >= width) {
+            inputRowStride = value;
+        }
+        if (AMediaFormat_getInt32(inputFormat, AMEDIAFORMAT_KEY_SLICE_HEIGHT, &value) && value >= height) {
+            inputSliceHeight = value;
+        }
+        AMediaFormat_delete(inputFormat);
+    }
+    inputBytes = packedSize(width, height, inputRowStride, inputSliceHeight);
+
+    status = AMediaCodec_start(codec);
+    if (status != AMEDIA_OK) {
+        LOGE("AMediaCodec_start failed: %d", status);
+        close();
+        return false;
+    }
+
+    muxer = AMediaMuxer_new(fd, AMEDIAMUXER_OUTPUT_FORMAT_MPEG_4);
+    if (muxer == nullptr) {
+        LOGE("AMediaMuxer_new failed");
+        close();
+        return false;
+    }
+    return true;
+}
+
+void MediaCodecSink::close() {
+    if (codec != nullptr) {
+        AMediaCodec_stop(codec);
+        AMediaCodec_delete(codec);
+        codec = nullptr;
+    }
+    if (muxer != nullptr) {
+        if (muxerStarted) {
+            AMediaMuxer_stop(muxer);
+        }
+        AMediaMuxer_delete(muxer);
+        muxer = nullptr;
+    }
+    if (fd >= 0) {
+        ::close(fd);
+        fd = -1;
+    }
+    track = -1;
+    muxerStarted = false;
+    finished = false;
+}
+
+bool MediaCodecSink::dequeueBuffer(long long timeoutUs, SinkBuffer &buffer) {
+    if (codec == nullptr || finished) {
+        return false;
+    }
+    // Output only moves while someone drains it; a full output side would stall the input side
+    drainOutput(0);
+
+    ssize_t index = AMediaCodec_dequeueInputBuffer(codec, timeoutUs);
+    if (index < 0) {
+        return false;
+    }
+    size_t capacity = 0;
+    uint8_t *data = AMediaCodec_getInputBuffer(codec, index, &capacity);
+    if (data == nullptr || capacity < inputBytes) {
+        LOGE("Encoder input buffer too small: %zu < %zu", capacity, inputBytes);
+        AMediaCodec_queueInputBuffer(codec, index, 0, 0, 0, 0);
+        return false;
+    }
+    buffer.index = (int) index;
+    buffer.view = packedView(data, width, height, inputLayout, inputRowStride, inputSliceHeight);
+    buffer.payloadSize = (int) inputBytes;
+    return true;
+}
+
+void MediaCodecSink::queueBuffer(const SinkBuffer &buffer, long long timestampUs, bool filled) {
+    if (codec == nullptr || buffer.index < 0) {
+        return;
+    }
+    AMediaCodec_queueInputBuffer(codec, buffer.index, 0, filled ? buffer.payloadSize : 0,
+                                 timestampUs < 0 ? 0 : (uint64_t) timestampUs, 0);
+    drainOutput(0);
+}
+
+void MediaCodecSink::requestKeyFrame() {
+    if (codec == nullptr || finished) {
+        return;
+    }
+    AMediaFormat *params = AMediaFormat_new();
+    AMediaFormat_setInt32(params, AMEDIACODEC_KEY_REQUEST_SYNC_FRAME, 0);
+    media_status_t status = AMediaCodec_setParameters(codec, params);
+    AMediaFormat_delete(params);
+    if (status != AMEDIA_OK) {
+        LOGE("Key frame request failed: %d", status);
+    }
+}
+
+void MediaCodecSink::finish() {
+    if (codec == nullptr || finished) {
+        return;
+    }
+    finished = true;
+    long long waitedUs = 0;
+    ssize_t index = -1;
+    while (waitedUs < kFinishTimeoutUs) {
+        drainOutput(0);
+        index = AMediaCodec_dequeueInputBuffer(codec, 10 * 1000);
+        if (index >= 0) {
+            break;
+        }
+        waitedUs += 10 * 1000;
+    }
+    if (index < 0) {
+        LOGE("No input buffer for end of stream");
+        return;
+    }
+    AMediaCodec_queueInputBuffer(codec, index, 0, 0, 0, AMEDIACODEC_BUFFER_FLAG_END_OF_STREAM);
+    while (waitedUs < kFinishTimeoutUs && !drainOutput(10 * 1000)) {
+        waitedUs += 10 * 1000;
+    }
+    if (muxerStarted) {
+        AMediaMuxer_stop(muxer);
+        muxerStarted = false;
+    }
+}
+
+bool MediaCodecSink::drainOutput(long long timeoutUs) {
+    for (;;) {
+        AMediaCodecBufferInfo info;
+        ssize_t index = AMediaCodec_dequeueOutputBuffer(codec, &info, timeoutUs);
+        if (index == AMEDIACODEC_INFO_OUTPUT_FORMAT_CHANGED) {
+            AMediaFormat *format = AMediaCodec_getOutputFormat(codec);
+            track = (int) AMediaMuxer_addTrack(muxer, format);
+            AMediaFormat_delete(format);
+            muxerStarted = track >= 0 && AMediaMuxer_start(muxer) == AMEDIA_OK;
+            if (!muxerStarted) {
+                LOGE("Muxer could not start, encoded frames are discarded");
+            }
+            continue;
+        }
+        if (index == AMEDIACODEC_INFO_OUTPUT_BUFFERS_CHANGED) {
+            continue;
+        }
+        if (index < 0) {
+            return false;
+        }
+
+        size_t capacity = 0;
+        uint8_t *data = AMediaCodec_getOutputBuffer(codec, index, &capacity);
+        // Codec config (SPS/PPS) already went to the muxer with the track format
+        if (data != nullptr && info.size > 0 && muxerStarted &&
+            (info.flags & AMEDIACODEC_BUFFER_FLAG_CODEC_CONFIG) == 0) {
+            AMediaMuxer_writeSampleData(muxer, track, data, &info);
+            writtenSamples.fetch_add(1, std::memory_order_relaxed);
+        }
+        AMediaCodec_releaseOutputBuffer(codec, index, false);
+        if ((info.flags & AMEDIACODEC_BUFFER_FLAG_END_OF_STREAM) != 0) {
+            return true;
+        }
+    }
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+#include <media/NdkMediaCodec.h>
+#include <media/NdkMediaMuxer.h>
+
+#include "frame_sink.h"
+
+/**
+ * Encoder sink: an AMediaCodec fed through its input buffers (YUV 4:2:0 in ByteBuffer mode) whose
+ * output is drained into an MP4 AMediaMuxer on the same thread, so a FrameFeeder runs the whole
+ * camera-to-file path without the JVM.
+ */
+class MediaCodecSink : public FrameSink {
+public:
+    MediaCodecSink() = default;
+
+    ~MediaCodecSink() override;
+
+    MediaCodecSink(const MediaCodecSink &) = delete;
+    MediaCodecSink &operator=(const MediaCodecSink &) = delete;
+
+    // Configures and starts the encoder and muxes into outputFd, which the sink takes ownership of
+    bool open(const char *mime, int width, int height, int bitRate, int frameRate, int iFrameIntervalSec,
+              int outputFd);
+
+    void close();
+
+    bool dequeueBuffer(long long timeoutUs, SinkBuffer &buffer) override;
+
+    void queueBuffer(const SinkBuffer &buffer, long long timestampUs, bool filled) override;
+
+    // Signals end of stream, drains the encoder and finalizes the file
+    void finish() override;
+
+    // Asks the encoder for a sync frame as soon as possible
+    void requestKeyFrame() override;
+
+    uint64_t getWrittenSamples() const {
+        return writtenSamples.load(std::memory_order_relaxed);
+    }
+
+private:
+    // Upper bound on draining the encoder after end of stream
+    static constexpr long long kFinishTimeoutUs = 1000 * 1000;
+
+    // Moves finished output to the muxer; true once the end of stream came out
+    bool drainOutput(long long timeoutUs);
+
+    AMediaCodec *codec = nullptr;
+    AMediaMuxer *muxer = nullptr;
+    int fd = -1;
+    int track = -1;
+    bool muxerStarted = false;
+    bool finished = false;
+
+    int width = 0;
+    int height = 0;
+    YUVLayout inputLayout = YUVLayout::NV12;
+    int inputRowStride = 0;
+    int inputSliceHeight = 0;
+    size_t inputBytes = 0;
+
+    std::atomic<uint64_t> writtenSamples{0};
+};
@@ -0,0 +1,88 @@
+#include "motion_detector.h"
+
+#include <algorithm>
+#include <cstring>
+
+MotionDetector::MotionDetector(int rowStep) : rowStep(std::min(std::max(rowStep, 1), kBlockSize)) {}
+
+bool MotionDetector::resize(const YUVImageView &frame) {
+    if (frame.width == width && frame.height == height) {
+        return true;
+    }
+    width = frame.width;
+    height = frame.height;
+    current.columns = width / kBlockSize;
+    current.rows = height / kBlockSize;
+    reference.assign((size_t) current.columns * kBlockSize * current.rows * sampleRows(), 0);
+    sums.assign((size_t) current.columns * current.rows, 0);
+    rowScratch.assign(width, 0);
+    hasReference = false;
+    return false;
+}
+
+void MotionDetector::analyze(const YUVImageView &frame) {
+    simd = &simdKernels();
+    bool sameSize = resize(frame);
+    int columns = current.columns;
+    int rows = current.rows;
+    size_t rowBytes = (size_t) columns * kBlockSize;
+    std::fill(sums.begin(), sums.end(), 0);
+
+    uint8_t *ref = reference.data();
+    for (int blockRow = 0; blockRow < rows; blockRow++) {
+        uint32_t *blockSums = sums.data() + (size_t) blockRow * columns;
+        // Sample the middle of each step rather than its first row
+        for (int y = blockRow * kBlockSize + rowStep / 2; y < (blockRow + 1) * kBlockSize; y += rowStep) {
+            const uint8_t *row = frame.data[0] + (size_t) y * frame.rowStride[0];
+            if (frame.pixelStride[0] != 1) {
+                for (size_t x = 0; x < rowBytes; x++) {
+                    rowScratch[x] = row[x * frame.pixelStride[0]];
+                }
+                row = rowScratch.data();
+            }
+            if (hasReference) {
+                simd->sadBlocks(row, ref, blockSums, columns);
+            }
+            memcpy(ref, row, rowBytes);
+            ref += rowBytes;
+        }
+    }
+
+    bool compared = hasReference && sameSize;
+    hasReference = true;
+    int samples = kBlockSize * sampleRows();
+    uint64_t total = 0;
+    int changed = 0;
+    for (uint32_t sum : sums) {
+        total += sum;
+        if (sum > (uint32_t) (blockThreshold * samples)) {
+            changed++;
+        }
+    }
+    int blocks = columns * rows;
+    current.compared = compared;
+    current.score = compared && blocks > 0 ? (double) total / ((double) blocks * samples) : 0;
+    current.changedBlocks = compared ? changed : 0;
+    current.sceneCut = compared && blocks > 0 && changed >= sceneCutShare * blocks;
+    current.analyzedFrames++;
+    if (current.sceneCut) {
+        current.sceneCuts++;
+    }
+
+    std::lock_guard<std::mutex> lock(resultMutex);
+    published = current;
+    blockMap.resize(sums.size());
+    for (size_t i = 0; i < sums.size(); i++) {
+        blockMap[i] = compared ? (uint8_t) std::min<uint32_t>(255, (sums[i] + samples / 2) / samples) : 0;
+    }
+}
+
+MotionDetector::Summary MotionDetector::getSummary() const {
+    std::lock_guard<std::mutex> lock(resultMutex);
+    return published;
+}
+
+void MotionDetector::copyBlockMap(std::vector<uint8_t> &map) const {
+    std::lock_guard<std::mutex> lock(resultMutex);
+    map = blockMap;
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include "yuv_frame.h"
+#include "yuv_simd.h"
+
+/**
+ * Block motion between consecutive frames, from luma alone, for leaving unchanged frames out of a stream
+ * and spotting scene cuts.
+ *
+ * The frame is cut into 16x16 blocks (a partial block at the right or bottom edge is ignored). Every
+ * rowStep-th row of a block is compared with the same row of the previous frame, using the SimdKernels
+ * sum of absolute differences over 16 bytes. That is a quarter of the luma at the default step, well
+ * under a millisecond at 1080p. The sampled rows are kept as the next frame's reference while they are
+ * still in cache; the previous frame itself may be gone by then.
+ *
+ * A block counts as changed when its mean absolute difference is above blockThreshold, which sits above
+ * sensor noise. A scene cut is a frame where at least sceneCutShare of the blocks changed.
+ *
+ * analyze() is for one thread. getSummary() and copyBlockMap() may be called from any thread.
+ */
+class MotionDetector {
+public:
+    static constexpr int kBlockSize = 16;
+    static constexpr int kDefaultRowStep = 4;
+    // Mean absolute luma difference of a changed block; camera noise stays around 1-3 levels
+    static constexpr int kDefaultBlockThreshold = 8;
+    static constexpr double kDefaultSceneCutShare = 0.6;
+
+    // Result of the last analyze()
+    struct Summary {
+        // Mean absolute luma difference over the sampled pixels, 0-255
+        double score = 0;
+        int changedBlocks = 0;
+        int columns = 0;
+        int rows = 0;
+        bool sceneCut = false;
+        // False for the first frame and after a size change: nothing to compare with
+        bool compared = false;
+        uint64_t analyzedFrames = 0;
+        uint64_t sceneCuts = 0;
+    };
+
+    // rowStep: every how many rows of a block are sampled, 1-16
+    explicit MotionDetector(int rowStep = kDefaultRowStep);
+
+    // Set before the first analyze()
+    void setThresholds(int blockThreshold, double sceneCutShare) {
+        this->blockThreshold = blockThreshold;
+        this->sceneCutShare = sceneCutShare;
+    }
+
+    // Compares frame's luma with the previous analyzed frame and keeps it as the next reference
+    void analyze(const YUVImageView &frame);
+
+    // Last result; from analyze()'s thread these can be read without the lock
+    int getChangedBlocks() const {
+        return current.changedBlocks;
+    }
+
+    bool isSceneCut() const {
+        return current.sceneCut;
+    }
+
+    bool hasCompared() const {
+        return current.compared;
+    }
+
+    // Snapshot of the last result, any thread
+    Summary getSummary() const;
+
+    // Per block mean absolute difference of the last frame, row-major, clamped to 255; any thread
+    void copyBlockMap(std::vector<uint8_t> &map) const;
+
+private:
+    // Rows of a block that are sampled, the middle one of every rowStep
+    int sampleRows() const {
+        return (kBlockSize - rowStep / 2 + rowStep - 1) / rowStep;
+    }
+
+    // Sizes the reference for frame; false when the size changed, the reference is then stale
+    bool resize(const YUVImageView &frame);
+
+    const int rowStep;
+    int blockThreshold = kDefaultBlockThreshold;
+    double sceneCutShare = kDefaultSceneCutShare;
+    const SimdKernels *simd = nullptr;
+
+    int width = 0;
+    int height = 0;
+    // Sampled luma rows of the previous frame, columns * kBlockSize bytes each
+    std::vector<uint8_t> reference;
+    bool hasReference = false;
+    // Per block sums of the frame being analyzed
+    std::vector<uint32_t> sums;
+    // Luma row with pixel stride 1, for sources whose luma is not contiguous
+    std::vector<uint8_t> rowScratch;
+
+    Summary current;
+    // Published copy of current and the block map, for other threads
+    mutable std::mutex resultMutex;
+    Summary published;
+    std::vector<uint8_t> blockMap;
+};
@@ -0,0 +1,175 @@
+#include "output_graph.h"
+
+OutputGraph::OutputGraph(FrameRing *ring, int consumerId)
+        : ring(ring), consumerId(consumerId), stats(ring != nullptr ? ring->getStats() : nullptr) {}
+
+OutputGraph::~OutputGraph() {
+    stop();
+}
+
+int OutputGraph::addOutput(FrameSink *sink, const OutputProfile &profile) {
+    if (sink == nullptr || outputCount == kMaxOutputs || running.load()) {
+        return -1;
+    }
+    int index = outputCount++;
+    Output &output = outputs[index];
+    output.sink = sink;
+    output.profile = profile;
+    output.pacer.setFrameRate(profile.fps);
+
+    // Insertion sort; equal priorities keep the order they were added in
+    int position = index;
+    while (position > 0 && outputs[order[position - 1]].profile.priority < profile.priority) {
+        order[position] = order[position - 1];
+        position--;
+    }
+    order[position] = index;
+    return index;
+}
+
+bool OutputGraph::start() {
+    if (running.load() || ring == nullptr || consumerId < 0 || outputCount == 0) {
+        return false;
+    }
+    running.store(true);
+    thread = std::thread(&OutputGraph::run, this);
+    return true;
+}
+
+void OutputGraph::stop() {
+    if (!thread.joinable()) {
+        return;
+    }
+    running.store(false);
+    thread.join();
+    for (int i = 0; i < outputCount; i++) {
+        outputs[i].sink->finish();
+    }
+}
+
+void OutputGraph::run() {
+    Output &lead = outputs[order[0]];
+    while (running.load(std::memory_order_relaxed)) {
+        if (!ring->waitForFrame(consumerId, kFrameWaitNs)) {
+            continue;
+        }
+        // Keep the lead buffer across iterations rather than handing the encoder an empty one
+        if (!lead.holding && !lead.sink->dequeueBuffer(kBufferWaitUs, lead.buffer)) {
+            continue;
+        }
+        lead.holding = true;
+        if (placer != nullptr) {
+            placer->enter(ThreadRole::Feeder);
+        }
+        feed();
+    }
+    for (int i = 0; i < outputCount; i++) {
+        if (outputs[i].holding) {
+            outputs[i].sink->queueBuffer(outputs[i].buffer, 0, false);
+            outputs[i].holding = false;
+        }
+    }
+}
+
+void OutputGraph::feed() {
+    YUV420 *frame = ring->acquire(consumerId);
+    if (frame == nullptr) {
+        return;
+    }
+    long long timestampUs = toPresentationTimeUs(frame->timestampNs);
+    if (stats != nullptr) {
+        stats->record(FrameStage::QueueWait, steadyNowNs() - frame->enqueuedNs);
+    }
+    YUVImageView src = frame->view();
+    // Every frame goes through the detector, so the outputs get their key frame on the cut itself
+    bool moving = analyzeMotion(src);
+    bool still = false;
+
+    // Targets go in pass order, so each output keeps its YUVMultiOut lane
+    YUVMultiOut::Target targets[kMaxOutputs];
+    bool written[kMaxOutputs];
+    for (int i = 0; i < outputCount; i++) {
+        Output &output = outputs[order[i]];
+        targets[i].filter = output.profile.filter;
+        if (!output.pacer.accept(frame->timestampNs)) {
+            continue;
+        }
+        if (output.profile.motionGated && !moving && !passesFloor(output, timestampUs)) {
+            still = true;
+            continue;
+        }
+        if (!output.holding && !output.sink->dequeueBuffer(0, output.buffer)) {
+            output.missed.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+        output.holding = true;
+        targets[i].view = output.buffer.view;
+    }
+    if (still && stats != nullptr) {
+        stats->count(FrameCounter::Still);
+    }
+    {
+        // One walk over the source for all outputs, timed as the HQ copy like a FrameFeeder fan-out
+        ScopedStageTimer timer(stats, FrameStage::HqCopy);
+        if (crop != nullptr && !crop->isWhole()) {
+            // The region is read once per frame, so all outputs show the same part
+            cropTargets(src, crop->resolve(src.width, src.height), targets, written);
+        } else {
+            ImageStats *gathered = imageStatsLog != nullptr ? &imageStats : nullptr;
+            multiOut.fanOut(src, targets, outputCount, written, YUVConverter::kDefaultBandBytes, gathered);
+            bool copied = false;
+            for (int i = 0; i < outputCount; i++) {
+                copied = copied || (written[i] && targets[i].view.width == src.width &&
+                                    targets[i].view.height == src.height);
+            }
+            if (gathered != nullptr && copied) {
+                imageStatsLog->record(timestampUs, src.width, src.height, imageStats);
+            }
+        }
+    }
+    ring->release(consumerId);
+
+    for (int i = 0; i < outputCount; i++) {
+        Output &output = outputs[order[i]];
+        if (targets[i].view.data[0] == nullptr) {
+            continue;
+        }
+        output.sink->queueBuffer(output.buffer, timestampUs, written[i]);
+        output.holding = false;
+        if (written[i]) {
+            output.delivered.fetch_add(1, std::memory_order_relaxed);
+            output.gatedUntilUs = timestampUs;
+        }
+    }
+}
+
+void OutputGraph::cropTargets(const YUVImageView &src, const CropRect &region, const YUVMultiOut::Target *targets,
+                              bool *written) {
+    // A crop resamples each output from its own window, there is no shared pass to fuse
+    for (int i = 0; i < outputCount; i++) {
+        const YUVMultiOut::Target &target = targets[i];
+        written[i] = target.view.data[0] != nullptr &&
+                     outputs[order[i]].cropper.crop(src, region, target.view, target.filter);
+    }
+}
+
+bool OutputGraph::analyzeMotion(const YUVImageView &src) {
+    if (motion == nullptr) {
+        return true;
+    }
+    {
+        ScopedStageTimer timer(stats, FrameStage::Motion);
+        motion->analyze(src);
+    }
+    if (motion->isSceneCut()) {
+        for (int i = 0; i < outputCount; i++) {
+            outputs[i].sink->requestKeyFrame();
+        }
+    }
+    return !motion->hasCompared() || motion->getChangedBlocks() > 0;
+}
+
+bool OutputGraph::passesFloor(const Output &output, long long timestampUs) const {
+    return output.gatedUntilUs < 0 || timestampUs < output.gatedUntilUs ||
+           (motionFloorUs > 0 && timestampUs - output.gatedUntilUs >= motionFloorUs);
+}
@@ -0,0 +1,161 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+
+#include "cpu_topology.h"
+#include "frame_pacer.h"
+#include "frame_ring.h"
+#include "frame_sink.h"
+#include "frame_stats.h"
+#include "image_stats.h"
+#include "motion_detector.h"
+#include "yuv_crop.h"
+#include "yuv_fanout.h"
+#include "yuv_scaler.h"
+
+// How one output of an OutputGraph is fed; its resolution and pixel layout are those of its sink's buffers
+struct OutputProfile {
+    // Frames per second of capture time the output keeps, 0 = every frame
+    double fps = 0;
+    // Higher goes first; the highest one paces the graph, see OutputGraph
+    int priority = 0;
+    // Used when the output's size differs from the source's
+    ScaleFilter filter = ScaleFilter::Area;
+    // Behind the graph's motion gate, see OutputGraph::setMotionGate
+    bool motionGated = false;
+};
+
+/**
+ * Feeds any number of outputs off one ring consumer, e.g. an archive encoder, a live stream, a thumbnail
+ * and an analytics frame, each at its own size, layout and frame rate. Every frame is acquired once and
+ * written to all outputs that keep it in one pass over the source (YUVMultiOut), on one thread, so adding
+ * an output costs only its own conversion or scale.
+ *
+ * The output with the highest priority is the graph's pace-setter: like a FrameFeeder, a frame is only
+ * acquired once it had a free buffer. The others never hold the graph up; an output whose sink has no
+ * free buffer at that moment misses the frame (getMissedFrames), so a stalled thumbnail reader cannot
+ * stall the archive.
+ */
+class OutputGraph {
+public:
+    static constexpr int kMaxOutputs = YUVMultiOut::kMaxTargets;
+
+    OutputGraph(FrameRing *ring, int consumerId);
+
+    // Stops the thread if still running
+    ~OutputGraph();
+
+    OutputGraph(const OutputGraph &) = delete;
+    OutputGraph &operator=(const OutputGraph &) = delete;
+
+    // Returns the output's index, or -1 when kMaxOutputs are taken or the graph runs. sink must outlive
+    // the graph; before start()
+    int addOutput(FrameSink *sink, const OutputProfile &profile);
+
+    // Runs the thread where the placer's ThreadRole::Feeder placement puts it; placer must outlive the
+    // graph. Set before start()
+    void setPlacer(ThreadPlacer *placer) {
+        this->placer = placer;
+    }
+
+    // Where queue waits and the pass are timed, the ring's stats by default; nullptr for none. Set before start()
+    void setStats(FrameStats *stats) {
+        this->stats = stats;
+    }
+
+    // Leaves frames in which nothing moved out of the motionGated outputs but still passes them one at least
+    // every 1 / minFps seconds (0 = no floor), and asks every sink for a key frame at a scene cut. detector
+    // must outlive the graph; set before start()
+    void setMotionGate(MotionDetector *detector, double minFps) {
+        motion = detector;
+        motionFloorUs = minFps > 0 ? (long long) (1e6 / minFps) : 0;
+    }
+
+    // Writes only the region control currently holds, scaled to each output's size; control is read once
+    // per frame and must outlive the graph. A cropped frame is resampled per output rather than in one
+    // shared pass. Set before start()
+    void setCrop(const CropControl *control) {
+        crop = control;
+    }
+
+    // Gathers the statistics of every frame written whole (not cropped or scaled) to an output and records
+    // them in log, which must outlive the graph; set before start()
+    void setImageStats(ImageStatsLog *log) {
+        imageStatsLog = log;
+    }
+
+    // False without outputs
+    bool start();
+
+    // Joins the thread, hands back the buffers it still held and finishes every sink
+    void stop();
+
+    int getOutputCount() const {
+        return outputCount;
+    }
+
+    // Frames delivered to the output at index (as returned by addOutput)
+    uint64_t getDeliveredFrames(int index) const {
+        return index >= 0 && index < outputCount ? outputs[index].delivered.load(std::memory_order_relaxed) : 0;
+    }
+
+    // Frames the output's pacer kept but its sink had no free buffer for
+    uint64_t getMissedFrames(int index) const {
+        return index >= 0 && index < outputCount ? outputs[index].missed.load(std::memory_order_relaxed) : 0;
+    }
+
+private:
+    // Upper bounds on one wait, so stop() is noticed promptly
+    static constexpr long long kFrameWaitNs = 20 * 1000000LL;
+    static constexpr long long kBufferWaitUs = 10 * 1000;
+
+    struct Output {
+        FrameSink *sink = nullptr;
+        OutputProfile profile;
+        FramePacer pacer;
+        SinkBuffer buffer;
+        bool holding = false;
+        // Last frame the output took past the motion gate
+        long long gatedUntilUs = -1;
+        YUVCropper cropper;
+        std::atomic<uint64_t> delivered{0};
+        std::atomic<uint64_t> missed{0};
+    };
+
+    void run();
+
+    // Takes the next frame and writes it to every output that keeps it
+    void feed();
+
+    // Runs the motion detector on the frame; true when something moved or there is no gate
+    bool analyzeMotion(const YUVImageView &src);
+
+    // Whether a motionGated output takes a frame in which nothing moved: only at the floor rate, or after
+    // a timestamp jump
+    bool passesFloor(const Output &output, long long timestampUs) const;
+
+    // Writes region of src into every target, each through its output's cropper
+    void cropTargets(const YUVImageView &src, const CropRect &region, const YUVMultiOut::Target *targets,
+                     bool *written);
+
+    FrameRing *ring;
+    int consumerId;
+    FrameStats *stats;
+    ThreadPlacer *placer = nullptr;
+    const CropControl *crop = nullptr;
+    ImageStatsLog *imageStatsLog = nullptr;
+    ImageStats imageStats;
+    MotionDetector *motion = nullptr;
+    long long motionFloorUs = 0;
+    Output outputs[kMaxOutputs];
+    int outputCount = 0;
+    // Output indices by descending priority, the pace-setter first
+    int order[kMaxOutputs];
+
+    YUVMultiOut multiOut;
+
+    std::thread thread;
+    std::atomic<bool> running{false};
+};
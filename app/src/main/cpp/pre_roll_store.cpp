@@ -0,0 +1,168 @@
+#include "pre_roll_store.h"
+
+#include <algorithm>
+#include <new>
+
+#include "delta_codec.h"
+
+PreRollStore::PreRollStore(int width, int height, size_t budgetBytes, int keyFrameInterval)
+        : width(width), height(height), keyFrameInterval(keyFrameInterval > 0 ? keyFrameInterval : 1),
+          lumaBytes((size_t) width * height), frameBytes(packedSize(width, height)),
+          current(frameBytes), previous(frameBytes) {
+    if (width <= 0 || height <= 0) {
+        return;
+    }
+    slab.reset(new(std::nothrow) uint8_t[budgetBytes]);
+    if (slab != nullptr) {
+        this->budgetBytes = budgetBytes;
+    }
+}
+
+bool PreRollStore::dequeueBuffer(long long /* timeoutUs */, SinkBuffer &buffer) {
+    if (!isValid()) {
+        return false;
+    }
+    buffer.index = 0;
+    buffer.view = packedView(current.data(), width, height, YUVLayout::NV12);
+    buffer.payloadSize = (int) frameBytes;
+    return true;
+}
+
+void PreRollStore::queueBuffer(const SinkBuffer & /* buffer */, long long timestampUs, bool filled) {
+    if (!filled || !isValid()) {
+        return;
+    }
+    long long startNs = steadyNowNs();
+    size_t chromaBytes = frameBytes - lumaBytes;
+    size_t worstBytes = maxDeltaEncodedSize(lumaBytes) + maxDeltaEncodedSize(chromaBytes);
+    bool key = framesSinceKey == 0;
+    size_t offset = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        key = key || entries.empty();
+        if (!reserve(worstBytes, !key, offset)) {
+            // Only the group this frame depends on could make room: start over with a key frame
+            if (key || !reserve(worstBytes, false, offset)) {
+                refusedFrames++;
+                framesSinceKey = 0;
+                return;
+            }
+            key = true;
+        }
+    }
+
+    // The reserved range belongs to no entry, readers never look at it
+    uint8_t *out = slab.get() + offset;
+    const uint8_t *reference = key ? nullptr : previous.data();
+    size_t luma = encodeDeltaPlane(current.data(), reference, lumaBytes, 1, out);
+    size_t chroma = encodeDeltaPlane(current.data() + lumaBytes, key ? nullptr : reference + lumaBytes,
+                                     chromaBytes, 2, out + luma);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        entries.push_back({offset, (uint32_t) luma, (uint32_t) chroma, timestampUs, key});
+        storedBytes += luma + chroma;
+    }
+    newestUs.store(timestampUs, std::memory_order_release);
+
+    current.swap(previous);
+    framesSinceKey = key ? 1 : framesSinceKey + 1;
+    if (framesSinceKey >= keyFrameInterval) {
+        framesSinceKey = 0;
+    }
+    if (stats != nullptr) {
+        stats->record(FrameStage::PreRollEncode, steadyNowNs() - startNs);
+    }
+}
+
+bool PreRollStore::reserve(size_t bytes, bool keepLastGroup, size_t &offset) {
+    if (bytes > budgetBytes) {
+        return false;
+    }
+    for (;;) {
+        if (entries.empty()) {
+            offset = 0;
+            return true;
+        }
+        size_t head = entries.front().offset;
+        const Entry &last = entries.back();
+        size_t tail = last.offset + last.lumaBytes + last.chromaBytes;
+        if (head < tail) {
+            // In use: [head, tail); free: the end of the slab, else its start
+            if (budgetBytes - tail >= bytes) {
+                offset = tail;
+                return true;
+            }
+            if (head >= bytes) {
+                offset = 0;
+                return true;
+            }
+        } else if (head - tail >= bytes) {
+            // Wrapped, in use: [head, end) and [0, tail)
+            offset = tail;
+            return true;
+        }
+        // The oldest group is also the newest when no later entry is a key frame (a lone key frame included)
+        if (keepLastGroup &&
+            std::find_if(entries.begin() + 1, entries.end(), [](const Entry &e) { return e.key; }) == entries.end()) {
+            return false;
+        }
+        evictOldestGroup();
+    }
+}
+
+void PreRollStore::evictOldestGroup() {
+    do {
+        storedBytes -= entries.front().lumaBytes + entries.front().chromaBytes;
+        entries.pop_front();
+        firstSeq++;
+        evictedFrames++;
+    } while (!entries.empty() && !entries.front().key);
+}
+
+bool PreRollStore::decode(uint64_t seq, const uint8_t *previousFrame, uint8_t *frame) const {
+    const Entry &entry = entries[seq - firstSeq];
+    const uint8_t *in = slab.get() + entry.offset;
+    const uint8_t *reference = entry.key ? nullptr : previousFrame;
+    return decodeDeltaPlane(in, entry.lumaBytes, reference, lumaBytes, 1, frame) &&
+           decodeDeltaPlane(in + entry.lumaBytes, entry.chromaBytes, entry.key ? nullptr : reference + lumaBytes,
+                            frameBytes - lumaBytes, 2, frame + lumaBytes);
+}
+
+PreRollStore::Summary PreRollStore::getSummary() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    Summary summary{};
+    summary.frames = entries.size();
+    summary.storedBytes = storedBytes;
+    summary.rawBytes = entries.size() * frameBytes;
+    summary.oldestUs = entries.empty() ? -1 : entries.front().timestampUs;
+    summary.newestUs = entries.empty() ? -1 : entries.back().timestampUs;
+    summary.evictedFrames = evictedFrames;
+    summary.refusedFrames = refusedFrames;
+    return summary;
+}
+
+PreRollReader::PreRollReader(const PreRollStore &store)
+        : store(store), frame(store.frameBytes), previous(store.frameBytes) {}
+
+bool PreRollReader::next(long long &timestampUs) {
+    std::lock_guard<std::mutex> lock(store.mutex);
+    if (!started || nextSeq < store.firstSeq) {
+        // First call, or the writer evicted what we were about to read: the oldest group is a key frame
+        nextSeq = store.firstSeq;
+    }
+    if (nextSeq >= store.firstSeq + store.entries.size()) {
+        return false;
+    }
+    long long startNs = steadyNowNs();
+    frame.swap(previous);
+    if (!store.decode(nextSeq, previous.data(), frame.data())) {
+        return false;
+    }
+    started = true;
+    timestampUs = store.entries[nextSeq - store.firstSeq].timestampUs;
+    nextSeq++;
+    if (store.stats != nullptr) {
+        store.stats->record(FrameStage::PreRollDecode, steadyNowNs() - startNs);
+    }
+    return true;
+}
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "frame_sink.h"
+#include "frame_stats.h"
+
+/**
+ * "The last N seconds before the trigger": keeps the newest frames of a stream, compressed losslessly
+ * (delta_codec.h) into one fixed byte budget, e.g. 10 s of 1080p at 30 fps in the memory of a few
+ * dozen raw frames.
+ *
+ * Fed as a FrameSink by its own FrameFeeder, so compression runs on that thread and the ring's drop
+ * policy handles it falling behind. Every keyFrameInterval-th frame is coded on its own, the others
+ * against the previous frame; when the budget is full the oldest group of frames (a key frame and its
+ * followers) is evicted as a whole. Frames are stored packed NV12.
+ *
+ * Read back with a PreRollReader, which may run while the store is still being fed.
+ */
+class PreRollStore : public FrameSink {
+public:
+    static constexpr int kDefaultKeyFrameInterval = 30;
+
+    struct Summary {
+        uint64_t frames;       // frames held now
+        uint64_t storedBytes;  // their compressed size
+        uint64_t rawBytes;     // their packed NV12 size
+        long long oldestUs;    // presentation time of the oldest and newest held frame, -1 when empty
+        long long newestUs;
+        uint64_t evictedFrames;
+        uint64_t refusedFrames;  // did not fit the budget even with the store emptied
+    };
+
+    PreRollStore(int width, int height, size_t budgetBytes, int keyFrameInterval = kDefaultKeyFrameInterval);
+
+    PreRollStore(const PreRollStore &) = delete;
+    PreRollStore &operator=(const PreRollStore &) = delete;
+
+    // False when the budget could not be allocated
+    bool isValid() const {
+        return budgetBytes > 0;
+    }
+
+    int getWidth() const {
+        return width;
+    }
+
+    int getHeight() const {
+        return height;
+    }
+
+    // Packed NV12 size of one frame
+    size_t getFrameBytes() const {
+        return frameBytes;
+    }
+
+    // Encode and decode times go to the PreRollEncode / PreRollDecode stages; set before feeding
+    void setStats(FrameStats *stats) {
+        this->stats = stats;
+    }
+
+    bool dequeueBuffer(long long timeoutUs, SinkBuffer &buffer) override;
+
+    void queueBuffer(const SinkBuffer &buffer, long long timestampUs, bool filled) override;
+
+    // Presentation time of the newest stored frame, -1 when empty; readable from any thread
+    long long getNewestTimestampUs() const {
+        return newestUs.load(std::memory_order_acquire);
+    }
+
+    Summary getSummary() const;
+
+private:
+    friend class PreRollReader;
+
+    struct Entry {
+        size_t offset;
+        uint32_t lumaBytes;
+        uint32_t chromaBytes;
+        long long timestampUs;
+        bool key;
+    };
+
+    // Space for bytes contiguous in the slab, evicting the oldest groups; false when even an empty store
+    // is too small. Keeps the newest group when keepLastGroup, for a frame coded against it.
+    bool reserve(size_t bytes, bool keepLastGroup, size_t &offset);
+
+    void evictOldestGroup();
+
+    // Decodes entry seq into frame given the previous frame; called by readers under mutex
+    bool decode(uint64_t seq, const uint8_t *previous, uint8_t *frame) const;
+
+    int width;
+    int height;
+    int keyFrameInterval;
+    size_t lumaBytes;
+    size_t frameBytes;
+    size_t budgetBytes = 0;
+    std::unique_ptr<uint8_t[]> slab;
+    FrameStats *stats = nullptr;
+
+    // Feeder thread only: the frame being filled and the one before it
+    std::vector<uint8_t> current;
+    std::vector<uint8_t> previous;
+    int framesSinceKey = 0;
+
+    mutable std::mutex mutex;
+    std::deque<Entry> entries;
+    // Sequence number of entries.front()
+    uint64_t firstSeq = 0;
+    uint64_t storedBytes = 0;
+    uint64_t evictedFrames = 0;
+    uint64_t refusedFrames = 0;
+    std::atomic<long long> newestUs{-1};
+};
+
+/**
+ * Replays a PreRollStore oldest frame first. If the writer evicts frames the reader has not got to, the
+ * reader skips ahead to the oldest group still held.
+ */
+class PreRollReader {
+public:
+    explicit PreRollReader(const PreRollStore &store);
+
+    // Decodes the next stored frame; false once caught up with the writer
+    bool next(long long &timestampUs);
+
+    // The frame decoded by the last next(), packed NV12, valid until the next call
+    YUVImageView view() const {
+        return packedView(const_cast<uint8_t *>(frame.data()), store.width, store.height, YUVLayout::NV12);
+    }
+
+private:
+    const PreRollStore &store;
+    uint64_t nextSeq = 0;
+    bool started = false;
+    std::vector<uint8_t> frame;
+    std::vector<uint8_t> previous;
+};
@@ -0,0 +1,116 @@
+#include "worker_pool.h"
+
+#include <algorithm>
+
+namespace {
+
+// Polls of the generation counter before an idle worker goes to sleep
+constexpr int kSpinIterations = 500;
+
+constexpr int kMaxDefaultThreads = 4;
+
+uint64_t packCursor(uint32_t generation, uint32_t index) {
+    return ((uint64_t) generation << 32) | index;
+}
+
+}  // namespace
+
+WorkerPool::WorkerPool(int threadCount, ThreadPlacer *placer) : placer(placer) {
+    if (threadCount <= 0) {
+        threadCount = std::min((int) std::thread::hardware_concurrency(), kMaxDefaultThreads);
+    }
+    for (int i = 1; i < threadCount; i++) {
+        threads.emplace_back(&WorkerPool::workerLoop, this);
+    }
+}
+
+WorkerPool::~WorkerPool() {
+    {
+        std::lock_guard<std::mutex> lock(wakeMutex);
+        stopping = true;
+    }
+    wakeCondition.notify_all();
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+}
+
+void WorkerPool::run(int count, int grain, BandFunction function, void *context) {
+    if (count <= 0) {
+        return;
+    }
+    grain = std::max(1, grain);
+    int chunkCount = (count + grain - 1) / grain;
+
+    // Nothing to share, or another caller owns the workers: do it on this thread
+    std::unique_lock<std::mutex> submitLock(submitMutex, std::try_to_lock);
+    if (threads.empty() || chunkCount == 1 || !submitLock.owns_lock()) {
+        function(context, 0, count);
+        return;
+    }
+
+    Job job;
+    {
+        std::lock_guard<std::mutex> lock(wakeMutex);
+        uint32_t nextGeneration = generation.load(std::memory_order_relaxed) + 1;
+        current = Job{function, context, count, grain, chunkCount, nextGeneration};
+        pendingChunks.store(chunkCount, std::memory_order_relaxed);
+        cursor.store(packCursor(nextGeneration, 0), std::memory_order_relaxed);
+        generation.store(nextGeneration, std::memory_order_release);
+        job = current;
+    }
+    wakeCondition.notify_all();
+
+    drain(job);
+
+    // Completion barrier: the caller's own bands are done, wait out the ones still on workers
+    while (pendingChunks.load(std::memory_order_acquire) != 0) {
+        std::this_thread::yield();
+    }
+}
+
+void WorkerPool::drain(const Job &job) {
+    uint64_t claimed = cursor.load(std::memory_order_relaxed);
+    for (;;) {
+        if ((uint32_t) (claimed >> 32) != job.generation || (int) (uint32_t) claimed >= job.chunkCount) {
+            return;
+        }
+        if (!cursor.compare_exchange_weak(claimed, claimed + 1, std::memory_order_relaxed)) {
+            continue;
+        }
+        int begin = (int) (uint32_t) claimed * job.grain;
+        int end = std::min(job.count, begin + job.grain);
+        job.function(job.context, begin, end);
+        pendingChunks.fetch_sub(1, std::memory_order_release);
+        claimed = cursor.load(std::memory_order_relaxed);
+    }
+}
+
+void WorkerPool::workerLoop() {
+    uint32_t seenGeneration = 0;
+    for (;;) {
+        for (int i = 0; i < kSpinIterations; i++) {
+            if (generation.load(std::memory_order_relaxed) != seenGeneration) {
+                break;
+            }
+            std::this_thread::yield();
+        }
+
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(wakeMutex);
+            wakeCondition.wait(lock, [&] {
+                return stopping || generation.load(std::memory_order_relaxed) != seenGeneration;
+            });
+            if (stopping) {
+                return;
+            }
+            job = current;
+            seenGeneration = job.generation;
+        }
+        if (placer != nullptr) {
+            placer->enter(ThreadRole::CopyWorker);
+        }
+        drain(job);
+    }
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "cpu_topology.h"
+
+/**
+ * Long-lived threads that split one job into row bands, so a frame copy does not pay for thread
+ * creation. The calling thread works on bands too and returns once every band is done.
+ *
+ * Idle workers poll for the next job for a short while before sleeping, so back-to-back frames are picked up
+ * without a futex wake. One job runs at a time; a caller that finds the pool busy (e.g. the HQ and LQ
+ * encoders copying at the same moment) runs its job inline instead of waiting.
+ */
+class WorkerPool {
+public:
+    // Work on bands [begin, end)
+    typedef void (*BandFunction)(void *context, int begin, int end);
+
+    // threadCount counts the caller, so threadCount - 1 threads are started; 0 picks one per core (up to 4).
+    // With a placer the workers run where its ThreadRole::CopyWorker placement puts them; it must outlive the pool
+    explicit WorkerPool(int threadCount, ThreadPlacer *placer = nullptr);
+
+    ~WorkerPool();
+
+    WorkerPool(const WorkerPool &) = delete;
+    WorkerPool &operator=(const WorkerPool &) = delete;
+
+    // Runs function over [0, count) in chunks of grain, blocking until all of them are done
+    void run(int count, int grain, BandFunction function, void *context);
+
+    // Convenience wrapper for lambdas taking (begin, end)
+    template<typename Function>
+    void run(int count, int grain, Function &&function) {
+        using Callable = std::remove_reference_t<Function>;
+        run(count, grain, [](void *context, int begin, int end) {
+            (*static_cast<Callable *>(context))(begin, end);
+        }, (void *) &function);
+    }
+
+    int getThreadCount() const {
+        return (int) threads.size() + 1;
+    }
+
+private:
+    void workerLoop();
+
+    struct Job {
+        BandFunction function;
+        void *context;
+        int count;
+        int grain;
+        int chunkCount;
+        uint32_t generation;
+    };
+
+    // Claims and runs chunks of job until none are left
+    void drain(const Job &job);
+
+    std::vector<std::thread> threads;
+    ThreadPlacer *placer;
+
+    // Serialises callers; held for the whole job
+    std::mutex submitMutex;
+
+    // Current job; written under wakeMutex and published by bumping generation
+    Job current{};
+    std::atomic<uint32_t> generation{0};
+    bool stopping = false;
+    std::mutex wakeMutex;
+    std::condition_variable wakeCondition;
+
+    // Next chunk to claim, tagged with the job's generation in the high half so a worker that
+    // wakes up late cannot claim a chunk of the following job
+    std::atomic<uint64_t> cursor{0};
+    std::atomic<int> pendingChunks{0};
+};
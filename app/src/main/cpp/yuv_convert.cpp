@@ -0,0 +1,246 @@
+#include "yuv_convert.h"
+
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+
+namespace {
+
+void copyStridedRow(const uint8_t *src, int srcPixelStride, uint8_t *dst, int dstPixelStride, int width) {
+    for (int x = 0; x < width; x++) {
+        dst[x * dstPixelStride] = src[x * srcPixelStride];
+    }
+}
+
+// Plane that starts the interleaved chroma row
+int interleavedBase(YUVLayout layout) {
+    return layout == YUVLayout::NV21 ? 2 : 1;
+}
+
+}  // namespace
+
+YUVLayout detectLayout(const YUVImageView &view) {
+    if (view.pixelStride[0] != 1 || view.rowStride[1] != view.rowStride[2]) {
+        return YUVLayout::Generic;
+    }
+    if (view.pixelStride[1] == 1 && view.pixelStride[2] == 1) {
+        return YUVLayout::I420;
+    }
+    if (view.pixelStride[1] == 2 && view.pixelStride[2] == 2) {
+        if (view.data[2] == view.data[1] + 1) {
+            return YUVLayout::NV12;
+        }
+        if (view.data[1] == view.data[2] + 1) {
+            return YUVLayout::NV21;
+        }
+    }
+    return YUVLayout::Generic;
+}
+
+const char *layoutName(YUVLayout layout) {
+    switch (layout) {
+        case YUVLayout::I420:
+            return "I420";
+        case YUVLayout::NV12:
+            return "NV12";
+        case YUVLayout::NV21:
+            return "NV21";
+        default:
+            return "Generic";
+    }
+}
+
+YUVImageView packedView(uint8_t *data, int width, int height, YUVLayout layout, int rowStride, int sliceHeight) {
+    if (rowStride <= 0) {
+        rowStride = width;
+    }
+    if (sliceHeight <= 0) {
+        sliceHeight = height;
+    }
+    YUVImageView view;
+    view.width = width;
+    view.height = height;
+    view.data[0] = data;
+    view.rowStride[0] = rowStride;
+    view.pixelStride[0] = 1;
+
+    uint8_t *chroma = data + (size_t) rowStride * sliceHeight;
+    if (layout == YUVLayout::I420) {
+        int chromaStride = (rowStride + 1) / 2;
+        view.data[1] = chroma;
+        view.data[2] = chroma + (size_t) chromaStride * ((sliceHeight + 1) / 2);
+        view.rowStride[1] = view.rowStride[2] = chromaStride;
+        view.pixelStride[1] = view.pixelStride[2] = 1;
+    } else {
+        int uOffset = layout == YUVLayout::NV21 ? 1 : 0;
+        view.data[1] = chroma + uOffset;
+        view.data[2] = chroma + 1 - uOffset;
+        // An odd width still has a whole pair at the end of the row
+        view.rowStride[1] = view.rowStride[2] = (rowStride + 1) / 2 * 2;
+        view.pixelStride[1] = view.pixelStride[2] = 2;
+    }
+    return view;
+}
+
+size_t packedSize(int width, int height, int rowStride, int sliceHeight) {
+    if (rowStride <= 0) {
+        rowStride = width;
+    }
+    if (sliceHeight <= 0) {
+        sliceHeight = height;
+    }
+    // Both layouts hold two chroma bytes per 2x2 block; I420 rows are half as wide
+    return (size_t) rowStride * sliceHeight + (size_t) ((rowStride + 1) / 2) * 2 * ((sliceHeight + 1) / 2);
+}
+
+void YUVConverter::select(const YUVImageView &src, const YUVImageView &dst) {
+    YUVLayout newSrc = detectLayout(src);
+    YUVLayout newDst = detectLayout(dst);
+    const SimdKernels *newSimd = &simdKernels();
+    if (selected && newSrc == srcLayout && newDst == dstLayout && newSimd == simd) {
+        return;
+    }
+    selected = true;
+    srcLayout = newSrc;
+    dstLayout = newDst;
+    simd = newSimd;
+    srcPlane0 = 1;
+    srcPlane1 = 2;
+    dstPlane0 = 1;
+    dstPlane1 = 2;
+    chromaOp = ChromaOp::Strided;
+
+    bool srcPlanar = srcLayout == YUVLayout::I420;
+    bool dstPlanar = dstLayout == YUVLayout::I420;
+    if (srcLayout == YUVLayout::Generic || dstLayout == YUVLayout::Generic) {
+        return;
+    }
+
+    if (srcPlanar && dstPlanar) {
+        chromaOp = ChromaOp::CopyPlanar;
+    } else if (srcPlanar) {
+        // The first interleaved byte comes from the plane the destination starts with
+        chromaOp = ChromaOp::Merge;
+        dstPlane0 = interleavedBase(dstLayout);
+        srcPlane0 = dstPlane0;
+        srcPlane1 = 3 - dstPlane0;
+    } else if (dstPlanar) {
+        chromaOp = ChromaOp::Split;
+        srcPlane0 = interleavedBase(srcLayout);
+        dstPlane0 = srcPlane0;
+        dstPlane1 = 3 - srcPlane0;
+    } else {
+        chromaOp = srcLayout == dstLayout ? ChromaOp::CopyInterleaved : ChromaOp::Swap;
+        srcPlane0 = interleavedBase(srcLayout);
+        dstPlane0 = interleavedBase(dstLayout);
+    }
+}
+
+int YUVConverter::chromaRows(const YUVImageView &src, const YUVImageView &dst) {
+    return (std::min(src.height, dst.height) + 1) / 2;
+}
+
+int YUVConverter::bandRows(const YUVImageView &src, const YUVImageView &dst, int bandBytes) {
+    int width = std::max(1, std::min(src.width, dst.width));
+    return std::max(1, bandBytes / (width * 3));
+}
+
+void YUVConverter::convert(const YUVImageView &src, const YUVImageView &dst, WorkerPool *pool, int bandBytes,
+                           ImageStats *stats) {
+    select(src, dst);
+    int rows = chromaRows(src, dst);
+    if (stats != nullptr) {
+        stats->clear();
+    }
+    if (pool == nullptr) {
+        convertRows(src, dst, 0, rows, stats);
+        return;
+    }
+    if (stats == nullptr) {
+        pool->run(rows, bandRows(src, dst, bandBytes), [&](int begin, int end) {
+            convertRows(src, dst, begin, end);
+        });
+        return;
+    }
+    // Each band gathers on its own and merges once
+    std::mutex statsMutex;
+    pool->run(rows, bandRows(src, dst, bandBytes), [&](int begin, int end) {
+        ImageStats band;
+        convertRows(src, dst, begin, end, &band);
+        std::lock_guard<std::mutex> lock(statsMutex);
+        stats->merge(band);
+    });
+}
+
+bool YUVConverter::exportPacked(const YUVImageView &src, uint8_t *dst, size_t capacity, YUVLayout layout,
+                                WorkerPool *pool, int bandBytes) {
+    if (layout == YUVLayout::Generic || src.width <= 0 || src.height <= 0 || dst == nullptr ||
+        capacity < packedSize(src.width, src.height)) {
+        return false;
+    }
+    // Rows of the packed view are the row copies and SimdKernels chroma ops of any conversion
+    convert(src, packedView(dst, src.width, src.height, layout), pool, bandBytes);
+    return true;
+}
+
+void YUVConverter::convertRows(const YUVImageView &src, const YUVImageView &dst,
+                               int chromaRowBegin, int chromaRowEnd, ImageStats *stats) const {
+    int width = std::min(src.width, dst.width);
+    int height = std::min(src.height, dst.height);
+    int chromaWidth = (width + 1) / 2;
+
+    // Luma
+    int lumaEnd = std::min(chromaRowEnd * 2, height);
+    for (int row = chromaRowBegin * 2; row < lumaEnd; row++) {
+        const uint8_t *srcRow = src.data[0] + (size_t) row * src.rowStride[0];
+        uint8_t *dstRow = dst.data[0] + (size_t) row * dst.rowStride[0];
+        if (src.pixelStride[0] == 1 && dst.pixelStride[0] == 1) {
+            memcpy(dstRow, srcRow, width);
+        } else {
+            copyStridedRow(srcRow, src.pixelStride[0], dstRow, dst.pixelStride[0], width);
+        }
+        if (stats != nullptr) {
+            // From the row just written, it is still in cache
+            stats->addLumaRow(dstRow, dst.pixelStride[0], width, *simd);
+        }
+    }
+
+    // Chroma
+    for (int row = chromaRowBegin; row < chromaRowEnd; row++) {
+        const uint8_t *s0 = src.data[srcPlane0] + (size_t) row * src.rowStride[srcPlane0];
+        const uint8_t *s1 = src.data[srcPlane1] + (size_t) row * src.rowStride[srcPlane1];
+        uint8_t *d0 = dst.data[dstPlane0] + (size_t) row * dst.rowStride[dstPlane0];
+        uint8_t *d1 = dst.data[dstPlane1] + (size_t) row * dst.rowStride[dstPlane1];
+        switch (chromaOp) {
+            case ChromaOp::CopyPlanar:
+                memcpy(d0, s0, chromaWidth);
+                memcpy(d1, s1, chromaWidth);
+                break;
+            case ChromaOp::CopyInterleaved:
+                memcpy(d0, s0, chromaWidth * 2);
+                break;
+            case ChromaOp::Swap:
+                simd->swapPairs(s0, d0, chromaWidth);
+                break;
+            case ChromaOp::Split:
+                simd->splitPairs(s0, d0, d1, chromaWidth);
+                break;
+            case ChromaOp::Merge:
+                simd->mergePairs(s0, s1, d0, chromaWidth);
+                break;
+            case ChromaOp::Strided:
+                copyStridedRow(s0, src.pixelStride[srcPlane0], d0, dst.pixelStride[dstPlane0], chromaWidth);
+                copyStridedRow(s1, src.pixelStride[srcPlane1], d1, dst.pixelStride[dstPlane1], chromaWidth);
+                break;
+        }
+        if (stats == nullptr) {
+            continue;
+        }
+        if (chromaOp == ChromaOp::CopyInterleaved || chromaOp == ChromaOp::Swap || chromaOp == ChromaOp::Merge) {
+            stats->addChromaPairs(d0, chromaWidth, dstPlane0 - 1, *simd);
+        } else {
+            stats->addChromaRow(d0, dst.pixelStride[dstPlane0], chromaWidth, dstPlane0 - 1, *simd);
+            stats->addChromaRow(d1, dst.pixelStride[dstPlane1], chromaWidth, dstPlane1 - 1, *simd);
+        }
+    }
+}
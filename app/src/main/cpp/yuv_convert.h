@@ -0,0 +1,101 @@
+#pragma once
+
+#include <cstdint>
+
+#include "image_stats.h"
+#include "worker_pool.h"
+#include "yuv_frame.h"
+#include "yuv_simd.h"
+
+// Memory layout of a YUV 4:2:0 image, detected from its plane pointers and pixel strides
+enum class YUVLayout {
+    I420,     // three planes, pixel stride 1 (YV12 as well, plane order does not matter)
+    NV12,     // interleaved chroma starting with U
+    NV21,     // interleaved chroma starting with V
+    Generic,  // anything else, handled by the per-pixel fallback
+};
+
+YUVLayout detectLayout(const YUVImageView &view);
+
+const char *layoutName(YUVLayout layout);
+
+// View of a 4:2:0 frame stored in one flat buffer, as in an encoder's input buffer or a raw .yuv file:
+// luma rows of rowStride bytes (0 = width), then chroma starting sliceHeight luma rows in (0 = height).
+// layout must be I420, NV12 or NV21.
+YUVImageView packedView(uint8_t *data, int width, int height, YUVLayout layout, int rowStride = 0, int sliceHeight = 0);
+
+// Bytes packedView() spans with the same arguments
+size_t packedSize(int width, int height, int rowStride = 0, int sliceHeight = 0);
+
+/**
+ * Copies YUV 4:2:0 images between any pair of layouts (I420 / NV12 / NV21, arbitrary row strides).
+ *
+ * The kernel for the source/destination layout pair is picked the first time that pair is seen and
+ * kept until it changes, so per-frame work is only the row loops. Each kernel works on whole rows:
+ * memcpy for matching layouts, otherwise the SimdKernels split, merge or pair swap.
+ *
+ * Not thread-safe: keep one converter per consumer. A single conversion can still be spread over a
+ * WorkerPool, in bands of whole chroma rows so interleaved chroma is never written from two threads.
+ *
+ * Given an ImageStats, a conversion also gathers the frame's statistics from each row it writes.
+ */
+class YUVConverter {
+public:
+    // Bytes moved per band by default, small enough for a band to stay in L2 on mobile cores
+    static constexpr int kDefaultBandBytes = 64 * 1024;
+
+    // Converts the overlapping area of src and dst, split over pool when one is given; stats, when given,
+    // is cleared and gets the statistics of the converted area
+    void convert(const YUVImageView &src, const YUVImageView &dst,
+                 WorkerPool *pool = nullptr, int bandBytes = kDefaultBandBytes, ImageStats *stats = nullptr);
+
+    // Writes src tightly packed (packedView with no row padding, packedSize bytes) into dst, e.g. a frame
+    // grab into a caller's buffer. False, with nothing written, when layout is not I420, NV12 or NV21 or
+    // capacity is below packedSize(src.width, src.height).
+    bool exportPacked(const YUVImageView &src, uint8_t *dst, size_t capacity, YUVLayout layout,
+                      WorkerPool *pool = nullptr, int bandBytes = kDefaultBandBytes);
+
+    // Converts chroma rows [chromaRowBegin, chromaRowEnd) and the luma rows they cover, so a frame can
+    // be split into independent row bands, adding their statistics to stats when given. Call select() first.
+    void convertRows(const YUVImageView &src, const YUVImageView &dst, int chromaRowBegin, int chromaRowEnd,
+                     ImageStats *stats = nullptr) const;
+
+    // Picks the kernels for the pair of layouts, a no-op while they stay the same
+    void select(const YUVImageView &src, const YUVImageView &dst);
+
+    YUVLayout getSourceLayout() const {
+        return srcLayout;
+    }
+
+    YUVLayout getDestinationLayout() const {
+        return dstLayout;
+    }
+
+    // Rows of chroma for the overlapping area, the unit convertRows() bands are expressed in
+    static int chromaRows(const YUVImageView &src, const YUVImageView &dst);
+
+    // Chroma rows per band so that one band moves about bandBytes (two luma rows and a chroma row each)
+    static int bandRows(const YUVImageView &src, const YUVImageView &dst, int bandBytes);
+
+private:
+    // Work done per chroma row
+    enum class ChromaOp {
+        CopyPlanar,       // two memcpy
+        CopyInterleaved,  // one memcpy of the pairs
+        Swap,             // NV12 <-> NV21
+        Split,            // semi-planar -> planar
+        Merge,            // planar -> semi-planar
+        Strided,          // per-pixel fallback
+    };
+
+    bool selected = false;
+    YUVLayout srcLayout = YUVLayout::Generic;
+    YUVLayout dstLayout = YUVLayout::Generic;
+    ChromaOp chromaOp = ChromaOp::Strided;
+    const SimdKernels *simd = nullptr;
+    // Plane indices (1 = U, 2 = V) of the first and second chroma row pointers; interleaved sides only use the first
+    int srcPlane0 = 1;
+    int srcPlane1 = 2;
+    int dstPlane0 = 1;
+    int dstPlane1 = 2;
+};
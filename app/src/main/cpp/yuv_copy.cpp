@@ -1,966 +1,1430 @@
 #include <jni.h>
-#include <android/log.h>
+#include <algorithm>
+#include <atomic>
 #include <cstring>
 #include <vector>
-#include <queue>
 #include <cstdint>
 #include <mutex>
-#include <thread>
-#include <condition_variable>
-#include <future>
+#include <string>
+#include <unistd.h>
 
 #include <android/bitmap.h>
 #include <media/NdkImage.h>
 #include <media/NdkImageReader.h>
-#include <arm_neon.h>
-
-#define LOG_TAG "YuvUtils"
-#define LOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
-#define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
-
-std::mutex copyMutex;
-
-struct YUVImagePlane {
-    std::vector<uint8_t> byteBuffer;
-    int pixelStride;
-    int rowStride;
-
-    YUVImagePlane(int size, int pixelStride, int rowStride)
-            : byteBuffer(size), pixelStride(pixelStride), rowStride(rowStride) {}
+#include <android/native_window_jni.h>
+
+#include "cpu_topology.h"
+#include "frame_capture.h"
+#include "frame_feeder.h"
+#include "frame_ring.h"
+#include "frame_stats.h"
+#include "image_binding.h"
+#include "image_stats.h"
+#include "image_reader_source.h"
+#include "media_codec_sink.h"
+#include "motion_detector.h"
+#include "output_graph.h"
+#include "pre_roll_store.h"
+#include "worker_pool.h"
+#include "yuv_convert.h"
+#include "yuv_crop.h"
+#include "yuv_log.h"
+#include "yuv_scaler.h"
+
+FrameRing *yuvQueue = nullptr;
+ImageReaderSource *imageSource = nullptr;
+
+// Per-stage latency and frame counters, read through getStats()
+FrameStats frameStats;
+
+// Raw frame capture of addToNativeQueue (startCaptureRecording); idle unless recording
+CaptureRecorder captureRecorder;
+
+// Capture replay into the queue (startCaptureReplay), stopped in cleanupQueue before the ring goes
+CaptureReader *captureReader = nullptr;
+CaptureReplayer *captureReplayer = nullptr;
+
+// Clusters and nice values of the ingest, copy worker and feeder threads, see configureThreadPlacement;
+// threads are left where the system puts them until then
+ThreadPlacer threadPlacer;
+
+// Shared by every consumer's copy, lives from setupQueue to cleanupQueue
+WorkerPool *copyWorkers = nullptr;
+int copyWorkerThreads = 0;  // 0 = one per core
+int copyBandBytes = YUVConverter::kDefaultBandBytes;
+
+// What the queue does once a consumer is a full queue behind, see configureDropPolicy
+DropPolicy queueDropPolicy = DropPolicy::DropNewest;
+long long queueBlockTimeoutNs = 0;
+
+// Largest capture size the ring's storage is sized for up front, see configureQueueBudget
+int queueMaxWidth = 0;
+int queueMaxHeight = 0;
+
+// File-backed overflow for the queue, see configureQueueSpill; no spill while spillFrames is 0
+std::string queueSpillPath;
+int queueSpillFrames = 0;
+
+// How long a reconfigure waits for consumers to finish the frame they are copying
+constexpr long long kReconfigureDrainTimeoutNs = 100 * 1000000LL;
+
+// Bound codec input Images per consumer, dropped in cleanupQueue when the codecs stop
+CodecImageCache consumerImages[FrameRing::kMaxConsumers];
+
+// Native encode path per consumer (startNativeFeeder), stopped in cleanupQueue before the ring goes
+FrameFeeder *consumerFeeders[FrameRing::kMaxConsumers] = {};
+MediaCodecSink *consumerSinks[FrameRing::kMaxConsumers] = {};
+// Second encoder of a fan-out feeder (startNativeFanOut), fed by the same consumer
+MediaCodecSink *consumerScaledSinks[FrameRing::kMaxConsumers] = {};
+
+// Output graph per consumer (addNativeOutput, addNativeFrameOutput, startNativeOutputs), torn down with the
+// consumer's native feeder
+struct NativeOutputs {
+    OutputGraph *graph = nullptr;
+    // Owned, one per output in addOutput order
+    std::vector<FrameSink *> sinks;
+    // The outputs read back with readNativeOutput, null for encoder outputs
+    LatestFrameSink *frames[OutputGraph::kMaxOutputs] = {};
+    bool started = false;
 };
-
-class YUV420 {
-public:
-    int width;
-    int height;
-    long long timestampUs;
-    std::vector<YUVImagePlane> planes;
-
-    YUV420(int width, int height, long long timestampUs)
-            : width(width), height(height), timestampUs(timestampUs) {
-        // Pre-allocate planes for Y, U, and V
-        planes.emplace_back(width * height, 1, width);  // Y plane
-        planes.emplace_back(width * height / 2, 2, width);  // U plane
-        planes.emplace_back(width * height / 2, 2, width);  // V plane
-    }
-
-    void update(int width, int height, long long timestampUs,
-                const uint8_t *yData, int yRowStride, int yPixelStride,
-                const uint8_t *uData, int uRowStride, int uPixelStride,
-                const uint8_t *vData, int vRowStride, int vPixelStride) {
-        this->width = width;
-        this->height = height;
-        this->timestampUs = timestampUs;
-
-        // Update Y plane
-        planes[0].rowStride = yRowStride;
-        planes[0].pixelStride = yPixelStride;
-        memcpy(planes[0].byteBuffer.data(), yData, width * height);
-
-        // Update U plane
-        planes[1].rowStride = uRowStride;
-        planes[1].pixelStride = uPixelStride;
-        memcpy(planes[1].byteBuffer.data(), uData, width * height / 2);
-
-        // Update V plane
-        planes[2].rowStride = vRowStride;
-        planes[2].pixelStride = vPixelStride;
-        memcpy(planes[2].byteBuffer.data(), vData, width * height / 2);
+NativeOutputs consumerOutputs[FrameRing::kMaxConsumers];
+
+// Motion gate for downscaled native streams, see configureMotionGate; off while the threshold is 0
+int motionBlockThreshold = 0;
+double motionSceneCutShare = MotionDetector::kDefaultSceneCutShare;
+double motionMinFps = 0;
+MotionDetector *consumerMotion[FrameRing::kMaxConsumers] = {};
+
+// Digital zoom (setCropRegion) applied by every copy off the queue; the pre-roll keeps whole frames
+CropControl cropRegion;
+
+// Statistics gathered by full-size copies while configureImageStats has them on
+std::atomic<bool> imageStatsEnabled{false};
+ImageStatsLog imageStatsLog;
+ImageStats consumerImageStats[FrameRing::kMaxConsumers];
+
+// Pre-roll (startPreRoll): the store outlives its feeder until cleanupQueue, native feeders replay from it
+PreRollStore *preRollStore = nullptr;
+FrameFeeder *preRollFeeder = nullptr;
+int preRollConsumerId = -1;
+
+static void startCopyWorkers() {
+    if (copyWorkers == nullptr) {
+        copyWorkers = new WorkerPool(copyWorkerThreads, &threadPlacer);
+        LOGI("Copy worker pool started with %d threads", copyWorkers->getThreadCount());
     }
-};
-
-class CircularArrayQueue {
-private:
-    std::vector<YUV420> queue;
-    int front;
-    int rear;
-    int size;
-    int capacity;
-    std::mutex mutex;
-    std::condition_variable notFull, notEmpty;
+}
 
-public:
-    CircularArrayQueue(int capacity, int width, int height)
-            : queue(capacity, YUV420(width, height, 0)), front(0), rear(-1), size(0), capacity(capacity) {}
+static void stopCopyWorkers() {
+    delete copyWorkers;
+    copyWorkers = nullptr;
+}
 
-    void enqueue(int width, int height, long long timestampUs,
-                 const uint8_t *yData, int yRowStride, int yPixelStride,
-                 const uint8_t *uData, int uRowStride, int uPixelStride,
-                 const uint8_t *vData, int vRowStride, int vPixelStride) {
-//        std::unique_lock<std::mutex> lock(mutex);
-//        notFull.wait(lock, [this] { return size < capacity; });
+static void stopCaptureReplay() {
+    delete captureReplayer;
+    captureReplayer = nullptr;
+    delete captureReader;
+    captureReader = nullptr;
+}
 
-        rear = (rear + 1) % capacity;
-        queue[rear].update(width, height, timestampUs,
-                           yData, yRowStride, yPixelStride,
-                           uData, uRowStride, uPixelStride,
-                           vData, vRowStride, vPixelStride);
-        size++;
+static void stopPreRollFeeder() {
+    if (preRollFeeder != nullptr) {
+        preRollFeeder->stop();
+        delete preRollFeeder;
+        preRollFeeder = nullptr;
+    }
+    if (preRollConsumerId >= 0 && yuvQueue != nullptr) {
+        yuvQueue->unregisterConsumer(preRollConsumerId);
+    }
+    preRollConsumerId = -1;
+}
 
-//        lock.unlock();
-        notEmpty.notify_one();
+static void stopNativeOutputs(int consumerId) {
+    NativeOutputs &outputs = consumerOutputs[consumerId];
+    if (outputs.graph != nullptr) {
+        outputs.graph->stop();
+        for (int i = 0; i < outputs.graph->getOutputCount(); i++) {
+            LOGI("Native output %d.%d stopped after %llu frames, %llu missed", consumerId, i,
+                 (unsigned long long) outputs.graph->getDeliveredFrames(i),
+                 (unsigned long long) outputs.graph->getMissedFrames(i));
+        }
+        delete outputs.graph;
+        outputs.graph = nullptr;
+        if (consumerMotion[consumerId] != nullptr) {
+            MotionDetector::Summary motion = consumerMotion[consumerId]->getSummary();
+            LOGI("Native outputs %d motion gate analyzed %llu frames, %llu scene cuts", consumerId,
+                 (unsigned long long) motion.analyzedFrames, (unsigned long long) motion.sceneCuts);
+            delete consumerMotion[consumerId];
+            consumerMotion[consumerId] = nullptr;
+        }
     }
+    for (FrameSink *sink : outputs.sinks) {
+        delete sink;
+    }
+    outputs.sinks.clear();
+    std::fill(outputs.frames, outputs.frames + OutputGraph::kMaxOutputs, nullptr);
+    outputs.started = false;
+}
 
-    YUV420 dequeueCopy() {
-        std::unique_lock<std::mutex> lock(mutex);
-        notEmpty.wait(lock, [this] { return size > 0; });
+static void stopNativeFeeder(int consumerId) {
+    stopNativeOutputs(consumerId);
+    FrameFeeder *&feeder = consumerFeeders[consumerId];
+    if (feeder != nullptr) {
+        feeder->stop();
+        LOGI("Native feeder %d stopped after %llu frames, %llu samples written", consumerId,
+             (unsigned long long) feeder->getFedFrames(),
+             (unsigned long long) consumerSinks[consumerId]->getWrittenSamples());
+        if (consumerScaledSinks[consumerId] != nullptr) {
+            LOGI("Native feeder %d fanned out %llu scaled frames, %llu samples written", consumerId,
+                 (unsigned long long) feeder->getScaledFrames(),
+                 (unsigned long long) consumerScaledSinks[consumerId]->getWrittenSamples());
+        }
+        if (consumerMotion[consumerId] != nullptr) {
+            MotionDetector::Summary motion = consumerMotion[consumerId]->getSummary();
+            LOGI("Native feeder %d motion gate analyzed %llu frames, %llu scene cuts", consumerId,
+                 (unsigned long long) motion.analyzedFrames, (unsigned long long) motion.sceneCuts);
+        }
+        delete feeder;
+        feeder = nullptr;
+    }
+    delete consumerSinks[consumerId];
+    consumerSinks[consumerId] = nullptr;
+    delete consumerScaledSinks[consumerId];
+    consumerScaledSinks[consumerId] = nullptr;
+    delete consumerMotion[consumerId];
+    consumerMotion[consumerId] = nullptr;
+}
 
-        YUV420 item = queue[front];
-        front = (front + 1) % capacity;
-        size--;
+// The consumer's motion detector when configureMotionGate turned the gate on, else null
+static MotionDetector *createMotionGate(int consumerId) {
+    if (motionBlockThreshold <= 0) {
+        return nullptr;
+    }
+    auto *detector = new MotionDetector();
+    detector->setThresholds(motionBlockThreshold, motionSceneCutShare);
+    consumerMotion[consumerId] = detector;
+    return detector;
+}
 
-        lock.unlock();
-        notFull.notify_one();
-        return item;
+// Gates feeder's downscaled stream on motion when configureMotionGate turned it on
+static void applyMotionGate(int consumerId, FrameFeeder *feeder) {
+    if (MotionDetector *detector = createMotionGate(consumerId)) {
+        feeder->setMotionGate(detector, motionMinFps);
     }
+}
 
-    YUV420 peekCopy() {
-        std::unique_lock<std::mutex> lock(mutex);
-        notEmpty.wait(lock, [this] { return size > 0; });
+/**
+ * Pins the threads of role (ThreadRole: 0 ingest, 1 copy workers, 2 feeders) to the clusters in clusterMask
+ * (bit i = cluster i of getCpuTopology, slowest first; 0 = any core) and sets their nice value (-20 to 19,
+ * Integer.MIN_VALUE leaves it). Running threads move at their next frame. False for an unknown role or a
+ * mask naming no cluster of this device.
+ */
+extern "C"
+JNIEXPORT jboolean JNICALL
+Java_com_qdev_singlesurfacedualquality_utils_YuvUtils_configureThreadPlacement(JNIEnv *env, jobject thiz, jint role,
+                                                                               jint clusterMask, jint nice) {
+    uint32_t clusters = (uint32_t) clusterMask;
+    int clusterCount = threadPlacer.getTopology().getClusterCount();
+    if (role < 0 || role >= (int) ThreadRole::Count ||
+        (clusters != 0 && (clusters & ((1u << clusterCount) - 1)) == 0)) {
+        LOGE("Thread placement %d on clusters %#x is not supported", (int) role, clusters);
+        return false;
+    }
+    ThreadPlacement placement;
+    placement.clusterMask = clusters;
+    placement.nice = nice;
+    threadPlacer.configure(static_cast<ThreadRole>(role), placement);
+    return true;
+}
 
-        YUV420 item = queue[front];
+/**
+ * Sets the thread count (including the calling thread, 0 = one per core, 1 = no workers) and the
+ * bytes per row band used by copyToImage. Takes effect at the next setupQueue / setupZeroCopyQueue.
+ */
+extern "C"
+JNIEXPORT void JNICALL
+Java_com_qdev_singlesurfacedualquality_utils_YuvUtils_configureCopyWorkers(JNIEnv *env, jobject thiz,
+                                                                           jint threadCount, jint bandBytes) {
+    copyWorkerThreads = threadCount;
+    copyBandBytes = bandBytes > 0 ? bandBytes : YUVConverter::kDefaultBandBytes;
+}
 
-        lock.unlock();
-        return item;
+/**
+ * Selects the DropPolicy (by value) applied when the slowest consumer is a full queue behind;
+ * blockTimeoutMs only matters for DropPolicy::Block. Takes effect at the next setupQueue / setupZeroCopyQueue.
+ */
+extern "C"
+JNIEXPORT void JNICALL
+Java_com_qdev_singlesurfacedualquality_utils_YuvUtils_configureDropPolicy(JNIEnv *env, jobject thiz,
+                                                                          jint policy, jint blockTimeoutMs) {
+    if (policy < (jint) DropPolicy::DropNewest || policy > (jint) DropPolicy::Block) {
+        LOGE("Unknown drop policy %d, keeping drop-newest", policy);
+        policy = (jint) DropPolicy::DropNewest;
     }
+    queueDropPolicy = static_cast<DropPolicy>(policy);
+    queueBlockTimeoutNs = blockTimeoutMs > 0 ? blockTimeoutMs * 1000000LL : 0;
+}
 
-    YUV420 &dequeue() {
-//        std::unique_lock<std::mutex> lock(mutex);
-//        notEmpty.wait(lock, [this] { return size > 0; });
-
-        YUV420 &item = queue[front];
-        front = (front + 1) % capacity;
-        size--;
+/**
+ * Sizes the queue's frame storage for captures up to maxWidth x maxHeight (0 = just the setup size), so
+ * reconfigureQueue to any size within that budget reuses the memory. Takes effect at the next setupQueue.
+ */
+extern "C"
+JNIEXPORT void JNICALL
+Java_com_qdev_singlesurfacedualquality_utils_YuvUtils_configureQueueBudget(JNIEnv *env, jobject thiz,
+                                                                           jint maxWidth, jint maxHeight) {
+    queueMaxWidth = maxWidth > 0 ? maxWidth : 0;
+    queueMaxHeight = maxHeight > 0 ? maxHeight : 0;
+}
 
-//        lock.unlock();
-//        notFull.notify_one();
-        return item;
+/**
+ * Lets frames that find the queue full overflow into a file of spillFrames frames created at path (in app
+ * storage, removed as soon as it is mapped) instead of being dropped; 0 frames turns it off.
+ * Takes effect at the next setupQueue / setupZeroCopyQueue.
+ */
+extern "C"
+JNIEXPORT void JNICALL
+Java_com_qdev_singlesurfacedualquality_utils_YuvUtils_configureQueueSpill(JNIEnv *env, jobject thiz, jstring path,
+                                                                          jint spillFrames) {
+    queueSpillFrames = 0;
+    if (path == nullptr || spillFrames <= 0) {
+        return;
     }
+    const char *chars = env->GetStringUTFChars(path, nullptr);
+    if (chars == nullptr) {
+        return;
+    }
+    queueSpillPath = chars;
+    env->ReleaseStringUTFChars(path, chars);
+    queueSpillFrames = spillFrames;
+}
 
-    YUV420 &peek() {
-//        std::unique_lock<std::mutex> lock(mutex);
-//        notEmpty.wait(lock, [this] { return size > 0; });
+/**
+ * Leaves frames in which nothing moved out of natively downscaled streams (startNativeFeeder with a scale
+ * filter, the LQ side of startNativeFanOut), down to minFps (0 = none), and forces a key frame in every
+ * stream of the feeder at a scene cut: sceneCutPercent of the 16x16 luma blocks changing at once. A block
+ * changes when its mean absolute luma difference to the previous frame exceeds blockThreshold; 0 turns
+ * the gate off. Takes effect at the next startNativeFeeder / startNativeFanOut.
+ */
+extern "C"
+JNIEXPORT void JNICALL
+Java_com_qdev_singlesurfacedualquality_utils_YuvUtils_configureMotionGate(JNIEnv *env, jobject thiz,
+                                                                          jint blockThreshold,
+                                                                          jint sceneCutPercent, jdouble minFps) {
+    motionBlockThreshold = blockThreshold > 0 ? blockThreshold : 0;
+    motionSceneCutShare = sceneCutPercent > 0 ? sceneCutPercent / 100.0 : MotionDetector::kDefaultSceneCutShare;
+    motionMinFps = minFps > 0 ? minFps : 0;
+}
 
-        YUV420 &item = queue[front];
+/**
+ * Zooms every stream off the queue into part of the frame: left, top, width and height as fractions of
+ * the camera frame (sensor orientation). Copies and downscales resample that part to their output size,
+ * so a zoomed stream keeps its resolution. Takes effect at the next frame; a width or height of 0 or less
+ * goes back to the whole frame.
+ */
+extern "C"
+JNIEXPORT void JNICALL
+Java_com_qdev_singlesurfacedualquality_utils_YuvUtils_setCropRegion(JNIEnv *env, jobject thiz, jfloat left,
+                                                                    jfloat top, jfloat width, jfloat height) {
+    cropRegion.set(left, top, width, height);
+}
 
-//        lock.unlock();
-        return item;
+/**
+ * Has full-size copies (copyToImage, copy feeders and the HQ side of a fan-out) gather each frame's luma
+ * histogram, luma mean and variance and chroma means from the rows they write, for getNativeImageStats.
+ * Cropped frames are not measured. copyToImage follows at its next frame, feeders at their next start.
+ */
+extern "C"
+JNIEXPORT void JNICALL
+Java_com_qdev_singlesurfacedualquality_utils_YuvUtils_configureImageStats(JNIEnv *env, jobject thiz,
+                                                                          jboolean enabled) {
+    if (enabled && !imageStatsEnabled.load(std::memory_order_relaxed)) {
+        imageStatsLog.clear();
     }
+    imageStatsEnabled.store(enabled, std::memory_order_relaxed);
+}
 
-    bool isEmpty() const {
-        return size == 0;
+static void enableQueueSpill(int width, int height) {
+    if (queueSpillFrames <= 0) {
+        return;
     }
+    if (!yuvQueue->enableSpill(queueSpillPath.c_str(), queueSpillFrames, width, height)) {
+        LOGE("Queue spill of %d frames at %s could not be set up, dropping instead", queueSpillFrames,
+             queueSpillPath.c_str());
+    }
+}
 
-    bool isFull() const {
-        return size == capacity;
+static bool reconfigureQueue(int width, int height) {
+    long long startNs = steadyNowNs();
+    if (!yuvQueue->reconfigure(width, height, kReconfigureDrainTimeoutNs)) {
+        LOGE("Queue reconfigure to %dx%d failed", width, height);
+        return false;
     }
+    LOGI("Queue reconfigured to %dx%d in %lld us", width, height, (steadyNowNs() - startNs) / 1000);
+    return true;
+}
 
-    int getSize() const {
-        return size;
+// Stops what produces into the queue and what copies out of it on native threads, so its storage can change
+static void stopQueueTraffic() {
+    if (imageSource != nullptr) {
+        // Stop new camera frames before the ring hands its borrowed images back
+        imageSource->stop();
     }
-};
+    stopCaptureReplay();
+    for (int consumerId = 0; consumerId < FrameRing::kMaxConsumers; consumerId++) {
+        stopNativeFeeder(consumerId);
+    }
+    // After the native feeders, which may still be replaying it
+    stopPreRollFeeder();
+    // The feeders band their copies over it
+    stopCopyWorkers();
+}
 
-CircularArrayQueue *yuvQueue = nullptr;
+static void releaseQueue() {
+    stopQueueTraffic();
+    delete preRollStore;
+    preRollStore = nullptr;
+    if (yuvQueue != nullptr) {
+        delete yuvQueue;
+        yuvQueue = nullptr;
+    }
+    if (imageSource != nullptr) {
+        delete imageSource;
+        imageSource = nullptr;
+    }
+    for (CodecImageCache &images : consumerImages) {
+        images.clear();
+    }
+}
 
 extern "C"
 JNIEXPORT void JNICALL
 Java_com_qdev_singlesurfacedualquality_utils_YuvUtils_setupQueue(JNIEnv *env, jobject thiz, jint capacity, jint width, jint height) {
+    if (yuvQueue != nullptr && (yuvQueue->getFrameWidth() != width || yuvQueue->getFrameHeight() != height)) {
+        // Still set up from an earlier session at another size
+        stopQueueTraffic();
+        // A borrow-only ring (setupZeroCopyQueue) has no storage to copy frames into, start over
+        if (yuvQueue->getFrameWidth() == 0 || !reconfigureQueue(width, height)) {
+            releaseQueue();
+        }
+    }
     if (yuvQueue == nullptr) {
-        yuvQueue = new CircularArrayQueue(capacity, width, height);
+        yuvQueue = new FrameRing(capacity, width, height, queueMaxWidth, queueMaxHeight);
+        yuvQueue->setStats(&frameStats);
+        yuvQueue->setDropPolicy(queueDropPolicy, queueBlockTimeoutNs);
+        enableQueueSpill(width, height);
     }
+    startCopyWorkers();
 }
 
+extern "C"
+JNIEXPORT jint JNICALL
+Java_com_qdev_singlesurfacedualquality_utils_YuvUtils_registerConsumer(JNIEnv *env, jobject thiz, jboolean latestOnly) {
+    if (yuvQueue == nullptr) {
+        return -1;
+    }
+    return yuvQueue->registerConsumer(latestOnly);
+}
+
+/**
+ * Paces a consumer to about fps frames per second of capture time (0 = every frame); the frames in
+ * between are passed over in the queue and never copied.
+ */
 extern "C"
 JNIEXPORT void JNICALL
-Java_com_qdev_singlesurfacedualquality_utils_YuvUtils_cleanupQueue(JNIEnv *env, jobject thiz) {
+Java_com_qdev_singlesurfacedualquality_utils_YuvUtils_setConsumerFrameRate(JNIEnv *env, jobject thiz, jint consumerId,
+                                                                           jdouble fps) {
     if (yuvQueue != nullptr) {
-        delete yuvQueue;
-        yuvQueue = nullptr;
+        yuvQueue->setFrameRate(consumerId, fps);
     }
 }
 
 extern "C"
 JNIEXPORT void JNICALL
-Java_com_qdev_singlesurfacedualquality_utils_YuvUtils_addToNativeQueue(
-        JNIEnv *env, jobject thiz,
-        jobject y_data, jobject u_data, jobject v_data,
-        jint y_row_stride, jint u_row_stride, jint v_row_stride,
-        jint y_pixel_stride, jint u_pixel_stride, jint v_pixel_stride,
-        jlong timestamp_us, jint width, jint height) {
-
-    yuvQueue->enqueue(width,height, timestamp_us,
-                      static_cast<const uint8_t *>(env->GetDirectBufferAddress(y_data)), y_row_stride, y_pixel_stride,
-                      static_cast<const uint8_t *>(env->GetDirectBufferAddress(u_data)), u_row_stride, u_pixel_stride,
-                      static_cast<const uint8_t *>(env->GetDirectBufferAddress(v_data)), v_row_stride, v_pixel_stride);
+Java_com_qdev_singlesurfacedualquality_utils_YuvUtils_cleanupQueue(JNIEnv *env, jobject thiz) {
+    releaseQueue();
+}
 
-    LOGI("Native YUV queue size: %d", yuvQueue->getSize());
+/**
+ * Zero-copy ingest: the native queue holds the camera's own AImage buffers instead of copies.
+ * Returns the Surface to add as a capture target in place of the Kotlin ImageReader's, or null on failure.
+ */
+extern "C"
+JNIEXPORT jobject JNICALL
+Java_com_qdev_singlesurfacedualquality_utils_YuvUtils_setupZeroCopyQueue(JNIEnv *env, jobject thiz, jint capacity,
+                                                                         jint width, jint height, jint maxImages) {
+    if (yuvQueue == nullptr) {
+        // Frames are borrowed, the ring needs no storage of its own
+        yuvQueue = new FrameRing(capacity, 0, 0);
+        yuvQueue->setStats(&frameStats);
+        yuvQueue->setDropPolicy(queueDropPolicy, queueBlockTimeoutNs);
+        // Spilled frames are copies, sized for the capture
+        enableQueueSpill(width, height);
+    }
+    startCopyWorkers();
+    if (imageSource == nullptr) {
+        imageSource = new ImageReaderSource(yuvQueue);
+        imageSource->setPlacer(&threadPlacer);
+        if (!imageSource->open(width, height, maxImages)) {
+            delete imageSource;
+            imageSource = nullptr;
+            return nullptr;
+        }
+    }
+    return ANativeWindow_toSurface(env, imageSource->getWindow());
 }
 
-//function to return if the queue is empty
+/**
+ * Switches a running copy queue (setupQueue) to a new capture size in place: in-flight frames are
+ * discarded and the frame storage is reshaped, reusing it within the configureQueueBudget size.
+ * Camera frames must not be added meanwhile. Consumers stay registered; their converters and scalers
+ * re-plan on the first frame of the new size, reusing their buffers.
+ */
 extern "C"
 JNIEXPORT jboolean JNICALL
-Java_com_qdev_singlesurfacedualquality_utils_YuvUtils_isQueueEmpty(JNIEnv *env, jobject thiz) {
-    return yuvQueue->isEmpty();
+Java_com_qdev_singlesurfacedualquality_utils_YuvUtils_reconfigureQueue(JNIEnv *env, jobject thiz,
+                                                                       jint width, jint height) {
+    if (yuvQueue == nullptr) {
+        return false;
+    }
+    return reconfigureQueue(width, height);
 }
 
-JavaVM *gJvm = nullptr; // Store the JavaVM reference
-std::mutex queueMutex;
-
+/**
+ * Zero-copy counterpart of reconfigureQueue: stops the camera reader, hands every queued camera image
+ * back and reopens the reader at the new size. Returns the new capture Surface, or null on failure, after
+ * which the queue has no camera input until cleanupQueue / setupZeroCopyQueue.
+ */
 extern "C"
-JNIEXPORT void JNICALL
-Java_com_qdev_singlesurfacedualquality_utils_YuvUtils_copyYUV(JNIEnv *env, jobject thiz, jobject srcImage, jobject dstImage) {
-    jclass srcImageClass = env->GetObjectClass(srcImage);
-    jclass destImageClass = env->GetObjectClass(dstImage);
-    jmethodID getSrcPlanesMethod = env->GetMethodID(srcImageClass, "getPlanes", "()[Landroid/media/Image$Plane;");
-    jmethodID getDestPlanesMethod = env->GetMethodID(destImageClass, "getPlanes", "()[Landroid/media/Image$Plane;");
-
-    jobjectArray srcPlanes = (jobjectArray) env->CallObjectMethod(srcImage, getSrcPlanesMethod);
-    jobjectArray dstPlanes = (jobjectArray) env->CallObjectMethod(dstImage, getDestPlanesMethod);
-
-    jclass planeClass = env->FindClass("android/media/Image$Plane");
-    jmethodID getBufferMethod = env->GetMethodID(planeClass, "getBuffer", "()Ljava/nio/ByteBuffer;");
-    jmethodID getRowStrideMethod = env->GetMethodID(planeClass, "getRowStride", "()I");
-    jmethodID getPixelStrideMethod = env->GetMethodID(planeClass, "getPixelStride", "()I");
-
-    int srcWidth = env->CallIntMethod(srcImage, env->GetMethodID(srcImageClass, "getWidth", "()I"));
-    int srcHeight = env->CallIntMethod(srcImage, env->GetMethodID(srcImageClass, "getHeight", "()I"));
+JNIEXPORT jobject JNICALL
+Java_com_qdev_singlesurfacedualquality_utils_YuvUtils_reconfigureZeroCopyQueue(JNIEnv *env, jobject thiz, jint width,
+                                                                               jint height, jint maxImages) {
+    if (yuvQueue == nullptr || imageSource == nullptr) {
+        return nullptr;
+    }
+    imageSource->stop();
+    // Nothing enqueues into the ring past stop(), so the reconfigure drains a quiet ring. The old reader
+    // frees its images on close, so the ring must have given them all back first
+    if (!reconfigureQueue(width, height)) {
+        return nullptr;
+    }
+    imageSource->close();
+    if (!imageSource->open(width, height, maxImages)) {
+        return nullptr;
+    }
+    return ANativeWindow_toSurface(env, imageSource->getWindow());
+}
 
-    for (int i = 0; i < 3; i++) {
-        jobject srcPlane = env->GetObjectArrayElement(srcPlanes, i);
-        jobject dstPlane = env->GetObjectArrayElement(dstPlanes, i);
+/**
+ * Encodes a consumer's frames without the JVM: a native thread copies (scaleFilter < 0) or downscales
+ * (scaleFilter = ScaleFilter value) every frame into an AMediaCodec encoder of the given size and muxes
+ * the output as MP4 into outputFd, which is handed over (ParcelFileDescriptor.detachFd()). Replaces the
+ * Kotlin codec loop for that consumer; runs until stopNativeFeeder or cleanupQueue.
+ */
+extern "C"
+JNIEXPORT jboolean JNICALL
+Java_com_qdev_singlesurfacedualquality_utils_YuvUtils_startNativeFeeder(JNIEnv *env, jobject thiz, jint consumerId,
+                                                                        jstring mime, jint outputFd, jint width,
+                                                                        jint height, jint bitRate, jint frameRate,
+                                                                        jint iFrameInterval, jint scaleFilter) {
+    if (yuvQueue == nullptr || consumerId < 0 || consumerId >= FrameRing::kMaxConsumers) {
+        close(outputFd);
+        return false;
+    }
+    stopNativeFeeder(consumerId);
+
+    auto *sink = new MediaCodecSink();
+    const char *mimeType = env->GetStringUTFChars(mime, nullptr);
+    bool opened = sink->open(mimeType, width, height, bitRate, frameRate, iFrameInterval, outputFd);
+    env->ReleaseStringUTFChars(mime, mimeType);
+    if (!opened) {
+        delete sink;
+        return false;
+    }
 
-        jobject srcBuffer = env->CallObjectMethod(srcPlane, getBufferMethod);
-        jobject dstBuffer = env->CallObjectMethod(dstPlane, getBufferMethod);
+    auto *feeder = new FrameFeeder(yuvQueue, consumerId, sink);
+    feeder->setPlacer(&threadPlacer);
+    if (scaleFilter >= 0) {
+        feeder->setScaling(static_cast<ScaleFilter>(scaleFilter));
+        applyMotionGate(consumerId, feeder);
+    } else {
+        feeder->setWorkers(copyWorkers, copyBandBytes);
+        if (imageStatsEnabled.load(std::memory_order_relaxed)) {
+            feeder->setImageStats(&imageStatsLog);
+        }
+    }
+    feeder->setCrop(&cropRegion);
+    if (preRollStore != nullptr) {
+        feeder->setPreRoll(preRollStore);
+    }
+    consumerSinks[consumerId] = sink;
+    consumerFeeders[consumerId] = feeder;
+    if (!feeder->start()) {
+        stopNativeFeeder(consumerId);
+        return false;
+    }
+    return true;
+}
 
-        int srcRowStride = env->CallIntMethod(srcPlane, getRowStrideMethod);
-        int dstRowStride = env->CallIntMethod(dstPlane, getRowStrideMethod);
+/**
+ * Encodes two streams off one consumer natively: every frame is copied into an encoder of the capture
+ * size (hq*, muxed into hqFd) and the frames a pacer at lqFrameRate keeps are downscaled with scaleFilter
+ * into a second encoder (lq*, muxed into lqFd), both in the same pass over the frame (YUVFanOut), so the
+ * queued frame is read from memory once instead of twice. Both fds are handed over. Stopped with
+ * stopNativeFeeder(consumerId) or cleanupQueue.
+ */
+extern "C"
+JNIEXPORT jboolean JNICALL
+Java_com_qdev_singlesurfacedualquality_utils_YuvUtils_startNativeFanOut(JNIEnv *env, jobject thiz, jint consumerId,
+                                                                        jstring mime, jint hqFd, jint hqWidth,
+                                                                        jint hqHeight, jint hqBitRate,
+                                                                        jint hqFrameRate, jint hqIFrameInterval,
+                                                                        jint lqFd, jint lqWidth, jint lqHeight,
+                                                                        jint lqBitRate, jint lqFrameRate,
+                                                                        jint lqIFrameInterval, jint scaleFilter) {
+    if (yuvQueue == nullptr || consumerId < 0 || consumerId >= FrameRing::kMaxConsumers) {
+        close(hqFd);
+        close(lqFd);
+        return false;
+    }
+    stopNativeFeeder(consumerId);
+
+    auto *sink = new MediaCodecSink();
+    auto *scaledSink = new MediaCodecSink();
+    const char *mimeType = env->GetStringUTFChars(mime, nullptr);
+    bool opened = sink->open(mimeType, hqWidth, hqHeight, hqBitRate, hqFrameRate, hqIFrameInterval, hqFd);
+    if (opened) {
+        opened = scaledSink->open(mimeType, lqWidth, lqHeight, lqBitRate, lqFrameRate, lqIFrameInterval, lqFd);
+    } else {
+        close(lqFd);
+    }
+    env->ReleaseStringUTFChars(mime, mimeType);
+    if (!opened) {
+        delete sink;
+        delete scaledSink;
+        return false;
+    }
 
-        int srcPixelStride = env->CallIntMethod(srcPlane, getPixelStrideMethod);
-        int dstPixelStride = env->CallIntMethod(dstPlane, getPixelStrideMethod);
+    auto *feeder = new FrameFeeder(yuvQueue, consumerId, sink);
+    feeder->setPlacer(&threadPlacer);
+    feeder->setFanOut(scaledSink, static_cast<ScaleFilter>(scaleFilter), lqFrameRate);
+    applyMotionGate(consumerId, feeder);
+    // Only frames the LQ stream passes over use the pool, the fused pass runs on the feeder thread
+    feeder->setWorkers(copyWorkers, copyBandBytes);
+    if (imageStatsEnabled.load(std::memory_order_relaxed)) {
+        feeder->setImageStats(&imageStatsLog);
+    }
+    feeder->setCrop(&cropRegion);
+    if (preRollStore != nullptr) {
+        feeder->setPreRoll(preRollStore);
+    }
+    consumerSinks[consumerId] = sink;
+    consumerScaledSinks[consumerId] = scaledSink;
+    consumerFeeders[consumerId] = feeder;
+    if (!feeder->start()) {
+        stopNativeFeeder(consumerId);
+        return false;
+    }
+    return true;
+}
 
-        uint8_t *srcData = (uint8_t *) env->GetDirectBufferAddress(srcBuffer);
-        uint8_t *dstData = (uint8_t *) env->GetDirectBufferAddress(dstBuffer);
+/**
+ * Starts keeping the newest width x height (the capture size) frames, compressed losslessly into
+ * budgetBytes, on a consumer and thread of their own. Native feeders started from now on first replay
+ * the stored frames, then go on live. Replaces a store from an earlier call.
+ */
+extern "C"
+JNIEXPORT jboolean JNICALL
+Java_com_qdev_singlesurfacedualquality_utils_YuvUtils_startPreRoll(JNIEnv *env, jobject thiz, jint width, jint height,
+                                                                   jlong budgetBytes, jint keyFrameInterval) {
+    if (yuvQueue == nullptr || budgetBytes <= 0) {
+        return false;
+    }
+    stopPreRollFeeder();
+    delete preRollStore;
+    preRollStore = new PreRollStore(width, height, (size_t) budgetBytes, keyFrameInterval);
+    if (!preRollStore->isValid()) {
+        LOGE("Pre-roll budget of %lld bytes could not be allocated", (long long) budgetBytes);
+        delete preRollStore;
+        preRollStore = nullptr;
+        return false;
+    }
+    preRollStore->setStats(&frameStats);
 
-        if (srcData == nullptr || dstData == nullptr) {
-            LOGE("Failed to get direct buffer address.");
-            return;
-        }
+    preRollConsumerId = yuvQueue->registerConsumer(false);
+    if (preRollConsumerId < 0) {
+        delete preRollStore;
+        preRollStore = nullptr;
+        return false;
+    }
+    preRollFeeder = new FrameFeeder(yuvQueue, preRollConsumerId, preRollStore);
+    // Its copies are not an encoder's, keep them out of the HQ copy stage
+    preRollFeeder->setStats(nullptr);
+    preRollFeeder->setPlacer(&threadPlacer);
+    preRollFeeder->start();
+    return true;
+}
 
-        int planeWidth = (i == 0) ? srcWidth : srcWidth / 2;
-        int planeHeight = (i == 0) ? srcHeight : srcHeight / 2;
+// Stops feeding the pre-roll store; what it holds stays available to replays until cleanupQueue
+extern "C"
+JNIEXPORT void JNICALL
+Java_com_qdev_singlesurfacedualquality_utils_YuvUtils_stopPreRoll(JNIEnv *env, jobject thiz) {
+    stopPreRollFeeder();
+}
 
-        for (int row = 0; row < planeHeight; row++) {
-            uint8_t *srcRow = srcData + row * srcRowStride;
-            uint8_t *dstRow = dstData + row * dstRowStride;
+/**
+ * Pre-roll store state: frames held, their compressed and raw bytes, oldest and newest presentation
+ * time (us, -1 when empty), frames evicted and frames refused. Empty without a store.
+ */
+extern "C"
+JNIEXPORT jlongArray JNICALL
+Java_com_qdev_singlesurfacedualquality_utils_YuvUtils_getNativePreRollStats(JNIEnv *env, jobject thiz) {
+    std::vector<jlong> values;
+    if (preRollStore != nullptr) {
+        PreRollStore::Summary summary = preRollStore->getSummary();
+        values = {(jlong) summary.frames, (jlong) summary.storedBytes, (jlong) summary.rawBytes,
+                  (jlong) summary.oldestUs, (jlong) summary.newestUs, (jlong) summary.evictedFrames,
+                  (jlong) summary.refusedFrames};
+    }
+    jlongArray result = env->NewLongArray((jsize) values.size());
+    if (result != nullptr) {
+        env->SetLongArrayRegion(result, 0, (jsize) values.size(), values.data());
+    }
+    return result;
+}
 
-            if (srcPixelStride == 1 && dstPixelStride == 1) {
-                memcpy(dstRow, srcRow, planeWidth);
-            } else {
-                for (int col = 0; col < planeWidth; col++) {
-                    dstRow[col * dstPixelStride] = srcRow[col * srcPixelStride];
-                }
-            }
-        }
+// Ends the consumer's native encode: pending frames are dropped, the stream is finished and the file closed
+extern "C"
+JNIEXPORT void JNICALL
+Java_com_qdev_singlesurfacedualquality_utils_YuvUtils_stopNativeFeeder(JNIEnv *env, jobject thiz, jint consumerId) {
+    if (consumerId >= 0 && consumerId < FrameRing::kMaxConsumers) {
+        stopNativeFeeder(consumerId);
     }
 }
 
 extern "C"
 JNIEXPORT void JNICALL
-Java_com_qdev_singlesurfacedualquality_utils_YuvUtils_copyToImage2(
-        JNIEnv *env,
-        jobject /* this */,
-        jobject image,  // The Image object from Kotlin
-        jboolean removeFromQueue) {
+Java_com_qdev_singlesurfacedualquality_utils_YuvUtils_addToNativeQueue(
+        JNIEnv *env, jobject thiz,
+        jobject y_data, jobject u_data, jobject v_data,
+        jint y_row_stride, jint u_row_stride, jint v_row_stride,
+        jint y_pixel_stride, jint u_pixel_stride, jint v_pixel_stride,
+        jlong timestamp_ns, jint width, jint height) {
+    const auto *yData = static_cast<const uint8_t *>(env->GetDirectBufferAddress(y_data));
+    const auto *uData = static_cast<const uint8_t *>(env->GetDirectBufferAddress(u_data));
+    const auto *vData = static_cast<const uint8_t *>(env->GetDirectBufferAddress(v_data));
+    threadPlacer.enter(ThreadRole::Ingest);
+    {
+        ScopedStageTimer timer(&frameStats, FrameStage::Ingest);
+
+        // Drops are counted in frameStats rather than logged, a struggling device would log every frame
+        yuvQueue->enqueue(width, height, timestamp_ns,
+                          yData, y_row_stride, y_pixel_stride,
+                          uData, u_row_stride, u_pixel_stride,
+                          vData, v_row_stride, v_pixel_stride);
+    }
+    // Outside the ingest time, so recording does not show up as a slower queue
+    captureRecorder.record(width, height, timestamp_ns,
+                           yData, y_row_stride, y_pixel_stride,
+                           uData, u_row_stride, u_pixel_stride,
+                           vData, v_row_stride, v_pixel_stride);
+}
 
-    // Check if the queue is empty
-    if (yuvQueue->isEmpty()) {
-        LOGI("Queue is empty.");
-        return;
+/**
+ * Starts writing every frame passed to addToNativeQueue, with its strides and timestamp, into a capture
+ * file at path (frame_capture.h) for offline replay, e.g. yuv_bench --capture. Frames the disk cannot
+ * keep up with are left out and counted. Zero-copy ingest is not recorded.
+ */
+extern "C"
+JNIEXPORT jboolean JNICALL
+Java_com_qdev_singlesurfacedualquality_utils_YuvUtils_startCaptureRecording(JNIEnv *env, jobject thiz, jstring path) {
+    const char *chars = env->GetStringUTFChars(path, nullptr);
+    if (chars == nullptr) {
+        return false;
     }
+    bool started = captureRecorder.start(chars);
+    if (!started) {
+        LOGE("Capture file %s could not be created", chars);
+    }
+    env->ReleaseStringUTFChars(path, chars);
+    return started;
+}
 
-    //  time to fetch references
-    long long startTime = std::chrono::duration_cast<std::chrono::milliseconds>(
-            std::chrono::system_clock::now().time_since_epoch()).count();
+// Finishes the capture file; false when it could not be written completely
+extern "C"
+JNIEXPORT jboolean JNICALL
+Java_com_qdev_singlesurfacedualquality_utils_YuvUtils_stopCaptureRecording(JNIEnv *env, jobject thiz) {
+    bool written = captureRecorder.stop();
+    LOGI("Capture recorded %llu frames, %llu left out", (unsigned long long) captureRecorder.getRecordedFrames(),
+         (unsigned long long) captureRecorder.getMissedFrames());
+    return written;
+}
 
-    // Dequeue the next YUV frame from the circular queue
-    YUV420 &yuvFrame = yuvQueue->peek();
-    if (removeFromQueue) {
-        yuvQueue->dequeue();
+/**
+ * Feeds a capture file into the queue set up by setupQueue in place of the camera, at its recorded pace
+ * times speed (0 = as fast as the queue takes frames), loops times (0 = until stopCaptureReplay or
+ * cleanupQueue). Do not add camera frames meanwhile.
+ */
+extern "C"
+JNIEXPORT jboolean JNICALL
+Java_com_qdev_singlesurfacedualquality_utils_YuvUtils_startCaptureReplay(JNIEnv *env, jobject thiz, jstring path,
+                                                                         jdouble speed, jint loops) {
+    if (yuvQueue == nullptr) {
+        return false;
+    }
+    stopCaptureReplay();
+    const char *chars = env->GetStringUTFChars(path, nullptr);
+    if (chars == nullptr) {
+        return false;
+    }
+    captureReader = new CaptureReader();
+    if (!captureReader->open(chars)) {
+        LOGE("%s is not a readable capture", chars);
+        env->ReleaseStringUTFChars(path, chars);
+        stopCaptureReplay();
+        return false;
     }
+    env->ReleaseStringUTFChars(path, chars);
+    captureReplayer = new CaptureReplayer(*captureReader, yuvQueue);
+    if (!captureReplayer->start(speed, loops)) {
+        stopCaptureReplay();
+        return false;
+    }
+    return true;
+}
 
-    long long dequeueTime = std::chrono::duration_cast<std::chrono::milliseconds>(
-            std::chrono::system_clock::now().time_since_epoch()).count();
+extern "C"
+JNIEXPORT void JNICALL
+Java_com_qdev_singlesurfacedualquality_utils_YuvUtils_stopCaptureReplay(JNIEnv *env, jobject thiz) {
+    stopCaptureReplay();
+}
 
-    LOGI("Time to dequeue: %lld", dequeueTime - startTime);
+//function to return if the queue is empty
+extern "C"
+JNIEXPORT jboolean JNICALL
+Java_com_qdev_singlesurfacedualquality_utils_YuvUtils_isQueueEmpty(JNIEnv *env, jobject thiz) {
+    return yuvQueue == nullptr || yuvQueue->isEmpty();
+}
 
+/**
+ * Blocks until the consumer (any consumer for -1) has a frame waiting, up to timeoutNs.
+ * Returns false on timeout or when there is no queue.
+ */
+extern "C"
+JNIEXPORT jboolean JNICALL
+Java_com_qdev_singlesurfacedualquality_utils_YuvUtils_waitForFrame(JNIEnv *env, jobject thiz, jint consumerId,
+                                                                   jlong timeoutNs) {
+    return yuvQueue != nullptr && yuvQueue->waitForFrame(consumerId, timeoutNs);
+}
 
-    long long refStartTime = std::chrono::duration_cast<std::chrono::milliseconds>(
-            std::chrono::system_clock::now().time_since_epoch()).count();
+// eventfd signalled on every queued frame, for polling next to other fds; -1 without a queue
+extern "C"
+JNIEXPORT jint JNICALL
+Java_com_qdev_singlesurfacedualquality_utils_YuvUtils_getFrameEventFd(JNIEnv *env, jobject thiz) {
+    return yuvQueue != nullptr ? yuvQueue->getEventFd() : -1;
+}
 
-    // Get the Image class and its Plane array
-    jclass imageClass = env->GetObjectClass(image);
-    static jmethodID getPlanesMethodID = env->GetMethodID(imageClass, "getPlanes", "()[Landroid/media/Image$Plane;");
-    jobjectArray planes = static_cast<jobjectArray>(env->CallObjectMethod(image, getPlanesMethodID));
+//function to return the capture timestamp (ns) of the next frame for a consumer, -1 if it has none
+extern "C"
+JNIEXPORT jlong JNICALL
+Java_com_qdev_singlesurfacedualquality_utils_YuvUtils_peekTimestamp(JNIEnv *env, jobject thiz, jint consumerId) {
+    if (yuvQueue == nullptr) {
+        return -1;
+    }
+    YUV420 *frame = yuvQueue->acquire(consumerId);
+    return frame != nullptr ? frame->timestampNs : -1;
+}
 
-    // Get the Y, U, and V planes from the Image object
-    jobject yPlane = env->GetObjectArrayElement(planes, 0);
-    jobject uPlane = env->GetObjectArrayElement(planes, 1);
-    jobject vPlane = env->GetObjectArrayElement(planes, 2);
+JavaVM *gJvm = nullptr; // Store the JavaVM reference
+std::mutex queueMutex;
 
-    // Plane class and field IDs
-    jclass planeClass = env->GetObjectClass(yPlane);
-    static jmethodID getBufferMethodID = env->GetMethodID(planeClass, "getBuffer", "()Ljava/nio/ByteBuffer;");
-    static jmethodID getRowStrideMethodID = env->GetMethodID(planeClass, "getRowStride", "()I");
-    static jmethodID getPixelStrideMethodID = env->GetMethodID(planeClass, "getPixelStride", "()I");
-    //  method to get the timestamp
-    static jmethodID setTimestampMethodID = env->GetMethodID(imageClass, "setTimestamp", "(J)V");
-    static jmethodID getTimestampMethodID = env->GetMethodID(imageClass, "getTimestamp", "()J");
+extern "C"
+JNIEXPORT void JNICALL
+Java_com_qdev_singlesurfacedualquality_utils_YuvUtils_copyYUV(JNIEnv *env, jobject thiz, jobject srcImage, jobject dstImage) {
+    YUVImageView src;
+    YUVImageView dst;
+    int payloadSize;
+    if (!bindImage(env, srcImage, src, payloadSize) || !bindImage(env, dstImage, dst, payloadSize)) {
+        LOGE("Failed to get direct buffer address.");
+        return;
+    }
 
-    // Get the ByteBuffers from the Image.Planes
-    jobject yPlaneBuffer = env->CallObjectMethod(yPlane, getBufferMethodID);
-    jobject uPlaneBuffer = env->CallObjectMethod(uPlane, getBufferMethodID);
-    jobject vPlaneBuffer = env->CallObjectMethod(vPlane, getBufferMethodID);
+    YUVConverter converter;
+    converter.convert(src, dst);
+}
 
-    auto *yPlanePtr = static_cast<uint8_t *>(env->GetDirectBufferAddress(yPlaneBuffer));
-    auto *uPlanePtr = static_cast<uint8_t *>(env->GetDirectBufferAddress(uPlaneBuffer));
-    auto *vPlanePtr = static_cast<uint8_t *>(env->GetDirectBufferAddress(vPlaneBuffer));
+// One converter per consumer so each keeps the kernel picked for its codec's layout
+YUVConverter consumerConverters[FrameRing::kMaxConsumers];
 
-    if (yPlanePtr == nullptr || uPlanePtr == nullptr || vPlanePtr == nullptr) {
+// Used instead while setCropRegion zooms in, per consumer for the same reason
+YUVCropper consumerCroppers[FrameRing::kMaxConsumers];
+
+/**
+ * Copies the consumer's next queued frame into a codec input Image of the same size, converting
+ * between the queued and the codec's layout (I420 / NV12 / NV21) on the way.
+ * bufferIndex is the codec's input buffer index, used to skip the Image's JNI getters once it has been
+ * seen (-1 binds every time). stage is the FrameStage the copy is timed under, the stream's own copy
+ * stage, so a second copying consumer does not land in the HQ histogram. Returns the size to queue the
+ * input buffer with, 0 if nothing was copied.
+ */
+extern "C"
+JNIEXPORT jint JNICALL
+Java_com_qdev_singlesurfacedualquality_utils_YuvUtils_copyToImage(
+        JNIEnv *env,
+        jobject /* this */,
+        jobject image,  // The Image object from Kotlin
+        jint bufferIndex,
+        jint consumerId,
+        jint stage) {
+    if (yuvQueue == nullptr || consumerId < 0 || consumerId >= FrameRing::kMaxConsumers) {
+        return 0;
+    }
+    if (stage < 0 || stage >= (int) FrameStage::Count) {
+        LOGE("Unknown copy stage %d", stage);
+        return 0;
+    }
+
+    YUVImageView dst;
+    int payloadSize;
+    if (!consumerImages[consumerId].bind(env, image, bufferIndex, dst, payloadSize)) {
         LOGE("Failed to get direct buffer address.");
-        return;
+        return 0;
     }
 
-    jint yPlaneRowStride = env->CallIntMethod(yPlane, getRowStrideMethodID);
-    jint uPlaneRowStride = env->CallIntMethod(uPlane, getRowStrideMethodID);
-    jint vPlaneRowStride = env->CallIntMethod(vPlane, getRowStrideMethodID);
-    jint yPlanePixelStride = env->CallIntMethod(yPlane, getPixelStrideMethodID);
-    jint uPlanePixelStride = env->CallIntMethod(uPlane, getPixelStrideMethodID);
-    jint vPlanePixelStride = env->CallIntMethod(vPlane, getPixelStrideMethodID);
-
-    // Get the YUV frame data
-    const uint8_t *yPtr = yuvFrame.planes[0].byteBuffer.data();
-    const uint8_t *uPtr = yuvFrame.planes[1].byteBuffer.data();
-    const uint8_t *vPtr = yuvFrame.planes[2].byteBuffer.data();
-    int yRowStride = yuvFrame.planes[0].rowStride;
-    int uRowStride = yuvFrame.planes[1].rowStride;
-    int vRowStride = yuvFrame.planes[2].rowStride;
-    int yPixelStride = yuvFrame.planes[0].pixelStride;
-    int uPixelStride = yuvFrame.planes[1].pixelStride;
-    int vPixelStride = yuvFrame.planes[2].pixelStride;
-    int width = yuvFrame.width;
-    int height = yuvFrame.height;
-    int chromaHeight = height / 2;
-
-
-    long long prepWorkTime = std::chrono::duration_cast<std::chrono::milliseconds>(
-            std::chrono::system_clock::now().time_since_epoch()).count();
-
-    LOGI("Time to do prep work: %lld", prepWorkTime - refStartTime);
-
-    // Define thread functions for copying data
-    auto copyYPlane = [&]() {
-        if (yPixelStride == 1 && yRowStride == yPlaneRowStride && yPlanePixelStride == 1) {
-            memcpy(yPlanePtr, yPtr, height * yRowStride);
+    // Take the next frame for this consumer, it stays in the ring until released
+    YUV420 *frame = yuvQueue->acquire(consumerId);
+    if (frame == nullptr) {
+        return 0;
+    }
+    frameStats.record(FrameStage::QueueWait, steadyNowNs() - frame->enqueuedNs);
+    ScopedStageTimer timer(&frameStats, static_cast<FrameStage>(stage));
+
+    bool copied = true;
+    if (cropRegion.isWhole()) {
+        YUVConverter &converter = consumerConverters[consumerId];
+        if (imageStatsEnabled.load(std::memory_order_relaxed)) {
+            ImageStats &stats = consumerImageStats[consumerId];
+            converter.convert(frame->view(), dst, copyWorkers, copyBandBytes, &stats);
+            imageStatsLog.record(toPresentationTimeUs(frame->timestampNs), frame->width, frame->height, stats);
         } else {
-            for (int row = 0; row < height; row++) {
-                memcpy(yPlanePtr + row * yPlaneRowStride, yPtr + row * yRowStride, width);
-            }
-            /*for (int row = 0; row < height; ++row) {
-                uint8_t *src = const_cast<uint8_t *>(yPtr + row * yRowStride);
-                uint8_t *dst = yPlanePtr + row * yPlaneRowStride;
-                if (yPixelStride == 1 && yPlanePixelStride == 1) {
-                    memcpy(dst, src, width);
-                } else {
-                    for (int col = 0; col < width; ++col) {
-                        dst[col * yPlanePixelStride] = src[col * yPixelStride];
-                    }
-                }
-            }*/
+            converter.convert(frame->view(), dst, copyWorkers, copyBandBytes);
         }
-    };
-
-    auto copyUPlane = [&]() {
-        //  time to copy the U plane
-        if (uPixelStride == 1 && uRowStride == uPlaneRowStride && uPlanePixelStride == 1) {
-            memcpy(uPlanePtr, uPtr, chromaHeight * uRowStride);
-        } else {
-            for (int row = 0; row < chromaHeight; row++) {
-                memcpy(uPlanePtr + row * uPlaneRowStride, uPtr + row * uRowStride, width);
-            }
-            /*for (int row = 0; row < chromaHeight; ++row) {
-                uint8_t *src = const_cast<uint8_t *>(uPtr + row * uRowStride);
-                uint8_t *dst = uPlanePtr + row * uPlaneRowStride;
-                if (uPixelStride == 1 && uPlanePixelStride == 1) {
-                    memcpy(dst, src, width / 2);
-                } else {
-                    for (int col = 0; col < width / 2; ++col) {
-                        dst[col * uPlanePixelStride] = src[col * uPixelStride];
-                    }
-                }
-            }*/
+    } else {
+        CropRect region = cropRegion.resolve(frame->width, frame->height);
+        copied = consumerCroppers[consumerId].crop(frame->view(), region, dst, ScaleFilter::Bilinear,
+                                                   copyWorkers, copyBandBytes);
+        if (!copied) {
+            LOGE("Unsupported crop of %dx%d into %dx%d", frame->width, frame->height, dst.width, dst.height);
         }
-    };
+    }
 
-    auto copyVPlane = [&]() {
-        //  time to copy the V plane
-        if (vPixelStride == 1 && vRowStride == vPlaneRowStride && vPlanePixelStride == 1) {
-            memcpy(vPlanePtr, vPtr, chromaHeight * vRowStride);
-        } else {
-            for (int row = 0; row < chromaHeight; row++) {
-                memcpy(vPlanePtr + row * vPlaneRowStride, vPtr + row * vRowStride, width);
-            }
-            /*for (int row = 0; row < chromaHeight; ++row) {
-                uint8_t *src = const_cast<uint8_t *>(vPtr + row * vRowStride);
-                uint8_t *dst = vPlanePtr + row * vPlaneRowStride;
-                if (vPixelStride == 1 && vPlanePixelStride == 1) {
-                    memcpy(dst, src, width / 2);
-                } else {
-                    for (int col = 0; col < width / 2; ++col) {
-                        dst[col * vPlanePixelStride] = src[col * vPixelStride];
-                    }
-                }
-            }*/
-        }
-    };
+    yuvQueue->release(consumerId);
+    return copied ? payloadSize : 0;
+}
 
-    //  time to trigger copy
-    long long copyTriggerTime = std::chrono::duration_cast<std::chrono::milliseconds>(
-            std::chrono::system_clock::now().time_since_epoch()).count();
+// One scaler per consumer, each keeps its own plan and row scratch
+YUVScaler consumerScalers[FrameRing::kMaxConsumers];
 
-    LOGI("Time to trigger the copy: %lld", copyTriggerTime - refStartTime);
+/**
+ * Downscales the consumer's next queued frame into a smaller codec input Image, honouring the Image's
+ * own row and pixel strides. filter is a ScaleFilter value; bufferIndex and the return value are the
+ * same as for copyToImage.
+ */
+extern "C"
+JNIEXPORT jint JNICALL
+Java_com_qdev_singlesurfacedualquality_utils_YuvUtils_scaleToImage(
+        JNIEnv *env,
+        jobject /* this */,
+        jobject image,  // The Image object from Kotlin
+        jint bufferIndex,
+        jint consumerId,
+        jint filter) {
+    if (yuvQueue == nullptr || consumerId < 0 || consumerId >= FrameRing::kMaxConsumers) {
+        return 0;
+    }
 
-    // Create and run threads for copying each plane
-    std::vector<std::thread> threads;
-    threads.emplace_back(copyYPlane);
-    threads.emplace_back(copyUPlane);
-    threads.emplace_back(copyVPlane);
+    YUVImageView dst;
+    int payloadSize;
+    if (!consumerImages[consumerId].bind(env, image, bufferIndex, dst, payloadSize)) {
+        LOGE("Failed to get direct buffer address.");
+        return 0;
+    }
 
-    // Wait for all threads to finish
-    for (auto &thread: threads) {
-        thread.join();
+    YUV420 *frame = yuvQueue->acquire(consumerId);
+    if (frame == nullptr) {
+        return 0;
+    }
+    frameStats.record(FrameStage::QueueWait, steadyNowNs() - frame->enqueuedNs);
+    ScopedStageTimer timer(&frameStats, FrameStage::LqCopy);
+
+    // The plan only changes with the capture or codec size, not per frame
+    YUVScaler &scaler = consumerScalers[consumerId];
+    auto scaleFilter = static_cast<ScaleFilter>(filter);
+    bool ready;
+    if (cropRegion.isWhole()) {
+        ready = scaler.isConfiguredFor(frame->width, frame->height, dst.width, dst.height, scaleFilter) ||
+                scaler.configure(frame->width, frame->height, dst.width, dst.height, scaleFilter);
+        if (ready) {
+            scaler.scale(frame->view(), dst);
+        }
+    } else {
+        CropRect region = cropRegion.resolve(frame->width, frame->height);
+        ready = consumerCroppers[consumerId].crop(frame->view(), region, dst, scaleFilter, copyWorkers,
+                                                  copyBandBytes);
+    }
+    if (!ready) {
+        LOGE("Unsupported scale %dx%d -> %dx%d", frame->width, frame->height, dst.width, dst.height);
     }
 
-    // Clean up local references
-    env->DeleteLocalRef(yPlane);
-    env->DeleteLocalRef(uPlane);
-    env->DeleteLocalRef(vPlane);
-    env->DeleteLocalRef(planes);
-    env->DeleteLocalRef(imageClass);
+    yuvQueue->release(consumerId);
+    return ready ? payloadSize : 0;
+}
 
-    // Log to verify successful copying
-    LOGI("Successfully copied YUV data to Image object.");
 
-    //  time to complete the copy
-    long long endTime = std::chrono::duration_cast<std::chrono::milliseconds>(
-            std::chrono::system_clock::now().time_since_epoch()).count();
+/**
+ * Snapshot of frameStats as a flat array, optionally clearing it: the FrameCounter values, then per
+ * FrameStage count, total, max, p50, p90 and p99 in ns. Layout must match NativeStats.fromArray.
+ */
+extern "C"
+JNIEXPORT jlongArray JNICALL
+Java_com_qdev_singlesurfacedualquality_utils_YuvUtils_getNativeStats(JNIEnv *env, jobject thiz, jboolean reset) {
+    FrameStats::Snapshot snapshot = frameStats.snapshot(reset);
 
-    LOGI("Total Time to do copy: %lld", endTime - startTime);
+    std::vector<jlong> values;
+    for (uint64_t counter : snapshot.counters) {
+        values.push_back((jlong) counter);
+    }
+    for (const FrameStats::StageSummary &stage : snapshot.stages) {
+        values.insert(values.end(), {(jlong) stage.count, (jlong) stage.totalNs, (jlong) stage.maxNs,
+                                     (jlong) stage.p50Ns, (jlong) stage.p90Ns, (jlong) stage.p99Ns});
+    }
 
-    return;
+    jlongArray result = env->NewLongArray((jsize) values.size());
+    if (result != nullptr) {
+        env->SetLongArrayRegion(result, 0, (jsize) values.size(), values.data());
+    }
+    return result;
 }
 
-// Helper function to split the plane copy into row ranges and run it on separate threads
-void copyPlaneInParallel(const uint8_t *src, int srcRowStride, int srcPixelStride,
-                         uint8_t *dst, int dstRowStride, int dstPixelStride,
-                         int width, int height) {
-
-    if (srcPixelStride == dstPixelStride && srcRowStride == dstRowStride) {
-        // Direct memcpy when strides are the same
-        memcpy(dst, src, height * srcRowStride);
-    } else {
-        // Slow path: copy pixel by pixel
-        for (int row = 0; row < height; ++row) {
-            for (int col = 0; col < width; ++col) {
-                uint8_t *srcPixel = const_cast<uint8_t *>(&src[row * srcRowStride + col * srcPixelStride]);
-                uint8_t *dstPixel = &dst[row * dstRowStride + col * dstPixelStride];
-                *dstPixel = *srcPixel;
-            }
-        }
+/**
+ * Last motion analysis of a gated consumer: mean absolute luma difference in thousandths of a level,
+ * changed blocks, block columns and rows, 1 when it was a scene cut, frames analyzed and scene cuts so far.
+ * Empty without a motion gate on that consumer.
+ */
+extern "C"
+JNIEXPORT jlongArray JNICALL
+Java_com_qdev_singlesurfacedualquality_utils_YuvUtils_getNativeMotionStats(JNIEnv *env, jobject thiz, jint consumerId) {
+    std::vector<jlong> values;
+    if (consumerId >= 0 && consumerId < FrameRing::kMaxConsumers && consumerMotion[consumerId] != nullptr) {
+        MotionDetector::Summary summary = consumerMotion[consumerId]->getSummary();
+        values = {(jlong) (summary.score * 1000), summary.changedBlocks, summary.columns, summary.rows,
+                  summary.sceneCut ? 1 : 0, (jlong) summary.analyzedFrames, (jlong) summary.sceneCuts};
     }
+    jlongArray result = env->NewLongArray((jsize) values.size());
+    if (result != nullptr) {
+        env->SetLongArrayRegion(result, 0, (jsize) values.size(), values.data());
+    }
+    return result;
 }
 
-void copyPlane(const uint8_t *src, uint8_t *dst, int width, int height, int srcRowStride, int dstRowStride, int srcPixelStride, int dstPixelStride) {
-    for (int row = 0; row < height; ++row) {
-        for (int col = 0; col < width; ++col) {
-            dst[row * dstRowStride + col * dstPixelStride] = src[row * srcRowStride + col * srcPixelStride];
-        }
+/**
+ * Statistics of the frame captured at timestampNs (peekTimestamp), or of the newest measured frame for -1:
+ * timestamp (us), width, height, luma sum, luma sum of squares, luma samples, U sum, V sum, chroma samples,
+ * then the 256 histogram bins. Layout must match ImageStats.fromArray; empty when the frame was not measured.
+ */
+extern "C"
+JNIEXPORT jlongArray JNICALL
+Java_com_qdev_singlesurfacedualquality_utils_YuvUtils_getNativeImageStats(JNIEnv *env, jobject thiz,
+                                                                          jlong timestampNs) {
+    std::vector<jlong> values;
+    ImageStatsLog::Record record;
+    if (imageStatsLog.find(timestampNs >= 0 ? toPresentationTimeUs(timestampNs) : -1, record)) {
+        const ImageStats &stats = record.stats;
+        values = {record.timestampUs, record.width, record.height, (jlong) stats.lumaSum,
+                  (jlong) stats.lumaSquares, (jlong) stats.lumaCount, (jlong) stats.chromaSum[0],
+                  (jlong) stats.chromaSum[1], (jlong) stats.chromaCount};
+        values.insert(values.end(), stats.histogram, stats.histogram + 256);
+    }
+    jlongArray result = env->NewLongArray((jsize) values.size());
+    if (result != nullptr) {
+        env->SetLongArrayRegion(result, 0, (jsize) values.size(), values.data());
     }
+    return result;
 }
 
-void neonCopyPlane(uint8_t *src, uint8_t *dst, int width, int height, int srcRowStride, int dstRowStride) {
-    for (int row = 0; row < height; ++row) {
-        uint8_t *srcRow = src + row * srcRowStride;
-        uint8_t *dstRow = dst + row * dstRowStride;
-
-        for (int col = 0; col < width; col += 16) {
-            // Load 16 bytes from src
-            uint8x16_t data = vld1q_u8(srcRow + col);
-            // Store 16 bytes to dst
-            vst1q_u8(dstRow + col, data);
-        }
+// Per block mean absolute luma difference of the last analyzed frame, row-major; empty without a motion gate
+extern "C"
+JNIEXPORT jbyteArray JNICALL
+Java_com_qdev_singlesurfacedualquality_utils_YuvUtils_getMotionMap(JNIEnv *env, jobject thiz, jint consumerId) {
+    std::vector<uint8_t> map;
+    if (consumerId >= 0 && consumerId < FrameRing::kMaxConsumers && consumerMotion[consumerId] != nullptr) {
+        consumerMotion[consumerId]->copyBlockMap(map);
+    }
+    jbyteArray result = env->NewByteArray((jsize) map.size());
+    if (result != nullptr) {
+        env->SetByteArrayRegion(result, 0, (jsize) map.size(), reinterpret_cast<const jbyte *>(map.data()));
     }
+    return result;
 }
 
-void multiThreadedCopyYUV420(const uint8_t *ySrc, const uint8_t *uSrc, const uint8_t *vSrc,
-                             uint8_t *yDst, uint8_t *uDst, uint8_t *vDst,
-                             int width, int height, int ySrcRowStride, int yDstRowStride,
-                             int uSrcRowStride, int uDstRowStride, int vSrcRowStride, int vDstRowStride,
-                             int numThreads) {
-    std::vector<std::thread> threads;
-
-    // Process Y plane in multiple threads
-    int yHeight = height;
-    int rowsPerThread = yHeight / numThreads;
-    int extraRows = yHeight % numThreads;
-    int startRow = 0;
-
-    for (int i = 0; i < numThreads; ++i) {
-        int rowsToCopy = rowsPerThread + (i < extraRows ? 1 : 0);
-        threads.emplace_back([=]() {
-            copyPlane(ySrc + startRow * ySrcRowStride, yDst + startRow * yDstRowStride,
-                      width, rowsToCopy, ySrcRowStride, yDstRowStride, 1, 1);
-        });
-        startRow += rowsToCopy;
+// Queue spill depth: frames waiting in it, the most that waited at once and its size in frames. Empty without a spill.
+extern "C"
+JNIEXPORT jlongArray JNICALL
+Java_com_qdev_singlesurfacedualquality_utils_YuvUtils_getNativeSpillStats(JNIEnv *env, jobject thiz) {
+    std::vector<jlong> values;
+    const FrameSpill *spill = yuvQueue != nullptr ? yuvQueue->getSpill() : nullptr;
+    if (spill != nullptr) {
+        values = {(jlong) spill->getPending(), (jlong) spill->getPeakPending(), (jlong) spill->getCapacity()};
     }
-
-    // Wait for Y plane threads
-    for (auto &thread: threads) {
-        thread.join();
+    jlongArray result = env->NewLongArray((jsize) values.size());
+    if (result != nullptr) {
+        env->SetLongArrayRegion(result, 0, (jsize) values.size(), values.data());
     }
+    return result;
+}
 
-    // Process U and V planes (subsampled)
-    threads.clear();
-    int uvWidth = width / 2;
-    int uvHeight = height / 2;
-
-    rowsPerThread = uvHeight / numThreads;
-    extraRows = uvHeight % numThreads;
-    startRow = 0;
-
-    for (int i = 0; i < numThreads; ++i) {
-        int rowsToCopy = rowsPerThread + (i < extraRows ? 1 : 0);
-        threads.emplace_back([=]() {
-            copyPlane(uSrc + startRow * uSrcRowStride, uDst + startRow * uDstRowStride,
-                      uvWidth, rowsToCopy, uSrcRowStride, uDstRowStride, 1, 1);
-            copyPlane(vSrc + startRow * vSrcRowStride, vDst + startRow * vDstRowStride,
-                      uvWidth, rowsToCopy, vSrcRowStride, vDstRowStride, 1, 1);
-        });
-        startRow += rowsToCopy;
+// Layout argument of the export calls as a YUVLayout; Generic for values that are not a packed layout
+static YUVLayout packedLayout(jint layout) {
+    switch (layout) {
+        case (jint) YUVLayout::I420:
+            return YUVLayout::I420;
+        case (jint) YUVLayout::NV12:
+            return YUVLayout::NV12;
+        case (jint) YUVLayout::NV21:
+            return YUVLayout::NV21;
+        default:
+            return YUVLayout::Generic;
     }
+}
 
-    // Wait for U/V plane threads
-    for (auto &thread: threads) {
-        thread.join();
+// Exports the consumer's next queued frame packed into dst; its capture timestamp, -1 if none was written
+static jlong exportNextFrame(int consumerId, uint8_t *dst, size_t capacity, jint layout) {
+    if (yuvQueue == nullptr || consumerId < 0 || consumerId >= FrameRing::kMaxConsumers) {
+        return -1;
+    }
+    YUV420 *frame = yuvQueue->acquire(consumerId);
+    if (frame == nullptr) {
+        return -1;
     }
+    bool exported = consumerConverters[consumerId].exportPacked(frame->view(), dst, capacity, packedLayout(layout),
+                                                                copyWorkers, copyBandBytes);
+    if (!exported) {
+        LOGE("Export of %dx%d as layout %d into %zu bytes failed", frame->width, frame->height, (int) layout,
+             capacity);
+    }
+    long long timestampNs = frame->timestampNs;
+    yuvQueue->release(consumerId);
+    return exported ? timestampNs : -1;
 }
 
+// Bytes a packed export of a width x height frame writes, the same for every layout
+extern "C"
+JNIEXPORT jint JNICALL
+Java_com_qdev_singlesurfacedualquality_utils_YuvUtils_getPackedFrameSize(JNIEnv *env, jobject thiz, jint width,
+                                                                         jint height) {
+    return width > 0 && height > 0 ? (jint) packedSize(width, height) : 0;
+}
 
+/**
+ * Writes the consumer's next queued frame tightly packed (no row padding) as I420, NV12 or NV21 into a
+ * direct ByteBuffer the caller keeps reusing, so frame grabs allocate nothing. Returns the frame's capture
+ * timestamp, -1 when no frame was waiting, the layout is unknown or the buffer is smaller than
+ * getPackedFrameSize. The buffer's position and limit are left alone.
+ */
 extern "C"
-JNIEXPORT void JNICALL
-Java_com_qdev_singlesurfacedualquality_utils_YuvUtils_copyToImageV2(
-        JNIEnv *env,
-        jobject /* this */,
-        jobject image,  // The Image object from Kotlin
-        jboolean removeFromQueue) {
-    // Step 1: Initialize the Android Image object
-    jclass imageClass = env->GetObjectClass(image);
-    jmethodID getPlanesMethod = env->GetMethodID(imageClass, "getPlanes", "()[Landroid/media/Image$Plane;");
-    jobjectArray planes = (jobjectArray) env->CallObjectMethod(image, getPlanesMethod);
-    int numPlanes = env->GetArrayLength(planes);
-
-    if (numPlanes != 3) {
-        // Ensure the Image object has three planes (YUV 420 format)
-        return;
+JNIEXPORT jlong JNICALL
+Java_com_qdev_singlesurfacedualquality_utils_YuvUtils_exportFrame(JNIEnv *env, jobject thiz, jint consumerId,
+                                                                  jobject buffer, jint layout) {
+    auto *dst = static_cast<uint8_t *>(env->GetDirectBufferAddress(buffer));
+    jlong capacity = env->GetDirectBufferCapacity(buffer);
+    if (dst == nullptr || capacity <= 0) {
+        LOGE("exportFrame needs a direct buffer");
+        return -1;
     }
+    return exportNextFrame(consumerId, dst, (size_t) capacity, layout);
+}
 
-    // Step 2: Dequeue or Peek frame from CircularArrayQueue
-    YUV420 &frame = removeFromQueue ? yuvQueue->dequeue() : yuvQueue->peek();
-
-    // Step 3: Copy YUV data from frame to Image object
-    for (int i = 0; i < numPlanes; i++) {
-        jobject planeObj = env->GetObjectArrayElement(planes, i);
-        jclass planeClass = env->GetObjectClass(planeObj);
-
-        // Get the ByteBuffer for each plane
-        jmethodID getBufferMethod = env->GetMethodID(planeClass, "getBuffer", "()Ljava/nio/ByteBuffer;");
-        jobject bufferObj = env->CallObjectMethod(planeObj, getBufferMethod);
-        uint8_t *destBuffer = (uint8_t *) env->GetDirectBufferAddress(bufferObj);
-
-        // Get the pixel and row strides for each plane
-        jmethodID getRowStrideMethod = env->GetMethodID(planeClass, "getRowStride", "()I");
-        jint destRowStride = env->CallIntMethod(planeObj, getRowStrideMethod);
-
-        jmethodID getPixelStrideMethod = env->GetMethodID(planeClass, "getPixelStride", "()I");
-        jint destPixelStride = env->CallIntMethod(planeObj, getPixelStrideMethod);
-
-        // Source YUVImagePlane data
-        YUVImagePlane &srcPlane = frame.planes[i];
-        int srcRowStride = srcPlane.rowStride;
-        int srcPixelStride = srcPlane.pixelStride;
-        uint8_t *srcBuffer = srcPlane.byteBuffer.data();
-
-        // Step 4: Copy the data using NEON intrinsics
-        int height = (i == 0) ? frame.height : frame.height / 2;
-        int width = (i == 0) ? frame.width : frame.width / 2;
-
-        for (int y = 0; y < height; ++y) {
-            uint8_t *srcRow = srcBuffer + y * srcRowStride;
-            uint8_t *destRow = destBuffer + y * destRowStride;
-
-            // Check alignment
-            if ((((uintptr_t) srcRow % 16) == 0) && (((uintptr_t) destRow % 16) == 0) &&
-                srcPixelStride == destPixelStride && srcPixelStride > 1) {
-                // Strides are equal but greater than 1 and both source and destination are aligned
-                int stride = srcPixelStride;
-                int x = 0;
-
-                // Use NEON to process pixels in chunks of 16 bytes
-                for (; x <= (width - 16); x += 16) {
-                    // Load pixels using stride
-                    uint8x16x2_t srcData = vld2q_u8(srcRow + x * stride);
-
-                    // Store pixels using stride
-                    vst2q_u8(destRow + x * stride, srcData);
-                }
-
-                // Handle any remaining pixels after processing in chunks of 16
-                for (; x < width; ++x) {
-                    uint8_t pixelValue = *(srcRow + x * stride);
-                    *(destRow + x * stride) = pixelValue;
-                }
-            } else if (srcPixelStride == 1 && destPixelStride == 1) {
-                // Both strides are 1, use memcpy for the entire row
-                memcpy(destRow, srcRow, width);
-            } else {
-                // Fallback to manual copy if pixel strides are different or alignment is incorrect
-                for (int x = 0; x < width; ++x) {
-                    uint8_t pixelValue = *(srcRow + x * srcPixelStride);
-                    *(destRow + x * destPixelStride) = pixelValue;
-                }
-            }
-        }
+// exportFrame into native memory at address, capacity bytes long, e.g. an ML runtime's input tensor
+extern "C"
+JNIEXPORT jlong JNICALL
+Java_com_qdev_singlesurfacedualquality_utils_YuvUtils_exportFrameToAddress(JNIEnv *env, jobject thiz,
+                                                                           jint consumerId, jlong address,
+                                                                           jlong capacity, jint layout) {
+    if (address == 0 || capacity <= 0) {
+        return -1;
     }
+    return exportNextFrame(consumerId, reinterpret_cast<uint8_t *>(address), (size_t) capacity, layout);
 }
 
+/**
+ * Writes image tightly packed as I420, NV12 or NV21 into a reusable direct ByteBuffer. Returns the bytes
+ * written (getPackedFrameSize), 0 when the layout is unknown or the buffer is too small.
+ */
 extern "C"
-JNIEXPORT void JNICALL
-Java_com_qdev_singlesurfacedualquality_utils_YuvUtils_copyToImageV3(
-        JNIEnv *env,
-        jobject /* this */,
-        jobject image,  // The Image object from Kotlin
-        jboolean removeFromQueue) {
-    // Step 1: Initialize the Android Image object
-    jclass imageClass = env->GetObjectClass(image);
-    jmethodID getPlanesMethod = env->GetMethodID(imageClass, "getPlanes", "()[Landroid/media/Image$Plane;");
-    jobjectArray planes = (jobjectArray) env->CallObjectMethod(image, getPlanesMethod);
-    int numPlanes = env->GetArrayLength(planes);
-
-    if (numPlanes != 3) {
-        // Ensure the Image object has three planes (YUV 420 format)
-        return;
+JNIEXPORT jint JNICALL
+Java_com_qdev_singlesurfacedualquality_utils_YuvUtils_exportImage(JNIEnv *env, jobject thiz, jobject image,
+                                                                  jobject buffer, jint layout) {
+    YUVImageView src;
+    int payloadSize;
+    auto *dst = static_cast<uint8_t *>(env->GetDirectBufferAddress(buffer));
+    jlong capacity = env->GetDirectBufferCapacity(buffer);
+    if (dst == nullptr || capacity <= 0 || !bindImage(env, image, src, payloadSize)) {
+        LOGE("Failed to get direct buffer address.");
+        return 0;
     }
+    YUVConverter converter;
+    if (!converter.exportPacked(src, dst, (size_t) capacity, packedLayout(layout))) {
+        return 0;
+    }
+    return (jint) packedSize(src.width, src.height);
+}
 
-    // Step 2: Dequeue or Peek frame from CircularArrayQueue
-    YUV420 &frame = removeFromQueue ? yuvQueue->dequeue() : yuvQueue->peek();
-
-    // Step 3: Copy YUV data from frame to Image object
-    for (int i = 0; i < numPlanes; i++) {
-        jobject planeObj = env->GetObjectArrayElement(planes, i);
-        jclass planeClass = env->GetObjectClass(planeObj);
-
-        // Get the ByteBuffer for each plane
-        jmethodID getBufferMethod = env->GetMethodID(planeClass, "getBuffer", "()Ljava/nio/ByteBuffer;");
-        jobject bufferObj = env->CallObjectMethod(planeObj, getBufferMethod);
-        uint8_t *destBuffer = (uint8_t *) env->GetDirectBufferAddress(bufferObj);
-
-        if (destBuffer == nullptr) {
-            // Direct buffer address is not valid; return or handle the error
-            return;
-        }
-
-        // Get the pixel and row strides for each plane
-        jmethodID getRowStrideMethod = env->GetMethodID(planeClass, "getRowStride", "()I");
-        jint destRowStride = env->CallIntMethod(planeObj, getRowStrideMethod);
+// image as a new byte array, packed I420; allocates on every call, exportImage reuses a buffer instead
+extern "C" JNIEXPORT jbyteArray JNICALL
+Java_com_qdev_singlesurfacedualquality_utils_YuvUtils_copyYUVBuffer(JNIEnv *env, jobject thiz, jobject image) {
+    YUVImageView src;
+    int payloadSize;
+    if (!bindImage(env, image, src, payloadSize)) {
+        LOGE("Failed to get direct buffer address.");
+        return nullptr;
+    }
+    size_t size = packedSize(src.width, src.height);
+    jbyteArray yuvData = env->NewByteArray((jsize) size);
+    if (yuvData == nullptr) {
+        return nullptr;
+    }
+    jbyte *yuvBuffer = env->GetByteArrayElements(yuvData, nullptr);
+    YUVConverter converter;
+    converter.exportPacked(src, reinterpret_cast<uint8_t *>(yuvBuffer), size, YUVLayout::I420);
+    env->ReleaseByteArrayElements(yuvData, yuvBuffer, 0);
+    return yuvData;
+}
 
-        jmethodID getPixelStrideMethod = env->GetMethodID(planeClass, "getPixelStride", "()I");
-        jint destPixelStride = env->CallIntMethod(planeObj, getPixelStrideMethod);
 
-        // Source YUVImagePlane data
-        YUVImagePlane &srcPlane = frame.planes[i];
-        int srcRowStride = srcPlane.rowStride;
-        int srcPixelStride = srcPlane.pixelStride;
-        uint8_t *srcBuffer = srcPlane.byteBuffer.data();
+// JNI_OnLoad function to store the JavaVM reference and resolve the Image accessors once
+JNIEXPORT jint JNICALL JNI_OnLoad(JavaVM *vm, void * /* reserved */) {
+    gJvm = vm;
+    JNIEnv *env = nullptr;
+    if (vm->GetEnv(reinterpret_cast<void **>(&env), JNI_VERSION_1_6) != JNI_OK || !cacheImageBindings(env)) {
+        return JNI_ERR;
+    }
+    return JNI_VERSION_1_6;
+}
 
-        if (srcBuffer == nullptr) {
-            // Source buffer is not valid; return or handle the error
-            return;
+// The consumer's output graph for another output, or null (logged) when it already runs or is full
+static OutputGraph *outputGraphToExtend(int consumerId) {
+    if (yuvQueue == nullptr || consumerId < 0 || consumerId >= FrameRing::kMaxConsumers) {
+        return nullptr;
+    }
+    NativeOutputs &outputs = consumerOutputs[consumerId];
+    if (outputs.started || (outputs.graph != nullptr && outputs.graph->getOutputCount() == OutputGraph::kMaxOutputs)) {
+        LOGE("Outputs of consumer %d are running or full", consumerId);
+        return nullptr;
+    }
+    if (outputs.graph == nullptr) {
+        // The graph takes over the consumer from a feeder
+        stopNativeFeeder(consumerId);
+        outputs.graph = new OutputGraph(yuvQueue, consumerId);
+        outputs.graph->setPlacer(&threadPlacer);
+        outputs.graph->setCrop(&cropRegion);
+        if (imageStatsEnabled.load(std::memory_order_relaxed)) {
+            outputs.graph->setImageStats(&imageStatsLog);
         }
-
-        // Step 4: Copy the data using NEON intrinsics
-        int height = (i == 0) ? frame.height : frame.height / 2;
-        int width = (i == 0) ? frame.width : frame.width / 2;
-
-        for (int y = 0; y < height; ++y) {
-            uint8_t *srcRow = srcBuffer + y * srcRowStride;
-            uint8_t *destRow = destBuffer + y * destRowStride;
-
-            // Ensure not to exceed the buffer boundary
-            if ((srcRow >= srcBuffer + (height * srcRowStride)) ||
-                (destRow >= destBuffer + (height * destRowStride))) {
-                // Avoid accessing memory beyond allocated buffers
-                return;
-            }
-
-            if ((((uintptr_t) srcRow % 16) == 0) && (((uintptr_t) destRow % 16) == 0) &&
-                srcPixelStride == destPixelStride && srcPixelStride > 1) {
-                // Strides are equal but greater than 1 and both source and destination are aligned
-                int stride = srcPixelStride;
-                int x = 0;
-
-                // Use NEON to process pixels in chunks of 16 bytes
-                for (; x <= (width - 16); x += 16) {
-                    // Load pixels using stride
-                    uint8x16x2_t srcData = vld2q_u8(srcRow + x * stride);
-                    // Store pixels using stride
-                    vst2q_u8(destRow + x * stride, srcData);
-                }
-
-                // Handle any remaining pixels after processing in chunks of 16
-                for (; x < width; ++x) {
-                    uint8_t pixelValue = *(srcRow + x * stride);
-                    *(destRow + x * stride) = pixelValue;
-                }
-            } else if (srcPixelStride == 1 && destPixelStride == 1) {
-                // Both strides are 1, use memcpy for the entire row
-                // Ensure that memcpy does not copy more than available space
-                int copySize = std::min(width, destRowStride);
-                memcpy(destRow, srcRow, copySize);
-            } else {
-                // Fallback to manual copy if pixel strides are different or alignment is incorrect
-                for (int x = 0; x < width; ++x) {
-                    uint8_t pixelValue = *(srcRow + x * srcPixelStride);
-                    *(destRow + x * destPixelStride) = pixelValue;
-                }
-            }
+        // Gates the outputs of another size than the capture, like a scaling feeder
+        if (MotionDetector *detector = createMotionGate(consumerId)) {
+            outputs.graph->setMotionGate(detector, motionMinFps);
         }
     }
+    return outputs.graph;
 }
 
+static OutputProfile outputProfile(jint width, jint height, jdouble frameRate, jint priority, jint scaleFilter) {
+    OutputProfile profile;
+    profile.fps = frameRate;
+    profile.priority = priority;
+    if (scaleFilter >= 0) {
+        profile.filter = static_cast<ScaleFilter>(scaleFilter);
+    }
+    profile.motionGated = width != yuvQueue->getFrameWidth() || height != yuvQueue->getFrameHeight();
+    return profile;
+}
 
 /**
- * Function to copy YUV data from a YUV420 object to an Image object
+ * Adds an encoder output to the consumer's output graph: every frame a pacer at frameRate (0 = every frame)
+ * keeps is copied, or scaled with scaleFilter when width x height is not the capture size, into an
+ * AMediaCodec encoder muxing MP4 into outputFd, which is handed over. All outputs of a consumer are fed in
+ * one pass over each frame (OutputGraph); the highest priority one paces the graph, the others skip frames
+ * their encoder has no free buffer for. setCropRegion, configureImageStats and configureMotionGate (which
+ * gates the outputs of another size than the capture) apply as to a native feeder. Add all outputs, then
+ * startNativeOutputs. Takes the consumer over from a native feeder. Returns the output's index, -1 on failure.
  */
 extern "C"
-JNIEXPORT void JNICALL
-Java_com_qdev_singlesurfacedualquality_utils_YuvUtils_copyToImage(
-        JNIEnv *env,
-        jobject /* this */,
-        jobject yuv420Object,  // YUV420 Kotlin object
-        jobject imageObject    // android.media.Image object
-) {
-    // Get the YUV420 class and field IDs
-    jclass yuv420Class = env->GetObjectClass(yuv420Object);
-
-    // Cache field IDs
-    static jfieldID yBufferFieldID = env->GetFieldID(yuv420Class, "yBuffer", "Ljava/nio/ByteBuffer;");
-    static jfieldID uBufferFieldID = env->GetFieldID(yuv420Class, "uBuffer", "Ljava/nio/ByteBuffer;");
-    static jfieldID vBufferFieldID = env->GetFieldID(yuv420Class, "vBuffer", "Ljava/nio/ByteBuffer;");
-    static jfieldID yRowStrideFieldID = env->GetFieldID(yuv420Class, "yRowStride", "I");
-    static jfieldID uRowStrideFieldID = env->GetFieldID(yuv420Class, "uRowStride", "I");
-    static jfieldID vRowStrideFieldID = env->GetFieldID(yuv420Class, "vRowStride", "I");
-    static jfieldID yPixelStrideFieldID = env->GetFieldID(yuv420Class, "yPixelStride", "I");
-    static jfieldID uPixelStrideFieldID = env->GetFieldID(yuv420Class, "uPixelStride", "I");
-    static jfieldID vPixelStrideFieldID = env->GetFieldID(yuv420Class, "vPixelStride", "I");
-    static jfieldID widthFieldID = env->GetFieldID(yuv420Class, "width", "I");
-    static jfieldID heightFieldID = env->GetFieldID(yuv420Class, "height", "I");
-
-    // Get the ByteBuffers from the YUV420 object
-    jobject yBuffer = env->GetObjectField(yuv420Object, yBufferFieldID);
-    jobject uBuffer = env->GetObjectField(yuv420Object, uBufferFieldID);
-    jobject vBuffer = env->GetObjectField(yuv420Object, vBufferFieldID);
-
-    // Get the strides and sizes from the YUV420 object
-    jint yRowStride = env->GetIntField(yuv420Object, yRowStrideFieldID);
-    jint uRowStride = env->GetIntField(yuv420Object, uRowStrideFieldID);
-    jint vRowStride = env->GetIntField(yuv420Object, vRowStrideFieldID);
-    jint yPixelStride = env->GetIntField(yuv420Object, yPixelStrideFieldID);
-    jint uPixelStride = env->GetIntField(yuv420Object, uPixelStrideFieldID);
-    jint vPixelStride = env->GetIntField(yuv420Object, vPixelStrideFieldID);
-    jint width = env->GetIntField(yuv420Object, widthFieldID);
-    jint height = env->GetIntField(yuv420Object, heightFieldID);
-    jint chromaHeight = height / 2;
-
-    // Get the direct buffer addresses
-    uint8_t *yPtr = static_cast<uint8_t *>(env->GetDirectBufferAddress(yBuffer));
-    uint8_t *uPtr = static_cast<uint8_t *>(env->GetDirectBufferAddress(uBuffer));
-    uint8_t *vPtr = static_cast<uint8_t *>(env->GetDirectBufferAddress(vBuffer));
-
-    // Get the Image class and its Plane array
-    jclass imageClass = env->GetObjectClass(imageObject);
-    static jmethodID getPlanesMethodID = env->GetMethodID(imageClass, "getPlanes", "()[Landroid/media/Image$Plane;");
-    jobjectArray planes = static_cast<jobjectArray>(env->CallObjectMethod(imageObject, getPlanesMethodID));
-
-    // Get the Y, U, and V planes from the Image object
-    jobject yPlane = env->GetObjectArrayElement(planes, 0);
-    jobject uPlane = env->GetObjectArrayElement(planes, 1);
-    jobject vPlane = env->GetObjectArrayElement(planes, 2);
-
-    // Plane class and field IDs
-    jclass planeClass = env->GetObjectClass(yPlane);
-    static jmethodID getBufferMethodID = env->GetMethodID(planeClass, "getBuffer", "()Ljava/nio/ByteBuffer;");
-    static jmethodID getRowStrideMethodID = env->GetMethodID(planeClass, "getRowStride", "()I");
-    static jmethodID getPixelStrideMethodID = env->GetMethodID(planeClass, "getPixelStride", "()I");
-
-    // Get the ByteBuffers from the Image.Planes
-    jobject yPlaneBuffer = env->CallObjectMethod(yPlane, getBufferMethodID);
-    jobject uPlaneBuffer = env->CallObjectMethod(uPlane, getBufferMethodID);
-    jobject vPlaneBuffer = env->CallObjectMethod(vPlane, getBufferMethodID);
-
-    uint8_t *yPlanePtr = static_cast<uint8_t *>(env->GetDirectBufferAddress(yPlaneBuffer));
-    uint8_t *uPlanePtr = static_cast<uint8_t *>(env->GetDirectBufferAddress(uPlaneBuffer));
-    uint8_t *vPlanePtr = static_cast<uint8_t *>(env->GetDirectBufferAddress(vPlaneBuffer));
-
-    jint yPlaneRowStride = env->CallIntMethod(yPlane, getRowStrideMethodID);
-    jint uPlaneRowStride = env->CallIntMethod(uPlane, getRowStrideMethodID);
-    jint vPlaneRowStride = env->CallIntMethod(vPlane, getRowStrideMethodID);
-    jint yPlanePixelStride = env->CallIntMethod(yPlane, getPixelStrideMethodID);
-    jint uPlanePixelStride = env->CallIntMethod(uPlane, getPixelStrideMethodID);
-    jint vPlanePixelStride = env->CallIntMethod(vPlane, getPixelStrideMethodID);
-
-    // Define thread functions for copying data
-    auto copyYPlane = [&]() {
-        std::lock_guard<std::mutex> guard(copyMutex);
-        if (yPixelStride == 1 && yRowStride == yPlaneRowStride && yPlanePixelStride == 1) {
-            memcpy(yPlanePtr, yPtr, height * yRowStride);
-        } else {
-            for (int i = 0; i < height; ++i) {
-                uint8_t *src = yPtr + i * yRowStride;
-                uint8_t *dst = yPlanePtr + i * yPlaneRowStride;
-                if (yPixelStride == 1 && yPlanePixelStride == 1) {
-                    memcpy(dst, src, width);
-                } else {
-                    for (int j = 0; j < width; ++j) {
-                        dst[j * yPlanePixelStride] = src[j * yPixelStride];
-                    }
-                }
-            }
-        }
-    };
-
-    auto copyUPlane = [&]() {
-        std::lock_guard<std::mutex> guard(copyMutex);
-        if (uPixelStride == 1 && uRowStride == uPlaneRowStride && uPlanePixelStride == 1) {
-            memcpy(uPlanePtr, uPtr, chromaHeight * uRowStride);
-        } else {
-            for (int i = 0; i < chromaHeight; ++i) {
-                uint8_t *src = uPtr + i * uRowStride;
-                uint8_t *dst = uPlanePtr + i * uPlaneRowStride;
-                if (uPixelStride == 1 && uPlanePixelStride == 1) {
-                    memcpy(dst, src, width / 2);
-                } else {
-                    for (int j = 0; j < width / 2; ++j) {
-                        dst[j * uPlanePixelStride] = src[j * uPixelStride];
-                    }
-                }
-            }
-        }
-    };
-
-    auto copyVPlane = [&]() {
-        std::lock_guard<std::mutex> guard(copyMutex);
-        if (vPixelStride == 1 && vRowStride == vPlaneRowStride && vPlanePixelStride == 1) {
-            memcpy(vPlanePtr, vPtr, chromaHeight * vRowStride);
-        } else {
-            for (int i = 0; i < chromaHeight; ++i) {
-                uint8_t *src = vPtr + i * vRowStride;
-                uint8_t *dst = vPlanePtr + i * vPlaneRowStride;
-                if (vPixelStride == 1 && vPlanePixelStride == 1) {
-                    memcpy(dst, src, width / 2);
-                } else {
-                    for (int j = 0; j < width / 2; ++j) {
-                        dst[j * vPlanePixelStride] = src[j * vPixelStride];
-                    }
-                }
-            }
-        }
-    };
-
-    // Create and run threads for copying each plane
-    std::vector<std::thread> threads;
-    threads.emplace_back(copyYPlane);
-    threads.emplace_back(copyUPlane);
-    threads.emplace_back(copyVPlane);
-
-    // Wait for all threads to finish
-    for (auto &thread: threads) {
-        thread.join();
+JNIEXPORT jint JNICALL
+Java_com_qdev_singlesurfacedualquality_utils_YuvUtils_addNativeOutput(JNIEnv *env, jobject thiz, jint consumerId,
+                                                                      jstring mime, jint outputFd, jint width,
+                                                                      jint height, jint bitRate, jint frameRate,
+                                                                      jint iFrameInterval, jint priority,
+                                                                      jint scaleFilter) {
+    OutputGraph *graph = outputGraphToExtend(consumerId);
+    if (graph == nullptr) {
+        close(outputFd);
+        return -1;
     }
-
-    // Clean up local references
-    env->DeleteLocalRef(yuv420Class);
-    env->DeleteLocalRef(imageClass);
-    env->DeleteLocalRef(planes);
-    env->DeleteLocalRef(yPlane);
-    env->DeleteLocalRef(uPlane);
-    env->DeleteLocalRef(vPlane);
+    auto *sink = new MediaCodecSink();
+    const char *mimeType = env->GetStringUTFChars(mime, nullptr);
+    bool opened = sink->open(mimeType, width, height, bitRate, frameRate, iFrameInterval, outputFd);
+    env->ReleaseStringUTFChars(mime, mimeType);
+    if (!opened) {
+        delete sink;
+        return -1;
+    }
+    int index = graph->addOutput(sink, outputProfile(width, height, frameRate, priority, scaleFilter));
+    if (index < 0) {
+        // Closing hands outputFd back along with the encoder and the muxer
+        LOGE("Output graph of consumer %d refused the output", consumerId);
+        sink->close();
+        delete sink;
+        return -1;
+    }
+    consumerOutputs[consumerId].sinks.push_back(sink);
+    return index;
 }
 
-extern "C" JNIEXPORT jbyteArray JNICALL
-Java_com_qdev_singlesurfacedualquality_utils_YuvUtils_copyYUVBuffer(JNIEnv *env, jobject thiz, jobject image) {
-    // Get the Image class and methods to access the planes
-    jclass imageClass = env->GetObjectClass(image);
-    jmethodID getPlanesMethod = env->GetMethodID(imageClass, "getPlanes", "()[Landroid/media/Image$Plane;");
-    jobjectArray planesArray = (jobjectArray) env->CallObjectMethod(image, getPlanesMethod);
-
-    // Get the Plane class and methods
-    jclass planeClass = env->FindClass("android/media/Image$Plane");
-    jmethodID getBufferMethod = env->GetMethodID(planeClass, "getBuffer", "()Ljava/nio/ByteBuffer;");
-    jmethodID getRowStrideMethod = env->GetMethodID(planeClass, "getRowStride", "()I");
-
-    // Get the Y plane
-    jobject yPlane = env->GetObjectArrayElement(planesArray, 0);
-    jobject yBufferObj = env->CallObjectMethod(yPlane, getBufferMethod);
-    jint yRowStride = env->CallIntMethod(yPlane, getRowStrideMethod);
-    jbyte *yBuffer = (jbyte *) env->GetDirectBufferAddress(yBufferObj);
-    jint ySize = env->GetDirectBufferCapacity(yBufferObj);
-
-    // Get the U plane
-    jobject uPlane = env->GetObjectArrayElement(planesArray, 1);
-    jobject uBufferObj = env->CallObjectMethod(uPlane, getBufferMethod);
-    jint uRowStride = env->CallIntMethod(uPlane, getRowStrideMethod);
-    jbyte *uBuffer = (jbyte *) env->GetDirectBufferAddress(uBufferObj);
-    jint uSize = env->GetDirectBufferCapacity(uBufferObj);
-
-    // Get the V plane
-    jobject vPlane = env->GetObjectArrayElement(planesArray, 2);
-    jobject vBufferObj = env->CallObjectMethod(vPlane, getBufferMethod);
-    jint vRowStride = env->CallIntMethod(vPlane, getRowStrideMethod);
-    jbyte *vBuffer = (jbyte *) env->GetDirectBufferAddress(vBufferObj);
-    jint vSize = env->GetDirectBufferCapacity(vBufferObj);
-
-    // Allocate a byte array to hold the YUV data
-    jbyteArray yuvData = env->NewByteArray(ySize + uSize + vSize);
-    jbyte *yuvBuffer = env->GetByteArrayElements(yuvData, nullptr);
-
-    // Copy the Y plane data
-    memcpy(yuvBuffer, yBuffer, ySize);
-
-    // Copy the U plane data
-    memcpy(yuvBuffer + ySize, uBuffer, uSize);
+/**
+ * Adds an output to the consumer's output graph that keeps only its newest frame, width x height packed as
+ * layout (YuvUtils.PACKED_*), for readNativeOutput, e.g. a thumbnail or the input of a frame analyser.
+ * Paced, prioritised and scaled like addNativeOutput. Returns the output's index, -1 on failure.
+ */
+extern "C"
+JNIEXPORT jint JNICALL
+Java_com_qdev_singlesurfacedualquality_utils_YuvUtils_addNativeFrameOutput(JNIEnv *env, jobject thiz,
+                                                                           jint consumerId, jint width, jint height,
+                                                                           jint layout, jdouble frameRate,
+                                                                           jint priority, jint scaleFilter) {
+    YUVLayout packed = packedLayout(layout);
+    if (width <= 0 || height <= 0 || packed == YUVLayout::Generic) {
+        LOGE("Frame output %dx%d with layout %d is not supported", width, height, (int) layout);
+        return -1;
+    }
+    OutputGraph *graph = outputGraphToExtend(consumerId);
+    if (graph == nullptr) {
+        return -1;
+    }
+    auto *sink = new LatestFrameSink(width, height, packed);
+    int index = graph->addOutput(sink, outputProfile(width, height, frameRate, priority, scaleFilter));
+    if (index < 0) {
+        LOGE("Output graph of consumer %d refused the output", consumerId);
+        delete sink;
+        return -1;
+    }
+    consumerOutputs[consumerId].sinks.push_back(sink);
+    consumerOutputs[consumerId].frames[index] = sink;
+    return index;
+}
 
-    // Copy the V plane data
-    memcpy(yuvBuffer + ySize + uSize, vBuffer, vSize);
+// Starts feeding the outputs added to the consumer; they run until stopNativeFeeder or cleanupQueue
+extern "C"
+JNIEXPORT jboolean JNICALL
+Java_com_qdev_singlesurfacedualquality_utils_YuvUtils_startNativeOutputs(JNIEnv *env, jobject thiz,
+                                                                         jint consumerId) {
+    if (consumerId < 0 || consumerId >= FrameRing::kMaxConsumers) {
+        return false;
+    }
+    NativeOutputs &outputs = consumerOutputs[consumerId];
+    if (outputs.graph == nullptr || outputs.started || !outputs.graph->start()) {
+        LOGE("Outputs of consumer %d could not be started", consumerId);
+        stopNativeOutputs(consumerId);
+        return false;
+    }
+    outputs.started = true;
+    return true;
+}
 
-    // Release the byte array back to the JVM
-    env->ReleaseByteArrayElements(yuvData, yuvBuffer, 0);
+/**
+ * Copies the newest frame of a frame output (addNativeFrameOutput) into a direct ByteBuffer of at least
+ * getPackedFrameSize(width, height) bytes. Returns its presentation time (us), -1 when the output has no
+ * frame yet, is not a frame output or the buffer is too small.
+ */
+extern "C"
+JNIEXPORT jlong JNICALL
+Java_com_qdev_singlesurfacedualquality_utils_YuvUtils_readNativeOutput(JNIEnv *env, jobject thiz, jint consumerId,
+                                                                       jint output, jobject buffer) {
+    if (consumerId < 0 || consumerId >= FrameRing::kMaxConsumers || output < 0 ||
+        output >= OutputGraph::kMaxOutputs || consumerOutputs[consumerId].frames[output] == nullptr) {
+        return -1;
+    }
+    auto *dst = static_cast<uint8_t *>(env->GetDirectBufferAddress(buffer));
+    jlong capacity = env->GetDirectBufferCapacity(buffer);
+    if (dst == nullptr || capacity <= 0) {
+        LOGE("readNativeOutput needs a direct buffer");
+        return -1;
+    }
+    long long timestampUs = -1;
+    if (!consumerOutputs[consumerId].frames[output]->copyLatest(dst, (size_t) capacity, timestampUs)) {
+        return -1;
+    }
+    return timestampUs;
+}
 
-    // Return the byte array containing the YUV data
-    return yuvData;
+// Frames delivered and missed (no free buffer) per output of the consumer's graph, in pairs by output index;
+// empty without outputs
+extern "C"
+JNIEXPORT jlongArray JNICALL
+Java_com_qdev_singlesurfacedualquality_utils_YuvUtils_getNativeOutputStats(JNIEnv *env, jobject thiz,
+                                                                           jint consumerId) {
+    std::vector<jlong> values;
+    if (consumerId >= 0 && consumerId < FrameRing::kMaxConsumers && consumerOutputs[consumerId].graph != nullptr) {
+        const OutputGraph *graph = consumerOutputs[consumerId].graph;
+        for (int i = 0; i < graph->getOutputCount(); i++) {
+            values.push_back((jlong) graph->getDeliveredFrames(i));
+            values.push_back((jlong) graph->getMissedFrames(i));
+        }
+    }
+    jlongArray result = env->NewLongArray((jsize) values.size());
+    if (result != nullptr) {
+        env->SetLongArrayRegion(result, 0, (jsize) values.size(), values.data());
+    }
+    return result;
 }
 
+// The CPUs as read from /sys/devices/system/cpu, four values each: id, cluster (0 = slowest), capacity (0 when
+// not reported) and maximum frequency in kHz (0 when unknown). Layout must match CpuCore.fromArray.
+extern "C"
+JNIEXPORT jlongArray JNICALL
+Java_com_qdev_singlesurfacedualquality_utils_YuvUtils_getNativeCpuTopology(JNIEnv *env, jobject thiz) {
+    std::vector<jlong> values;
+    for (const CpuCore &core : threadPlacer.getTopology().getCores()) {
+        values.insert(values.end(), {core.id, core.cluster, core.capacity, core.maxFreqKhz});
+    }
+    jlongArray result = env->NewLongArray((jsize) values.size());
+    if (result != nullptr) {
+        env->SetLongArrayRegion(result, 0, (jsize) values.size(), values.data());
+    }
+    return result;
+}
 
-// JNI_OnLoad function to store the JavaVM reference
-JNIEXPORT jint JNICALL JNI_OnLoad(JavaVM *vm, void * /* reserved */) {
-    gJvm = vm;
-    return JNI_VERSION_1_6;
+/**
+ * Where the work of each ThreadRole ran, optionally clearing the counters: the cluster count, then per role
+ * the units of work (frames, bands) outside its clusters, the placements the kernel refused and the units
+ * of work per cluster. Layout must match PlacementStats.fromArray.
+ */
+extern "C"
+JNIEXPORT jlongArray JNICALL
+Java_com_qdev_singlesurfacedualquality_utils_YuvUtils_getNativePlacementStats(JNIEnv *env, jobject thiz,
+                                                                              jboolean reset) {
+    ThreadPlacer::Summary summary = threadPlacer.getSummary();
+    if (reset) {
+        threadPlacer.resetCounters();
+    }
+    std::vector<jlong> values = {summary.clusterCount};
+    for (int role = 0; role < (int) ThreadRole::Count; role++) {
+        values.push_back((jlong) summary.misplaced[role]);
+        values.push_back((jlong) summary.failures[role]);
+        values.insert(values.end(), summary.runs[role], summary.runs[role] + summary.clusterCount);
+    }
+    jlongArray result = env->NewLongArray((jsize) values.size());
+    if (result != nullptr) {
+        env->SetLongArrayRegion(result, 0, (jsize) values.size(), values.data());
+    }
+    return result;
 }
@@ -0,0 +1,109 @@
+#include "yuv_crop.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+constexpr int kFractionOne = 65535;
+
+int toFraction(float value) {
+    return (int) std::lround(std::min(1.0f, std::max(0.0f, value)) * kFractionOne);
+}
+
+// Position in 1/256 pixels moved onto the nearest even pixel when that is within 1/8 pixel
+long long snapToGrid(long long position) {
+    const long long grid = 2 * CropRect::kOne;
+    long long nearest = (position + grid / 2) / grid * grid;
+    return std::llabs(position - nearest) <= CropRect::kOne / 8 ? nearest : position;
+}
+
+// One axis of a region: [begin, begin + size) of extent pixels, in 1/256 pixels
+void resolveAxis(int begin, int size, int extent, int &position, int &length) {
+    long long full = (long long) extent * CropRect::kOne;
+    long long start = snapToGrid(begin * full / kFractionOne);
+    long long end = snapToGrid((begin + (long long) size) * full / kFractionOne);
+    long long minimum = std::min(full, (long long) CropControl::kMinimumSize * CropRect::kOne);
+    end = std::min(end, full);
+    if (end - start < minimum) {
+        // Grows around the centre, then back inside the frame
+        long long centre = (start + end) / 2;
+        start = std::max(0LL, std::min(full - minimum, centre - minimum / 2));
+        end = start + minimum;
+    }
+    position = (int) start;
+    length = (int) (end - start);
+}
+
+}  // namespace
+
+YUVImageView cropView(const YUVImageView &src, const CropRect &region) {
+    YUVImageView view = src;
+    view.width = region.width / CropRect::kOne;
+    view.height = region.height / CropRect::kOne;
+    int x = region.x / CropRect::kOne;
+    int y = region.y / CropRect::kOne;
+    view.data[0] += (size_t) y * src.rowStride[0] + (size_t) x * src.pixelStride[0];
+    for (int plane = 1; plane < 3; plane++) {
+        view.data[plane] += (size_t) (y / 2) * src.rowStride[plane] + (size_t) (x / 2) * src.pixelStride[plane];
+    }
+    return view;
+}
+
+void CropControl::set(float left, float top, float width, float height) {
+    if (!(width > 0.0f) || !(height > 0.0f)) {
+        reset();
+        return;
+    }
+    int l = toFraction(left);
+    int t = toFraction(top);
+    int w = std::max(1, std::min(kFractionOne - l, toFraction(width)));
+    int h = std::max(1, std::min(kFractionOne - t, toFraction(height)));
+    if (l == kFractionOne) {
+        l = kFractionOne - 1;
+    }
+    if (t == kFractionOne) {
+        t = kFractionOne - 1;
+    }
+    packed.store((uint64_t) l | (uint64_t) t << 16 | (uint64_t) w << 32 | (uint64_t) h << 48,
+                 std::memory_order_relaxed);
+}
+
+CropRect CropControl::resolve(int width, int height) const {
+    uint64_t value = packed.load(std::memory_order_relaxed);
+    if (value == kWhole) {
+        return CropRect::whole(width, height);
+    }
+    CropRect region;
+    resolveAxis((int) (value & 0xFFFF), (int) (value >> 32 & 0xFFFF), width, region.x, region.width);
+    resolveAxis((int) (value >> 16 & 0xFFFF), (int) (value >> 48 & 0xFFFF), height, region.y, region.height);
+    return region;
+}
+
+bool YUVCropper::crop(const YUVImageView &src, const CropRect &region, const YUVImageView &dst,
+                      ScaleFilter filter, WorkerPool *pool, int bandBytes) {
+    if (region.isAligned()) {
+        YUVImageView view = cropView(src, region);
+        if (view.width == dst.width && view.height == dst.height) {
+            converter.convert(view, dst, pool, bandBytes);
+            return true;
+        }
+        if (dst.width > view.width || dst.height > view.height) {
+            filter = ScaleFilter::Bilinear;
+        }
+        bool ready = scaler.isConfiguredFor(view.width, view.height, dst.width, dst.height, filter) ||
+                     scaler.configure(view.width, view.height, dst.width, dst.height, filter);
+        if (!ready) {
+            return false;
+        }
+        scaler.scale(view, dst, pool, bandBytes);
+        return true;
+    }
+    bool ready = scaler.isConfiguredFor(src.width, src.height, dst.width, dst.height, ScaleFilter::Bilinear, region) ||
+                 scaler.configure(src.width, src.height, dst.width, dst.height, ScaleFilter::Bilinear, region);
+    if (!ready) {
+        return false;
+    }
+    scaler.scale(src, dst, pool, bandBytes);
+    return true;
+}
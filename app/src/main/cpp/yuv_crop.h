@@ -0,0 +1,63 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+#include "worker_pool.h"
+#include "yuv_convert.h"
+#include "yuv_frame.h"
+#include "yuv_scaler.h"
+
+// The part of src an aligned region covers, without copying: plane pointers moved to the region's origin
+YUVImageView cropView(const YUVImageView &src, const CropRect &region);
+
+/**
+ * The digital zoom the preview gestures ask for, as a region of the frame in fractions of its size. The UI
+ * thread sets it, every copy reads it, so it lives in one atomic word: each fraction is 16 bits (1/65535).
+ */
+class CropControl {
+public:
+    // Smallest region resolve() hands out, in luma pixels
+    static constexpr int kMinimumSize = 16;
+
+    // Fractions of the frame; clamped into it, and a width or height of 0 or less goes back to the whole frame
+    void set(float left, float top, float width, float height);
+
+    void reset() {
+        packed.store(kWhole, std::memory_order_relaxed);
+    }
+
+    bool isWhole() const {
+        return packed.load(std::memory_order_relaxed) == kWhole;
+    }
+
+    // The region for a width x height frame in 1/256 pixels. Edges within 1/8 pixel of an even pixel snap to
+    // it, so a zoom at rest on the pixel grid is an aligned crop.
+    CropRect resolve(int width, int height) const;
+
+private:
+    static constexpr uint64_t kWhole = 0xFFFFFFFF00000000ULL;
+
+    // left | top << 16 | width << 32 | height << 48
+    std::atomic<uint64_t> packed{kWhole};
+};
+
+/**
+ * Copies a region of a frame into a destination of any size and layout. An aligned region of the
+ * destination's size is a plain conversion of the region's view, an aligned region of another size is
+ * scaled from that view, and a region at sub-pixel positions is resampled from the whole source with a
+ * windowed Bilinear scaler, which a smooth pinch produces between grid positions.
+ *
+ * Not thread-safe: keep one per output stream.
+ */
+class YUVCropper {
+public:
+    // filter is used for downscales only, Bilinear upscales. pool spreads the conversion or scale in bands.
+    // False, with nothing written, when the scaler does not support the sizes.
+    bool crop(const YUVImageView &src, const CropRect &region, const YUVImageView &dst, ScaleFilter filter,
+              WorkerPool *pool = nullptr, int bandBytes = YUVConverter::kDefaultBandBytes);
+
+private:
+    YUVConverter converter;
+    YUVScaler scaler;
+};
@@ -0,0 +1,103 @@
+#include "yuv_fanout.h"
+
+#include <algorithm>
+
+bool YUVFanOut::fanOut(const YUVImageView &src, const YUVImageView &hqDst, const YUVImageView &lqDst,
+                       ScaleFilter filter, int bandBytes, ImageStats *stats) {
+    bool ready = scaler.isConfiguredFor(src.width, src.height, lqDst.width, lqDst.height, filter) ||
+                 scaler.configure(src.width, src.height, lqDst.width, lqDst.height, filter);
+    if (!ready) {
+        return false;
+    }
+    converter.select(src, hqDst);
+    int rows = YUVConverter::chromaRows(src, hqDst);
+    int band = YUVConverter::bandRows(src, hqDst, bandBytes);
+
+    if (stats != nullptr) {
+        stats->clear();
+    }
+    // LQ rows already written, per plane
+    int scaled[3] = {0, 0, 0};
+    for (int begin = 0; begin < rows; begin += band) {
+        int end = std::min(begin + band, rows);
+        converter.convertRows(src, hqDst, begin, end, stats);
+        // After the last band the rest goes too, in case hqDst is smaller than the source
+        bool last = end == rows;
+        for (int plane = 0; plane < 3; plane++) {
+            int readRows = plane == 0 ? end * 2 : end;
+            int next = last ? scaler.planeRows(plane) : scaler.readyRows(plane, readRows);
+            if (next > scaled[plane]) {
+                scaler.scaleRows(src, lqDst, plane, scaled[plane], next);
+                scaled[plane] = next;
+            }
+        }
+    }
+    return true;
+}
+
+bool YUVMultiOut::fanOut(const YUVImageView &src, const Target *targets, int count, bool *written, int bandBytes,
+                         ImageStats *stats) {
+    if (count < 0 || count > kMaxTargets) {
+        return false;
+    }
+    if ((int) lanes.size() < count) {
+        lanes.resize(count);
+    }
+    // Lanes taking part in this frame; the first copy target sets the band height
+    int active[kMaxTargets];
+    int activeCount = 0;
+    const YUVImageView *bandTarget = &src;
+    for (int i = 0; i < count; i++) {
+        const YUVImageView &dst = targets[i].view;
+        Lane &lane = lanes[i];
+        written[i] = false;
+        if (dst.data[0] == nullptr) {
+            continue;
+        }
+        lane.copy = dst.width == src.width && dst.height == src.height;
+        if (lane.copy) {
+            lane.converter.select(src, dst);
+            if (bandTarget == &src) {
+                bandTarget = &dst;
+            }
+        } else {
+            ScaleFilter filter = targets[i].filter;
+            bool ready = lane.scaler.isConfiguredFor(src.width, src.height, dst.width, dst.height, filter) ||
+                         lane.scaler.configure(src.width, src.height, dst.width, dst.height, filter);
+            if (!ready) {
+                continue;
+            }
+            lane.scaled[0] = lane.scaled[1] = lane.scaled[2] = 0;
+        }
+        written[i] = true;
+        active[activeCount++] = i;
+    }
+
+    int rows = YUVConverter::chromaRows(src, src);
+    int band = YUVConverter::bandRows(src, *bandTarget, bandBytes);
+    if (stats != nullptr) {
+        stats->clear();
+    }
+    for (int begin = 0; begin < rows; begin += band) {
+        int end = std::min(begin + band, rows);
+        bool last = end == rows;
+        for (int a = 0; a < activeCount; a++) {
+            Lane &lane = lanes[active[a]];
+            const YUVImageView &dst = targets[active[a]].view;
+            if (lane.copy) {
+                // The band target is the first copy, so only it gathers
+                lane.converter.convertRows(src, dst, begin, end, &dst == bandTarget ? stats : nullptr);
+                continue;
+            }
+            for (int plane = 0; plane < 3; plane++) {
+                int readRows = plane == 0 ? end * 2 : end;
+                int next = last ? lane.scaler.planeRows(plane) : lane.scaler.readyRows(plane, readRows);
+                if (next > lane.scaled[plane]) {
+                    lane.scaler.scaleRows(src, dst, plane, lane.scaled[plane], next);
+                    lane.scaled[plane] = next;
+                }
+            }
+        }
+    }
+    return true;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <vector>
+
+#include "worker_pool.h"
+#include "yuv_convert.h"
+#include "yuv_frame.h"
+#include "yuv_scaler.h"
+
+/**
+ * Produces both outputs of one frame, the full-size copy (HQ) and the downscale (LQ), in a single pass
+ * over the source.
+ *
+ * Copying and scaling one after the other reads the whole source from memory twice, and a 4K frame is
+ * far larger than any cache, so the second pass finds none of it. fanOut() walks the source in bands
+ * of about bandBytes instead: it converts a band into the HQ destination, then scales every LQ row whose
+ * source rows have all been read while they are still in cache. On a bandwidth-bound SoC that halves
+ * the source traffic.
+ *
+ * The fused pass runs on the calling thread, since the scaler's row scratch is per instance. Not
+ * thread-safe: keep one per output pair.
+ */
+class YUVFanOut {
+public:
+    // Copies src into hqDst (any layouts) and downscales it into lqDst, gathering the copy's statistics
+    // into stats when given. False, with nothing written, when the scaler does not support the sizes.
+    bool fanOut(const YUVImageView &src, const YUVImageView &hqDst, const YUVImageView &lqDst, ScaleFilter filter,
+                int bandBytes = YUVConverter::kDefaultBandBytes, ImageStats *stats = nullptr);
+
+    // The copy alone, for frames the LQ stream passes over
+    void copy(const YUVImageView &src, const YUVImageView &hqDst, WorkerPool *pool = nullptr,
+              int bandBytes = YUVConverter::kDefaultBandBytes, ImageStats *stats = nullptr) {
+        converter.convert(src, hqDst, pool, bandBytes, stats);
+    }
+
+private:
+    YUVConverter converter;
+    YUVScaler scaler;
+};
+
+/**
+ * YUVFanOut for any number of outputs, e.g. an archive copy, a live stream, a thumbnail and an analytics
+ * frame off one camera frame. Targets of the source's size are converted, the others are scaled with
+ * their own filter, all in one banded walk over the source, so an extra output costs its own writes and
+ * arithmetic but no further read of the frame from memory.
+ *
+ * Each target index keeps its converter and scaler between frames, so keep indices stable. Runs on the
+ * calling thread. Not thread-safe.
+ */
+class YUVMultiOut {
+public:
+    static constexpr int kMaxTargets = 8;
+
+    struct Target {
+        // data[0] == nullptr leaves the target out of this frame
+        YUVImageView view;
+        // For targets of another size than the source
+        ScaleFilter filter = ScaleFilter::Area;
+    };
+
+    // Writes src into targets[0, count); written[i] is false for a target that was left out or whose
+    // size the scaler does not support (nothing is written to it). stats, when given, gets the statistics
+    // of the first target of the source's size; it is left cleared when there is none. False when count
+    // is out of range.
+    bool fanOut(const YUVImageView &src, const Target *targets, int count, bool *written,
+                int bandBytes = YUVConverter::kDefaultBandBytes, ImageStats *stats = nullptr);
+
+private:
+    struct Lane {
+        YUVConverter converter;
+        YUVScaler scaler;
+        bool copy = false;
+        // Destination rows already written, per plane
+        int scaled[3] = {0, 0, 0};
+    };
+
+    std::vector<Lane> lanes;
+};
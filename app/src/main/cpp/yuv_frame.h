@@ -0,0 +1,200 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// Raw pointers and strides of a YUV 4:2:0 image's three planes: a queued frame, a codec input Image, ...
+struct YUVImageView {
+    int width = 0;
+    int height = 0;
+    uint8_t *data[3] = {nullptr, nullptr, nullptr};
+    int rowStride[3] = {0, 0, 0};
+    int pixelStride[3] = {0, 0, 0};
+};
+
+struct YUVImagePlane {
+    // Memory frames are copied into, a FrameArena slice; null for frames that only ever borrow
+    uint8_t *storage = nullptr;
+    size_t storageCapacity = 0;
+    // Row stride used when a source's own rows do not fit the storage and are repacked
+    int storageRowStride = 0;
+    int pixelStride = 1;
+    int rowStride = 0;
+    // Set when the plane does not start at storage: memory owned by someone else (e.g. a camera AImage),
+    // or the second half of chroma stored interleaved in the other chroma plane's storage
+    const uint8_t *borrowedData = nullptr;
+
+    const uint8_t *data() const {
+        return borrowedData != nullptr ? borrowedData : storage;
+    }
+};
+
+// Bytes spanned by a plane from its first sample to its last, row padding after the last row excluded
+inline size_t planeExtent(int width, int height, int rowStride, int pixelStride) {
+    if (width <= 0 || height <= 0) {
+        return 0;
+    }
+    return (size_t) (height - 1) * rowStride + (size_t) (width - 1) * pixelStride + 1;
+}
+
+// Part of a frame in luma pixels, in 1/256 pixel steps so a zoom can move smoothly
+struct CropRect {
+    static constexpr int kOne = 256;
+
+    int x = 0;
+    int y = 0;
+    int width = 0;
+    int height = 0;
+
+    static CropRect whole(int width, int height) {
+        return {0, 0, width * kOne, height * kOne};
+    }
+
+    // On even pixels throughout, so chroma lines up and the crop is a pointer offset
+    bool isAligned() const {
+        return ((x | y | width | height) & (2 * kOne - 1)) == 0;
+    }
+
+    bool operator==(const CropRect &other) const {
+        return x == other.x && y == other.y && width == other.width && height == other.height;
+    }
+
+    bool operator!=(const CropRect &other) const {
+        return !(*this == other);
+    }
+};
+
+/**
+ * One queued frame: geometry, timestamps and a view of each plane. A frame owns no memory; copies go to
+ * the storage a FrameArena attached, borrowed frames point at their source's buffers. Frames can be
+ * moved but not copied, so reading one never duplicates its pixels by accident.
+ */
+class YUV420 {
+public:
+    int width = 0;
+    int height = 0;
+    // Capture time on the camera clock (CLOCK_BOOTTIME ns on device)
+    long long timestampNs = 0;
+    // steady_clock time the queue published the frame, for queue wait stats
+    long long enqueuedNs = 0;
+    YUVImagePlane planes[3];
+
+    YUV420() = default;
+
+    YUV420(const YUV420 &) = delete;
+    YUV420 &operator=(const YUV420 &) = delete;
+    YUV420(YUV420 &&) = default;
+    YUV420 &operator=(YUV420 &&) = default;
+
+    void attachStorage(int plane, uint8_t *storage, size_t capacity, int rowStride) {
+        planes[plane].storage = storage;
+        planes[plane].storageCapacity = capacity;
+        planes[plane].storageRowStride = rowStride;
+    }
+
+    // True when update() can copy a frame of this size into the attached storage
+    bool fits(int width, int height) const {
+        int chromaWidth = (width + 1) / 2;
+        int chromaHeight = (height + 1) / 2;
+        return planes[0].storage != nullptr && width <= planes[0].storageRowStride &&
+               (size_t) planes[0].storageRowStride * height <= planes[0].storageCapacity &&
+               2 * chromaWidth <= planes[1].storageRowStride &&
+               (size_t) planes[1].storageRowStride * chromaHeight <= planes[1].storageCapacity &&
+               2 * chromaWidth <= planes[2].storageRowStride &&
+               (size_t) planes[2].storageRowStride * chromaHeight <= planes[2].storageCapacity;
+    }
+
+    // Copies a frame into the attached storage; the caller checks fits() first
+    void update(int width, int height, long long timestampNs,
+                const uint8_t *yData, int yRowStride, int yPixelStride,
+                const uint8_t *uData, int uRowStride, int uPixelStride,
+                const uint8_t *vData, int vRowStride, int vPixelStride) {
+        this->width = width;
+        this->height = height;
+        this->timestampNs = timestampNs;
+        int chromaWidth = (width + 1) / 2;
+        int chromaHeight = (height + 1) / 2;
+
+        // Update Y plane, keeping the source row stride when its padded rows fit so they are copied whole
+        planes[0].borrowedData = nullptr;
+        copyPlane(planes[0], yData, width, height, yRowStride, yPixelStride);
+
+        bool interleaved = uPixelStride == 2 && vPixelStride == 2 && uRowStride == vRowStride &&
+                           (vData == uData + 1 || uData == vData + 1);
+        if (interleaved) {
+            // Semi-planar chroma: one copy of the interleaved block keeps it NV12/NV21 for the converters
+            const uint8_t *base = uData < vData ? uData : vData;
+            copyPlane(planes[1], base, 2 * chromaWidth, chromaHeight, uRowStride, 1);
+            planes[1].borrowedData = planes[1].storage + (uData - base);
+            planes[2].borrowedData = planes[1].storage + (vData - base);
+            planes[1].pixelStride = 2;
+            planes[2].pixelStride = 2;
+            planes[2].rowStride = planes[1].rowStride;
+            return;
+        }
+
+        // Update U plane
+        planes[1].borrowedData = nullptr;
+        copyPlane(planes[1], uData, chromaWidth, chromaHeight, uRowStride, uPixelStride);
+
+        // Update V plane
+        planes[2].borrowedData = nullptr;
+        copyPlane(planes[2], vData, chromaWidth, chromaHeight, vRowStride, vPixelStride);
+    }
+
+    // The frame is only read through the view, the const_cast just lets sources and destinations share a type
+    YUVImageView view() const {
+        YUVImageView view;
+        view.width = width;
+        view.height = height;
+        for (int i = 0; i < 3; i++) {
+            view.data[i] = const_cast<uint8_t *>(planes[i].data());
+            view.rowStride[i] = planes[i].rowStride;
+            view.pixelStride[i] = planes[i].pixelStride;
+        }
+        return view;
+    }
+
+    // Point the planes at externally owned memory instead of copying it. The caller keeps the
+    // memory alive until every reader is done with this frame.
+    void borrow(int width, int height, long long timestampNs,
+                const uint8_t *yData, int yRowStride, int yPixelStride,
+                const uint8_t *uData, int uRowStride, int uPixelStride,
+                const uint8_t *vData, int vRowStride, int vPixelStride) {
+        this->width = width;
+        this->height = height;
+        this->timestampNs = timestampNs;
+
+        planes[0].borrowedData = yData;
+        planes[0].rowStride = yRowStride;
+        planes[0].pixelStride = yPixelStride;
+
+        planes[1].borrowedData = uData;
+        planes[1].rowStride = uRowStride;
+        planes[1].pixelStride = uPixelStride;
+
+        planes[2].borrowedData = vData;
+        planes[2].rowStride = vRowStride;
+        planes[2].pixelStride = vPixelStride;
+    }
+
+private:
+    static void copyPlane(YUVImagePlane &plane, const uint8_t *src, int width, int height,
+                          int rowStride, int pixelStride) {
+        plane.pixelStride = pixelStride;
+        size_t extent = planeExtent(width, height, rowStride, pixelStride);
+        if (extent <= plane.storageCapacity) {
+            // One copy, row padding included
+            plane.rowStride = rowStride;
+            memcpy(plane.storage, src, extent);
+            return;
+        }
+        // The source's rows are padded more than the arena's, repack them at the arena's stride
+        size_t rowBytes = planeExtent(width, 1, rowStride, pixelStride);
+        plane.rowStride = plane.storageRowStride;
+        for (int row = 0; row < height; row++) {
+            memcpy(plane.storage + (size_t) row * plane.storageRowStride, src + (size_t) row * rowStride, rowBytes);
+        }
+    }
+};
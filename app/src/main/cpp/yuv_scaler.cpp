@@ -0,0 +1,305 @@
+#include "yuv_scaler.h"
+
+#include <algorithm>
+#include <atomic>
+
+namespace {
+
+// Bilinear mapping of the window [start, start + size) (in 1/256 samples) with pixel centres aligned;
+// weight is the share of index + 1 in 1/256ths
+void buildBilinearAxis(int srcSize, long long start, long long size, int dstSize, std::vector<int> &index,
+                       std::vector<int> &weight) {
+    index.resize(dstSize);
+    weight.resize(dstSize);
+    for (int d = 0; d < dstSize; d++) {
+        long long pos = start + ((2LL * d + 1) * size) / (2LL * dstSize) - 128;
+        pos = std::max(0LL, pos);
+        int i = (int) (pos >> 8);
+        int w = (int) (pos & 255);
+        if (i >= srcSize - 1) {
+            i = srcSize - 2;
+            w = 256;
+        }
+        index[d] = i;
+        weight[d] = w;
+    }
+}
+
+// Area mapping of the window [start, start + size) (in 1/256 samples, rounded to whole samples):
+// destination sample d covers source samples [index, index + count)
+void buildAreaAxis(int srcSize, long long start, long long size, int dstSize, std::vector<int> &index,
+                   std::vector<int> &count) {
+    index.resize(dstSize);
+    count.resize(dstSize);
+    long long first = (start + 128) >> 8;
+    long long samples = std::max(1LL, std::min((long long) srcSize - first, (size + 128) >> 8));
+    for (int d = 0; d < dstSize; d++) {
+        int begin = (int) (first + (long long) d * samples / dstSize);
+        int end = (int) (first + (long long) (d + 1) * samples / dstSize);
+        index[d] = std::min(begin, srcSize - 1);
+        count[d] = std::max(1, end - begin);
+    }
+}
+
+// Makes x indices relative to the first column they read; extent is how many columns past an index are read
+void trimColumns(std::vector<int> &index, const std::vector<int> &extent, bool extentIsCount, int &begin,
+                 int &count) {
+    begin = index.empty() ? 0 : index.front();
+    int end = begin;
+    for (size_t d = 0; d < index.size(); d++) {
+        begin = std::min(begin, index[d]);
+        end = std::max(end, index[d] + (extentIsCount ? extent[d] : 2));
+    }
+    for (int &i : index) {
+        i -= begin;
+    }
+    count = end - begin;
+}
+
+}  // namespace
+
+bool YUVScaler::configure(int srcWidth, int srcHeight, int dstWidth, int dstHeight, ScaleFilter filter,
+                          const CropRect &window) {
+    if (srcWidth < 4 || srcHeight < 4 || dstWidth < 4 || dstHeight < 4 ||
+        (srcWidth | srcHeight | dstWidth | dstHeight) & 1) {
+        return false;
+    }
+    if (window.x < 0 || window.y < 0 || window.width < 2 * CropRect::kOne || window.height < 2 * CropRect::kOne ||
+        (long long) window.x + window.width > (long long) srcWidth * CropRect::kOne ||
+        (long long) window.y + window.height > (long long) srcHeight * CropRect::kOne) {
+        return false;
+    }
+    bool whole = window == CropRect::whole(srcWidth, srcHeight);
+
+    this->srcWidth = srcWidth;
+    this->srcHeight = srcHeight;
+    this->dstWidth = dstWidth;
+    this->dstHeight = dstHeight;
+    this->window = window;
+    this->requestedFilter = filter;
+    this->filter = filter;
+    if (filter == ScaleFilter::Box && (!whole || srcWidth != dstWidth * 2 || srcHeight != dstHeight * 2)) {
+        this->filter = ScaleFilter::Area;
+    }
+
+    for (int p = 0; p < 2; p++) {
+        PlanePlan &plan = planePlans[p];
+        int shift = p == 0 ? 0 : 1;
+        plan.srcWidth = srcWidth >> shift;
+        plan.srcHeight = srcHeight >> shift;
+        plan.dstWidth = dstWidth >> shift;
+        plan.dstHeight = dstHeight >> shift;
+        plan.columnBegin = 0;
+        plan.columnCount = plan.srcWidth;
+        if (this->filter == ScaleFilter::Bilinear) {
+            buildBilinearAxis(plan.srcWidth, window.x >> shift, window.width >> shift, plan.dstWidth,
+                              plan.x.index, plan.x.weight);
+            buildBilinearAxis(plan.srcHeight, window.y >> shift, window.height >> shift, plan.dstHeight,
+                              plan.y.index, plan.y.weight);
+            trimColumns(plan.x.index, plan.x.weight, false, plan.columnBegin, plan.columnCount);
+            plan.xPairs.resize(plan.dstWidth * 2);
+            for (int d = 0; d < plan.dstWidth; d++) {
+                plan.xPairs[d * 2] = (uint16_t) (256 - plan.x.weight[d]);
+                plan.xPairs[d * 2 + 1] = (uint16_t) plan.x.weight[d];
+            }
+        } else if (this->filter == ScaleFilter::Area) {
+            buildAreaAxis(plan.srcWidth, window.x >> shift, window.width >> shift, plan.dstWidth,
+                          plan.x.index, plan.x.weight);
+            buildAreaAxis(plan.srcHeight, window.y >> shift, window.height >> shift, plan.dstHeight,
+                          plan.y.index, plan.y.weight);
+            trimColumns(plan.x.index, plan.x.weight, true, plan.columnBegin, plan.columnCount);
+        }
+    }
+
+    simd = &simdKernels();
+    sizeScratch(1);
+    return true;
+}
+
+void YUVScaler::sizeScratch(int lanes) {
+    if ((int) scratchSets.size() < lanes) {
+        scratchSets.resize(lanes);
+    }
+    for (Scratch &set : scratchSets) {
+        set.rowA.resize(srcWidth);
+        set.rowB.resize(srcWidth);
+        set.rowOut.resize(std::max(srcWidth, dstWidth));
+        set.rowSum.resize(srcWidth);
+        set.rowWideSum.resize(srcWidth);
+    }
+}
+
+const uint8_t *YUVScaler::loadRow(const uint8_t *src, int pixelStride, int width, uint8_t *scratch) {
+    if (pixelStride == 1) {
+        return src;
+    }
+    if (pixelStride == 2) {
+        simd->gatherEven(src, scratch, width);
+    } else {
+        for (int x = 0; x < width; x++) {
+            scratch[x] = src[x * pixelStride];
+        }
+    }
+    return scratch;
+}
+
+void YUVScaler::scale(const YUVImageView &src, const YUVImageView &dst) {
+    if (src.width != srcWidth || src.height != srcHeight || dst.width != dstWidth || dst.height != dstHeight) {
+        return;
+    }
+    for (int i = 0; i < 3; i++) {
+        scaleRows(src, dst, i, 0, planeRows(i));
+    }
+}
+
+void YUVScaler::scale(const YUVImageView &src, const YUVImageView &dst, WorkerPool *pool, int bandBytes) {
+    if (pool == nullptr) {
+        scale(src, dst);
+        return;
+    }
+    if (src.width != srcWidth || src.height != srcHeight || dst.width != dstWidth || dst.height != dstHeight) {
+        return;
+    }
+    int lanes = std::min(pool->getThreadCount(), kMaxLanes);
+    if ((int) scratchSets.size() < lanes) {
+        sizeScratch(lanes);
+    }
+    // Bands of chroma rows with the two luma rows over them, as YUVConverter bands a conversion. Each band
+    // claims a free scratch set; no more bands run at once than the pool has threads.
+    std::atomic<uint32_t> busy{0};
+    int rows = planePlans[1].dstHeight;
+    pool->run(rows, std::max(1, bandBytes / (dstWidth * 3)), [&](int begin, int end) {
+        int lane = 0;
+        while (busy.fetch_or(1u << lane, std::memory_order_acquire) & (1u << lane)) {
+            lane = (lane + 1) % lanes;
+        }
+        Scratch &set = scratchSets[lane];
+        scalePlane(planePlans[0], set, begin * 2, end * 2, src.data[0], src.rowStride[0], src.pixelStride[0],
+                   dst.data[0], dst.rowStride[0], dst.pixelStride[0]);
+        for (int plane = 1; plane < 3; plane++) {
+            scalePlane(planePlans[1], set, begin, end, src.data[plane], src.rowStride[plane],
+                       src.pixelStride[plane], dst.data[plane], dst.rowStride[plane], dst.pixelStride[plane]);
+        }
+        busy.fetch_and(~(1u << lane), std::memory_order_release);
+    });
+}
+
+void YUVScaler::scaleRows(const YUVImageView &src, const YUVImageView &dst, int plane, int dstRowBegin,
+                          int dstRowEnd) {
+    if (src.width != srcWidth || src.height != srcHeight || dst.width != dstWidth || dst.height != dstHeight) {
+        return;
+    }
+    const PlanePlan &plan = planePlans[plane == 0 ? 0 : 1];
+    scalePlane(plan, scratchSets[0], std::max(dstRowBegin, 0), std::min(dstRowEnd, plan.dstHeight),
+               src.data[plane], src.rowStride[plane], src.pixelStride[plane],
+               dst.data[plane], dst.rowStride[plane], dst.pixelStride[plane]);
+}
+
+int YUVScaler::lastSourceRow(const PlanePlan &plan, int dy) const {
+    if (filter == ScaleFilter::Box) {
+        return dy * 2 + 1;
+    }
+    if (filter == ScaleFilter::Bilinear) {
+        return plan.y.index[dy] + (plan.y.weight[dy] != 0 ? 1 : 0);
+    }
+    return plan.y.index[dy] + plan.y.weight[dy] - 1;
+}
+
+int YUVScaler::readyRows(int plane, int srcRows) const {
+    const PlanePlan &plan = planePlans[plane == 0 ? 0 : 1];
+    if (srcRows >= plan.srcHeight) {
+        return plan.dstHeight;
+    }
+    // The last row read never decreases down the destination, so the ready rows are a prefix
+    int low = 0;
+    int high = plan.dstHeight;
+    while (low < high) {
+        int mid = (low + high) / 2;
+        if (lastSourceRow(plan, mid) < srcRows) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+void YUVScaler::scalePlane(const PlanePlan &plan, Scratch &scratch, int dstRowBegin, int dstRowEnd,
+                           const uint8_t *src, int srcRowStride, int srcPixelStride,
+                           uint8_t *dst, int dstRowStride, int dstPixelStride) {
+    // Rows are only loaded from the first column the plan reads
+    src += (size_t) plan.columnBegin * srcPixelStride;
+    int columns = plan.columnCount;
+    for (int dy = dstRowBegin; dy < dstRowEnd; dy++) {
+        uint8_t *dstRow = dst + (size_t) dy * dstRowStride;
+        // Write straight into the destination when it is contiguous
+        uint8_t *out = dstPixelStride == 1 ? dstRow : scratch.rowOut.data();
+
+        if (filter == ScaleFilter::Box) {
+            const uint8_t *row0 = loadRow(src + (size_t) (dy * 2) * srcRowStride, srcPixelStride, columns, scratch.rowA.data());
+            const uint8_t *row1 = loadRow(src + (size_t) (dy * 2 + 1) * srcRowStride, srcPixelStride, columns, scratch.rowB.data());
+            simd->box2Row(row0, row1, out, plan.dstWidth);
+        } else if (filter == ScaleFilter::Bilinear) {
+            int sy = plan.y.index[dy];
+            int wy = plan.y.weight[dy];
+            const uint8_t *row0 = loadRow(src + (size_t) sy * srcRowStride, srcPixelStride, columns, scratch.rowA.data());
+            const uint8_t *blended = row0;
+            if (wy != 0) {
+                const uint8_t *row1 = loadRow(src + (size_t) (sy + 1) * srcRowStride, srcPixelStride, columns, scratch.rowB.data());
+                if (wy == 256) {
+                    blended = row1;
+                } else {
+                    simd->blendRows(row0, row1, wy, scratch.rowA.data(), columns);
+                    blended = scratch.rowA.data();
+                }
+            }
+            simd->lerpColumns(blended, plan.x.index.data(), plan.xPairs.data(), out, plan.dstWidth);
+        } else if (plan.y.weight[dy] > kMaxSummedRows) {
+            averageTallSpan(plan, scratch, src + (size_t) plan.y.index[dy] * srcRowStride, srcRowStride,
+                            srcPixelStride, plan.y.weight[dy], out);
+        } else {
+            int sy = plan.y.index[dy];
+            int rows = plan.y.weight[dy];
+            std::fill(scratch.rowSum.begin(), scratch.rowSum.begin() + columns, 0);
+            for (int r = 0; r < rows; r++) {
+                const uint8_t *row = loadRow(src + (size_t) (sy + r) * srcRowStride, srcPixelStride, columns, scratch.rowA.data());
+                simd->accumulateRow(row, scratch.rowSum.data(), columns);
+            }
+            simd->averageColumns(scratch.rowSum.data(), plan.x.index.data(), plan.x.weight.data(), rows, out,
+                                 plan.dstWidth);
+        }
+
+        if (dstPixelStride == 2) {
+            simd->scatterEven(out, dstRow, plan.dstWidth);
+        } else if (dstPixelStride != 1) {
+            for (int dx = 0; dx < plan.dstWidth; dx++) {
+                dstRow[dx * dstPixelStride] = out[dx];
+            }
+        }
+    }
+}
+
+void YUVScaler::averageTallSpan(const PlanePlan &plan, Scratch &scratch, const uint8_t *src, int srcRowStride,
+                                int srcPixelStride, int rows, uint8_t *out) {
+    // Only extreme downscales (a few output rows from a tall frame) get here, so the wide sums stay scalar
+    int columns = plan.columnCount;
+    std::fill(scratch.rowWideSum.begin(), scratch.rowWideSum.begin() + columns, 0);
+    for (int chunk = 0; chunk < rows; chunk += kMaxSummedRows) {
+        std::fill(scratch.rowSum.begin(), scratch.rowSum.begin() + columns, 0);
+        for (int r = chunk; r < std::min(chunk + kMaxSummedRows, rows); r++) {
+            const uint8_t *row = loadRow(src + (size_t) r * srcRowStride, srcPixelStride, columns, scratch.rowA.data());
+            simd->accumulateRow(row, scratch.rowSum.data(), columns);
+        }
+        for (int x = 0; x < columns; x++) {
+            scratch.rowWideSum[x] += scratch.rowSum[x];
+        }
+    }
+    for (int dx = 0; dx < plan.dstWidth; dx++) {
+        uint64_t total = 0;
+        for (int c = 0; c < plan.x.weight[dx]; c++) {
+            total += scratch.rowWideSum[plan.x.index[dx] + c];
+        }
+        uint64_t samples = (uint64_t) plan.x.weight[dx] * rows;
+        out[dx] = (uint8_t) ((total + samples / 2) / samples);
+    }
+}
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "worker_pool.h"
+#include "yuv_frame.h"
+#include "yuv_simd.h"
+
+enum class ScaleFilter {
+    // 2x2 average; only exact 2:1 ratios, anything else falls back to Area
+    Box = 0,
+    Bilinear = 1,
+    // Average of every source pixel a destination pixel covers, best for large downscale ratios
+    Area = 2,
+};
+
+/**
+ * Downscales YUV 4:2:0 frames (planar or semi-planar, any row/pixel strides) straight into a
+ * destination image, e.g. the LQ codec's input Image.
+ *
+ * configure() precomputes the per-column and per-row source mapping once per size change, scale()
+ * then only walks rows. A window limits the mapping to part of the source, at sub-pixel positions for
+ * Bilinear (which upscales as well), so a digital zoom resamples straight from the full frame; only
+ * the columns the window covers are loaded. Not thread-safe: keep one scaler per output stream (a pooled
+ * scale() keeps row scratch per band itself).
+ */
+class YUVScaler {
+public:
+    // Returns false for unsupported sizes (zero or odd dimensions)
+    bool configure(int srcWidth, int srcHeight, int dstWidth, int dstHeight, ScaleFilter filter) {
+        return configure(srcWidth, srcHeight, dstWidth, dstHeight, filter, CropRect::whole(srcWidth, srcHeight));
+    }
+
+    // Scales only window of the source. Box needs the whole frame; Area rounds the window to whole pixels.
+    // False as well when the window is not inside the source or is under 2 pixels.
+    bool configure(int srcWidth, int srcHeight, int dstWidth, int dstHeight, ScaleFilter filter,
+                   const CropRect &window);
+
+    bool isConfiguredFor(int srcWidth, int srcHeight, int dstWidth, int dstHeight, ScaleFilter filter) const {
+        return isConfiguredFor(srcWidth, srcHeight, dstWidth, dstHeight, filter,
+                               CropRect::whole(srcWidth, srcHeight));
+    }
+
+    bool isConfiguredFor(int srcWidth, int srcHeight, int dstWidth, int dstHeight, ScaleFilter filter,
+                         const CropRect &window) const {
+        return srcWidth == this->srcWidth && srcHeight == this->srcHeight &&
+               dstWidth == this->dstWidth && dstHeight == this->dstHeight && filter == requestedFilter &&
+               window == this->window;
+    }
+
+    void scale(const YUVImageView &src, const YUVImageView &dst);
+
+    // Spreads the rows over pool in bands of about bandBytes of output, as YUVConverter::convert does;
+    // without a pool it is the plain scale()
+    void scale(const YUVImageView &src, const YUVImageView &dst, WorkerPool *pool, int bandBytes);
+
+    // Scales rows [dstRowBegin, dstRowEnd) of one plane (0 = Y, 1 = U, 2 = V), so a caller walking the
+    // source in bands can produce each destination row while the rows it reads are still in cache
+    void scaleRows(const YUVImageView &src, const YUVImageView &dst, int plane, int dstRowBegin, int dstRowEnd);
+
+    // Leading destination rows of plane that only read the plane's first srcRows source rows
+    int readyRows(int plane, int srcRows) const;
+
+    // Destination rows of plane
+    int planeRows(int plane) const {
+        return planePlans[plane == 0 ? 0 : 1].dstHeight;
+    }
+
+private:
+    // Source mapping of one axis of one plane
+    struct AxisPlan {
+        // Bilinear: first source index and weight of the next one (0..256)
+        // Area: first source index and number of source samples covered
+        std::vector<int> index;
+        std::vector<int> weight;
+    };
+
+    struct PlanePlan {
+        int srcWidth = 0;
+        int srcHeight = 0;
+        int dstWidth = 0;
+        int dstHeight = 0;
+        // Source columns a row load covers; x indices are relative to columnBegin
+        int columnBegin = 0;
+        int columnCount = 0;
+        AxisPlan x;
+        AxisPlan y;
+        // Bilinear: x weights as the pairs lerpColumns takes, 256 - weight then weight
+        std::vector<uint16_t> xPairs;
+    };
+
+    // Row scratch of one band in flight
+    struct Scratch {
+        std::vector<uint8_t> rowA;
+        std::vector<uint8_t> rowB;
+        std::vector<uint8_t> rowOut;
+        std::vector<uint16_t> rowSum;
+        // Area rows past kMaxSummedRows, added up chunk by chunk
+        std::vector<uint32_t> rowWideSum;
+    };
+
+    // Rows of 255 a uint16 column sum holds; taller Area spans go through rowWideSum
+    static constexpr int kMaxSummedRows = 257;
+
+    // Most bands a pooled scale() runs at once, one bit of its lane mask each
+    static constexpr int kMaxLanes = 32;
+
+    // At least lanes scratch sets, each sized for the configured plan
+    void sizeScratch(int lanes);
+
+    void scalePlane(const PlanePlan &plan, Scratch &scratch, int dstRowBegin, int dstRowEnd,
+                    const uint8_t *src, int srcRowStride, int srcPixelStride,
+                    uint8_t *dst, int dstRowStride, int dstPixelStride);
+
+    // Last source row destination row dy of plan reads
+    int lastSourceRow(const PlanePlan &plan, int dy) const;
+
+    const uint8_t *loadRow(const uint8_t *src, int pixelStride, int width, uint8_t *scratch);
+
+    // Area average of the rows source rows from src into out, for spans over kMaxSummedRows
+    void averageTallSpan(const PlanePlan &plan, Scratch &scratch, const uint8_t *src, int srcRowStride,
+                         int srcPixelStride, int rows, uint8_t *out);
+
+    int srcWidth = 0;
+    int srcHeight = 0;
+    int dstWidth = 0;
+    int dstHeight = 0;
+    CropRect window;
+    ScaleFilter requestedFilter = ScaleFilter::Area;
+    ScaleFilter filter = ScaleFilter::Area;
+    PlanePlan planePlans[2];  // luma, chroma
+    const SimdKernels *simd = nullptr;
+
+    // Row scratch, the first for scaleRows(), one per pool thread for a pooled scale(); sized in configure()
+    // and on the first pooled scale(), so scaling never allocates after that
+    std::vector<Scratch> scratchSets;
+};
@@ -0,0 +1,111 @@
+#include "yuv_simd.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__arm__) && defined(__linux__)
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+
+namespace {
+
+// Each probe is only built where backends() asks for it
+#if defined(__x86_64__) || defined(__i386__)
+bool cpuHasSse2() {
+#if defined(__x86_64__)
+    return true;
+#else
+    return __builtin_cpu_supports("sse2");
+#endif
+}
+
+bool cpuHasAvx2() {
+    return __builtin_cpu_supports("avx2");
+}
+#endif
+
+#if defined(__aarch64__) || defined(__arm__)
+bool cpuHasNeon() {
+#if defined(__aarch64__)
+    return true;
+#elif defined(__linux__)
+    return (getauxval(AT_HWCAP) & HWCAP_NEON) != 0;
+#else
+    return false;
+#endif
+}
+#endif
+
+struct Backends {
+    const SimdKernels *list[5] = {};
+    int count = 0;
+
+    void add(const SimdKernels &kernels) {
+        list[count++] = &kernels;
+    }
+};
+
+const Backends &backends() {
+    static const Backends available = [] {
+        Backends result;
+        result.add(scalarKernels());
+#if defined(__x86_64__) || defined(__i386__)
+        if (cpuHasSse2()) {
+            result.add(sse2Kernels());
+        }
+        if (cpuHasAvx2()) {
+            result.add(avx2Kernels());
+        }
+#endif
+#if defined(__aarch64__) || defined(__arm__)
+        if (cpuHasNeon()) {
+            result.add(neonKernels());
+        }
+#endif
+        return result;
+    }();
+    return available;
+}
+
+const SimdKernels *findKernels(const char *name) {
+    const Backends &available = backends();
+    for (int i = 0; i < available.count; i++) {
+        if (strcmp(available.list[i]->name, name) == 0) {
+            return available.list[i];
+        }
+    }
+    return nullptr;
+}
+
+std::atomic<const SimdKernels *> selected{nullptr};
+
+}  // namespace
+
+const SimdKernels &simdKernels() {
+    const SimdKernels *kernels = selected.load(std::memory_order_acquire);
+    if (kernels == nullptr) {
+        const char *forced = getenv("YUV_SIMD");
+        kernels = forced != nullptr ? findKernels(forced) : nullptr;
+        if (kernels == nullptr) {
+            const Backends &available = backends();
+            kernels = available.list[available.count - 1];
+        }
+        selected.store(kernels, std::memory_order_release);
+    }
+    return *kernels;
+}
+
+const SimdKernels *const *availableSimdKernels() {
+    return backends().list;
+}
+
+bool selectSimdKernels(const char *name) {
+    const SimdKernels *kernels = findKernels(name);
+    if (kernels == nullptr) {
+        return false;
+    }
+    selected.store(kernels, std::memory_order_release);
+    return true;
+}
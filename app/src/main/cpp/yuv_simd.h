@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstdint>
+
+/**
+ * Row kernels shared by the converter, the scaler, the motion detector and the image statistics, one table
+ * per instruction set.
+ *
+ * Each backend lives in its own translation unit compiled with just the flags it needs (NEON on
+ * ARMv7, AVX2 on x86), so the rest of the library builds for any ABI. simdKernels() picks the best
+ * table the CPU supports the first time it is called. Plane copies stay on memcpy, which the C
+ * library already tunes per CPU.
+ *
+ * Widths are in output pixels. Interleaved rows hold width pairs (2 * width bytes).
+ */
+struct SimdKernels {
+    const char *name;
+
+    // Interleaved pairs -> two planes: d0[x] = src[2x], d1[x] = src[2x + 1]
+    void (*splitPairs)(const uint8_t *src, uint8_t *d0, uint8_t *d1, int width);
+
+    // Two planes -> interleaved pairs: dst[2x] = s0[x], dst[2x + 1] = s1[x]
+    void (*mergePairs)(const uint8_t *s0, const uint8_t *s1, uint8_t *dst, int width);
+
+    // Swaps the bytes of every pair (NV12 <-> NV21)
+    void (*swapPairs)(const uint8_t *src, uint8_t *dst, int width);
+
+    // out[x] = src[2x]
+    void (*gatherEven)(const uint8_t *src, uint8_t *out, int width);
+
+    // dst[2x] = row[x], leaving the odd bytes as they are; never touches dst past dst[2 * width - 2]
+    void (*scatterEven)(const uint8_t *row, uint8_t *dst, int width);
+
+    // 2x2 average of two source rows into dstWidth pixels
+    void (*box2Row)(const uint8_t *row0, const uint8_t *row1, uint8_t *out, int dstWidth);
+
+    // out = (row0 * (256 - weight) + row1 * weight) / 256, rounded; weight in 1..255
+    void (*blendRows)(const uint8_t *row0, const uint8_t *row1, int weight, uint8_t *out, int width);
+
+    // sum[x] += row[x]
+    void (*accumulateRow)(const uint8_t *row, uint16_t *sum, int width);
+
+    // Horizontal bilinear: out[x] = (row[i] * weights[2x] + row[i + 1] * weights[2x + 1]) / 256, rounded, with
+    // i = index[x]; the two weights of a column add up to 256
+    void (*lerpColumns)(const uint8_t *row, const int *index, const uint16_t *weights, uint8_t *out, int width);
+
+    // Horizontal area average of column sums over rows rows: out[x] = the rounded mean of the count[x] * rows
+    // samples in sum[index[x]] .. sum[index[x] + count[x] - 1]
+    void (*averageColumns)(const uint16_t *sum, const int *index, const int *count, int rows, uint8_t *out,
+                           int width);
+
+    // sums[i] += sum of |a[x] - b[x]| over the 16 bytes of block i, for blocks 16-byte blocks
+    void (*sadBlocks)(const uint8_t *a, const uint8_t *b, uint32_t *sums, int blocks);
+
+    // sums[0] += sum of row[x], sums[1] += sum of row[x]^2
+    void (*rowMoments)(const uint8_t *row, int width, uint64_t *sums);
+
+    // sums[0] += sum of row[2x], sums[1] += sum of row[2x + 1], over width pairs
+    void (*pairSums)(const uint8_t *row, int width, uint64_t *sums);
+};
+
+// Best backend for this CPU; the YUV_SIMD environment variable (scalar, sse2, avx2, neon) overrides it
+const SimdKernels &simdKernels();
+
+// Every backend built into the library that this CPU can run, best last, nullptr-terminated
+const SimdKernels *const *availableSimdKernels();
+
+// Switches the backend returned by simdKernels() (benchmarks, tests); false if name is not available.
+// Converters and scalers pick the table up the next time they select kernels or are configured.
+bool selectSimdKernels(const char *name);
+
+// Backend tables, defined in yuv_simd_<name>.cpp
+const SimdKernels &scalarKernels();
+#if defined(__x86_64__) || defined(__i386__)
+const SimdKernels &sse2Kernels();
+const SimdKernels &avx2Kernels();
+#endif
+#if defined(__aarch64__) || defined(__arm__)
+const SimdKernels &neonKernels();
+#endif
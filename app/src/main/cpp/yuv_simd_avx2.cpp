@@ -0,0 +1,205 @@
+// Built with -mavx2; only reached when the CPU reports AVX2
+#include "yuv_simd.h"
+
+#include <immintrin.h>
+
+namespace {
+
+const SimdKernels &tail() {
+    return sse2Kernels();
+}
+
+__m256i load(const uint8_t *p) {
+    return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+}
+
+void store(uint8_t *p, __m256i v) {
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(p), v);
+}
+
+// Widens 16 bytes to 16-bit lanes in order
+__m256i widen(const uint8_t *p) {
+    return _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p)));
+}
+
+// Narrows 16 16-bit lanes (all <= 255) back to 16 bytes in order
+void narrowStore(uint8_t *p, __m256i v) {
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(p),
+                     _mm_packus_epi16(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1)));
+}
+
+// packus works per 128-bit lane; puts the four 64-bit quarters back in source order
+__m256i packOrdered(__m256i a, __m256i b) {
+    return _mm256_permute4x64_epi64(_mm256_packus_epi16(a, b), 0xd8);
+}
+
+void splitPairs(const uint8_t *src, uint8_t *d0, uint8_t *d1, int width) {
+    const __m256i low = _mm256_set1_epi16(0x00ff);
+    int x = 0;
+    for (; x <= width - 32; x += 32) {
+        __m256i a = load(src + x * 2);
+        __m256i b = load(src + x * 2 + 32);
+        store(d0 + x, packOrdered(_mm256_and_si256(a, low), _mm256_and_si256(b, low)));
+        store(d1 + x, packOrdered(_mm256_srli_epi16(a, 8), _mm256_srli_epi16(b, 8)));
+    }
+    tail().splitPairs(src + x * 2, d0 + x, d1 + x, width - x);
+}
+
+void mergePairs(const uint8_t *s0, const uint8_t *s1, uint8_t *dst, int width) {
+    int x = 0;
+    for (; x <= width - 32; x += 32) {
+        __m256i a = load(s0 + x);
+        __m256i b = load(s1 + x);
+        // unpack works per 128-bit lane: lo holds pairs 0-7 and 16-23, hi pairs 8-15 and 24-31
+        __m256i lo = _mm256_unpacklo_epi8(a, b);
+        __m256i hi = _mm256_unpackhi_epi8(a, b);
+        store(dst + x * 2, _mm256_permute2x128_si256(lo, hi, 0x20));
+        store(dst + x * 2 + 32, _mm256_permute2x128_si256(lo, hi, 0x31));
+    }
+    tail().mergePairs(s0 + x, s1 + x, dst + x * 2, width - x);
+}
+
+void swapPairs(const uint8_t *src, uint8_t *dst, int width) {
+    int x = 0;
+    for (; x <= width - 16; x += 16) {
+        __m256i v = load(src + x * 2);
+        store(dst + x * 2, _mm256_or_si256(_mm256_slli_epi16(v, 8), _mm256_srli_epi16(v, 8)));
+    }
+    tail().swapPairs(src + x * 2, dst + x * 2, width - x);
+}
+
+void gatherEven(const uint8_t *src, uint8_t *out, int width) {
+    const __m256i low = _mm256_set1_epi16(0x00ff);
+    int x = 0;
+    for (; x <= width - 32; x += 32) {
+        __m256i a = _mm256_and_si256(load(src + x * 2), low);
+        __m256i b = _mm256_and_si256(load(src + x * 2 + 32), low);
+        store(out + x, packOrdered(a, b));
+    }
+    tail().gatherEven(src + x * 2, out + x, width - x);
+}
+
+void scatterEven(const uint8_t *row, uint8_t *dst, int width) {
+    const __m256i high = _mm256_set1_epi16((short) 0xff00);
+    int x = 0;
+    // The last pair's second byte may be past the end of the plane, keep the vector loop clear of it
+    for (; x <= width - 33; x += 32) {
+        __m256i lo = _mm256_or_si256(_mm256_and_si256(load(dst + x * 2), high), widen(row + x));
+        __m256i hi = _mm256_or_si256(_mm256_and_si256(load(dst + x * 2 + 32), high), widen(row + x + 16));
+        store(dst + x * 2, lo);
+        store(dst + x * 2 + 32, hi);
+    }
+    tail().scatterEven(row + x, dst + x * 2, width - x);
+}
+
+// Sum of each byte pair as 16-bit lanes
+__m256i pairSums(__m256i v) {
+    return _mm256_add_epi16(_mm256_and_si256(v, _mm256_set1_epi16(0x00ff)), _mm256_srli_epi16(v, 8));
+}
+
+void box2Row(const uint8_t *row0, const uint8_t *row1, uint8_t *out, int dstWidth) {
+    const __m256i two = _mm256_set1_epi16(2);
+    int x = 0;
+    for (; x <= dstWidth - 16; x += 16) {
+        __m256i sum = _mm256_add_epi16(pairSums(load(row0 + x * 2)), pairSums(load(row1 + x * 2)));
+        narrowStore(out + x, _mm256_srli_epi16(_mm256_add_epi16(sum, two), 2));
+    }
+    tail().box2Row(row0 + x * 2, row1 + x * 2, out + x, dstWidth - x);
+}
+
+void blendRows(const uint8_t *row0, const uint8_t *row1, int weight, uint8_t *out, int width) {
+    const __m256i w0 = _mm256_set1_epi16((short) (256 - weight));
+    const __m256i w1 = _mm256_set1_epi16((short) weight);
+    const __m256i half = _mm256_set1_epi16(128);
+    int x = 0;
+    for (; x <= width - 16; x += 16) {
+        __m256i blended = _mm256_add_epi16(_mm256_mullo_epi16(widen(row0 + x), w0),
+                                           _mm256_mullo_epi16(widen(row1 + x), w1));
+        narrowStore(out + x, _mm256_srli_epi16(_mm256_add_epi16(blended, half), 8));
+    }
+    tail().blendRows(row0 + x, row1 + x, weight, out + x, width - x);
+}
+
+void accumulateRow(const uint8_t *row, uint16_t *sum, int width) {
+    int x = 0;
+    for (; x <= width - 16; x += 16) {
+        auto *s = reinterpret_cast<__m256i *>(sum + x);
+        _mm256_storeu_si256(s, _mm256_add_epi16(_mm256_loadu_si256(s), widen(row + x)));
+    }
+    tail().accumulateRow(row + x, sum + x, width - x);
+}
+
+// The column kernels load their samples one by one, wider vectors gain nothing over SSE2
+void lerpColumns(const uint8_t *row, const int *index, const uint16_t *weights, uint8_t *out, int width) {
+    tail().lerpColumns(row, index, weights, out, width);
+}
+
+void averageColumns(const uint16_t *sum, const int *index, const int *count, int rows, uint8_t *out, int width) {
+    tail().averageColumns(sum, index, count, rows, out, width);
+}
+
+void sadBlocks(const uint8_t *a, const uint8_t *b, uint32_t *sums, int blocks) {
+    int i = 0;
+    for (; i <= blocks - 2; i += 2) {
+        // One 64-bit sum per 8 bytes: lanes 0-1 are block i, lanes 2-3 block i + 1
+        __m256i sad = _mm256_sad_epu8(load(a + i * 16), load(b + i * 16));
+        __m128i low = _mm256_castsi256_si128(sad);
+        __m128i high = _mm256_extracti128_si256(sad, 1);
+        sums[i] += (uint32_t) (_mm_cvtsi128_si32(low) + _mm_cvtsi128_si32(_mm_srli_si128(low, 8)));
+        sums[i + 1] += (uint32_t) (_mm_cvtsi128_si32(high) + _mm_cvtsi128_si32(_mm_srli_si128(high, 8)));
+    }
+    tail().sadBlocks(a + i * 16, b + i * 16, sums + i, blocks - i);
+}
+
+// Adds the four 64-bit lanes
+uint64_t sumLanes(__m256i v) {
+    __m128i half = _mm_add_epi64(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    uint64_t lanes[2];
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(lanes), half);
+    return lanes[0] + lanes[1];
+}
+
+void rowMoments(const uint8_t *row, int width, uint64_t *sums) {
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i sum = zero;
+    // 32-bit lanes take 4 * 255^2 per 32 bytes, which fits any row width this library sees
+    __m256i squares = zero;
+    int x = 0;
+    for (; x <= width - 32; x += 32) {
+        __m256i v = load(row + x);
+        sum = _mm256_add_epi64(sum, _mm256_sad_epu8(v, zero));
+        __m256i low = _mm256_unpacklo_epi8(v, zero);
+        __m256i high = _mm256_unpackhi_epi8(v, zero);
+        squares = _mm256_add_epi32(squares,
+                                   _mm256_add_epi32(_mm256_madd_epi16(low, low), _mm256_madd_epi16(high, high)));
+    }
+    sums[0] += sumLanes(sum);
+    sums[1] += sumLanes(_mm256_add_epi64(_mm256_unpacklo_epi32(squares, zero), _mm256_unpackhi_epi32(squares, zero)));
+    tail().rowMoments(row + x, width - x, sums);
+}
+
+void pairSums(const uint8_t *row, int width, uint64_t *sums) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i low = _mm256_set1_epi16(0x00ff);
+    __m256i sum0 = zero;
+    __m256i sum1 = zero;
+    int x = 0;
+    for (; x <= width - 16; x += 16) {
+        __m256i v = load(row + x * 2);
+        sum0 = _mm256_add_epi64(sum0, _mm256_sad_epu8(_mm256_and_si256(v, low), zero));
+        sum1 = _mm256_add_epi64(sum1, _mm256_sad_epu8(_mm256_srli_epi16(v, 8), zero));
+    }
+    sums[0] += sumLanes(sum0);
+    sums[1] += sumLanes(sum1);
+    tail().pairSums(row + x * 2, width - x, sums);
+}
+
+}  // namespace
+
+const SimdKernels &avx2Kernels() {
+    static const SimdKernels kernels = {
+            "avx2", splitPairs, mergePairs, swapPairs, gatherEven, scatterEven, box2Row, blendRows, accumulateRow,
+            lerpColumns, averageColumns, sadBlocks, rowMoments, pairSums,
+    };
+    return kernels;
+}
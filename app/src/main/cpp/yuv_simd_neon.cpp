@@ -0,0 +1,204 @@
+// Built with -mfpu=neon on ARMv7; NEON is part of the base instruction set on AArch64
+#include "yuv_simd.h"
+
+#include <cstring>
+
+#include <arm_neon.h>
+
+namespace {
+
+const SimdKernels &tail() {
+    return scalarKernels();
+}
+
+void splitPairs(const uint8_t *src, uint8_t *d0, uint8_t *d1, int width) {
+    int x = 0;
+    for (; x <= width - 16; x += 16) {
+        uint8x16x2_t pair = vld2q_u8(src + x * 2);
+        vst1q_u8(d0 + x, pair.val[0]);
+        vst1q_u8(d1 + x, pair.val[1]);
+    }
+    tail().splitPairs(src + x * 2, d0 + x, d1 + x, width - x);
+}
+
+void mergePairs(const uint8_t *s0, const uint8_t *s1, uint8_t *dst, int width) {
+    int x = 0;
+    for (; x <= width - 16; x += 16) {
+        uint8x16x2_t pair;
+        pair.val[0] = vld1q_u8(s0 + x);
+        pair.val[1] = vld1q_u8(s1 + x);
+        vst2q_u8(dst + x * 2, pair);
+    }
+    tail().mergePairs(s0 + x, s1 + x, dst + x * 2, width - x);
+}
+
+void swapPairs(const uint8_t *src, uint8_t *dst, int width) {
+    int x = 0;
+    for (; x <= width - 8; x += 8) {
+        vst1q_u8(dst + x * 2, vrev16q_u8(vld1q_u8(src + x * 2)));
+    }
+    tail().swapPairs(src + x * 2, dst + x * 2, width - x);
+}
+
+void gatherEven(const uint8_t *src, uint8_t *out, int width) {
+    int x = 0;
+    for (; x <= width - 16; x += 16) {
+        uint8x16x2_t pair = vld2q_u8(src + x * 2);
+        vst1q_u8(out + x, pair.val[0]);
+    }
+    tail().gatherEven(src + x * 2, out + x, width - x);
+}
+
+void scatterEven(const uint8_t *row, uint8_t *dst, int width) {
+    int x = 0;
+    // The last pair's second byte may be past the end of the plane, keep the vector loop clear of it
+    for (; x <= width - 17; x += 16) {
+        uint8x16x2_t pair = vld2q_u8(dst + x * 2);
+        pair.val[0] = vld1q_u8(row + x);
+        vst2q_u8(dst + x * 2, pair);
+    }
+    tail().scatterEven(row + x, dst + x * 2, width - x);
+}
+
+void box2Row(const uint8_t *row0, const uint8_t *row1, uint8_t *out, int dstWidth) {
+    int x = 0;
+    for (; x <= dstWidth - 16; x += 16) {
+        uint16x8_t lo = vaddq_u16(vpaddlq_u8(vld1q_u8(row0 + x * 2)), vpaddlq_u8(vld1q_u8(row1 + x * 2)));
+        uint16x8_t hi = vaddq_u16(vpaddlq_u8(vld1q_u8(row0 + x * 2 + 16)), vpaddlq_u8(vld1q_u8(row1 + x * 2 + 16)));
+        vst1q_u8(out + x, vcombine_u8(vrshrn_n_u16(lo, 2), vrshrn_n_u16(hi, 2)));
+    }
+    tail().box2Row(row0 + x * 2, row1 + x * 2, out + x, dstWidth - x);
+}
+
+void blendRows(const uint8_t *row0, const uint8_t *row1, int weight, uint8_t *out, int width) {
+    int x = 0;
+    uint8x8_t w0 = vdup_n_u8((uint8_t) (256 - weight));
+    uint8x8_t w1 = vdup_n_u8((uint8_t) weight);
+    for (; x <= width - 16; x += 16) {
+        uint8x16_t a = vld1q_u8(row0 + x);
+        uint8x16_t b = vld1q_u8(row1 + x);
+        uint16x8_t lo = vmlal_u8(vmull_u8(vget_low_u8(a), w0), vget_low_u8(b), w1);
+        uint16x8_t hi = vmlal_u8(vmull_u8(vget_high_u8(a), w0), vget_high_u8(b), w1);
+        vst1q_u8(out + x, vcombine_u8(vrshrn_n_u16(lo, 8), vrshrn_n_u16(hi, 8)));
+    }
+    tail().blendRows(row0 + x, row1 + x, weight, out + x, width - x);
+}
+
+void accumulateRow(const uint8_t *row, uint16_t *sum, int width) {
+    int x = 0;
+    for (; x <= width - 16; x += 16) {
+        uint8x16_t v = vld1q_u8(row + x);
+        vst1q_u16(sum + x, vaddw_u8(vld1q_u16(sum + x), vget_low_u8(v)));
+        vst1q_u16(sum + x + 8, vaddw_u8(vld1q_u16(sum + x + 8), vget_high_u8(v)));
+    }
+    tail().accumulateRow(row + x, sum + x, width - x);
+}
+
+void lerpColumns(const uint8_t *row, const int *index, const uint16_t *weights, uint8_t *out, int width) {
+    int x = 0;
+    for (; x <= width - 8; x += 8) {
+        // The pairs sit anywhere in the row, so they are loaded one by one; the arithmetic is vectorized
+        uint16_t pairs[8];
+        for (int i = 0; i < 8; i++) {
+            memcpy(&pairs[i], row + index[x + i], 2);
+        }
+        uint8x8x2_t samples = vld2_u8(reinterpret_cast<const uint8_t *>(pairs));
+        uint16x8x2_t w = vld2q_u16(weights + x * 2);
+        // The two weights add up to 256, so the sum stays within 255 * 256
+        uint16x8_t sum = vmulq_u16(vmovl_u8(samples.val[0]), w.val[0]);
+        sum = vmlaq_u16(sum, vmovl_u8(samples.val[1]), w.val[1]);
+        vst1_u8(out + x, vrshrn_n_u16(sum, 8));
+    }
+    tail().lerpColumns(row, index + x, weights + x * 2, out + x, width - x);
+}
+
+void averageColumns(const uint16_t *sum, const int *index, const int *count, int rows, uint8_t *out, int width) {
+    int x = 0;
+#if defined(__aarch64__)
+    // ARMv7 has no vector division, it stays on the scalar kernel. From this many samples per column on, a
+    // float quotient may round across an integer.
+    constexpr uint32_t kExactSamples = 1 << 15;
+    for (; x <= width - 4; x += 4) {
+        // A column covers a few sums, added up one by one; the divisions go four at a time
+        uint32_t numerators[4];
+        uint32_t samples[4];
+        uint32_t largest = 0;
+        for (int i = 0; i < 4; i++) {
+            const uint16_t *column = sum + index[x + i];
+            uint32_t total = 0;
+            for (int c = 0; c < count[x + i]; c++) {
+                total += column[c];
+            }
+            samples[i] = (uint32_t) (count[x + i] * rows);
+            numerators[i] = total + samples[i] / 2;
+            largest = samples[i] > largest ? samples[i] : largest;
+        }
+        if (largest >= kExactSamples) {
+            tail().averageColumns(sum, index + x, count + x, rows, out + x, 4);
+            continue;
+        }
+        // (n + 1/2) / s is at least 1/(2s) away from an integer, further than the quotient's rounding error
+        // below kExactSamples, so truncating it gives n / s exactly
+        float32x4_t n = vaddq_f32(vcvtq_f32_u32(vld1q_u32(numerators)), vdupq_n_f32(0.5f));
+        float32x4_t s = vcvtq_f32_u32(vld1q_u32(samples));
+        uint16x4_t q = vmovn_u32(vcvtq_u32_f32(vdivq_f32(n, s)));
+        uint32_t bytes = vget_lane_u32(vreinterpret_u32_u8(vmovn_u16(vcombine_u16(q, q))), 0);
+        memcpy(out + x, &bytes, 4);
+    }
+#endif
+    tail().averageColumns(sum, index + x, count + x, rows, out + x, width - x);
+}
+
+void sadBlocks(const uint8_t *a, const uint8_t *b, uint32_t *sums, int blocks) {
+    for (int i = 0; i < blocks; i++) {
+        uint8x16_t diff = vabdq_u8(vld1q_u8(a + i * 16), vld1q_u8(b + i * 16));
+        // Pairwise widening adds down to two 64-bit halves, ARMv7 has no across-vector add
+        uint64x2_t sum = vpaddlq_u32(vpaddlq_u16(vpaddlq_u8(diff)));
+        sums[i] += (uint32_t) (vgetq_lane_u64(sum, 0) + vgetq_lane_u64(sum, 1));
+    }
+}
+
+uint64_t sumLanes(uint32x4_t v) {
+    uint64x2_t sum = vpaddlq_u32(v);
+    return vgetq_lane_u64(sum, 0) + vgetq_lane_u64(sum, 1);
+}
+
+void rowMoments(const uint8_t *row, int width, uint64_t *sums) {
+    // 32-bit lanes take at most 4 * 255 and 4 * 255^2 per 16 bytes, which fits any row width this library sees
+    uint32x4_t sum = vdupq_n_u32(0);
+    uint32x4_t squares = vdupq_n_u32(0);
+    int x = 0;
+    for (; x <= width - 16; x += 16) {
+        uint8x16_t v = vld1q_u8(row + x);
+        sum = vpadalq_u16(sum, vpaddlq_u8(v));
+        squares = vpadalq_u16(squares, vmull_u8(vget_low_u8(v), vget_low_u8(v)));
+        squares = vpadalq_u16(squares, vmull_u8(vget_high_u8(v), vget_high_u8(v)));
+    }
+    sums[0] += sumLanes(sum);
+    sums[1] += sumLanes(squares);
+    tail().rowMoments(row + x, width - x, sums);
+}
+
+void pairSums(const uint8_t *row, int width, uint64_t *sums) {
+    uint32x4_t sum0 = vdupq_n_u32(0);
+    uint32x4_t sum1 = vdupq_n_u32(0);
+    int x = 0;
+    for (; x <= width - 16; x += 16) {
+        uint8x16x2_t pair = vld2q_u8(row + x * 2);
+        sum0 = vpadalq_u16(sum0, vpaddlq_u8(pair.val[0]));
+        sum1 = vpadalq_u16(sum1, vpaddlq_u8(pair.val[1]));
+    }
+    sums[0] += sumLanes(sum0);
+    sums[1] += sumLanes(sum1);
+    tail().pairSums(row + x * 2, width - x, sums);
+}
+
+}  // namespace
+
+const SimdKernels &neonKernels() {
+    static const SimdKernels kernels = {
+            "neon", splitPairs, mergePairs, swapPairs, gatherEven, scatterEven, box2Row, blendRows, accumulateRow,
+            lerpColumns, averageColumns, sadBlocks, rowMoments, pairSums,
+    };
+    return kernels;
+}
@@ -0,0 +1,115 @@
+#include "yuv_simd.h"
+
+namespace {
+
+void splitPairs(const uint8_t *src, uint8_t *d0, uint8_t *d1, int width) {
+    for (int x = 0; x < width; x++) {
+        d0[x] = src[x * 2];
+        d1[x] = src[x * 2 + 1];
+    }
+}
+
+void mergePairs(const uint8_t *s0, const uint8_t *s1, uint8_t *dst, int width) {
+    for (int x = 0; x < width; x++) {
+        dst[x * 2] = s0[x];
+        dst[x * 2 + 1] = s1[x];
+    }
+}
+
+void swapPairs(const uint8_t *src, uint8_t *dst, int width) {
+    for (int x = 0; x < width; x++) {
+        uint8_t first = src[x * 2];
+        dst[x * 2] = src[x * 2 + 1];
+        dst[x * 2 + 1] = first;
+    }
+}
+
+void gatherEven(const uint8_t *src, uint8_t *out, int width) {
+    for (int x = 0; x < width; x++) {
+        out[x] = src[x * 2];
+    }
+}
+
+void scatterEven(const uint8_t *row, uint8_t *dst, int width) {
+    for (int x = 0; x < width; x++) {
+        dst[x * 2] = row[x];
+    }
+}
+
+void box2Row(const uint8_t *row0, const uint8_t *row1, uint8_t *out, int dstWidth) {
+    for (int x = 0; x < dstWidth; x++) {
+        out[x] = (uint8_t) ((row0[x * 2] + row0[x * 2 + 1] + row1[x * 2] + row1[x * 2 + 1] + 2) >> 2);
+    }
+}
+
+void blendRows(const uint8_t *row0, const uint8_t *row1, int weight, uint8_t *out, int width) {
+    for (int x = 0; x < width; x++) {
+        out[x] = (uint8_t) ((row0[x] * (256 - weight) + row1[x] * weight + 128) >> 8);
+    }
+}
+
+void accumulateRow(const uint8_t *row, uint16_t *sum, int width) {
+    for (int x = 0; x < width; x++) {
+        sum[x] += row[x];
+    }
+}
+
+void lerpColumns(const uint8_t *row, const int *index, const uint16_t *weights, uint8_t *out, int width) {
+    for (int x = 0; x < width; x++) {
+        const uint8_t *pair = row + index[x];
+        out[x] = (uint8_t) ((pair[0] * weights[x * 2] + pair[1] * weights[x * 2 + 1] + 128) >> 8);
+    }
+}
+
+void averageColumns(const uint16_t *sum, const int *index, const int *count, int rows, uint8_t *out, int width) {
+    for (int x = 0; x < width; x++) {
+        uint32_t total = 0;
+        for (int c = 0; c < count[x]; c++) {
+            total += sum[index[x] + c];
+        }
+        uint32_t samples = (uint32_t) (count[x] * rows);
+        out[x] = (uint8_t) ((total + samples / 2) / samples);
+    }
+}
+
+void sadBlocks(const uint8_t *a, const uint8_t *b, uint32_t *sums, int blocks) {
+    for (int i = 0; i < blocks; i++) {
+        uint32_t sum = 0;
+        for (int x = i * 16; x < i * 16 + 16; x++) {
+            sum += (uint32_t) (a[x] > b[x] ? a[x] - b[x] : b[x] - a[x]);
+        }
+        sums[i] += sum;
+    }
+}
+
+void rowMoments(const uint8_t *row, int width, uint64_t *sums) {
+    uint64_t sum = 0;
+    uint64_t squares = 0;
+    for (int x = 0; x < width; x++) {
+        sum += row[x];
+        squares += (uint32_t) row[x] * row[x];
+    }
+    sums[0] += sum;
+    sums[1] += squares;
+}
+
+void pairSums(const uint8_t *row, int width, uint64_t *sums) {
+    uint64_t sum0 = 0;
+    uint64_t sum1 = 0;
+    for (int x = 0; x < width; x++) {
+        sum0 += row[x * 2];
+        sum1 += row[x * 2 + 1];
+    }
+    sums[0] += sum0;
+    sums[1] += sum1;
+}
+
+}  // namespace
+
+const SimdKernels &scalarKernels() {
+    static const SimdKernels kernels = {
+            "scalar", splitPairs, mergePairs, swapPairs, gatherEven, scatterEven, box2Row, blendRows, accumulateRow,
+            lerpColumns, averageColumns, sadBlocks, rowMoments, pairSums,
+    };
+    return kernels;
+}
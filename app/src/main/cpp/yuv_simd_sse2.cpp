@@ -0,0 +1,255 @@
+// SSE2 is the x86_64 baseline; on 32-bit x86 it is only used when the CPU reports it
+#include "yuv_simd.h"
+
+#include <cstring>
+
+#include <emmintrin.h>
+
+namespace {
+
+// From this many samples per column on, a float quotient may round across an integer
+constexpr int kExactSamples = 1 << 15;
+
+const SimdKernels &tail() {
+    return scalarKernels();
+}
+
+__m128i load(const uint8_t *p) {
+    return _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+}
+
+void store(uint8_t *p, __m128i v) {
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(p), v);
+}
+
+void splitPairs(const uint8_t *src, uint8_t *d0, uint8_t *d1, int width) {
+    const __m128i low = _mm_set1_epi16(0x00ff);
+    int x = 0;
+    for (; x <= width - 16; x += 16) {
+        __m128i a = load(src + x * 2);
+        __m128i b = load(src + x * 2 + 16);
+        store(d0 + x, _mm_packus_epi16(_mm_and_si128(a, low), _mm_and_si128(b, low)));
+        store(d1 + x, _mm_packus_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8)));
+    }
+    tail().splitPairs(src + x * 2, d0 + x, d1 + x, width - x);
+}
+
+void mergePairs(const uint8_t *s0, const uint8_t *s1, uint8_t *dst, int width) {
+    int x = 0;
+    for (; x <= width - 16; x += 16) {
+        __m128i a = load(s0 + x);
+        __m128i b = load(s1 + x);
+        store(dst + x * 2, _mm_unpacklo_epi8(a, b));
+        store(dst + x * 2 + 16, _mm_unpackhi_epi8(a, b));
+    }
+    tail().mergePairs(s0 + x, s1 + x, dst + x * 2, width - x);
+}
+
+void swapPairs(const uint8_t *src, uint8_t *dst, int width) {
+    int x = 0;
+    for (; x <= width - 8; x += 8) {
+        __m128i v = load(src + x * 2);
+        store(dst + x * 2, _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8)));
+    }
+    tail().swapPairs(src + x * 2, dst + x * 2, width - x);
+}
+
+void gatherEven(const uint8_t *src, uint8_t *out, int width) {
+    const __m128i low = _mm_set1_epi16(0x00ff);
+    int x = 0;
+    for (; x <= width - 16; x += 16) {
+        __m128i a = _mm_and_si128(load(src + x * 2), low);
+        __m128i b = _mm_and_si128(load(src + x * 2 + 16), low);
+        store(out + x, _mm_packus_epi16(a, b));
+    }
+    tail().gatherEven(src + x * 2, out + x, width - x);
+}
+
+void scatterEven(const uint8_t *row, uint8_t *dst, int width) {
+    const __m128i high = _mm_set1_epi16((short) 0xff00);
+    const __m128i zero = _mm_setzero_si128();
+    int x = 0;
+    // The last pair's second byte may be past the end of the plane, keep the vector loop clear of it
+    for (; x <= width - 17; x += 16) {
+        __m128i v = load(row + x);
+        __m128i lo = _mm_or_si128(_mm_and_si128(load(dst + x * 2), high), _mm_unpacklo_epi8(v, zero));
+        __m128i hi = _mm_or_si128(_mm_and_si128(load(dst + x * 2 + 16), high), _mm_unpackhi_epi8(v, zero));
+        store(dst + x * 2, lo);
+        store(dst + x * 2 + 16, hi);
+    }
+    tail().scatterEven(row + x, dst + x * 2, width - x);
+}
+
+// Sum of each byte pair as 16-bit lanes
+__m128i pairSums(__m128i v) {
+    return _mm_add_epi16(_mm_and_si128(v, _mm_set1_epi16(0x00ff)), _mm_srli_epi16(v, 8));
+}
+
+void box2Row(const uint8_t *row0, const uint8_t *row1, uint8_t *out, int dstWidth) {
+    const __m128i two = _mm_set1_epi16(2);
+    int x = 0;
+    for (; x <= dstWidth - 16; x += 16) {
+        __m128i lo = _mm_add_epi16(pairSums(load(row0 + x * 2)), pairSums(load(row1 + x * 2)));
+        __m128i hi = _mm_add_epi16(pairSums(load(row0 + x * 2 + 16)), pairSums(load(row1 + x * 2 + 16)));
+        lo = _mm_srli_epi16(_mm_add_epi16(lo, two), 2);
+        hi = _mm_srli_epi16(_mm_add_epi16(hi, two), 2);
+        store(out + x, _mm_packus_epi16(lo, hi));
+    }
+    tail().box2Row(row0 + x * 2, row1 + x * 2, out + x, dstWidth - x);
+}
+
+void blendRows(const uint8_t *row0, const uint8_t *row1, int weight, uint8_t *out, int width) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i w0 = _mm_set1_epi16((short) (256 - weight));
+    const __m128i w1 = _mm_set1_epi16((short) weight);
+    const __m128i half = _mm_set1_epi16(128);
+    int x = 0;
+    for (; x <= width - 16; x += 16) {
+        __m128i a = load(row0 + x);
+        __m128i b = load(row1 + x);
+        // At most 255 * 256 + 128, fits in an unsigned 16-bit lane
+        __m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(a, zero), w0),
+                                   _mm_mullo_epi16(_mm_unpacklo_epi8(b, zero), w1));
+        __m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(a, zero), w0),
+                                   _mm_mullo_epi16(_mm_unpackhi_epi8(b, zero), w1));
+        lo = _mm_srli_epi16(_mm_add_epi16(lo, half), 8);
+        hi = _mm_srli_epi16(_mm_add_epi16(hi, half), 8);
+        store(out + x, _mm_packus_epi16(lo, hi));
+    }
+    tail().blendRows(row0 + x, row1 + x, weight, out + x, width - x);
+}
+
+void accumulateRow(const uint8_t *row, uint16_t *sum, int width) {
+    const __m128i zero = _mm_setzero_si128();
+    int x = 0;
+    for (; x <= width - 16; x += 16) {
+        __m128i v = load(row + x);
+        auto *s = reinterpret_cast<__m128i *>(sum + x);
+        _mm_storeu_si128(s, _mm_add_epi16(_mm_loadu_si128(s), _mm_unpacklo_epi8(v, zero)));
+        _mm_storeu_si128(s + 1, _mm_add_epi16(_mm_loadu_si128(s + 1), _mm_unpackhi_epi8(v, zero)));
+    }
+    tail().accumulateRow(row + x, sum + x, width - x);
+}
+
+// Both samples of a column, the first in the low byte
+short loadPair(const uint8_t *p) {
+    uint16_t pair;
+    memcpy(&pair, p, 2);
+    return (short) pair;
+}
+
+void lerpColumns(const uint8_t *row, const int *index, const uint16_t *weights, uint8_t *out, int width) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i round = _mm_set1_epi32(128);
+    int x = 0;
+    for (; x <= width - 8; x += 8) {
+        // The pairs sit anywhere in the row, so they are loaded one by one; the arithmetic is vectorized
+        const int *i = index + x;
+        __m128i pairs = _mm_setr_epi16(loadPair(row + i[0]), loadPair(row + i[1]), loadPair(row + i[2]),
+                                       loadPair(row + i[3]), loadPair(row + i[4]), loadPair(row + i[5]),
+                                       loadPair(row + i[6]), loadPair(row + i[7]));
+        // Widened, each pair lines up with its two weights and madd adds the two products
+        auto *w = reinterpret_cast<const __m128i *>(weights + x * 2);
+        __m128i lo = _mm_madd_epi16(_mm_unpacklo_epi8(pairs, zero), _mm_loadu_si128(w));
+        __m128i hi = _mm_madd_epi16(_mm_unpackhi_epi8(pairs, zero), _mm_loadu_si128(w + 1));
+        lo = _mm_srli_epi32(_mm_add_epi32(lo, round), 8);
+        hi = _mm_srli_epi32(_mm_add_epi32(hi, round), 8);
+        __m128i words = _mm_packs_epi32(lo, hi);
+        _mm_storel_epi64(reinterpret_cast<__m128i *>(out + x), _mm_packus_epi16(words, words));
+    }
+    tail().lerpColumns(row, index + x, weights + x * 2, out + x, width - x);
+}
+
+void averageColumns(const uint16_t *sum, const int *index, const int *count, int rows, uint8_t *out, int width) {
+    const __m128 half = _mm_set1_ps(0.5f);
+    int x = 0;
+    for (; x <= width - 4; x += 4) {
+        // A column covers a few sums, added up one by one; the divisions go four at a time
+        alignas(16) int32_t numerators[4];
+        alignas(16) int32_t samples[4];
+        int largest = 0;
+        for (int i = 0; i < 4; i++) {
+            const uint16_t *column = sum + index[x + i];
+            int32_t total = 0;
+            for (int c = 0; c < count[x + i]; c++) {
+                total += column[c];
+            }
+            samples[i] = count[x + i] * rows;
+            numerators[i] = total + samples[i] / 2;
+            largest = samples[i] > largest ? samples[i] : largest;
+        }
+        if (largest >= kExactSamples) {
+            tail().averageColumns(sum, index + x, count + x, rows, out + x, 4);
+            continue;
+        }
+        // (n + 1/2) / s is at least 1/(2s) away from an integer, further than the quotient's rounding error
+        // below kExactSamples, so truncating it gives n / s exactly
+        __m128 n = _mm_add_ps(_mm_cvtepi32_ps(_mm_load_si128(reinterpret_cast<const __m128i *>(numerators))), half);
+        __m128 s = _mm_cvtepi32_ps(_mm_load_si128(reinterpret_cast<const __m128i *>(samples)));
+        __m128i q = _mm_cvttps_epi32(_mm_div_ps(n, s));
+        q = _mm_packs_epi32(q, q);
+        int32_t bytes = _mm_cvtsi128_si32(_mm_packus_epi16(q, q));
+        memcpy(out + x, &bytes, 4);
+    }
+    tail().averageColumns(sum, index + x, count + x, rows, out + x, width - x);
+}
+
+void sadBlocks(const uint8_t *a, const uint8_t *b, uint32_t *sums, int blocks) {
+    for (int i = 0; i < blocks; i++) {
+        // psadbw sums each 8-byte half into the low bits of its 64-bit lane
+        __m128i sad = _mm_sad_epu8(load(a + i * 16), load(b + i * 16));
+        sums[i] += (uint32_t) (_mm_cvtsi128_si32(sad) + _mm_cvtsi128_si32(_mm_srli_si128(sad, 8)));
+    }
+}
+
+// Adds the two 64-bit lanes
+uint64_t sumLanes(__m128i v) {
+    // Through memory, 32-bit x86 has no 64-bit move out of a register
+    uint64_t lanes[2];
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(lanes), v);
+    return lanes[0] + lanes[1];
+}
+
+void rowMoments(const uint8_t *row, int width, uint64_t *sums) {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i sum = zero;
+    // 32-bit lanes take 4 * 255^2 per 16 bytes, which fits any row width this library sees
+    __m128i squares = zero;
+    int x = 0;
+    for (; x <= width - 16; x += 16) {
+        __m128i v = load(row + x);
+        sum = _mm_add_epi64(sum, _mm_sad_epu8(v, zero));
+        __m128i low = _mm_unpacklo_epi8(v, zero);
+        __m128i high = _mm_unpackhi_epi8(v, zero);
+        squares = _mm_add_epi32(squares, _mm_add_epi32(_mm_madd_epi16(low, low), _mm_madd_epi16(high, high)));
+    }
+    sums[0] += sumLanes(sum);
+    sums[1] += sumLanes(_mm_add_epi64(_mm_unpacklo_epi32(squares, zero), _mm_unpackhi_epi32(squares, zero)));
+    tail().rowMoments(row + x, width - x, sums);
+}
+
+void pairSums(const uint8_t *row, int width, uint64_t *sums) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i low = _mm_set1_epi16(0x00ff);
+    __m128i sum0 = zero;
+    __m128i sum1 = zero;
+    int x = 0;
+    for (; x <= width - 8; x += 8) {
+        __m128i v = load(row + x * 2);
+        sum0 = _mm_add_epi64(sum0, _mm_sad_epu8(_mm_and_si128(v, low), zero));
+        sum1 = _mm_add_epi64(sum1, _mm_sad_epu8(_mm_srli_epi16(v, 8), zero));
+    }
+    sums[0] += sumLanes(sum0);
+    sums[1] += sumLanes(sum1);
+    tail().pairSums(row + x * 2, width - x, sums);
+}
+
+}  // namespace
+
+const SimdKernels &sse2Kernels() {
+    static const SimdKernels kernels = {
+            "sse2", splitPairs, mergePairs, swapPairs, gatherEven, scatterEven, box2Row, blendRows, accumulateRow,
+            lerpColumns, averageColumns, sadBlocks, rowMoments, pairSums,
+    };
+    return kernels;
+}
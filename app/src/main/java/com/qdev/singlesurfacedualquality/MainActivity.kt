@@ -25,6 +25,8 @@ import android.media.MediaMuxer
 import android.os.Bundle
 import android.os.Handler
 import android.os.HandlerThread
+import android.os.ParcelFileDescriptor
+import android.os.Process
 import android.os.SystemClock
 import android.text.InputType
 import android.util.Log
@@ -50,11 +52,8 @@ import kotlinx.coroutines.launch
 import java.io.File
 import java.io.IOException
 import java.nio.ByteBuffer
-import java.util.concurrent.ExecutorService
 import java.util.concurrent.Executors
-import java.util.concurrent.LinkedBlockingQueue
 import java.util.concurrent.Semaphore
-import java.util.concurrent.ThreadPoolExecutor
 import java.util.concurrent.TimeUnit
 import java.util.concurrent.atomic.AtomicBoolean
 import kotlin.math.max
@@ -64,6 +63,23 @@ import kotlin.system.measureTimeMillis
 class MainActivity : AppCompatActivity() {
     private val TAG = MainActivity::class.java.canonicalName
 
+    //  height of the low quality stream, the native scaler downsizes each frame to it
+    private val LQ_HEIGHT = 360
+    //  frame rate of the low quality stream, the native queue passes over the camera frames in between
+    private val LQ_FRAME_RATE = 15
+    //  the native LQ stream leaves out frames in which no 16x16 block changed by more than this many luma
+    //  levels on average, keeping at least LQ_STILL_FRAME_RATE of them
+    private val LQ_MOTION_THRESHOLD = 8
+    private val LQ_STILL_FRAME_RATE = 1.0
+    //  frames the native queue can overflow into a file when an encoder stalls, about 2 s at 30 fps
+    private val QUEUE_SPILL_FRAMES = 60
+    //  upper bound on one wait for a queued frame, so a stop is noticed promptly
+    private val FRAME_WAIT_TIMEOUT_NS = 20_000_000L
+    //  processQueue: no consumer to wait on
+    private val NO_CONSUMER = -2
+    //  processQueue: how long a drain blocks for encoder output while both encoders are stalled
+    private val CODEC_OUTPUT_WAIT_US = 10_000L
+
     private lateinit var binding: ActivityMainBinding
 
     private val permissions: Array<String> = arrayOf(android.Manifest.permission.CAMERA, android.Manifest.permission.RECORD_AUDIO)
@@ -81,6 +97,8 @@ class MainActivity : AppCompatActivity() {
     private var captureSession: CameraCaptureSession? = null
     private var isRecording: Boolean = false
     private var selectedResolution: Int = -1
+    //  clockwise rotation of the camera frames to the device's natural orientation
+    private var sensorOrientation: Int = 90
 
     private var mediaCodec: MediaCodec? = null
     private var lqMediaCodec: MediaCodec? = null
@@ -113,6 +131,31 @@ class MainActivity : AppCompatActivity() {
 
     private lateinit var queue: CircularArrayQueue
 
+    //  native queue reader ids for the two encoders
+    private var hqConsumerId: Int = -1
+    private var lqConsumerId: Int = -1
+
+    //  let the native layer read camera buffers in place instead of copying each frame into its queue;
+    //  opt-in, the copying path stays the default
+    private val useZeroCopyIngest: Boolean = false
+    private var zeroCopySurface: Surface? = null
+    //  encode both streams on native feeder threads instead of the Kotlin codec loops; writes one file
+    //  per stream for the whole recording, without the segmenting of the Kotlin path
+    private val useNativeFeeder: Boolean = false
+    //  with the native feeder, produce the LQ stream in the same pass over each frame as the HQ copy,
+    //  off the HQ consumer, instead of on a consumer of its own
+    private val useFusedFanOut: Boolean = false
+    //  with the native feeder, feed the HQ and LQ encoders plus a thumbnail and an analytics frame as
+    //  one output graph off the HQ consumer, all in one pass over each frame
+    private val useOutputGraph: Boolean = false
+    //  record the frames copied into the native queue to capture.yuvc for offline replay; only the
+    //  copying ingest is recorded, not zero-copy
+    private val recordCapture: Boolean = false
+    //  have the full-size native copy measure exposure (luma histogram, mean, variance) as it copies
+    private val measureFrames: Boolean = true
+    //  keep the native copy workers and feeders off the efficiency cores, where a 4K copy takes twice as long
+    private val pinNativeThreads: Boolean = true
+
     private val supportedResolutions by lazy(::getSupportedResolutionsList)
 
     private val imageListener = ImageReader.OnImageAvailableListener { reader ->
@@ -138,7 +181,7 @@ class MainActivity : AppCompatActivity() {
                     yPixelStride = cameraImage.planes[0].pixelStride,
                     uPixelStride = cameraImage.planes[1].pixelStride,
                     vPixelStride = cameraImage.planes[2].pixelStride,
-                    timestamp = cameraImage.timestamp,
+                    timestampNs = cameraImage.timestamp,
                     width = cameraImage.width,
                     height = cameraImage.height
                 )
@@ -178,10 +221,12 @@ class MainActivity : AppCompatActivity() {
             cameraImage.close()
             Log.d(TAG, "onImageAvailable: time taken to add to queue $timeToCreateQueueEntry ms")
 
-            handleHqInputBuffers(timestamp)
-            handleLqInputBuffers(timestamp)
-            handleHqCodecOutputBuffer()
-            handleLqCodecOutputBuffer()
+            if (!useNativeFeeder) {
+                handleHqInputBuffers(timestamp)
+                handleLqInputBuffers(timestamp)
+                handleHqCodecOutputBuffer()
+                handleLqCodecOutputBuffer()
+            }
 
         } else {
             cameraImage.close()
@@ -341,34 +386,46 @@ class MainActivity : AppCompatActivity() {
     }
 
     private fun processQueue() {
-        val corePoolSize = 4
-        val maximumPoolSize = corePoolSize * 4
-        val keepAliveTime = 100L
-        val workQueue = /*SynchronousQueue<Runnable>()*/ LinkedBlockingQueue<Runnable>()
-        val workerPool: ExecutorService = ThreadPoolExecutor(
-            corePoolSize, maximumPoolSize, keepAliveTime, TimeUnit.SECONDS, workQueue
-        )
+        //  frames through the ImageReader are fed and drained by its listener, there is nothing here to
+        //  wait on and the loop below would only spin on the drains
+        if (!useZeroCopyIngest) {
+            return
+        }
+
+        //  an encoder without a free input buffer cannot take its queued frame, so waiting on it would
+        //  return at once; wait only on the ones that took their last frame and retry the others each pass
+        var hqStalled = false
+        var lqStalled = false
 
         while (true) {/*if (!this::queue.isInitialized || queue.isEmpty()) {
                 Thread.sleep(10)
                 continue
             }*/
 
-            if (YuvUtils.isQueueEmpty()) {
-                Thread.sleep(5)
-                continue
+            if (isRecording) {
+                val waitConsumerId = when {
+                    hqStalled && lqStalled -> NO_CONSUMER
+                    hqStalled -> lqConsumerId
+                    lqStalled -> hqConsumerId
+                    else -> -1
+                }
+                //  with both stalled the output drain below paces the loop until a buffer frees up
+                if (waitConsumerId == NO_CONSUMER || YuvUtils.waitForFrame(waitConsumerId, FRAME_WAIT_TIMEOUT_NS)) {
+                    //  peekTimestamp also passes over the frames the LQ pacing drops
+                    val hqTimestamp = YuvUtils.peekTimestamp(hqConsumerId)
+                    hqStalled = hqTimestamp >= 0 && !handleHqInputBuffers(hqTimestamp)
+                    val lqTimestamp = YuvUtils.peekTimestamp(lqConsumerId)
+                    lqStalled = lqTimestamp >= 0 && !handleLqInputBuffers(lqTimestamp)
+                }
             }
 
 //            val cameraImage = queue.dequeue() ?: return
 
-            workerPool.submit {
-//                handleHqInputBuffers()
-//                handleLqInputBuffers()
-            }
-            workerPool.submit {
-                handleHqCodecOutputBuffer()
-                handleLqCodecOutputBuffer()
-            }
+            //  on this thread: draining is what frees the input buffers the next pass needs, so with both
+            //  encoders stalled block on their output rather than poll it
+            val drainTimeoutUs = if (hqStalled && lqStalled) CODEC_OUTPUT_WAIT_US else 500L
+            handleHqCodecOutputBuffer(drainTimeoutUs)
+            handleLqCodecOutputBuffer(drainTimeoutUs)
 
             /*encodeHandler?.post {
                 handleHqInputBuffers(cameraImage)
@@ -443,9 +500,12 @@ class MainActivity : AppCompatActivity() {
         }
     }
 
-    private fun handleHqInputBuffers(timestamp: Long) {
+    //  returns false when the encoder had no free input buffer, the frame then stays queued
+    private fun handleHqInputBuffers(timestamp: Long): Boolean {
+        var queued = false
         if (semaphore.tryAcquire(100, TimeUnit.MILLISECONDS)) {
             val index = mediaCodec?.dequeueInputBuffer(500)
+            queued = index != null && index >= 0
             if (index != null && index >= 0) {
                 val inBuff = mediaCodec?.getInputBuffer(index)
 
@@ -454,48 +514,46 @@ class MainActivity : AppCompatActivity() {
                     val inputImage = mediaCodec?.getInputImage(index)
                     inputImage?.let {
 //                        YuvUtils.copyYUV(cameraImage, it)
-                        Log.d(TAG, "handleHqInputBuffers: colour format = ${it.format}")
-                        Log.d(
-                            TAG, "handleHqInputBuffers: plane 0, pixel stride = ${it.planes[0].pixelStride}, row stride = ${it.planes[0].rowStride}"
-                        )
-                        Log.d(
-                            TAG, "handleHqInputBuffers: plane 1, pixel stride = ${it.planes[1].pixelStride}, row stride = ${it.planes[1].rowStride}"
-                        )
-                        Log.d(
-                            TAG, "handleHqInputBuffers: plane 2, pixel stride = ${it.planes[2].pixelStride}, row stride = ${it.planes[2].rowStride}"
-                        )
-                        val timeToCopy = measureTimeMillis {
 //                                YuvUtils.copyToImage(cameraImage, it)
-                            YuvUtils.copyToImageV3(it, false)
-                        }
-                        Log.d(TAG, "handleHqInputBuffers: time to copy ${timeToCopy} ms")
+                        //  copy time is in YuvUtils.getStats()
+                        val copiedSize = YuvUtils.copyToImage(it, index, hqConsumerId, YuvUtils.STAGE_HQ_COPY)
                         hqDone.set(true)
-                        mediaCodec?.queueInputBuffer(/* index = */ index,/* offset = */
-                            0,/* size = */
-                            it.planes[0].buffer.remaining(),/* presentationTimeUs = *//*cameraImage.timestampUs / 1000*/
-                            timestamp / 1000,/* flags = */
-                            if (isRecording) {
-                                if (hqFrameCount == 300) {
-                                    MediaCodec.BUFFER_FLAG_KEY_FRAME
-                                } else {
-                                    0
-                                }
-                            } else MediaCodec.BUFFER_FLAG_END_OF_STREAM
-                        )
+                        if (copiedSize > 0) {
+                            mediaCodec?.queueInputBuffer(/* index = */ index,/* offset = */
+                                0,/* size = */
+                                copiedSize,/* presentationTimeUs = *//*cameraImage.timestampUs / 1000*/
+                                timestamp / 1000,/* flags = */
+                                if (isRecording) {
+                                    if (hqFrameCount == 300) {
+                                        MediaCodec.BUFFER_FLAG_KEY_FRAME
+                                    } else {
+                                        0
+                                    }
+                                } else MediaCodec.BUFFER_FLAG_END_OF_STREAM
+                            )
+                            hqFrameCount++
+                        } else {
+                            //  nothing copied (no frame for the consumer or the copy failed): hand the buffer back
+                            //  empty, without a capture timestamp or a place in the segment's frame count
+                            mediaCodec?.queueInputBuffer(index, 0, 0, 0, if (isRecording) 0 else MediaCodec.BUFFER_FLAG_END_OF_STREAM)
+                        }
                     }
                 } else {
                     mediaCodec?.queueInputBuffer(index, 0, 0, 0, if (isRecording) 0 else MediaCodec.BUFFER_FLAG_END_OF_STREAM)
                 }
             }
 
-            hqFrameCount++
             semaphore.release()
         }
+        return queued
     }
 
-    private fun handleLqInputBuffers(timestamp: Long) {
+    //  returns false when the encoder had no free input buffer, the frame then stays queued
+    private fun handleLqInputBuffers(timestamp: Long): Boolean {
+        var queued = false
         if (semaphore.tryAcquire(100, TimeUnit.MILLISECONDS)) {
             val index = lqMediaCodec?.dequeueInputBuffer(0)
+            queued = index != null && index >= 0
             if (index != null && index >= 0) {
                 val inBuff = lqMediaCodec?.getInputBuffer(index)
                 if ((inBuff?.capacity() ?: -1) >= 0) {
@@ -503,39 +561,43 @@ class MainActivity : AppCompatActivity() {
                     val inputImage = lqMediaCodec?.getInputImage(index)
                     inputImage?.let {
 //                        YuvUtils.copyYUV(cameraImage, it)
-                        val timeToCopy = measureTimeMillis {
 //                            YuvUtils.copyToImage(cameraImage, it)
-                            YuvUtils.copyToImageV3(it, true)
-                        }
-                        Log.d(TAG, "handleLqInputBuffers: time to copy ${timeToCopy} ms")
+                        val copiedSize = YuvUtils.scaleToImage(it, index, lqConsumerId, YuvUtils.SCALE_FILTER_AREA)
                         lqDone.set(true)
-                        lqMediaCodec?.queueInputBuffer(/* index = */ index,/* offset = */
-                            0,/* size = */
-                            it.planes[0].buffer.remaining(),/* presentationTimeUs = *//*cameraImage.timestampUs / 1000*/
-                            timestamp / 1000,/* flags = */
-                            if (isRecording) {
-                                if (lqFrameCount == 300) {
-                                    MediaCodec.BUFFER_FLAG_KEY_FRAME
+                        if (copiedSize > 0) {
+                            lqMediaCodec?.queueInputBuffer(/* index = */ index,/* offset = */
+                                0,/* size = */
+                                copiedSize,/* presentationTimeUs = *//*cameraImage.timestampUs / 1000*/
+                                timestamp / 1000,/* flags = */
+                                if (isRecording) {
+                                    if (lqFrameCount == 300) {
+                                        MediaCodec.BUFFER_FLAG_KEY_FRAME
+                                    } else {
+                                        0
+                                    }
                                 } else {
-                                    0
+                                    MediaCodec.BUFFER_FLAG_END_OF_STREAM
                                 }
-                            } else {
-                                MediaCodec.BUFFER_FLAG_END_OF_STREAM
-                            }
-                        )
+                            )
+                            lqFrameCount++
+                        } else {
+                            //  nothing copied (no frame for the consumer or the copy failed): hand the buffer back
+                            //  empty, without a capture timestamp or a place in the segment's frame count
+                            lqMediaCodec?.queueInputBuffer(index, 0, 0, 0, if (isRecording) 0 else MediaCodec.BUFFER_FLAG_END_OF_STREAM)
+                        }
                     }
                 } else {
                     lqMediaCodec?.queueInputBuffer(index, 0, 0, 0, if (isRecording) 0 else MediaCodec.BUFFER_FLAG_END_OF_STREAM)
                 }
             }
 
-            lqFrameCount++
             semaphore.release()
         }
+        return queued
     }
 
-    private fun handleHqCodecOutputBuffer() {
-        val outputBufferIndex = mediaCodec?.dequeueOutputBuffer(imReaderBufferInfo, 500)
+    private fun handleHqCodecOutputBuffer(timeoutUs: Long = 500) {
+        val outputBufferIndex = mediaCodec?.dequeueOutputBuffer(imReaderBufferInfo, timeoutUs)
         if (outputBufferIndex != null && outputBufferIndex >= 0) {
             val outputBuffer = mediaCodec?.getOutputBuffer(outputBufferIndex)
 
@@ -585,8 +647,8 @@ class MainActivity : AppCompatActivity() {
         }
     }
 
-    private fun handleLqCodecOutputBuffer() {
-        val outputBufferIndex = lqMediaCodec?.dequeueOutputBuffer(imReaderBufferInfo, 500)
+    private fun handleLqCodecOutputBuffer(timeoutUs: Long = 500) {
+        val outputBufferIndex = lqMediaCodec?.dequeueOutputBuffer(imReaderBufferInfo, timeoutUs)
         if (outputBufferIndex != null && outputBufferIndex >= 0) {
             val outputBuffer = lqMediaCodec?.getOutputBuffer(outputBufferIndex)
 
@@ -764,7 +826,9 @@ class MainActivity : AppCompatActivity() {
         }
         try {
             setupSingleSurface()
-            setupMuxers()
+            if (!useNativeFeeder) {
+                setupMuxers()
+            }
             //  preview
             val texture = binding.texture.surfaceTexture
             texture?.setDefaultBufferSize(1920, 1080)
@@ -773,13 +837,14 @@ class MainActivity : AppCompatActivity() {
 //            val highQualitySurface: Surface = mediaCodec!!.createInputSurface()
 
             val captureRequestBuilder = cameraDevice!!.createCaptureRequest(CameraDevice.TEMPLATE_RECORD)
+            val ingestSurface = if (useZeroCopyIngest) zeroCopySurface!! else imageReader!!.surface
             captureRequestBuilder.addTarget(previewSurface)
-            captureRequestBuilder.addTarget(imageReader!!.surface)
+            captureRequestBuilder.addTarget(ingestSurface)
 //            captureRequestBuilder.addTarget(highQualitySurface)
 
             val surfaces: MutableList<Surface> = ArrayList()
             surfaces.add(previewSurface)
-            surfaces.add(imageReader!!.surface)
+            surfaces.add(ingestSurface)
 //            surfaces.add(highQualitySurface)
 
             cameraDevice!!.createCaptureSession(surfaces, object : CameraCaptureSession.StateCallback() {
@@ -804,6 +869,12 @@ class MainActivity : AppCompatActivity() {
                         /*processHandler?.post {
                             processQueue()
                         }*/
+                        if (useZeroCopyIngest && !useNativeFeeder) {
+                            //  no Kotlin image listener in this mode, drive the encoders from the native queue
+                            processHandler?.post {
+                                processQueue()
+                            }
+                        }
                     } catch (e: CameraAccessException) {
                         e.printStackTrace()
                     }
@@ -862,7 +933,23 @@ class MainActivity : AppCompatActivity() {
             close()
         }
 
+        if (recordCapture && !useZeroCopyIngest) {
+            YuvUtils.stopCaptureRecording()
+        }
+        Log.i(TAG, "stopRecording: native stats ${YuvUtils.getStats()}, spill ${YuvUtils.getSpillStats()}")
+        YuvUtils.getImageStats(-1)?.let {
+            Log.i(TAG, "stopRecording: last frame luma mean ${it.lumaMean}, variance ${it.lumaVariance}, clipped ${it.clippedShare()}")
+        }
+        if (pinNativeThreads) {
+            Log.i(TAG, "stopRecording: native thread placement ${YuvUtils.getPlacementStats(true)}")
+        }
+        if (useNativeFeeder && useOutputGraph) {
+            Log.i(TAG, "stopRecording: output graph ${YuvUtils.getOutputStats(hqConsumerId)}")
+        }
         YuvUtils.cleanupQueue()
+        hqConsumerId = -1
+        lqConsumerId = -1
+        zeroCopySurface = null
         stopChronometerUI()
     }
 
@@ -892,8 +979,41 @@ class MainActivity : AppCompatActivity() {
             Size(1920, 1080)
         }
 
-        YuvUtils.setupQueue(5, chosenSize.width, chosenSize.height)
+        YuvUtils.configureQueueSpill(File(cacheDir, "frame_spill.yuv").absolutePath, QUEUE_SPILL_FRAMES)
+        YuvUtils.configureImageStats(measureFrames)
+        if (pinNativeThreads) {
+            pinNativeThreads()
+        }
+        if (useZeroCopyIngest) {
+            //  5 queued frames plus the ones the camera holds while filling the next
+            zeroCopySurface = YuvUtils.setupZeroCopyQueue(5, chosenSize.width, chosenSize.height, 5 + 3)
+        } else {
+            YuvUtils.setupQueue(5, chosenSize.width, chosenSize.height)
+            if (recordCapture && !YuvUtils.startCaptureRecording(File(filesDir, "capture.yuvc").absolutePath)) {
+                Log.e(TAG, "setupSingleSurface: capture recording could not be started")
+            }
+        }
+        hqConsumerId = YuvUtils.registerConsumer(false)
+        //  a fused fan-out or output graph paces the LQ stream itself; an LQ consumer nobody reads would
+        //  hold up the queue
+        if (!(useNativeFeeder && (useFusedFanOut || useOutputGraph))) {
+            //  the LQ stream prefers fresh frames to complete ones
+            lqConsumerId = YuvUtils.registerConsumer(true)
+            YuvUtils.setConsumerFrameRate(lqConsumerId, LQ_FRAME_RATE.toDouble())
+        }
+
+        if (useNativeFeeder) {
+            startNativeFeeders(chosenSize)
+        } else {
+            setupCodecs(chosenSize)
+        }
+
+        imageReader?.close()
+        imageReader = ImageReader.newInstance(chosenSize.width, chosenSize.height/*1920, 1080*/, android.graphics.ImageFormat.YUV_420_888, 2)
+        imageReader?.setOnImageAvailableListener(imageListener, backgroundHandler)
+    }
 
+    private fun setupCodecs(chosenSize: Size) {
         try {
             mediaCodec = MediaCodec.createEncoderByType("video/avc")
 
@@ -912,9 +1032,10 @@ class MainActivity : AppCompatActivity() {
         try {
             lqMediaCodec = MediaCodec.createEncoderByType("video/avc")
 
-            val format = MediaFormat.createVideoFormat("video/avc", chosenSize.width, chosenSize.height/*1920, 1080*/)
+            val lqSize = getLowQualitySize(chosenSize)
+            val format = MediaFormat.createVideoFormat("video/avc", lqSize.width, lqSize.height)
             format.setInteger(MediaFormat.KEY_BIT_RATE, 500 * 1000) // 10 Mbps
-            format.setInteger(MediaFormat.KEY_FRAME_RATE, 30)
+            format.setInteger(MediaFormat.KEY_FRAME_RATE, LQ_FRAME_RATE)
             format.setInteger(MediaFormat.KEY_COLOR_FORMAT, MediaCodecInfo.CodecCapabilities.COLOR_FormatYUV420Flexible)
             format.setInteger(MediaFormat.KEY_I_FRAME_INTERVAL, 5) // 1 second between I-frames
 
@@ -924,10 +1045,77 @@ class MainActivity : AppCompatActivity() {
         } catch (e: CameraAccessException) {
             e.printStackTrace()
         }
+    }
 
-        imageReader?.close()
-        imageReader = ImageReader.newInstance(chosenSize.width, chosenSize.height/*1920, 1080*/, android.graphics.ImageFormat.YUV_420_888, 2)
-        imageReader?.setOnImageAvailableListener(imageListener, backgroundHandler)
+    //  copy workers and feeders on every cluster but the slowest, at video priority; ingest stays where the
+    //  camera callback runs, it only hands frames over. Nothing to do on a single-cluster CPU
+    private fun pinNativeThreads() {
+        val cores = YuvUtils.getCpuTopology()
+        val clusters = (cores.maxOfOrNull { it.cluster } ?: 0) + 1
+        Log.i(TAG, "pinNativeThreads: $clusters clusters, $cores")
+        if (clusters < 2) {
+            return
+        }
+        val fast = YuvUtils.fastestClusters(cores, clusters - 1)
+        YuvUtils.configureThreadPlacement(YuvUtils.THREAD_COPY_WORKERS, fast, Process.THREAD_PRIORITY_VIDEO)
+        YuvUtils.configureThreadPlacement(YuvUtils.THREAD_FEEDERS, fast, Process.THREAD_PRIORITY_VIDEO)
+    }
+
+    //  same streams as setupCodecs, encoded and muxed natively; the feeders stop in cleanupQueue
+    private fun startNativeFeeders(chosenSize: Size) {
+        val lqSize = getLowQualitySize(chosenSize)
+        YuvUtils.configureMotionGate(LQ_MOTION_THRESHOLD, 60, LQ_STILL_FRAME_RATE)
+        if (useOutputGraph) {
+            //  the archive paces the graph, the live stream and the frame outputs skip what they cannot take
+            val hq = YuvUtils.addNativeOutput(
+                hqConsumerId, "video/avc", openOutputFd("high_quality.mp4"),
+                chosenSize.width, chosenSize.height, 6 * 1000 * 1000, 30, 1, 2, YuvUtils.NATIVE_FEEDER_COPY
+            )
+            val lq = YuvUtils.addNativeOutput(
+                hqConsumerId, "video/avc", openOutputFd("low_quality.mp4"),
+                lqSize.width, lqSize.height, 500 * 1000, LQ_FRAME_RATE, 5, 1, YuvUtils.SCALE_FILTER_AREA
+            )
+            val thumbnail = YuvUtils.addNativeFrameOutput(
+                hqConsumerId, 320, 180, YuvUtils.PACKED_I420, 1.0, 0, YuvUtils.SCALE_FILTER_AREA
+            )
+            val analytics = YuvUtils.addNativeFrameOutput(
+                hqConsumerId, 640, 360, YuvUtils.PACKED_NV12, 5.0, 0, YuvUtils.SCALE_FILTER_BILINEAR
+            )
+            val started = YuvUtils.startNativeOutputs(hqConsumerId)
+            Log.i(TAG, "startNativeFeeders: output graph started = $started, outputs $hq $lq $thumbnail $analytics")
+            return
+        }
+        if (useFusedFanOut) {
+            val started = YuvUtils.startNativeFanOut(
+                hqConsumerId, "video/avc",
+                openOutputFd("high_quality.mp4"), chosenSize.width, chosenSize.height, 6 * 1000 * 1000, 30, 1,
+                openOutputFd("low_quality.mp4"), lqSize.width, lqSize.height, 500 * 1000, LQ_FRAME_RATE, 5,
+                YuvUtils.SCALE_FILTER_AREA
+            )
+            Log.i(TAG, "startNativeFeeders: fan-out started = $started")
+            return
+        }
+        val hqStarted = YuvUtils.startNativeFeeder(
+            hqConsumerId, "video/avc", openOutputFd("high_quality.mp4"),
+            chosenSize.width, chosenSize.height, 6 * 1000 * 1000, 30, 1, YuvUtils.NATIVE_FEEDER_COPY
+        )
+        val lqStarted = YuvUtils.startNativeFeeder(
+            lqConsumerId, "video/avc", openOutputFd("low_quality.mp4"),
+            lqSize.width, lqSize.height, 500 * 1000, LQ_FRAME_RATE, 5, YuvUtils.SCALE_FILTER_AREA
+        )
+        Log.i(TAG, "startNativeFeeders: hq started = $hqStarted, lq started = $lqStarted")
+    }
+
+    private fun openOutputFd(name: String): Int {
+        val mode = ParcelFileDescriptor.MODE_READ_WRITE or ParcelFileDescriptor.MODE_CREATE or ParcelFileDescriptor.MODE_TRUNCATE
+        return ParcelFileDescriptor.open(File(filesDir, name), mode).detachFd()
+    }
+
+    //  the LQ stream is encoded at 360p (or the capture size if smaller), keeping the capture aspect ratio
+    private fun getLowQualitySize(captureSize: Size): Size {
+        val height = minOf(LQ_HEIGHT, captureSize.height)
+        val width = captureSize.width * height / captureSize.height
+        return Size(width and 1.inv(), height and 1.inv())
     }
 
     private fun encodeFrames() {
@@ -1176,7 +1364,28 @@ class MainActivity : AppCompatActivity() {
             videoResolutions.setOnItemClickListener { _, _, position, _ ->
                 setSelectedResolutionText(position)
             }
+            texture.setOnRegionChangedListener { left, top, width, height ->
+                setCropRegion(RectF(left, top, left + width, top + height))
+            }
+        }
+    }
+
+    //  zooms the recorded streams into the part of the preview left visible; the preview shows the
+    //  camera frames rotated clockwise by the sensor orientation less the display rotation
+    private fun setCropRegion(view: RectF) {
+        val displayDegrees = when (windowManager?.defaultDisplay?.rotation) {
+            Surface.ROTATION_90 -> 90
+            Surface.ROTATION_180 -> 180
+            Surface.ROTATION_270 -> 270
+            else -> 0
+        }
+        val frame = when ((sensorOrientation - displayDegrees + 360) % 360) {
+            90 -> RectF(view.top, 1f - view.right, view.bottom, 1f - view.left)
+            180 -> RectF(1f - view.right, 1f - view.bottom, 1f - view.left, 1f - view.top)
+            270 -> RectF(1f - view.bottom, view.left, 1f - view.top, view.right)
+            else -> view
         }
+        YuvUtils.setCropRegion(frame.left, frame.top, frame.width(), frame.height())
     }
 
     override fun onResume() {
@@ -1204,6 +1413,7 @@ class MainActivity : AppCompatActivity() {
             Log.e(TAG, "No back facing camera found")
             return
         }
+        sensorOrientation = manager.getCameraCharacteristics(cameraId).get(CameraCharacteristics.SENSOR_ORIENTATION) ?: 90
         binding.texture.post {
             configureTransform(width, height)
             manager.openCamera(cameraId, cameraStateCallback, backgroundHandler)
@@ -0,0 +1,232 @@
+package com.qdev.singlesurfacedualquality.utils
+
+/**
+ * Latency of one native pipeline stage over a [YuvUtils.getStats] interval. Percentiles are the
+ * upper bounds of the histogram buckets they fall in, within 12.5% of the true value.
+ */
+data class StageStats(
+    val count: Long,
+    val totalNs: Long,
+    val maxNs: Long,
+    val p50Ns: Long,
+    val p90Ns: Long,
+    val p99Ns: Long
+) {
+    val meanNs: Long
+        get() = if (count > 0) totalNs / count else 0
+}
+
+data class NativeStats(
+    val frames: Long,
+    val droppedFrames: Long,
+    val timedOutFrames: Long,
+    val overwrittenFrames: Long,
+    val skippedFrames: Long,
+    val flushedFrames: Long,
+    //  frames a paced reader passed over to hold its frame rate
+    val decimatedFrames: Long,
+    //  frames that found the queue full and went to the file-backed spill instead of being dropped
+    val spilledFrames: Long,
+    //  frames a motion-gated stream left out because nothing moved
+    val stillFrames: Long,
+    val ingest: StageStats,
+    val queueWait: StageStats,
+    val hqCopy: StageStats,
+    val lqCopy: StageStats,
+    //  timestamp distance between consecutive frames a reader got, max and p99 show the worst drop bursts
+    val frameGap: StageStats,
+    //  compressing a frame into the pre-roll store, and restoring one for a replay
+    val preRollEncode: StageStats,
+    val preRollDecode: StageStats,
+    //  time frames waited in the spill before they got into the queue
+    val spillWait: StageStats,
+    //  comparing a frame with the previous one for the motion gate
+    val motion: StageStats
+) {
+    companion object {
+        private const val COUNTERS = 9
+        private const val STAGE_FIELDS = 6
+
+        //  layout written by getNativeStats in yuv_copy.cpp
+        fun fromArray(values: LongArray): NativeStats {
+            fun stage(index: Int): StageStats {
+                val base = COUNTERS + index * STAGE_FIELDS
+                return StageStats(values[base], values[base + 1], values[base + 2],
+                    values[base + 3], values[base + 4], values[base + 5])
+            }
+            return NativeStats(values[0], values[1], values[2], values[3], values[4], values[5], values[6],
+                values[7], values[8], stage(0), stage(1), stage(2), stage(3), stage(4), stage(5), stage(6),
+                stage(7), stage(8))
+        }
+    }
+}
+
+//  depth of the native queue's spill, see [YuvUtils.configureQueueSpill]
+data class SpillStats(
+    //  frames waiting in the spill now, and the most that waited at once
+    val depth: Long,
+    val peakDepth: Long,
+    val capacity: Long
+) {
+    companion object {
+        //  layout written by getNativeSpillStats in yuv_copy.cpp, null without a spill
+        fun fromArray(values: LongArray): SpillStats? {
+            if (values.size < 3) {
+                return null
+            }
+            return SpillStats(values[0], values[1], values[2])
+        }
+    }
+}
+
+//  last motion analysis of a gated native stream, see [YuvUtils.configureMotionGate]
+data class MotionStats(
+    //  mean absolute luma difference to the previous frame, 0-255
+    val score: Double,
+    val changedBlocks: Long,
+    //  size of the block grid [YuvUtils.getMotionMap] covers
+    val columns: Long,
+    val rows: Long,
+    val sceneCut: Boolean,
+    val analyzedFrames: Long,
+    val sceneCuts: Long
+) {
+    companion object {
+        //  layout written by getNativeMotionStats in yuv_copy.cpp, null without a motion gate
+        fun fromArray(values: LongArray): MotionStats? {
+            if (values.size < 7) {
+                return null
+            }
+            return MotionStats(values[0] / 1000.0, values[1], values[2], values[3], values[4] != 0L, values[5],
+                values[6])
+        }
+    }
+}
+
+//  exposure statistics one full-size native copy gathered, see [YuvUtils.configureImageStats]
+data class ImageStats(
+    val timestampUs: Long,
+    val width: Long,
+    val height: Long,
+    //  0-255
+    val lumaMean: Double,
+    val lumaVariance: Double,
+    val uMean: Double,
+    val vMean: Double,
+    //  pixels per luma level, 256 bins
+    val histogram: LongArray
+) {
+    //  share of pixels at the top or bottom of the range, for clipping checks
+    fun clippedShare(levels: Int = 4): Double {
+        val total = histogram.sum()
+        if (total == 0L) {
+            return 0.0
+        }
+        val clipped = (0 until levels).sumOf { histogram[it] + histogram[255 - it] }
+        return clipped.toDouble() / total
+    }
+
+    companion object {
+        //  layout written by getNativeImageStats in yuv_copy.cpp, null when the frame was not measured
+        fun fromArray(values: LongArray): ImageStats? {
+            if (values.size < 9 + 256) {
+                return null
+            }
+            val lumaCount = values[5].coerceAtLeast(1).toDouble()
+            val chromaCount = values[8].coerceAtLeast(1).toDouble()
+            val lumaMean = values[3] / lumaCount
+            val lumaVariance = (values[4] / lumaCount - lumaMean * lumaMean).coerceAtLeast(0.0)
+            return ImageStats(values[0], values[1], values[2], lumaMean, lumaVariance, values[6] / chromaCount,
+                values[7] / chromaCount, values.copyOfRange(9, 9 + 256))
+        }
+    }
+}
+
+//  state of the native pre-roll store, see [YuvUtils.startPreRoll]
+data class PreRollStats(
+    val frames: Long,
+    val storedBytes: Long,
+    val rawBytes: Long,
+    //  presentation times (us) of the oldest and newest frame held, -1 when empty
+    val oldestUs: Long,
+    val newestUs: Long,
+    val evictedFrames: Long,
+    //  frames that did not fit even after evicting everything
+    val refusedFrames: Long
+) {
+    val compressionRatio: Double
+        get() = if (storedBytes > 0) rawBytes.toDouble() / storedBytes else 0.0
+
+    val durationUs: Long
+        get() = if (frames > 0) newestUs - oldestUs else 0
+
+    companion object {
+        //  layout written by getNativePreRollStats in yuv_copy.cpp, null without a store
+        fun fromArray(values: LongArray): PreRollStats? {
+            if (values.size < 7) {
+                return null
+            }
+            return PreRollStats(values[0], values[1], values[2], values[3], values[4], values[5], values[6])
+        }
+    }
+}
+
+//  frames one output of a native output graph took, see [YuvUtils.addNativeOutput]
+data class OutputStats(
+    val deliveredFrames: Long,
+    //  frames its pacer kept that its sink had no free buffer for
+    val missedFrames: Long
+) {
+    companion object {
+        //  layout written by getNativeOutputStats in yuv_copy.cpp, one pair per output; empty without outputs
+        fun fromArray(values: LongArray): List<OutputStats> =
+            (0 until values.size / 2).map { OutputStats(values[it * 2], values[it * 2 + 1]) }
+    }
+}
+
+//  one CPU of the device, see [YuvUtils.getCpuTopology]
+data class CpuCore(
+    val id: Int,
+    //  0 = the slowest cluster
+    val cluster: Int,
+    //  relative compute capacity, 1024 = the biggest core; 0 when the kernel does not report it
+    val capacity: Int,
+    val maxFreqKhz: Long
+) {
+    companion object {
+        //  layout written by getNativeCpuTopology in yuv_copy.cpp, four values per core
+        fun fromArray(values: LongArray): List<CpuCore> =
+            (0 until values.size / 4).map {
+                CpuCore(values[it * 4].toInt(), values[it * 4 + 1].toInt(), values[it * 4 + 2].toInt(),
+                    values[it * 4 + 3])
+            }
+    }
+}
+
+//  where the work of one kind of native thread ran, see [YuvUtils.configureThreadPlacement]
+data class RolePlacement(
+    //  frames or bands run per cluster, slowest cluster first
+    val runsPerCluster: List<Long>,
+    //  of those, the ones that ran outside the configured clusters
+    val misplacedRuns: Long,
+    //  placements the kernel refused, e.g. a cpuset without the cluster or a nice value below the limit
+    val failures: Long
+)
+
+data class PlacementStats(
+    val ingest: RolePlacement,
+    val copyWorkers: RolePlacement,
+    val feeders: RolePlacement
+) {
+    companion object {
+        //  layout written by getNativePlacementStats in yuv_copy.cpp
+        fun fromArray(values: LongArray): PlacementStats {
+            val clusters = values[0].toInt()
+            fun role(index: Int): RolePlacement {
+                val base = 1 + index * (2 + clusters)
+                return RolePlacement(values.slice(base + 2 until base + 2 + clusters), values[base], values[base + 1])
+            }
+            return PlacementStats(role(0), role(1), role(2))
+        }
+    }
+}
@@ -1,7 +1,7 @@
 package com.qdev.singlesurfacedualquality.utils
 
 import android.media.Image
-import com.qdev.singlesurfacedualquality.YUV420
+import android.view.Surface
 import java.nio.ByteBuffer
 
 object YuvUtils {
@@ -9,10 +9,122 @@ object YuvUtils {
         System.loadLibrary("yuv_copy")
     }
 
+    //  filters for scaleToImage, must match ScaleFilter in yuv_scaler.h
+    const val SCALE_FILTER_BOX = 0
+    const val SCALE_FILTER_BILINEAR = 1
+    const val SCALE_FILTER_AREA = 2
+    //  scaleFilter for startNativeFeeder: copy at the capture size instead of scaling
+    const val NATIVE_FEEDER_COPY = -1
+
+    //  layouts for the packed exports, must match YUVLayout in yuv_convert.h
+    const val PACKED_I420 = 0
+    const val PACKED_NV12 = 1
+    const val PACKED_NV21 = 2
+
+    //  policies for configureDropPolicy, must match DropPolicy in frame_ring.h
+    const val DROP_NEWEST = 0
+    const val DROP_OLDEST = 1
+    const val DROP_BLOCK = 2
+
+    //  roles for configureThreadPlacement, must match ThreadRole in cpu_topology.h
+    const val THREAD_INGEST = 0
+    const val THREAD_COPY_WORKERS = 1
+    const val THREAD_FEEDERS = 2
+    //  nice for configureThreadPlacement: leave the threads' nice value alone
+    const val NICE_UNCHANGED = Int.MIN_VALUE
+
+    //  stats stages copyToImage records its copy under, must match FrameStage in frame_stats.h
+    const val STAGE_HQ_COPY = 2
+    const val STAGE_LQ_COPY = 3
+
     external fun setupQueue(capacity: Int, width: Int, height: Int)
 
     external fun cleanupQueue()
 
+    /**
+     * Sizes the native worker pool that splits each [copyToImage] into row bands. [threadCount]
+     * includes the calling thread (0 = one per core, 1 = copy on the caller only), [bandBytes] is the
+     * amount of image data per band (0 = default). Applies from the next [setupQueue] / [setupZeroCopyQueue].
+     */
+    external fun configureCopyWorkers(threadCount: Int, bandBytes: Int)
+
+    /**
+     * Pins the native threads of a THREAD_* [role] to the clusters in [clusterMask] (bit i = cluster i
+     * of [getCpuTopology], slowest first; 0 = any core) and sets their [nice] value, e.g. -10 for
+     * Process.THREAD_PRIORITY_VIDEO, or [NICE_UNCHANGED]. Running threads follow at their next frame;
+     * where the work then ran is in [getPlacementStats]. False if no cluster in the mask exists.
+     */
+    external fun configureThreadPlacement(role: Int, clusterMask: Int, nice: Int): Boolean
+
+    //  the device's CPUs grouped into clusters of equal cores, from /sys/devices/system/cpu
+    fun getCpuTopology(): List<CpuCore> = CpuCore.fromArray(getNativeCpuTopology())
+
+    private external fun getNativeCpuTopology(): LongArray
+
+    //  the [count] fastest clusters of [cores] as a [configureThreadPlacement] mask
+    fun fastestClusters(cores: List<CpuCore>, count: Int): Int {
+        val clusters = (cores.maxOfOrNull { it.cluster } ?: -1) + 1
+        return (maxOf(0, clusters - count) until clusters).fold(0) { mask, cluster -> mask or (1 shl cluster) }
+    }
+
+    //  on which clusters the native threads' work ran since the last [reset]
+    fun getPlacementStats(reset: Boolean): PlacementStats = PlacementStats.fromArray(getNativePlacementStats(reset))
+
+    private external fun getNativePlacementStats(reset: Boolean): LongArray
+
+    /**
+     * What the native queue does when the slowest reader is a full queue behind: refuse the new frame
+     * ([DROP_NEWEST], the default), evict the readers' oldest queued frame ([DROP_OLDEST]) or make the
+     * camera thread wait up to [blockTimeoutMs] before refusing it ([DROP_BLOCK]). Every drop is counted
+     * by reason in [getStats]. Applies from the next [setupQueue] / [setupZeroCopyQueue].
+     */
+    external fun configureDropPolicy(policy: Int, blockTimeoutMs: Int)
+
+    /**
+     * Sizes the native queue's frame memory for captures up to [maxWidth] x [maxHeight] (0 = just the
+     * [setupQueue] size), so [reconfigureQueue] within that budget allocates nothing.
+     * Applies from the next [setupQueue].
+     */
+    external fun configureQueueBudget(maxWidth: Int, maxHeight: Int)
+
+    /**
+     * Lets frames that find the native queue full (an encoder stalling at a key frame, thermal
+     * throttling, ...) overflow into a memory-mapped file of [spillFrames] frames at [path] instead of
+     * being dropped. They go back into the queue in order as the readers catch up; the camera thread
+     * never waits for the file. With the spill full as well, frames are refused whatever the drop policy.
+     * [path] should be in app storage, the file is removed as soon as it is mapped. 0 frames turns it off.
+     * Applies from the next [setupQueue] / [setupZeroCopyQueue].
+     */
+    external fun configureQueueSpill(path: String, spillFrames: Int)
+
+    /**
+     * Switches the queue set up by [setupQueue] to a new capture size without tearing it down. Stop
+     * calling [addToNativeQueue] first; frames still queued are discarded, reader ids stay valid.
+     * Returns false if a reader did not finish its current copy in time or memory ran out.
+     */
+    external fun reconfigureQueue(width: Int, height: Int): Boolean
+
+    /**
+     * [reconfigureQueue] for a [setupZeroCopyQueue] queue: the native camera reader is reopened at the
+     * new size. Returns its Surface, which replaces the old capture target, or null on failure.
+     */
+    external fun reconfigureZeroCopyQueue(width: Int, height: Int, maxImages: Int): Surface?
+
+    /**
+     * Registers a reader of the native queue. Every registered reader sees every queued frame,
+     * a frame slot is only reused once all readers have copied it out. A [latestOnly] reader instead
+     * always gets the newest frame and skips the ones it fell behind on.
+     * Returns the id to pass to the copy functions, or -1 if no reader slot is left.
+     */
+    external fun registerConsumer(latestOnly: Boolean): Int
+
+    /**
+     * Limits [consumerId] to about [fps] frames per second (0 = every frame), picked by capture
+     * timestamp so the rate holds without drift whatever the camera delivers. The frames in between
+     * are passed over inside the native queue, never copied. Call right after [registerConsumer].
+     */
+    external fun setConsumerFrameRate(consumerId: Int, fps: Double)
+
     external fun copyYUV(srcImage: Image, destImage: Image)
 //    external fun copyYUV2(srcImage: Image, destImage: Image)
     external fun addToNativeQueue(yData: ByteBuffer,
@@ -24,21 +136,211 @@ object YuvUtils {
                                   yPixelStride: Int,
                                   uPixelStride: Int,
                                   vPixelStride: Int,
-                                  timestamp: Long,
+                                  timestampNs: Long,
                                   width: Int,
                                   height: Int)
 
+    /**
+     * Zero-copy alternative to [setupQueue] + [addToNativeQueue]: the native queue reads the camera
+     * buffers in place and hands them back once every consumer copied them out.
+     * Returns the Surface to use as the capture target, or null if the native reader could not be created.
+     * [maxImages] must exceed [capacity] by the number of frames the camera keeps in flight.
+     */
+    external fun setupZeroCopyQueue(capacity: Int, width: Int, height: Int, maxImages: Int): Surface?
+
     external fun isQueueEmpty(): Boolean
 
+    /**
+     * Blocks until a frame is waiting for [consumerId] (for any reader with -1) or [timeoutNs] passed,
+     * waking as soon as the frame is queued. Returns false on timeout.
+     */
+    external fun waitForFrame(consumerId: Int, timeoutNs: Long): Boolean
+
+    /**
+     * An eventfd that becomes readable whenever a frame is queued, e.g. for
+     * MessageQueue.addOnFileDescriptorEventListener; read its 8-byte counter to reset it. Owned by the
+     * native queue and closed by [cleanupQueue]. -1 if there is no queue.
+     */
+    external fun getFrameEventFd(): Int
+
+    //  capture timestamp (ns) of the next frame waiting for the consumer, -1 if it is caught up
+    external fun peekTimestamp(consumerId: Int): Long
+
     /*external fun copyFromQueueToImage(image: Image, removeFromQueue: Boolean): Boolean*/
 
-    external fun copyToImage2(image: Image, removeFromQueue: Boolean)
+    /**
+     * Copies the consumer's next frame into [image], converting between I420, NV12 and NV21 as needed.
+     * [bufferIndex] is the codec input buffer index [image] belongs to: its planes are looked up only
+     * the first time that index is seen (pass -1 for Images that are not codec buffers). The copy is
+     * timed under [stage], a STAGE_*_COPY for the stream the consumer feeds.
+     * Returns the size to pass to queueInputBuffer, 0 if no frame is waiting.
+     */
+    external fun copyToImage(image: Image, bufferIndex: Int, consumerId: Int, stage: Int): Int
+
+    /**
+     * Downscales the consumer's next frame into [image], which may be any size smaller than the
+     * capture size. Box only applies to exact 2:1 sizes and falls back to area averaging otherwise.
+     * [bufferIndex] and the return value work as for [copyToImage].
+     */
+    external fun scaleToImage(image: Image, bufferIndex: Int, consumerId: Int, filter: Int): Int
+
+    /**
+     * Encodes [consumerId]'s frames without the Kotlin codec loop: a native thread copies
+     * ([NATIVE_FEEDER_COPY]) or downscales (a SCALE_FILTER_*) each frame into a [mime] encoder of
+     * [width] x [height] and muxes the output as MP4 into [outputFd], which it takes over
+     * (ParcelFileDescriptor.detachFd()). Do not read [consumerId] from Kotlin meanwhile.
+     * Runs until [stopNativeFeeder] or [cleanupQueue]; false if the encoder could not be set up.
+     */
+    external fun startNativeFeeder(consumerId: Int, mime: String, outputFd: Int, width: Int, height: Int,
+                                   bitRate: Int, frameRate: Int, iFrameInterval: Int, scaleFilter: Int): Boolean
+
+    /**
+     * Both streams off one consumer in one native pass per frame: each frame is copied into an hq*
+     * encoder muxed into [hqFd], and the frames a pacer at [lqFrameRate] keeps are downscaled with
+     * [scaleFilter] into an lq* encoder muxed into [lqFd] while the frame is still in cache. Reads each
+     * queued frame from memory once instead of twice, which counts at 4K. Takes over both fds; stopped
+     * like [startNativeFeeder]. False if either encoder could not be set up.
+     */
+    external fun startNativeFanOut(consumerId: Int, mime: String,
+                                   hqFd: Int, hqWidth: Int, hqHeight: Int, hqBitRate: Int, hqFrameRate: Int,
+                                   hqIFrameInterval: Int,
+                                   lqFd: Int, lqWidth: Int, lqHeight: Int, lqBitRate: Int, lqFrameRate: Int,
+                                   lqIFrameInterval: Int, scaleFilter: Int): Boolean
+
+    //  finishes [consumerId]'s native encode and closes its file(s)
+    external fun stopNativeFeeder(consumerId: Int)
+
+    /**
+     * Adds an encoder to [consumerId]'s output graph: the frames a pacer at [frameRate] keeps are copied,
+     * or scaled with [scaleFilter] when [width] x [height] is not the capture size, into an encoder muxed
+     * into [outputFd], which is taken over. All outputs of a consumer are written in one native pass per
+     * frame, so each extra output costs only its own conversion. The highest [priority] output paces the
+     * graph; the others skip frames their encoder is not ready for. Takes the consumer over from a native
+     * feeder. Returns the output's index, -1 on failure. Add every output, then [startNativeOutputs].
+     */
+    external fun addNativeOutput(consumerId: Int, mime: String, outputFd: Int, width: Int, height: Int,
+                                 bitRate: Int, frameRate: Int, iFrameInterval: Int, priority: Int,
+                                 scaleFilter: Int): Int
+
+    //  an output of [consumerId]'s graph that keeps its newest frame packed as a PACKED_* [layout], read
+    //  with [readNativeOutput]; e.g. a thumbnail or analytics frame. Index or -1 like [addNativeOutput]
+    external fun addNativeFrameOutput(consumerId: Int, width: Int, height: Int, layout: Int, frameRate: Double,
+                                      priority: Int, scaleFilter: Int): Int
+
+    //  feeds the outputs added to [consumerId] until [stopNativeFeeder] or [cleanupQueue]
+    external fun startNativeOutputs(consumerId: Int): Boolean
+
+    //  newest frame of frame output [output] into [buffer] (at least [getPackedFrameSize] bytes); its
+    //  presentation time (us), -1 when none arrived yet
+    external fun readNativeOutput(consumerId: Int, output: Int, buffer: ByteBuffer): Long
+
+    fun getOutputStats(consumerId: Int): List<OutputStats> =
+        OutputStats.fromArray(getNativeOutputStats(consumerId))
+
+    private external fun getNativeOutputStats(consumerId: Int): LongArray
+
+    /**
+     * Leaves frames in which nothing moved out of natively downscaled streams ([startNativeFeeder] with
+     * a SCALE_FILTER_*, the LQ side of [startNativeFanOut]), keeping at least [minFps] of them, and
+     * forces a key frame in the feeder's streams when [sceneCutPercent] of the 16x16 luma blocks change
+     * at once. A block changes when its mean luma difference to the previous frame exceeds
+     * [blockThreshold] levels; 0 turns the gate off. Applies to feeders started afterwards.
+     */
+    external fun configureMotionGate(blockThreshold: Int, sceneCutPercent: Int, minFps: Double)
+
+    /**
+     * Zooms every stream copied or encoded off the native queue into part of the camera frame: [left],
+     * [top], [width] and [height] as fractions of the frame in sensor orientation. Each stream keeps its
+     * size, the region is resampled to it. Applies from the next frame; a [width] or [height] of 0 goes
+     * back to the whole frame.
+     */
+    external fun setCropRegion(left: Float, top: Float, width: Float, height: Float)
+
+    /**
+     * Has the full-size native copies ([copyToImage], copy feeders, the HQ side of [startNativeFanOut])
+     * measure each frame while copying it: luma histogram, mean and variance and chroma means, at no
+     * extra pass over the frame. Cropped frames are not measured. Feeders started afterwards follow.
+     */
+    external fun configureImageStats(enabled: Boolean)
+
+    //  statistics of the frame captured at [timestampNs] (as [peekTimestamp] returns it), -1 for the newest
+    //  measured one; null when that frame was not measured or is too old
+    fun getImageStats(timestampNs: Long): ImageStats? = ImageStats.fromArray(getNativeImageStats(timestampNs))
+
+    private external fun getNativeImageStats(timestampNs: Long): LongArray
+
+    fun getMotionStats(consumerId: Int): MotionStats? = MotionStats.fromArray(getNativeMotionStats(consumerId))
+
+    private external fun getNativeMotionStats(consumerId: Int): LongArray
+
+    //  per 16x16 block mean luma difference of the last gated frame, row-major over [MotionStats.columns]
+    external fun getMotionMap(consumerId: Int): ByteArray
+
+    /**
+     * Keeps the newest captured frames, losslessly compressed, in [budgetBytes] of native memory, on a
+     * queue reader of its own. [width] x [height] must be the capture size; a key frame every
+     * [keyFrameInterval] frames bounds how far back a replay has to decode. Every [startNativeFeeder]
+     * from now on first encodes the stored frames, then continues live without a gap.
+     * False without a queue, without a free reader slot or if the budget could not be allocated.
+     */
+    external fun startPreRoll(width: Int, height: Int, budgetBytes: Long, keyFrameInterval: Int): Boolean
+
+    //  stops storing frames; the stored ones stay available to native feeders until [cleanupQueue]
+    external fun stopPreRoll()
+
+    fun getPreRollStats(): PreRollStats? = PreRollStats.fromArray(getNativePreRollStats())
+
+    private external fun getNativePreRollStats(): LongArray
+
+    /**
+     * Native per-stage latency histograms and frame counters since the previous call with [reset],
+     * recorded without logging on the frame path.
+     */
+    fun getStats(reset: Boolean = true): NativeStats = NativeStats.fromArray(getNativeStats(reset))
+
+    private external fun getNativeStats(reset: Boolean): LongArray
+
+    //  depth of the spill set up by [configureQueueSpill], null without one
+    fun getSpillStats(): SpillStats? = SpillStats.fromArray(getNativeSpillStats())
+
+    private external fun getNativeSpillStats(): LongArray
+
+    /**
+     * Writes every frame passed to [addToNativeQueue], strides and timestamps included, into a capture
+     * file at [path] for replaying the pipeline offline (yuv_bench --capture). Frames the disk cannot keep
+     * up with are left out. Zero-copy ingest is not recorded. False if the file could not be created.
+     */
+    external fun startCaptureRecording(path: String): Boolean
+
+    //  finishes the capture file; false if it could not be written completely
+    external fun stopCaptureRecording(): Boolean
+
+    /**
+     * Feeds a capture file into the queue set up by [setupQueue] instead of the camera, at the recorded
+     * pace times [speed] (0 = as fast as the queue takes frames), [loops] times (0 = until
+     * [stopCaptureReplay] or [cleanupQueue]). False without a queue or if [path] is not a capture.
+     */
+    external fun startCaptureReplay(path: String, speed: Double, loops: Int): Boolean
+
+    external fun stopCaptureReplay()
+
+    //  bytes a packed export of a [width] x [height] frame writes, for sizing the buffer once
+    external fun getPackedFrameSize(width: Int, height: Int): Int
 
-    external fun copyToImageV2(image: Image, removeFromQueue: Boolean)
+    /**
+     * Writes [consumerId]'s next frame tightly packed (no row padding) as a PACKED_* [layout] into
+     * [buffer], a direct ByteBuffer of at least [getPackedFrameSize] bytes that can be reused for every
+     * grab. Returns the frame's capture timestamp (ns), -1 if no frame was waiting or [buffer] is too
+     * small. [buffer]'s position and limit are not changed.
+     */
+    external fun exportFrame(consumerId: Int, buffer: ByteBuffer, layout: Int): Long
 
-    external fun copyToImageV3(image: Image, removeFromQueue: Boolean)
+    //  [exportFrame] into native memory, e.g. an ML runtime's input tensor at [address]
+    external fun exportFrameToAddress(consumerId: Int, address: Long, capacity: Long, layout: Int): Long
 
-    external fun copyYUVBuffer(image: Image): ByteArray //  hits buffer overflow
+    //  [image] packed like [exportFrame] into [buffer]; the bytes written, 0 if [buffer] is too small
+    external fun exportImage(image: Image, buffer: ByteBuffer, layout: Int): Int
 
-    external fun copyToImage(yuv420: YUV420, image: Image)
+    //  [image] as packed I420 in a new array on every call; [exportImage] reuses a buffer instead
+    external fun copyYUVBuffer(image: Image): ByteArray?
 }
\ No newline at end of file
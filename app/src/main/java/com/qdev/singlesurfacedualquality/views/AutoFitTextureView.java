@@ -30,15 +30,33 @@ import android.view.View;
 import android.view.WindowManager;
 
 /**
- * A {@link TextureView} that can be adjusted to a specified aspect ratio.
+ * A {@link TextureView} that can be adjusted to a specified aspect ratio, zoomed with a pinch and panned
+ * with a drag. The part of the view left visible is reported to an {@link OnRegionChangedListener}.
  */
 public class AutoFitTextureView extends TextureView implements View.OnTouchListener {
 
+    /**
+     * Told the visible part of the view after every zoom or pan, as fractions of the view's width and
+     * height; (0, 0, 1, 1) when not zoomed.
+     */
+    public interface OnRegionChangedListener {
+        void onRegionChanged(float left, float top, float width, float height);
+    }
+
     private int mRatioWidth = 0;
     private int mRatioHeight = 0;
 
     private Matrix mMatrix;
 
+    // Transform set from outside (the preview rotation), the zoom is applied on top of it
+    private final Matrix mBaseMatrix = new Matrix();
+
+    private final Matrix mTransform = new Matrix();
+
+    private OnRegionChangedListener mRegionListener;
+
+    private final float[] mRegion = {0.f, 0.f, 1.f, 1.f};
+
     private ScaleGestureDetector mScaleDetector;
 
     private MoveGestureDetector mMoveDetector;
@@ -59,6 +77,7 @@ public class AutoFitTextureView extends TextureView implements View.OnTouchListe
 
     public AutoFitTextureView(Context context, AttributeSet attrs, int defStyle) {
         super(context, attrs, defStyle);
+        init(context);
     }
 
     @TargetApi(Build.VERSION_CODES.LOLLIPOP)
@@ -76,6 +95,27 @@ public class AutoFitTextureView extends TextureView implements View.OnTouchListe
 
         mMoveDetector = new MoveGestureDetector(context, new MoveListener());
 
+        setOnTouchListener(this);
+
+    }
+
+    public void setOnRegionChangedListener(OnRegionChangedListener listener) {
+        mRegionListener = listener;
+    }
+
+    /**
+     * Sets the base transform, e.g. the preview rotation; the current zoom stays applied on top of it.
+     */
+    @Override
+    public void setTransform(Matrix transform) {
+        mBaseMatrix.set(transform);
+        applyTransform();
+    }
+
+    private void applyTransform() {
+        mTransform.set(mBaseMatrix);
+        mTransform.postConcat(mMatrix);
+        super.setTransform(mTransform);
     }
 
     @Override
@@ -135,14 +175,42 @@ public class AutoFitTextureView extends TextureView implements View.OnTouchListe
 
         mMatrix.postTranslate(dx, dy);
 
-        setTransform(mMatrix);
+        applyTransform();
 
         setAlpha(1);
 
+        notifyRegion(dx, dy);
+
         return true; // indicate event was handled
 
     }
 
+    // The view's visible part: the zoom scales about the top left corner, then moves it by (dx, dy) <= 0
+    private void notifyRegion(float dx, float dy) {
+
+        if (mRegionListener == null || getWidth() == 0 || getHeight() == 0) {
+            return;
+        }
+
+        float left = -dx / (getWidth() * mScaleFactor);
+
+        float top = -dy / (getHeight() * mScaleFactor);
+
+        float size = 1.f / mScaleFactor;
+
+        if (left == mRegion[0] && top == mRegion[1] && size == mRegion[2]) {
+            return;
+        }
+
+        mRegion[0] = left;
+        mRegion[1] = top;
+        mRegion[2] = size;
+        mRegion[3] = size;
+
+        mRegionListener.onRegionChanged(left, top, size, size);
+
+    }
+
     /**
      * Sets the aspect ratio for this view. The size of the view will be measured based on the ratio
      * calculated from the parameters. Note that the actual sizes of parameters don't matter, that
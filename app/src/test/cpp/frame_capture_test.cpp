@@ -0,0 +1,184 @@
+// Host tests of capture files, run by ctest.
+//
+// Frames in planar and both semi-planar layouts, with padded rows, are recorded and read back: every frame
+// must come back with its timestamp, size, strides and every sample unchanged. Replayed into a FrameRing,
+// the first pass must carry the recorded timestamps and a second pass continue them one frame interval
+// after the last, with the same pixels.
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "frame_capture.h"
+#include "frame_ring.h"
+#include "test_check.h"
+
+namespace {
+
+constexpr int kWidth = 62;
+constexpr int kHeight = 46;
+constexpr int kRowStride = 80;
+constexpr int kFrames = 9;
+constexpr long long kFrameIntervalNs = 33333333;
+constexpr const char *kCapturePath = "frame_capture_test.capture";
+
+std::mt19937 rng(20240611);
+
+enum class Layout { I420, NV12, NV21 };
+
+// A camera frame as an AImage hands it over: padded rows, chroma planar or interleaved in one buffer
+struct CameraFrame {
+    long long timestampNs;
+    std::vector<uint8_t> luma = std::vector<uint8_t>((size_t) kRowStride * kHeight);
+    std::vector<uint8_t> chroma = std::vector<uint8_t>((size_t) kRowStride * kHeight);
+    const uint8_t *data[3];
+    int rowStride[3];
+    int pixelStride[3];
+
+    CameraFrame(long long timestampNs, Layout layout) : timestampNs(timestampNs) {
+        for (uint8_t &byte : luma) {
+            byte = (uint8_t) rng();
+        }
+        for (uint8_t &byte : chroma) {
+            byte = (uint8_t) rng();
+        }
+        data[0] = luma.data();
+        rowStride[0] = kRowStride;
+        pixelStride[0] = 1;
+        if (layout == Layout::I420) {
+            data[1] = chroma.data();
+            data[2] = chroma.data() + (size_t) kRowStride / 2 * (kHeight / 2);
+            rowStride[1] = rowStride[2] = kRowStride / 2;
+            pixelStride[1] = pixelStride[2] = 1;
+        } else {
+            int uOffset = layout == Layout::NV21 ? 1 : 0;
+            data[1] = chroma.data() + uOffset;
+            data[2] = chroma.data() + 1 - uOffset;
+            rowStride[1] = rowStride[2] = kRowStride;
+            pixelStride[1] = pixelStride[2] = 2;
+        }
+    }
+
+    bool record(CaptureRecorder &recorder) const {
+        return recorder.record(kWidth, kHeight, timestampNs, data[0], rowStride[0], pixelStride[0], data[1],
+                               rowStride[1], pixelStride[1], data[2], rowStride[2], pixelStride[2]);
+    }
+};
+
+// Whether every sample of the frame at planes / strides equals the camera frame's
+bool sameSamples(const CameraFrame &expected, const uint8_t *const *planes, const int *rowStrides,
+                 const int *pixelStrides) {
+    for (int plane = 0; plane < 3; plane++) {
+        int width = plane == 0 ? kWidth : kWidth / 2;
+        int height = plane == 0 ? kHeight : kHeight / 2;
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++) {
+                uint8_t want = expected.data[plane][(size_t) y * expected.rowStride[plane] +
+                                                    (size_t) x * expected.pixelStride[plane]];
+                if (planes[plane][(size_t) y * rowStrides[plane] + (size_t) x * pixelStrides[plane]] != want) {
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+std::vector<CameraFrame> cameraFrames() {
+    std::vector<CameraFrame> frames;
+    const Layout layouts[] = {Layout::I420, Layout::NV12, Layout::NV21};
+    for (int i = 0; i < kFrames; i++) {
+        frames.emplace_back(1000000000LL + i * kFrameIntervalNs, layouts[i % 3]);
+    }
+    return frames;
+}
+
+bool recordAll(const std::vector<CameraFrame> &frames) {
+    CaptureRecorder recorder;
+    if (!recorder.start(kCapturePath, kFrames)) {
+        return false;
+    }
+    for (const CameraFrame &frame : frames) {
+        CHECK(frame.record(recorder));
+    }
+    bool stopped = recorder.stop();
+    CHECK(recorder.getRecordedFrames() == (uint64_t) kFrames);
+    CHECK(recorder.getMissedFrames() == 0);
+    CHECK(!recorder.hasFailed());
+    return stopped;
+}
+
+void testRecordAndRead() {
+    std::vector<CameraFrame> frames = cameraFrames();
+    CHECK(recordAll(frames));
+
+    CaptureReader reader;
+    CHECK(reader.open(kCapturePath));
+    CHECK(reader.getFrameCount() == kFrames);
+    CHECK(reader.getDurationNs() == (kFrames - 1) * kFrameIntervalNs);
+    for (int i = 0; i < reader.getFrameCount(); i++) {
+        BorrowedFrame frame{};
+        CHECK(reader.getFrame(i, frame));
+        CHECK(frame.timestampNs == frames[i].timestampNs);
+        CHECK(frame.width == kWidth && frame.height == kHeight);
+        for (int plane = 0; plane < 3; plane++) {
+            CHECK(frame.rowStride[plane] == frames[i].rowStride[plane]);
+            CHECK(frame.pixelStride[plane] == frames[i].pixelStride[plane]);
+        }
+        // Interleaved chroma stays one span, the planes one byte apart
+        CHECK(frame.planeData[2] - frame.planeData[1] == frames[i].data[2] - frames[i].data[1]);
+        CHECK(sameSamples(frames[i], frame.planeData, frame.rowStride, frame.pixelStride));
+    }
+    BorrowedFrame outside{};
+    CHECK(!reader.getFrame(kFrames, outside));
+    reader.close();
+}
+
+void testReplay() {
+    std::vector<CameraFrame> frames = cameraFrames();
+    CHECK(recordAll(frames));
+    CaptureReader reader;
+    CHECK(reader.open(kCapturePath));
+
+    // Room for both passes, so nothing is dropped while the consumer waits for the replay to finish
+    FrameRing ring(kFrames * 2, kWidth, kHeight);
+    int consumer = ring.registerConsumer();
+    CaptureReplayer replayer(reader, &ring);
+    CHECK(replayer.start(0, 2));
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (replayer.isRunning() && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    replayer.stop();
+    CHECK(replayer.getPushedFrames() == (uint64_t) kFrames * 2);
+    CHECK(replayer.getRefusedFrames() == 0);
+
+    long long loopNs = kFrames * kFrameIntervalNs;
+    for (int i = 0; i < kFrames * 2; i++) {
+        YUV420 *frame = ring.acquire(consumer);
+        CHECK(frame != nullptr);
+        if (frame == nullptr) {
+            break;
+        }
+        const CameraFrame &expected = frames[i % kFrames];
+        CHECK(frame->timestampNs == expected.timestampNs + (i / kFrames) * loopNs);
+        YUVImageView view = frame->view();
+        const uint8_t *planes[3] = {view.data[0], view.data[1], view.data[2]};
+        CHECK(sameSamples(expected, planes, view.rowStride, view.pixelStride));
+        ring.release(consumer);
+    }
+    ring.unregisterConsumer(consumer);
+    reader.close();
+}
+
+}  // namespace
+
+int main() {
+    testRecordAndRead();
+    testReplay();
+    remove(kCapturePath);
+    return checkResult();
+}
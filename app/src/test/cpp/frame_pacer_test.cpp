@@ -0,0 +1,138 @@
+// Host tests of the frame pacer, run by ctest.
+//
+// A 30 fps camera thinned to 15 fps must keep every other frame, with timestamps on time, jittered within
+// the tolerance or off by a 29.97 fps clock. After a stall or when timestamps go backwards (a new capture
+// session) the pacer must start over on the next frame instead of passing a burst to catch up.
+
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "frame_pacer.h"
+#include "test_check.h"
+
+namespace {
+
+constexpr long long kCameraIntervalNs = 33333333;
+constexpr long long kPacedIntervalNs = 66666667;
+
+std::mt19937 rng(20240611);
+
+// Indices of the frames at timestamps the pacer keeps
+std::vector<int> keptFrames(FramePacer &pacer, const std::vector<long long> &timestamps) {
+    std::vector<int> kept;
+    for (size_t i = 0; i < timestamps.size(); i++) {
+        if (pacer.accept(timestamps[i])) {
+            kept.push_back((int) i);
+        }
+    }
+    return kept;
+}
+
+// Timestamps of count camera frames from startNs, each moved by up to jitterNs either way
+std::vector<long long> cameraTimestamps(long long startNs, int count, long long jitterNs = 0) {
+    std::vector<long long> timestamps;
+    std::uniform_int_distribution<long long> jitter(-jitterNs, jitterNs);
+    for (int i = 0; i < count; i++) {
+        timestamps.push_back(startNs + i * kCameraIntervalNs + (jitterNs > 0 ? jitter(rng) : 0));
+    }
+    return timestamps;
+}
+
+bool everyOther(const std::vector<int> &kept, int first, int count) {
+    if (kept.size() != (size_t) (count + 1) / 2) {
+        return false;
+    }
+    for (size_t i = 0; i < kept.size(); i++) {
+        if (kept[i] != first + (int) i * 2) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void testHalfRate() {
+    FramePacer pacer;
+    pacer.setFrameRate(15);
+    CHECK(everyOther(keptFrames(pacer, cameraTimestamps(1000000000LL, 150)), 0, 150));
+
+    // Jitter inside the tolerance (a quarter of 66.7 ms) never moves the pick
+    char what[96];
+    for (long long jitterNs : {1000000LL, 4000000LL, 8000000LL}) {
+        pacer.setFrameRate(15);
+        snprintf(what, sizeof(what), "every other frame with %lld ns of jitter", jitterNs);
+        check(everyOther(keptFrames(pacer, cameraTimestamps(1000000000LL, 150, jitterNs)), 0, 150), what,
+              __FILE__, __LINE__);
+    }
+}
+
+void testDriftingClock() {
+    // 29.97 fps for 20 s: the grid does not drift, so 15 fps on average and never two frames in a row
+    // closer than the tolerance allows
+    FramePacer pacer;
+    pacer.setFrameRate(15);
+    std::vector<long long> timestamps;
+    for (int i = 0; i < 600; i++) {
+        timestamps.push_back((long long) (i * 1001000000.0 / 30000));
+    }
+    std::vector<int> kept = keptFrames(pacer, timestamps);
+    long long durationNs = timestamps.back() - timestamps.front();
+    long long expected = durationNs / kPacedIntervalNs + 1;
+    CHECK(kept.size() >= (size_t) expected - 1 && kept.size() <= (size_t) expected + 1);
+    for (size_t i = 1; i < kept.size(); i++) {
+        CHECK(timestamps[kept[i]] - timestamps[kept[i - 1]] >= kPacedIntervalNs - kPacedIntervalNs / 4);
+    }
+}
+
+void testStall() {
+    FramePacer pacer;
+    pacer.setFrameRate(15);
+    std::vector<long long> timestamps = cameraTimestamps(1000000000LL, 30);
+    // A second without frames, then the camera carries on one frame interval off the old grid
+    std::vector<long long> after = cameraTimestamps(timestamps.back() + 1000000000LL + kCameraIntervalNs, 30);
+    timestamps.insert(timestamps.end(), after.begin(), after.end());
+
+    std::vector<int> kept = keptFrames(pacer, timestamps);
+    CHECK(kept.size() == 30);
+    if (kept.size() == 30) {
+        CHECK(everyOther(std::vector<int>(kept.begin(), kept.begin() + 15), 0, 30));
+        CHECK(everyOther(std::vector<int>(kept.begin() + 15, kept.end()), 30, 30));
+    }
+}
+
+void testBackwards() {
+    FramePacer pacer;
+    pacer.setFrameRate(15);
+    std::vector<long long> timestamps = cameraTimestamps(5000000000LL, 30);
+    // A new session whose clock starts earlier, on an odd frame of the old grid
+    std::vector<long long> restarted = cameraTimestamps(1000000000LL + kCameraIntervalNs, 30);
+    timestamps.insert(timestamps.end(), restarted.begin(), restarted.end());
+
+    std::vector<int> kept = keptFrames(pacer, timestamps);
+    CHECK(kept.size() == 30);
+    if (kept.size() == 30) {
+        CHECK(everyOther(std::vector<int>(kept.begin(), kept.begin() + 15), 0, 30));
+        CHECK(everyOther(std::vector<int>(kept.begin() + 15, kept.end()), 30, 30));
+    }
+}
+
+void testPassThrough() {
+    FramePacer pacer;
+    std::vector<long long> timestamps = cameraTimestamps(1000000000LL, 30, 4000000);
+    CHECK(keptFrames(pacer, timestamps).size() == 30);
+    pacer.setFrameRate(15);
+    pacer.setFrameRate(0);
+    CHECK(pacer.getFrameRate() == 0);
+    CHECK(keptFrames(pacer, timestamps).size() == 30);
+}
+
+}  // namespace
+
+int main() {
+    testHalfRate();
+    testDriftingClock();
+    testStall();
+    testBackwards();
+    testPassThrough();
+    return checkResult();
+}
@@ -0,0 +1,230 @@
+// Host tests of the frame ring's consumer lifecycle on borrowed (zero-copy) frames, run by ctest.
+//
+//   frame_ring_test [--seconds=N]
+//
+// Consumers register and unregister while a FakeImageSource publishes borrowed frames, so registration
+// races with publishing. A consumer must only be handed frames it holds a reference on: every acquired
+// frame must still hold the pixels it was published with (a frame handed back to the source early gets
+// refilled under the reader), and once every consumer is gone, every buffer must be back with the source.
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "frame_ring.h"
+#include "frame_source.h"
+#include "test_check.h"
+
+namespace {
+
+constexpr int kWidth = 64;
+constexpr int kHeight = 48;
+constexpr int kCapacity = 4;
+constexpr int kImages = 6;
+constexpr int kConsumers = 4;
+constexpr long long kFrameWaitNs = 1000000;
+
+// FakeImageSource stamps the luma with the low byte of the timestamp
+bool holdsStamp(const YUV420 &frame) {
+    YUVImageView view = frame.view();
+    auto stamp = (uint8_t) (frame.timestampNs & 0xff);
+    const uint8_t *last = view.data[0] + (kHeight - 1) * view.rowStride[0] + kWidth - 1;
+    return view.data[0][0] == stamp && *last == stamp;
+}
+
+// Polls until the source has every buffer back, the last reader may still be on its way out
+bool waitForReturn(const FakeImageSource &source) {
+    for (int i = 0; i < 1000 && source.getOutstanding() != 0; i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return source.getOutstanding() == 0;
+}
+
+void testRegisterWhilePublishing(double seconds) {
+    FrameRing ring(kCapacity, kWidth, kHeight);
+    ring.setDropPolicy(DropPolicy::DropOldest, 0);
+    FakeImageSource source(kWidth, kHeight, kImages);
+
+    std::atomic<bool> running{true};
+    std::atomic<int> corrupted{0};
+    std::atomic<uint64_t> acquired{0};
+    std::atomic<uint64_t> registrations{0};
+
+    std::thread producer([&] {
+        long long timestampNs = 0;
+        while (running.load(std::memory_order_relaxed)) {
+            if (!source.produce(ring, ++timestampNs)) {
+                std::this_thread::yield();
+            }
+        }
+    });
+
+    std::vector<std::thread> consumers;
+    for (int c = 0; c < kConsumers; c++) {
+        consumers.emplace_back([&, c] {
+            int round = 0;
+            while (running.load(std::memory_order_relaxed)) {
+                int id = ring.registerConsumer((c + round) % 2 == 1);
+                if (id < 0) {
+                    std::this_thread::yield();
+                    continue;
+                }
+                registrations.fetch_add(1, std::memory_order_relaxed);
+                // Short lives, so most acquires land right after a registration; half the consumers wait for
+                // a frame, the others leave as soon as there is none, so ids are handed out again at once
+                for (int i = 0; i <= round % 3; i++) {
+                    if (c % 2 == 0) {
+                        ring.waitForFrame(id, kFrameWaitNs);
+                    }
+                    YUV420 *frame = ring.acquire(id);
+                    if (frame == nullptr) {
+                        continue;
+                    }
+                    if (!holdsStamp(*frame)) {
+                        corrupted.fetch_add(1, std::memory_order_relaxed);
+                    }
+                    std::this_thread::yield();
+                    if (!holdsStamp(*frame)) {
+                        corrupted.fetch_add(1, std::memory_order_relaxed);
+                    }
+                    acquired.fetch_add(1, std::memory_order_relaxed);
+                    // Sometimes leave without releasing, unregistering must hand the frame back
+                    if (round % 5 != 4) {
+                        ring.release(id);
+                    }
+                }
+                ring.unregisterConsumer(id);
+                round++;
+            }
+        });
+    }
+
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+    running.store(false);
+    for (std::thread &consumer : consumers) {
+        consumer.join();
+    }
+    producer.join();
+
+    CHECK(corrupted.load() == 0);
+    CHECK(acquired.load() > 0);
+    CHECK(registrations.load() > 0);
+    CHECK(waitForReturn(source));
+    printf("register_while_publishing: %llu registrations, %llu frames, %d corrupted, %d outstanding\n",
+           (unsigned long long) registrations.load(), (unsigned long long) acquired.load(), corrupted.load(),
+           source.getOutstanding());
+}
+
+// The producer samples the consumers, then waits for room (Block) while one more registers. The frame it
+// publishes then does not count the newcomer, which must not be handed it: the other consumer's release
+// returns it to the source.
+void testRegisterDuringPublish() {
+    FrameRing ring(2, kWidth, kHeight);
+    ring.setDropPolicy(DropPolicy::Block, 2000 * 1000000LL);
+    FakeImageSource source(kWidth, kHeight, kImages);
+    int first = ring.registerConsumer();
+    CHECK(source.produce(ring, 1));
+    CHECK(source.produce(ring, 2));
+
+    std::atomic<bool> published{false};
+    std::thread producer([&] {
+        published.store(source.produce(ring, 3));
+    });
+    // Give the producer time to sample the mask and block on the full ring
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    int second = ring.registerConsumer();
+    CHECK(second >= 0);
+
+    CHECK(ring.acquire(first) != nullptr);
+    ring.release(first);
+    producer.join();
+    CHECK(published.load());
+
+    YUV420 *frame = ring.acquire(second);
+    if (frame != nullptr) {
+        // Counted after all: the source must not get it back while we read it
+        for (int i = 0; i < 2; i++) {
+            CHECK(ring.acquire(first) != nullptr);
+            ring.release(first);
+        }
+        CHECK(source.getOutstanding() == 1);
+        ring.release(second);
+    }
+    ring.unregisterConsumer(first);
+    ring.unregisterConsumer(second);
+    CHECK(source.getOutstanding() == 0);
+}
+
+// Every way a borrowed frame can leave the ring hands it back exactly once: release, a latest-only skip,
+// pacing, eviction, a refused frame, unregistering with frames queued or one acquired, and the ring's end.
+void testBorrowedFramesReturn() {
+    FakeImageSource source(kWidth, kHeight, 8);
+    {
+        FrameRing ring(kCapacity, kWidth, kHeight);
+        long long timestampNs = 0;
+
+        // Nobody registered: straight back
+        CHECK(source.produce(ring, ++timestampNs));
+        CHECK(source.getOutstanding() == 0);
+
+        int all = ring.registerConsumer();
+        int latest = ring.registerConsumer(true);
+        int paced = ring.registerConsumer();
+        ring.setFrameRate(paced, 1);
+        for (int i = 0; i < kCapacity; i++) {
+            CHECK(source.produce(ring, timestampNs += 1000000));
+        }
+        // DropNewest: a full ring refuses the frame and returns it
+        CHECK(!source.produce(ring, timestampNs += 1000000));
+        CHECK(source.getOutstanding() == kCapacity);
+
+        // The latest-only and paced consumers take one frame each and pass over the rest
+        CHECK(ring.acquire(latest) != nullptr);
+        ring.release(latest);
+        CHECK(ring.acquire(paced) != nullptr);
+        ring.release(paced);
+        CHECK(ring.acquire(paced) == nullptr);
+        CHECK(source.getOutstanding() == kCapacity);
+        for (int i = 0; i < 2; i++) {
+            CHECK(ring.acquire(all) != nullptr);
+            ring.release(all);
+        }
+        CHECK(source.getOutstanding() == kCapacity - 2);
+
+        // DropOldest: evicting the slowest consumer's oldest frame returns it
+        ring.setDropPolicy(DropPolicy::DropOldest, 0);
+        for (int i = 0; i < 3; i++) {
+            CHECK(source.produce(ring, timestampNs += 1000000));
+        }
+        CHECK(source.getOutstanding() == kCapacity);
+
+        // Leaving with one frame acquired and more queued, and the ring going away with frames queued
+        CHECK(ring.acquire(all) != nullptr);
+        ring.unregisterConsumer(all);
+        ring.unregisterConsumer(latest);
+        CHECK(source.getOutstanding() > 0);
+    }
+    CHECK(source.getOutstanding() == 0);
+    CHECK(source.getReleasedCount() == 1 + kCapacity + 1 + 3);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    double seconds = 2;
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--seconds=", 10) == 0) {
+            seconds = atof(argv[i] + 10);
+        }
+    }
+
+    testBorrowedFramesReturn();
+    testRegisterDuringPublish();
+    testRegisterWhilePublishing(seconds);
+
+    return checkResult();
+}
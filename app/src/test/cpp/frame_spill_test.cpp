@@ -0,0 +1,137 @@
+// Host tests of the spill file behind the frame ring, run by ctest.
+//
+// A FrameSpill must hand frames back in the order they were pushed, refuse a push once every slot is taken
+// and reuse slots released in any order. Behind a FrameRing, a burst larger than the ring overflows into the
+// spill and a consumer that only starts reading afterwards must still get every frame, in order, each with
+// the pixels it was enqueued with.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+#include "frame_ring.h"
+#include "frame_spill.h"
+#include "test_check.h"
+#include "yuv_convert.h"
+
+namespace {
+
+constexpr int kWidth = 64;
+constexpr int kHeight = 48;
+constexpr int kSlots = 6;
+constexpr long long kFrameIntervalNs = 33333333;
+// Unlinked by the spill once mapped
+constexpr const char *kSpillPath = "frame_spill_test.spill";
+
+// A packed NV12 frame whose every luma byte is stamp
+struct StampedFrame {
+    std::vector<uint8_t> bytes = std::vector<uint8_t>(packedSize(kWidth, kHeight), 0x80);
+    YUVImageView view = packedView(bytes.data(), kWidth, kHeight, YUVLayout::NV12);
+
+    explicit StampedFrame(int stamp) {
+        std::fill(bytes.begin(), bytes.begin() + kWidth * kHeight, (uint8_t) stamp);
+    }
+};
+
+bool lumaIs(const uint8_t *luma, int rowStride, uint8_t stamp) {
+    for (int y = 0; y < kHeight; y++) {
+        for (int x = 0; x < kWidth; x++) {
+            if (luma[(size_t) y * rowStride + x] != stamp) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+void testSpillOrder() {
+    FrameSpill spill;
+    CHECK(spill.open(kSpillPath, kSlots, kWidth, kHeight));
+    CHECK(spill.getCapacity() == kSlots);
+
+    int pushed = 0;
+    while (spill.push(StampedFrame(pushed).view, pushed * kFrameIntervalNs)) {
+        pushed++;
+    }
+    CHECK(pushed == kSlots);
+    CHECK(spill.getPending() == kSlots);
+
+    // Publish all, release them out of order, then the slots take new frames
+    std::vector<void *> handles;
+    for (int i = 0; i < kSlots; i++) {
+        BorrowedFrame frame{};
+        long long spilledNs = 0;
+        CHECK(spill.front(frame, spilledNs));
+        CHECK(frame.timestampNs == i * kFrameIntervalNs);
+        CHECK(frame.width == kWidth && frame.height == kHeight);
+        CHECK(lumaIs(frame.planeData[0], frame.rowStride[0], (uint8_t) i));
+        handles.push_back(frame.handle);
+        spill.markPublished();
+    }
+    BorrowedFrame none{};
+    long long spilledNs = 0;
+    CHECK(!spill.front(none, spilledNs));
+    CHECK(!spill.push(StampedFrame(99).view, 99));
+
+    for (int i : {3, 1, 4, 0, 5, 2}) {
+        spill.releaseFrame(handles[i]);
+    }
+    for (int i = kSlots; i < kSlots * 2; i++) {
+        CHECK(spill.push(StampedFrame(i).view, i * kFrameIntervalNs));
+    }
+    for (int i = kSlots; i < kSlots * 2; i++) {
+        BorrowedFrame frame{};
+        CHECK(spill.front(frame, spilledNs));
+        CHECK(frame.timestampNs == i * kFrameIntervalNs);
+        CHECK(lumaIs(frame.planeData[0], frame.rowStride[0], (uint8_t) i));
+        spill.markPublished();
+        spill.releaseFrame(frame.handle);
+    }
+    spill.close();
+}
+
+void testRingOverflow() {
+    constexpr int kCapacity = 4;
+    constexpr int kFrames = kCapacity + 20;
+    FrameRing ring(kCapacity, kWidth, kHeight);
+    CHECK(ring.enableSpill(kSpillPath, 32, kWidth, kHeight));
+    int consumer = ring.registerConsumer();
+
+    // The consumer is not reading yet: everything past the ring's capacity has to go to the spill
+    for (int i = 0; i < kFrames; i++) {
+        StampedFrame frame(i);
+        const YUVImageView &view = frame.view;
+        CHECK(ring.enqueue(kWidth, kHeight, (i + 1) * kFrameIntervalNs, view.data[0], view.rowStride[0], 1,
+                           view.data[1], view.rowStride[1], 2, view.data[2], view.rowStride[2], 2));
+    }
+    CHECK(ring.getSpill()->getPeakPending() > 0);
+
+    int received = 0;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (received < kFrames && std::chrono::steady_clock::now() < deadline) {
+        if (!ring.waitForFrame(consumer, 10 * 1000000LL)) {
+            continue;
+        }
+        YUV420 *frame = ring.acquire(consumer);
+        if (frame == nullptr) {
+            continue;
+        }
+        YUVImageView view = frame->view();
+        CHECK(frame->timestampNs == (received + 1) * kFrameIntervalNs);
+        CHECK(lumaIs(view.data[0], view.rowStride[0], (uint8_t) received));
+        ring.release(consumer);
+        received++;
+    }
+    CHECK(received == kFrames);
+    CHECK(ring.getSpill()->getPending() == 0);
+    ring.unregisterConsumer(consumer);
+}
+
+}  // namespace
+
+int main() {
+    testSpillOrder();
+    testRingOverflow();
+    return checkResult();
+}
@@ -0,0 +1,199 @@
+// Host tests of the output graph's per-frame controls, run by ctest.
+//
+// Frames of a known pattern go through a FrameRing into an OutputGraph with LatestFrameSink outputs. A crop
+// must reach every output (an aligned region of the output's size comes out as the region's pixels), a
+// whole copy must record its image statistics, and the motion gate must leave still frames out of the gated
+// outputs only.
+
+#include <chrono>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "frame_ring.h"
+#include "frame_sink.h"
+#include "image_stats.h"
+#include "motion_detector.h"
+#include "output_graph.h"
+#include "test_check.h"
+#include "yuv_crop.h"
+
+namespace {
+
+constexpr int kWidth = 64;
+constexpr int kHeight = 48;
+constexpr int kCapacity = 4;
+constexpr long long kFrameIntervalNs = 33333333;
+
+// An I420 frame whose every sample is a function of its position and seed
+struct SourceFrame {
+    std::vector<uint8_t> y = std::vector<uint8_t>(kWidth * kHeight);
+    std::vector<uint8_t> u = std::vector<uint8_t>(kWidth * kHeight / 4);
+    std::vector<uint8_t> v = std::vector<uint8_t>(kWidth * kHeight / 4);
+
+    explicit SourceFrame(int seed) {
+        for (int row = 0; row < kHeight; row++) {
+            for (int x = 0; x < kWidth; x++) {
+                y[row * kWidth + x] = (uint8_t) (x * 3 + row * 5 + seed);
+            }
+        }
+        for (int row = 0; row < kHeight / 2; row++) {
+            for (int x = 0; x < kWidth / 2; x++) {
+                u[row * kWidth / 2 + x] = (uint8_t) (x * 7 + row + seed);
+                v[row * kWidth / 2 + x] = (uint8_t) (x + row * 9 + seed);
+            }
+        }
+    }
+
+    bool enqueue(FrameRing &ring, long long timestampNs) const {
+        return ring.enqueue(kWidth, kHeight, timestampNs, y.data(), kWidth, 1, u.data(), kWidth / 2, 1,
+                            v.data(), kWidth / 2, 1);
+    }
+};
+
+// Waits until the graph delivered count frames to output
+bool waitForDelivered(const OutputGraph &graph, int output, uint64_t count) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+    while (graph.getDeliveredFrames(output) < count) {
+        if (std::chrono::steady_clock::now() > deadline) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+// Whether sink's newest frame (packed I420) is the width x height region of frame at left, top
+bool showsRegion(const LatestFrameSink &sink, const SourceFrame &frame, int left, int top, int width, int height) {
+    std::vector<uint8_t> packed(sink.getFrameSize());
+    long long timestampUs = -1;
+    if (!sink.copyLatest(packed.data(), packed.size(), timestampUs)) {
+        return false;
+    }
+    const uint8_t *u = packed.data() + width * height;
+    const uint8_t *v = u + width * height / 4;
+    for (int row = 0; row < height; row++) {
+        for (int x = 0; x < width; x++) {
+            if (packed[row * width + x] != frame.y[(top + row) * kWidth + left + x]) {
+                return false;
+            }
+        }
+    }
+    for (int row = 0; row < height / 2; row++) {
+        for (int x = 0; x < width / 2; x++) {
+            int at = (top / 2 + row) * kWidth / 2 + left / 2 + x;
+            if (u[row * width / 2 + x] != frame.u[at] || v[row * width / 2 + x] != frame.v[at]) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+void testCroppedSource() {
+    FrameRing ring(kCapacity, kWidth, kHeight);
+    int consumer = ring.registerConsumer();
+    CropControl crop;
+    // The middle quarter: 32x24 at 16, 12, on the pixel grid
+    crop.set(0.25f, 0.25f, 0.5f, 0.5f);
+
+    LatestFrameSink region(kWidth / 2, kHeight / 2, YUVLayout::I420);
+    LatestFrameSink zoomed(kWidth, kHeight, YUVLayout::I420);
+    OutputGraph graph(&ring, consumer);
+    graph.setCrop(&crop);
+    int regionOutput = graph.addOutput(&region, OutputProfile());
+    int zoomedOutput = graph.addOutput(&zoomed, OutputProfile());
+    CHECK(graph.start());
+
+    SourceFrame frame(0);
+    CHECK(frame.enqueue(ring, kFrameIntervalNs));
+    CHECK(waitForDelivered(graph, regionOutput, 1));
+    CHECK(waitForDelivered(graph, zoomedOutput, 1));
+    graph.stop();
+
+    CHECK(showsRegion(region, frame, kWidth / 4, kHeight / 4, kWidth / 2, kHeight / 2));
+    // Scaled back up from the region, so no longer the whole frame
+    CHECK(!showsRegion(zoomed, frame, 0, 0, kWidth, kHeight));
+
+    // Back to the whole frame, the outputs see the source again
+    crop.reset();
+    CHECK(graph.start());
+    CHECK(frame.enqueue(ring, kFrameIntervalNs * 2));
+    CHECK(waitForDelivered(graph, zoomedOutput, 2));
+    graph.stop();
+    CHECK(showsRegion(zoomed, frame, 0, 0, kWidth, kHeight));
+}
+
+void testImageStats() {
+    FrameRing ring(kCapacity, kWidth, kHeight);
+    int consumer = ring.registerConsumer();
+    CropControl crop;
+    ImageStatsLog log;
+
+    LatestFrameSink whole(kWidth, kHeight, YUVLayout::NV12);
+    OutputGraph graph(&ring, consumer);
+    graph.setCrop(&crop);
+    graph.setImageStats(&log);
+    int output = graph.addOutput(&whole, OutputProfile());
+    CHECK(graph.start());
+
+    SourceFrame frame(0);
+    CHECK(frame.enqueue(ring, kFrameIntervalNs));
+    CHECK(waitForDelivered(graph, output, 1));
+
+    // A cropped frame is not whole, so it leaves no record
+    crop.set(0.25f, 0.25f, 0.5f, 0.5f);
+    CHECK(frame.enqueue(ring, kFrameIntervalNs * 2));
+    CHECK(waitForDelivered(graph, output, 2));
+    graph.stop();
+
+    ImageStatsLog::Record record;
+    CHECK(log.find(kFrameIntervalNs / 1000, record));
+    CHECK(record.width == kWidth && record.height == kHeight);
+    CHECK(record.stats.lumaCount == (uint64_t) kWidth * kHeight);
+    uint64_t lumaSum = 0;
+    for (uint8_t sample : frame.y) {
+        lumaSum += sample;
+    }
+    CHECK(record.stats.lumaSum == lumaSum);
+    CHECK(!log.find(kFrameIntervalNs * 2 / 1000, record));
+}
+
+void testMotionGate() {
+    FrameRing ring(kCapacity, kWidth, kHeight);
+    int consumer = ring.registerConsumer();
+    MotionDetector detector;
+
+    LatestFrameSink whole(kWidth, kHeight, YUVLayout::NV12);
+    LatestFrameSink thumbnail(kWidth / 2, kHeight / 2, YUVLayout::NV12);
+    OutputGraph graph(&ring, consumer);
+    graph.setMotionGate(&detector, 0);
+    OutputProfile gated;
+    gated.motionGated = true;
+    int wholeOutput = graph.addOutput(&whole, OutputProfile());
+    int thumbnailOutput = graph.addOutput(&thumbnail, gated);
+    CHECK(graph.start());
+
+    // The first frame has nothing to compare with and passes, the two still ones after it do not
+    SourceFrame still(0);
+    for (int i = 1; i <= 3; i++) {
+        CHECK(still.enqueue(ring, kFrameIntervalNs * i));
+        CHECK(waitForDelivered(graph, wholeOutput, i));
+    }
+    SourceFrame moved(128);
+    CHECK(moved.enqueue(ring, kFrameIntervalNs * 4));
+    CHECK(waitForDelivered(graph, wholeOutput, 4));
+    graph.stop();
+
+    CHECK(graph.getDeliveredFrames(thumbnailOutput) == 2);
+    CHECK(graph.getMissedFrames(thumbnailOutput) == 0);
+}
+
+}  // namespace
+
+int main() {
+    testCroppedSource();
+    testImageStats();
+    testMotionGate();
+    return checkResult();
+}
@@ -0,0 +1,213 @@
+// Host tests of the pre-roll store and its delta codec, run by ctest.
+//
+// The codec must give back every plane it encoded, spatially and against a reference, at sizes around its
+// 16-byte blocks, and refuse a truncated stream. The store is fed frames through its FrameSink side and
+// replayed with a PreRollReader: every replayed frame must equal the frame fed with its timestamp, with the
+// budget evicting whole groups, with a frame that only fits by restarting at a key frame, and with the
+// writer evicting frames a reader has not got to yet.
+
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <random>
+#include <vector>
+
+#include "delta_codec.h"
+#include "pre_roll_store.h"
+#include "test_check.h"
+
+namespace {
+
+constexpr int kWidth = 64;
+constexpr int kHeight = 48;
+constexpr long long kFrameIntervalUs = 33333;
+
+std::mt19937 rng(20240611);
+
+// Plane content a camera might give: a gradient with a little noise that moves with the frame index
+std::vector<uint8_t> scenePlane(size_t bytes, int frame, int noise) {
+    std::vector<uint8_t> plane(bytes);
+    for (size_t i = 0; i < bytes; i++) {
+        plane[i] = (uint8_t) (i % 61 + frame * 3 + (noise > 0 ? (int) (rng() % noise) : 0));
+    }
+    return plane;
+}
+
+bool roundTrips(const std::vector<uint8_t> &plane, const std::vector<uint8_t> *reference, int distance) {
+    const uint8_t *ref = reference != nullptr ? reference->data() : nullptr;
+    std::vector<uint8_t> encoded(maxDeltaEncodedSize(plane.size()));
+    size_t encodedBytes = encodeDeltaPlane(plane.data(), ref, plane.size(), distance, encoded.data());
+    if (encodedBytes > encoded.size()) {
+        return false;
+    }
+    std::vector<uint8_t> decoded(plane.size(), 0xEE);
+    if (!decodeDeltaPlane(encoded.data(), encodedBytes, ref, plane.size(), distance, decoded.data()) ||
+        decoded != plane) {
+        return false;
+    }
+    // One byte short is corrupt, not a shorter plane
+    return encodedBytes == 0 ||
+           !decodeDeltaPlane(encoded.data(), encodedBytes - 1, ref, plane.size(), distance, decoded.data());
+}
+
+void testDeltaCodec() {
+    for (size_t bytes : {1, 15, 16, 17, 255, 2048, 4099}) {
+        for (int distance : {1, 2}) {
+            std::vector<uint8_t> noise(bytes);
+            for (uint8_t &byte : noise) {
+                byte = (uint8_t) rng();
+            }
+            std::vector<uint8_t> previous = scenePlane(bytes, 0, 4);
+            std::vector<uint8_t> current = scenePlane(bytes, 1, 4);
+            std::vector<uint8_t> still = previous;
+
+            CHECK(roundTrips(noise, nullptr, distance));
+            CHECK(roundTrips(current, nullptr, distance));
+            CHECK(roundTrips(current, &previous, distance));
+            CHECK(roundTrips(noise, &previous, distance));
+            CHECK(roundTrips(still, &previous, distance));
+            CHECK(roundTrips(std::vector<uint8_t>(bytes, 0), nullptr, distance));
+        }
+    }
+}
+
+// Feeds frames [first, first + count) to store and keeps what was fed by timestamp
+void feed(PreRollStore &store, int first, int count, std::map<long long, std::vector<uint8_t>> &fed) {
+    for (int frame = first; frame < first + count; frame++) {
+        SinkBuffer buffer;
+        if (!store.dequeueBuffer(0, buffer)) {
+            CHECK(false);
+            return;
+        }
+        std::vector<uint8_t> content = scenePlane(store.getFrameBytes(), frame, 3);
+        memcpy(buffer.view.data[0], content.data(), content.size());
+        long long timestampUs = frame * kFrameIntervalUs;
+        store.queueBuffer(buffer, timestampUs, true);
+        fed[timestampUs] = content;
+    }
+}
+
+// Whether the frame reader decoded last is the one fed at timestampUs
+bool replaysFed(const PreRollReader &reader, long long timestampUs, size_t frameBytes,
+                const std::map<long long, std::vector<uint8_t>> &fed) {
+    auto found = fed.find(timestampUs);
+    return found != fed.end() && memcmp(reader.view().data[0], found->second.data(), frameBytes) == 0;
+}
+
+// Replays everything left; returns the frames read, -1 when one was not what was fed or out of order
+int replay(PreRollReader &reader, const PreRollStore &store, const std::map<long long, std::vector<uint8_t>> &fed,
+           long long &lastUs) {
+    int frames = 0;
+    long long timestampUs = -1;
+    while (reader.next(timestampUs)) {
+        if (timestampUs <= lastUs || !replaysFed(reader, timestampUs, store.getFrameBytes(), fed)) {
+            return -1;
+        }
+        lastUs = timestampUs;
+        frames++;
+    }
+    return frames;
+}
+
+void testRoundTrip() {
+    PreRollStore store(kWidth, kHeight, 4 * 1024 * 1024, 30);
+    CHECK(store.isValid());
+    std::map<long long, std::vector<uint8_t>> fed;
+    feed(store, 0, 70, fed);
+
+    PreRollStore::Summary summary = store.getSummary();
+    CHECK(summary.frames == 70);
+    CHECK(summary.evictedFrames == 0 && summary.refusedFrames == 0);
+    CHECK(summary.storedBytes < summary.rawBytes);
+
+    PreRollReader reader(store);
+    long long lastUs = -1;
+    CHECK(replay(reader, store, fed, lastUs) == 70);
+    CHECK(lastUs == 69 * kFrameIntervalUs);
+}
+
+void testBudgetEviction() {
+    // Room for a few groups of 5 at worst-case size, so the budget fills up early
+    size_t frameBytes = packedSize(kWidth, kHeight);
+    size_t worstBytes = maxDeltaEncodedSize(kWidth * kHeight) + maxDeltaEncodedSize(frameBytes - kWidth * kHeight);
+    PreRollStore store(kWidth, kHeight, worstBytes * 4, 5);
+    std::map<long long, std::vector<uint8_t>> fed;
+    feed(store, 0, 60, fed);
+
+    PreRollStore::Summary summary = store.getSummary();
+    CHECK(summary.evictedFrames > 0);
+    CHECK(summary.refusedFrames == 0);
+    CHECK(summary.frames + summary.evictedFrames == 60);
+    CHECK(summary.newestUs == 59 * kFrameIntervalUs);
+
+    // Whole groups go, so what is left still starts at a key frame and decodes
+    PreRollReader reader(store);
+    long long lastUs = -1;
+    CHECK(replay(reader, store, fed, lastUs) == (int) summary.frames);
+    CHECK(lastUs == summary.newestUs);
+}
+
+void testKeyFrameRestart() {
+    // One worst-case frame and a few bytes: a follower only fits by dropping the group it depends on, so
+    // each frame restarts at a key frame and is held alone
+    size_t frameBytes = packedSize(kWidth, kHeight);
+    size_t worstBytes = maxDeltaEncodedSize(kWidth * kHeight) + maxDeltaEncodedSize(frameBytes - kWidth * kHeight);
+    PreRollStore store(kWidth, kHeight, worstBytes + 64, 30);
+    std::map<long long, std::vector<uint8_t>> fed;
+    feed(store, 0, 10, fed);
+
+    PreRollStore::Summary summary = store.getSummary();
+    CHECK(summary.refusedFrames == 0);
+    CHECK(summary.frames == 1);
+    PreRollReader reader(store);
+    long long lastUs = -1;
+    CHECK(replay(reader, store, fed, lastUs) == 1);
+    CHECK(lastUs == 9 * kFrameIntervalUs);
+
+    // The next group restarts with a key frame too, which replays on its own
+    feed(store, 10, 1, fed);
+    CHECK(replay(reader, store, fed, lastUs) == 1);
+    CHECK(lastUs == 10 * kFrameIntervalUs);
+
+    // Below one worst-case frame nothing fits at all
+    PreRollStore tiny(kWidth, kHeight, worstBytes - 1, 30);
+    feed(tiny, 0, 3, fed);
+    CHECK(tiny.getSummary().refusedFrames == 3);
+    CHECK(tiny.getSummary().frames == 0);
+}
+
+void testReaderOvertaken() {
+    size_t frameBytes = packedSize(kWidth, kHeight);
+    size_t worstBytes = maxDeltaEncodedSize(kWidth * kHeight) + maxDeltaEncodedSize(frameBytes - kWidth * kHeight);
+    PreRollStore store(kWidth, kHeight, worstBytes * 4, 5);
+    std::map<long long, std::vector<uint8_t>> fed;
+    feed(store, 0, 20, fed);
+
+    PreRollReader reader(store);
+    long long timestampUs = -1;
+    CHECK(reader.next(timestampUs));
+    CHECK(replaysFed(reader, timestampUs, frameBytes, fed));
+    long long lastUs = timestampUs;
+
+    // The writer evicts past the reader, which skips ahead to the oldest group still held
+    feed(store, 20, 40, fed);
+    long long oldestUs = store.getSummary().oldestUs;
+    CHECK(oldestUs > lastUs + kFrameIntervalUs);
+    CHECK(reader.next(timestampUs));
+    CHECK(timestampUs == oldestUs);
+    CHECK(replaysFed(reader, timestampUs, frameBytes, fed));
+    lastUs = timestampUs;
+    CHECK(replay(reader, store, fed, lastUs) > 0);
+    CHECK(lastUs == 59 * kFrameIntervalUs);
+}
+
+}  // namespace
+
+int main() {
+    testDeltaCodec();
+    testRoundTrip();
+    testBudgetEviction();
+    testKeyFrameRestart();
+    testReaderOvertaken();
+    return checkResult();
+}
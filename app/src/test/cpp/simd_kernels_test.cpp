@@ -0,0 +1,228 @@
+// Host tests of the SIMD row kernels, run by ctest.
+//
+// Every kernel of every backend this CPU can run (availableSimdKernels) gets the same random input as the
+// scalar table, at odd widths around each vector size and from misaligned row starts, and has to write
+// byte for byte what scalar writes: no more, no less. Outputs sit in guard bytes, so a write past the row
+// shows up as a difference too.
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "test_check.h"
+#include "yuv_simd.h"
+
+namespace {
+
+// Odd widths on both sides of the 8, 16 and 32 pixel vector steps, and one wide row
+constexpr int kWidths[] = {1, 3, 7, 9, 15, 17, 31, 33, 47, 63, 65, 127, 129, 641};
+// Row start offsets from a 32-byte aligned base
+constexpr int kOffsets[] = {0, 1, 3};
+constexpr int kGuard = 64;
+constexpr uint8_t kGuardByte = 0xA5;
+
+std::mt19937 rng(20240611);
+
+std::vector<uint8_t> randomBytes(size_t size) {
+    std::vector<uint8_t> bytes(size);
+    for (uint8_t &byte : bytes) {
+        byte = (uint8_t) rng();
+    }
+    return bytes;
+}
+
+// A row of size bytes starting offset bytes past an aligned base, followed by guard bytes
+struct Row {
+    std::vector<uint8_t> storage;
+    uint8_t *data;
+
+    Row(size_t size, int offset) : storage(size + offset + 32 + kGuard, kGuardByte) {
+        auto base = reinterpret_cast<uintptr_t>(storage.data());
+        data = reinterpret_cast<uint8_t *>((base + 31) & ~uintptr_t(31)) + offset;
+    }
+
+    Row(const std::vector<uint8_t> &bytes, int offset) : Row(bytes.size(), offset) {
+        memcpy(data, bytes.data(), bytes.size());
+    }
+};
+
+void expectSame(const Row &expected, const Row &actual, size_t size, const SimdKernels &kernels,
+                const char *kernel, int width, int offset) {
+    bool same = memcmp(expected.data, actual.data, size + kGuard) == 0;
+    char what[128];
+    snprintf(what, sizeof(what), "%s %s matches scalar at width %d, offset %d", kernels.name, kernel, width, offset);
+    check(same, what, __FILE__, __LINE__);
+}
+
+void compareSplitMergeSwap(const SimdKernels &kernels, int width, int offset) {
+    const SimdKernels &scalar = scalarKernels();
+    std::vector<uint8_t> pairs = randomBytes(width * 2);
+    std::vector<uint8_t> plane0 = randomBytes(width);
+    std::vector<uint8_t> plane1 = randomBytes(width);
+    Row pairRow(pairs, offset);
+    Row row0(plane0, offset);
+    Row row1(plane1, offset);
+
+    Row expected0(width, offset), expected1(width, offset), actual0(width, offset), actual1(width, offset);
+    scalar.splitPairs(pairRow.data, expected0.data, expected1.data, width);
+    kernels.splitPairs(pairRow.data, actual0.data, actual1.data, width);
+    expectSame(expected0, actual0, width, kernels, "splitPairs", width, offset);
+    expectSame(expected1, actual1, width, kernels, "splitPairs", width, offset);
+
+    Row expected(width * 2, offset), actual(width * 2, offset);
+    scalar.mergePairs(row0.data, row1.data, expected.data, width);
+    kernels.mergePairs(row0.data, row1.data, actual.data, width);
+    expectSame(expected, actual, width * 2, kernels, "mergePairs", width, offset);
+
+    Row expectedSwap(width * 2, offset), actualSwap(width * 2, offset);
+    scalar.swapPairs(pairRow.data, expectedSwap.data, width);
+    kernels.swapPairs(pairRow.data, actualSwap.data, width);
+    expectSame(expectedSwap, actualSwap, width * 2, kernels, "swapPairs", width, offset);
+}
+
+void compareGatherScatter(const SimdKernels &kernels, int width, int offset) {
+    const SimdKernels &scalar = scalarKernels();
+    Row pairRow(randomBytes(width * 2), offset);
+    Row expected(width, offset), actual(width, offset);
+    scalar.gatherEven(pairRow.data, expected.data, width);
+    kernels.gatherEven(pairRow.data, actual.data, width);
+    expectSame(expected, actual, width, kernels, "gatherEven", width, offset);
+
+    // The odd bytes in between must be left as they are, and nothing past dst[2 * width - 2] touched
+    std::vector<uint8_t> destination = randomBytes(width * 2 - 1);
+    Row plane(randomBytes(width), offset);
+    Row expectedPairs(destination, offset), actualPairs(destination, offset);
+    scalar.scatterEven(plane.data, expectedPairs.data, width);
+    kernels.scatterEven(plane.data, actualPairs.data, width);
+    expectSame(expectedPairs, actualPairs, width * 2 - 1, kernels, "scatterEven", width, offset);
+}
+
+void compareRowFilters(const SimdKernels &kernels, int width, int offset) {
+    const SimdKernels &scalar = scalarKernels();
+    Row row0(randomBytes(width * 2), offset);
+    Row row1(randomBytes(width * 2), offset);
+
+    Row expected(width, offset), actual(width, offset);
+    scalar.box2Row(row0.data, row1.data, expected.data, width);
+    kernels.box2Row(row0.data, row1.data, actual.data, width);
+    expectSame(expected, actual, width, kernels, "box2Row", width, offset);
+
+    for (int weight : {1, 77, 128, 200, 255}) {
+        Row expectedBlend(width, offset), actualBlend(width, offset);
+        scalar.blendRows(row0.data, row1.data, weight, expectedBlend.data, width);
+        kernels.blendRows(row0.data, row1.data, weight, actualBlend.data, width);
+        expectSame(expectedBlend, actualBlend, width, kernels, "blendRows", width, offset);
+    }
+}
+
+void compareAccumulate(const SimdKernels &kernels, int width, int offset) {
+    Row row(randomBytes(width), offset);
+    // Sums that still have room for one more row
+    std::vector<uint16_t> start(width + kGuard);
+    for (uint16_t &sum : start) {
+        sum = (uint16_t) (rng() % (65535 - 255));
+    }
+    std::vector<uint16_t> expected = start;
+    std::vector<uint16_t> actual = start;
+    scalarKernels().accumulateRow(row.data, expected.data(), width);
+    kernels.accumulateRow(row.data, actual.data(), width);
+    char what[128];
+    snprintf(what, sizeof(what), "%s accumulateRow matches scalar at width %d, offset %d", kernels.name, width,
+             offset);
+    check(expected == actual, what, __FILE__, __LINE__);
+}
+
+void compareLerpColumns(const SimdKernels &kernels, int width, int offset) {
+    // A source row a bit wider than the output, read at increasing pairs like a bilinear scale does
+    int sourceWidth = width + width / 2 + 2;
+    Row row(randomBytes(sourceWidth), offset);
+    std::vector<int> index(width);
+    std::vector<uint16_t> weights(width * 2);
+    for (int x = 0; x < width; x++) {
+        index[x] = (int) ((long long) x * (sourceWidth - 2) / width);
+        int weight = (int) (rng() % 257);
+        weights[x * 2] = (uint16_t) (256 - weight);
+        weights[x * 2 + 1] = (uint16_t) weight;
+    }
+    Row expected(width, offset), actual(width, offset);
+    scalarKernels().lerpColumns(row.data, index.data(), weights.data(), expected.data, width);
+    kernels.lerpColumns(row.data, index.data(), weights.data(), actual.data, width);
+    expectSame(expected, actual, width, kernels, "lerpColumns", width, offset);
+}
+
+void compareAverageColumns(const SimdKernels &kernels, int width, int offset) {
+    // Up to 257 rows of 255 still fit a uint16 sum
+    for (int rows : {1, 2, 3, 7, 257}) {
+        std::vector<int> index(width);
+        std::vector<int> count(width);
+        int columns = 0;
+        for (int x = 0; x < width; x++) {
+            index[x] = columns;
+            count[x] = 1 + (int) (rng() % 4);
+            columns += count[x];
+        }
+        std::vector<uint16_t> sum(columns);
+        for (uint16_t &column : sum) {
+            column = (uint16_t) (rng() % (255 * rows + 1));
+        }
+        Row expected(width, offset), actual(width, offset);
+        scalarKernels().averageColumns(sum.data(), index.data(), count.data(), rows, expected.data, width);
+        kernels.averageColumns(sum.data(), index.data(), count.data(), rows, actual.data, width);
+        expectSame(expected, actual, width, kernels, "averageColumns", width, offset);
+    }
+}
+
+void compareStatistics(const SimdKernels &kernels, int width, int offset) {
+    char what[128];
+    Row a(randomBytes(width * 2), offset);
+    Row b(randomBytes(width * 2), offset);
+
+    int blocks = (width + 15) / 16;
+    Row blockA(randomBytes(blocks * 16), offset);
+    Row blockB(randomBytes(blocks * 16), offset);
+    std::vector<uint32_t> expectedSad(blocks + 4, 1000);
+    std::vector<uint32_t> actualSad = expectedSad;
+    scalarKernels().sadBlocks(blockA.data, blockB.data, expectedSad.data(), blocks);
+    kernels.sadBlocks(blockA.data, blockB.data, actualSad.data(), blocks);
+    snprintf(what, sizeof(what), "%s sadBlocks matches scalar at %d blocks, offset %d", kernels.name, blocks, offset);
+    check(expectedSad == actualSad, what, __FILE__, __LINE__);
+
+    uint64_t expectedMoments[2] = {12345, 678910};
+    uint64_t actualMoments[2] = {12345, 678910};
+    scalarKernels().rowMoments(a.data, width, expectedMoments);
+    kernels.rowMoments(a.data, width, actualMoments);
+    snprintf(what, sizeof(what), "%s rowMoments matches scalar at width %d, offset %d", kernels.name, width, offset);
+    check(memcmp(expectedMoments, actualMoments, sizeof(expectedMoments)) == 0, what, __FILE__, __LINE__);
+
+    uint64_t expectedPairs[2] = {3, 5};
+    uint64_t actualPairs[2] = {3, 5};
+    scalarKernels().pairSums(b.data, width, expectedPairs);
+    kernels.pairSums(b.data, width, actualPairs);
+    snprintf(what, sizeof(what), "%s pairSums matches scalar at width %d, offset %d", kernels.name, width, offset);
+    check(memcmp(expectedPairs, actualPairs, sizeof(expectedPairs)) == 0, what, __FILE__, __LINE__);
+}
+
+}  // namespace
+
+int main() {
+    int backends = 0;
+    for (const SimdKernels *const *kernels = availableSimdKernels(); *kernels != nullptr; kernels++) {
+        backends++;
+        for (int width : kWidths) {
+            for (int offset : kOffsets) {
+                compareSplitMergeSwap(**kernels, width, offset);
+                compareGatherScatter(**kernels, width, offset);
+                compareRowFilters(**kernels, width, offset);
+                compareAccumulate(**kernels, width, offset);
+                compareLerpColumns(**kernels, width, offset);
+                compareAverageColumns(**kernels, width, offset);
+                compareStatistics(**kernels, width, offset);
+            }
+        }
+    }
+    printf("Compared %d backend(s) with scalar\n", backends);
+    CHECK(backends > 0);
+    return checkResult();
+}
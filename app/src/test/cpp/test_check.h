@@ -0,0 +1,26 @@
+#pragma once
+
+// Checks shared by the host tests: a failed CHECK is reported with its line and the test goes on, main
+// returns checkResult().
+
+#include <cstdio>
+
+inline int checkFailures = 0;
+
+inline void check(bool ok, const char *what, const char *file, int line) {
+    if (!ok) {
+        fprintf(stderr, "%s:%d: check failed: %s\n", file, line, what);
+        checkFailures++;
+    }
+}
+
+#define CHECK(condition) check((condition), #condition, __FILE__, __LINE__)
+
+// Exit status of a test: 1 after any failed check
+inline int checkResult() {
+    if (checkFailures != 0) {
+        fprintf(stderr, "%d check(s) failed\n", checkFailures);
+        return 1;
+    }
+    return 0;
+}
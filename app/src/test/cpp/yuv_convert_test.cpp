@@ -0,0 +1,175 @@
+// Host tests of the YUV converter, run by ctest.
+//
+// A frame with a known pattern in every sample is converted between every pair of layouts (I420, NV12, NV21
+// and Generic, which here is chroma interleaved with pixel stride 2 in two separate planes), in row bands
+// through convertRows and whole through convert, and back again. Every destination must equal the pattern
+// written sample by sample into the same layout, row padding and the bytes between interleaved samples
+// included; exportPacked must equal the pattern packed. All of it runs on every available SIMD backend.
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+#include "test_check.h"
+#include "yuv_convert.h"
+#include "yuv_simd.h"
+
+namespace {
+
+constexpr YUVLayout kLayouts[] = {YUVLayout::I420, YUVLayout::NV12, YUVLayout::NV21, YUVLayout::Generic};
+constexpr YUVLayout kPackedLayouts[] = {YUVLayout::I420, YUVLayout::NV12, YUVLayout::NV21};
+// An even size, and an odd one whose last chroma column and row cover one luma pixel
+constexpr int kSizes[][2] = {{38, 30}, {37, 29}};
+constexpr uint8_t kPadding = 0xEE;
+
+uint8_t patternSample(int plane, int x, int y) {
+    return (uint8_t) (plane * 85 + x * 7 + y * 13 + (x * y) % 5);
+}
+
+// A frame in one of kLayouts, every row padded, filled with kPadding
+struct Image {
+    std::vector<uint8_t> luma;
+    std::vector<uint8_t> chroma[2];
+    YUVImageView view;
+
+    Image(int width, int height, YUVLayout layout) {
+        int chromaWidth = (width + 1) / 2;
+        int chromaHeight = (height + 1) / 2;
+        view.width = width;
+        view.height = height;
+        view.rowStride[0] = width + 5;
+        view.pixelStride[0] = 1;
+        luma.assign((size_t) view.rowStride[0] * height, kPadding);
+        view.data[0] = luma.data();
+        if (layout == YUVLayout::I420) {
+            view.rowStride[1] = view.rowStride[2] = chromaWidth + 3;
+            view.pixelStride[1] = view.pixelStride[2] = 1;
+        } else {
+            view.rowStride[1] = view.rowStride[2] = chromaWidth * 2 + 4;
+            view.pixelStride[1] = view.pixelStride[2] = 2;
+        }
+        size_t chromaSize = (size_t) view.rowStride[1] * chromaHeight;
+        if (layout == YUVLayout::NV12 || layout == YUVLayout::NV21) {
+            chroma[0].assign(chromaSize + 1, kPadding);
+            int uOffset = layout == YUVLayout::NV21 ? 1 : 0;
+            view.data[1] = chroma[0].data() + uOffset;
+            view.data[2] = chroma[0].data() + 1 - uOffset;
+        } else {
+            chroma[0].assign(chromaSize, kPadding);
+            chroma[1].assign(chromaSize, kPadding);
+            view.data[1] = chroma[0].data();
+            view.data[2] = chroma[1].data();
+        }
+    }
+
+    bool operator==(const Image &other) const {
+        return luma == other.luma && chroma[0] == other.chroma[0] && chroma[1] == other.chroma[1];
+    }
+};
+
+// Writes the pattern sample by sample, whatever the layout
+void writePattern(const YUVImageView &view) {
+    for (int plane = 0; plane < 3; plane++) {
+        int width = plane == 0 ? view.width : (view.width + 1) / 2;
+        int height = plane == 0 ? view.height : (view.height + 1) / 2;
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++) {
+                view.data[plane][(size_t) y * view.rowStride[plane] + (size_t) x * view.pixelStride[plane]] =
+                        patternSample(plane, x, y);
+            }
+        }
+    }
+}
+
+Image patternImage(int width, int height, YUVLayout layout) {
+    Image image(width, height, layout);
+    writePattern(image.view);
+    return image;
+}
+
+void testDetectLayout() {
+    for (YUVLayout layout : kLayouts) {
+        Image image(kSizes[0][0], kSizes[0][1], layout);
+        CHECK(detectLayout(image.view) == layout);
+    }
+}
+
+void testLayoutPairs() {
+    char what[128];
+    for (const int *size : kSizes) {
+        for (YUVLayout from : kLayouts) {
+            Image src = patternImage(size[0], size[1], from);
+            for (YUVLayout to : kLayouts) {
+                Image expected = patternImage(size[0], size[1], to);
+
+                // Bands of a few chroma rows, as a worker pool splits a frame
+                Image banded(size[0], size[1], to);
+                YUVConverter converter;
+                converter.select(src.view, banded.view);
+                int rows = YUVConverter::chromaRows(src.view, banded.view);
+                for (int begin = 0; begin < rows; begin += 4) {
+                    converter.convertRows(src.view, banded.view, begin, std::min(begin + 4, rows));
+                }
+                snprintf(what, sizeof(what), "%dx%d %s -> %s in bands", size[0], size[1], layoutName(from),
+                         layoutName(to));
+                check(banded == expected, what, __FILE__, __LINE__);
+
+                Image whole(size[0], size[1], to);
+                converter.convert(src.view, whole.view);
+                snprintf(what, sizeof(what), "%dx%d %s -> %s", size[0], size[1], layoutName(from), layoutName(to));
+                check(whole == expected, what, __FILE__, __LINE__);
+
+                Image back(size[0], size[1], from);
+                YUVConverter reverse;
+                reverse.convert(whole.view, back.view);
+                snprintf(what, sizeof(what), "%dx%d %s -> %s -> %s", size[0], size[1], layoutName(from),
+                         layoutName(to), layoutName(from));
+                check(back == src, what, __FILE__, __LINE__);
+            }
+        }
+    }
+}
+
+void testExportPacked() {
+    char what[128];
+    for (const int *size : kSizes) {
+        int width = size[0];
+        int height = size[1];
+        size_t packed = packedSize(width, height);
+        for (YUVLayout from : kLayouts) {
+            Image src = patternImage(width, height, from);
+            YUVConverter converter;
+            for (YUVLayout to : kPackedLayouts) {
+                std::vector<uint8_t> expected(packed + 16, kPadding);
+                writePattern(packedView(expected.data(), width, height, to));
+
+                std::vector<uint8_t> actual(packed + 16, kPadding);
+                snprintf(what, sizeof(what), "%dx%d %s exported as %s", width, height, layoutName(from),
+                         layoutName(to));
+                check(converter.exportPacked(src.view, actual.data(), packed, to) && actual == expected, what,
+                      __FILE__, __LINE__);
+
+                // Too small a buffer is left alone
+                std::vector<uint8_t> small(packed - 1, kPadding);
+                CHECK(!converter.exportPacked(src.view, small.data(), small.size(), to));
+                CHECK(small == std::vector<uint8_t>(packed - 1, kPadding));
+            }
+            std::vector<uint8_t> generic(packed, kPadding);
+            CHECK(!converter.exportPacked(src.view, generic.data(), generic.size(), YUVLayout::Generic));
+        }
+    }
+}
+
+}  // namespace
+
+int main() {
+    testDetectLayout();
+    // Converters pick up the backend when they select their kernels, so each one gets every pair
+    for (const SimdKernels *const *kernels = availableSimdKernels(); *kernels != nullptr; kernels++) {
+        selectSimdKernels((*kernels)->name);
+        testLayoutPairs();
+        testExportPacked();
+    }
+    return checkResult();
+}
@@ -0,0 +1,165 @@
+// Host tests of the fused fan-out passes, run by ctest.
+//
+// YUVFanOut's single banded pass must write the same HQ copy and LQ downscale, byte for byte, as a separate
+// YUVConverter::convert and YUVScaler::scale, and gather the same image statistics as the plain copy, for
+// every filter, several layouts and band sizes down to a few rows. YUVMultiOut is held to the same with
+// several scaled targets at once.
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "image_stats.h"
+#include "test_check.h"
+#include "yuv_convert.h"
+#include "yuv_fanout.h"
+#include "yuv_scaler.h"
+
+namespace {
+
+constexpr int kWidth = 64;
+constexpr int kHeight = 48;
+constexpr uint8_t kPadding = 0xEE;
+// A few rows per band, a few bands per frame, and the default
+constexpr int kBandBytes[] = {256, 4096, YUVConverter::kDefaultBandBytes};
+
+std::mt19937 rng(20240611);
+
+// A packed frame with padded rows and guard bytes after it
+struct Image {
+    std::vector<uint8_t> bytes;
+    YUVImageView view;
+
+    Image(int width, int height, YUVLayout layout) {
+        int rowStride = width + 8;
+        bytes.assign(packedSize(width, height, rowStride) + 64, kPadding);
+        view = packedView(bytes.data(), width, height, layout, rowStride);
+    }
+
+    bool operator==(const Image &other) const {
+        return bytes == other.bytes;
+    }
+};
+
+Image randomImage(YUVLayout layout) {
+    Image image(kWidth, kHeight, layout);
+    for (uint8_t &byte : image.bytes) {
+        byte = (uint8_t) rng();
+    }
+    return image;
+}
+
+bool sameStats(const ImageStats &a, const ImageStats &b) {
+    return memcmp(a.histogram, b.histogram, sizeof(a.histogram)) == 0 && a.lumaSum == b.lumaSum &&
+           a.lumaSquares == b.lumaSquares && a.lumaCount == b.lumaCount && a.chromaSum[0] == b.chromaSum[0] &&
+           a.chromaSum[1] == b.chromaSum[1] && a.chromaCount == b.chromaCount;
+}
+
+struct LqCase {
+    int width;
+    int height;
+    ScaleFilter filter;
+};
+
+constexpr LqCase kLqCases[] = {
+        {32, 24, ScaleFilter::Box},
+        {20, 14, ScaleFilter::Area},
+        {40, 30, ScaleFilter::Bilinear},
+        {8, 6, ScaleFilter::Area},
+};
+
+void testFanOut() {
+    char what[160];
+    for (YUVLayout srcLayout : {YUVLayout::I420, YUVLayout::NV12}) {
+        Image src = randomImage(srcLayout);
+        for (YUVLayout hqLayout : {YUVLayout::NV12, YUVLayout::I420, YUVLayout::NV21}) {
+            for (const LqCase &lq : kLqCases) {
+                // Separately: the copy, then the scale
+                Image hqExpected(kWidth, kHeight, hqLayout);
+                Image lqExpected(lq.width, lq.height, YUVLayout::NV12);
+                ImageStats statsExpected;
+                YUVConverter converter;
+                converter.convert(src.view, hqExpected.view, nullptr, YUVConverter::kDefaultBandBytes, &statsExpected);
+                YUVScaler scaler;
+                CHECK(scaler.configure(kWidth, kHeight, lq.width, lq.height, lq.filter));
+                scaler.scale(src.view, lqExpected.view);
+
+                YUVFanOut fanOut;
+                for (int bandBytes : kBandBytes) {
+                    Image hq(kWidth, kHeight, hqLayout);
+                    Image lqImage(lq.width, lq.height, YUVLayout::NV12);
+                    ImageStats stats;
+                    bool fused = fanOut.fanOut(src.view, hq.view, lqImage.view, lq.filter, bandBytes, &stats);
+                    snprintf(what, sizeof(what), "%s -> %s + %dx%d filter %d in bands of %d bytes",
+                             layoutName(srcLayout), layoutName(hqLayout), lq.width, lq.height, (int) lq.filter,
+                             bandBytes);
+                    check(fused && hq == hqExpected && lqImage == lqExpected && sameStats(stats, statsExpected),
+                          what, __FILE__, __LINE__);
+                }
+            }
+        }
+    }
+}
+
+void testUnsupportedScale() {
+    Image src = randomImage(YUVLayout::NV12);
+    Image hq(kWidth, kHeight, YUVLayout::NV12);
+    Image lq(21, 14, YUVLayout::NV12);
+    Image untouched(kWidth, kHeight, YUVLayout::NV12);
+    YUVFanOut fanOut;
+    CHECK(!fanOut.fanOut(src.view, hq.view, lq.view, ScaleFilter::Area));
+    CHECK(hq == untouched);
+}
+
+void testMultiOut() {
+    char what[128];
+    Image src = randomImage(YUVLayout::NV12);
+    for (int bandBytes : kBandBytes) {
+        // A copy after the scaled targets, so the copy lane is not the first
+        YUVMultiOut::Target targets[5];
+        Image outputs[5] = {
+                Image(kLqCases[0].width, kLqCases[0].height, YUVLayout::I420),
+                Image(kLqCases[1].width, kLqCases[1].height, YUVLayout::NV12),
+                Image(kWidth, kHeight, YUVLayout::I420),
+                Image(kLqCases[2].width, kLqCases[2].height, YUVLayout::NV21),
+                Image(kLqCases[3].width, kLqCases[3].height, YUVLayout::NV12),
+        };
+        const ScaleFilter filters[5] = {kLqCases[0].filter, kLqCases[1].filter, ScaleFilter::Area,
+                                        kLqCases[2].filter, kLqCases[3].filter};
+        for (int i = 0; i < 5; i++) {
+            targets[i].view = outputs[i].view;
+            targets[i].filter = filters[i];
+        }
+        YUVMultiOut multiOut;
+        bool written[5];
+        ImageStats stats;
+        CHECK(multiOut.fanOut(src.view, targets, 5, written, bandBytes, &stats));
+
+        for (int i = 0; i < 5; i++) {
+            Image expected(outputs[i].view.width, outputs[i].view.height, detectLayout(outputs[i].view));
+            if (i == 2) {
+                ImageStats statsExpected;
+                YUVConverter().convert(src.view, expected.view, nullptr, YUVConverter::kDefaultBandBytes,
+                                       &statsExpected);
+                CHECK(sameStats(stats, statsExpected));
+            } else {
+                YUVScaler scaler;
+                CHECK(scaler.configure(kWidth, kHeight, expected.view.width, expected.view.height, filters[i]));
+                scaler.scale(src.view, expected.view);
+            }
+            snprintf(what, sizeof(what), "target %d in bands of %d bytes", i, bandBytes);
+            check(written[i] && outputs[i] == expected, what, __FILE__, __LINE__);
+        }
+    }
+}
+
+}  // namespace
+
+int main() {
+    testFanOut();
+    testUnsupportedScale();
+    testMultiOut();
+    return checkResult();
+}
@@ -0,0 +1,336 @@
+// Host tests of the YUV scaler, run by ctest.
+//
+// Box, Bilinear and Area scales of whole frames and of crop windows (which the scaler trims its row loads
+// to) are compared plane by plane with a straightforward reference: Box and Area must match it exactly,
+// Bilinear, which rounds after each pass, to within about one level of the exact interpolation. Planar and
+// interleaved sources and destinations are covered, as are banded scaleRows, the pooled scale() and an Area
+// ratio whose spans average more rows than a uint16 column sum holds.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "test_check.h"
+#include "worker_pool.h"
+#include "yuv_scaler.h"
+#include "yuv_simd.h"
+
+namespace {
+
+constexpr uint8_t kPadding = 0xEE;
+// Exact interpolation against two rounded passes, plus the 1/256 pixel positions
+constexpr double kBilinearTolerance = 1.25;
+
+std::mt19937 rng(20240611);
+
+// A 4:2:0 frame, I420 or NV12, with padded rows
+struct Frame {
+    int width;
+    int height;
+    std::vector<uint8_t> luma;
+    std::vector<uint8_t> chroma;
+    YUVImageView view;
+
+    Frame(int width, int height, bool interleaved) : width(width), height(height) {
+        int chromaWidth = width / 2;
+        int chromaHeight = height / 2;
+        view.width = width;
+        view.height = height;
+        view.rowStride[0] = width + 6;
+        view.pixelStride[0] = 1;
+        luma.assign((size_t) view.rowStride[0] * height, kPadding);
+        view.data[0] = luma.data();
+        if (interleaved) {
+            view.rowStride[1] = view.rowStride[2] = width + 4;
+            view.pixelStride[1] = view.pixelStride[2] = 2;
+            chroma.assign((size_t) view.rowStride[1] * chromaHeight, kPadding);
+            view.data[1] = chroma.data();
+            view.data[2] = chroma.data() + 1;
+        } else {
+            view.rowStride[1] = view.rowStride[2] = chromaWidth + 2;
+            view.pixelStride[1] = view.pixelStride[2] = 1;
+            size_t planeSize = (size_t) view.rowStride[1] * chromaHeight;
+            chroma.assign(planeSize * 2, kPadding);
+            view.data[1] = chroma.data();
+            view.data[2] = chroma.data() + planeSize;
+        }
+    }
+
+    int planeWidth(int plane) const {
+        return plane == 0 ? width : width / 2;
+    }
+
+    int planeHeight(int plane) const {
+        return plane == 0 ? height : height / 2;
+    }
+
+    uint8_t &at(int plane, int x, int y) {
+        return view.data[plane][(size_t) y * view.rowStride[plane] + (size_t) x * view.pixelStride[plane]];
+    }
+
+    // Noise, for the exact filters
+    void fillRandom() {
+        for (int plane = 0; plane < 3; plane++) {
+            for (int y = 0; y < planeHeight(plane); y++) {
+                for (int x = 0; x < planeWidth(plane); x++) {
+                    at(plane, x, y) = (uint8_t) rng();
+                }
+            }
+        }
+    }
+
+    // A gentle gradient, so Bilinear's 1/256 pixel positions stay well under a level
+    void fillSmooth() {
+        for (int plane = 0; plane < 3; plane++) {
+            for (int y = 0; y < planeHeight(plane); y++) {
+                for (int x = 0; x < planeWidth(plane); x++) {
+                    at(plane, x, y) = (uint8_t) (128 + 100 * sin(x * 0.11 + plane) * cos(y * 0.07 - plane));
+                }
+            }
+        }
+    }
+};
+
+// A window in whole pixels
+CropRect pixelWindow(int x, int y, int width, int height) {
+    return {x * CropRect::kOne, y * CropRect::kOne, width * CropRect::kOne, height * CropRect::kOne};
+}
+
+// The rounded mean of the source samples destination sample (dx, dy) covers, the window in whole samples
+uint8_t referenceArea(Frame &src, int plane, int left, int top, int width, int height, int dstWidth,
+                      int dstHeight, int dx, int dy) {
+    int x0 = left + dx * width / dstWidth;
+    int x1 = left + (dx + 1) * width / dstWidth;
+    int y0 = top + dy * height / dstHeight;
+    int y1 = top + (dy + 1) * height / dstHeight;
+    uint64_t total = 0;
+    for (int y = y0; y < y1; y++) {
+        for (int x = x0; x < x1; x++) {
+            total += src.at(plane, x, y);
+        }
+    }
+    uint64_t samples = (uint64_t) (x1 - x0) * (y1 - y0);
+    return (uint8_t) ((total + samples / 2) / samples);
+}
+
+// Source position of destination sample d with pixel centres aligned, clamped into the plane
+double bilinearPosition(double start, double size, int dstSize, int srcSize, int d) {
+    double position = start + (d + 0.5) * size / dstSize - 0.5;
+    return std::min(std::max(position, 0.0), srcSize - 1.0);
+}
+
+double referenceBilinear(Frame &src, int plane, const CropRect &window, int dstWidth, int dstHeight, int dx,
+                         int dy) {
+    double scale = plane == 0 ? CropRect::kOne : 2.0 * CropRect::kOne;
+    double x = bilinearPosition(window.x / scale, window.width / scale, dstWidth, src.planeWidth(plane), dx);
+    double y = bilinearPosition(window.y / scale, window.height / scale, dstHeight, src.planeHeight(plane), dy);
+    int x0 = std::min((int) x, src.planeWidth(plane) - 2);
+    int y0 = std::min((int) y, src.planeHeight(plane) - 2);
+    double fx = x - x0;
+    double fy = y - y0;
+    double top = src.at(plane, x0, y0) * (1 - fx) + src.at(plane, x0 + 1, y0) * fx;
+    double bottom = src.at(plane, x0, y0 + 1) * (1 - fx) + src.at(plane, x0 + 1, y0 + 1) * fx;
+    return top * (1 - fy) + bottom * fy;
+}
+
+// Whether every sample of dst is within tolerance of reference(plane, dx, dy), and the row padding untouched
+template<typename Reference>
+bool matches(Frame &dst, double tolerance, Reference reference) {
+    for (int plane = 0; plane < 3; plane++) {
+        for (int y = 0; y < dst.planeHeight(plane); y++) {
+            for (int x = 0; x < dst.planeWidth(plane); x++) {
+                if (std::fabs(dst.at(plane, x, y) - (double) reference(plane, x, y)) > tolerance) {
+                    return false;
+                }
+            }
+        }
+    }
+    int lumaEnd = dst.width;
+    for (int y = 0; y < dst.height; y++) {
+        for (int x = lumaEnd; x < dst.view.rowStride[0]; x++) {
+            if (dst.luma[(size_t) y * dst.view.rowStride[0] + x] != kPadding) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+void report(bool ok, const char *filter, const Frame &src, const Frame &dst, const char *detail, int line) {
+    char what[160];
+    snprintf(what, sizeof(what), "%s %dx%d -> %dx%d %s on %s", filter, src.width, src.height, dst.width,
+             dst.height, detail, simdKernels().name);
+    check(ok, what, __FILE__, line);
+}
+
+void testBox() {
+    for (bool interleaved : {false, true}) {
+        Frame src(64, 48, interleaved);
+        src.fillRandom();
+        Frame dst(32, 24, !interleaved);
+        YUVScaler scaler;
+        CHECK(scaler.configure(64, 48, 32, 24, ScaleFilter::Box));
+        scaler.scale(src.view, dst.view);
+        bool ok = matches(dst, 0, [&](int plane, int x, int y) {
+            int sum = src.at(plane, x * 2, y * 2) + src.at(plane, x * 2 + 1, y * 2) +
+                      src.at(plane, x * 2, y * 2 + 1) + src.at(plane, x * 2 + 1, y * 2 + 1);
+            return (sum + 2) >> 2;
+        });
+        report(ok, "Box", src, dst, interleaved ? "from NV12" : "from I420", __LINE__);
+
+        // Any other ratio is an Area scale
+        Frame other(20, 14, interleaved);
+        CHECK(scaler.configure(64, 48, 20, 14, ScaleFilter::Box));
+        scaler.scale(src.view, other.view);
+        ok = matches(other, 0, [&](int plane, int x, int y) {
+            int shift = plane == 0 ? 0 : 1;
+            return referenceArea(src, plane, 0, 0, 64 >> shift, 48 >> shift, 20 >> shift, 14 >> shift, x, y);
+        });
+        report(ok, "Box", src, other, "as Area", __LINE__);
+    }
+}
+
+void testArea() {
+    // dst size, window in pixels (whole frame when width is 0)
+    const int cases[][6] = {
+            {20, 14, 0, 0, 0, 0},
+            {6, 4, 0, 0, 0, 0},
+            {32, 24, 0, 0, 0, 0},
+            {18, 10, 8, 6, 40, 30},
+            {10, 8, 22, 14, 36, 28},
+    };
+    for (const int *c : cases) {
+        for (bool interleaved : {false, true}) {
+            Frame src(64, 48, interleaved);
+            src.fillRandom();
+            Frame dst(c[0], c[1], interleaved);
+            CropRect window = c[4] != 0 ? pixelWindow(c[2], c[3], c[4], c[5]) : CropRect::whole(64, 48);
+            YUVScaler scaler;
+            CHECK(scaler.configure(64, 48, c[0], c[1], ScaleFilter::Area, window));
+            scaler.scale(src.view, dst.view);
+            bool ok = matches(dst, 0, [&](int plane, int x, int y) {
+                int shift = plane == 0 ? 0 : 1;
+                int left = window.x / CropRect::kOne >> shift;
+                int top = window.y / CropRect::kOne >> shift;
+                int width = window.width / CropRect::kOne >> shift;
+                int height = window.height / CropRect::kOne >> shift;
+                return referenceArea(src, plane, left, top, width, height, c[0] >> shift, c[1] >> shift, x, y);
+            });
+            report(ok, "Area", src, dst, c[4] != 0 ? "windowed" : "whole", __LINE__);
+        }
+    }
+}
+
+void testBilinear() {
+    // dst size, window in 1/256 pixels (whole frame when width is 0)
+    const int cases[][6] = {
+            {40, 30, 0, 0, 0, 0},
+            {96, 72, 0, 0, 0, 0},
+            {64, 48, 2624, 1600, 8192, 6144},
+            {24, 18, 4000, 3000, 7000, 5500},
+            {128, 96, 0, 0, 1024, 768},
+    };
+    for (const int *c : cases) {
+        for (bool interleaved : {false, true}) {
+            Frame src(64, 48, interleaved);
+            src.fillSmooth();
+            Frame dst(c[0], c[1], !interleaved);
+            CropRect window = c[4] != 0 ? CropRect{c[2], c[3], c[4], c[5]} : CropRect::whole(64, 48);
+            YUVScaler scaler;
+            CHECK(scaler.configure(64, 48, c[0], c[1], ScaleFilter::Bilinear, window));
+            scaler.scale(src.view, dst.view);
+            bool ok = matches(dst, kBilinearTolerance, [&](int plane, int x, int y) {
+                int shift = plane == 0 ? 0 : 1;
+                return referenceBilinear(src, plane, window, c[0] >> shift, c[1] >> shift, x, y);
+            });
+            report(ok, "Bilinear", src, dst, c[4] != 0 ? "windowed" : "whole", __LINE__);
+        }
+    }
+}
+
+void testTallArea() {
+    // 258 luma rows per output row, one more than a uint16 sum of 255s holds, and all of them 255
+    constexpr int kHeight = 4 * 258;
+    for (bool saturated : {true, false}) {
+        Frame src(16, kHeight, false);
+        if (saturated) {
+            for (uint8_t &sample : src.luma) {
+                sample = 255;
+            }
+            for (uint8_t &sample : src.chroma) {
+                sample = 255;
+            }
+        } else {
+            src.fillRandom();
+        }
+        Frame dst(4, 4, true);
+        YUVScaler scaler;
+        CHECK(scaler.configure(16, kHeight, 4, 4, ScaleFilter::Area));
+        scaler.scale(src.view, dst.view);
+        bool ok = matches(dst, 0, [&](int plane, int x, int y) {
+            int shift = plane == 0 ? 0 : 1;
+            return referenceArea(src, plane, 0, 0, 16 >> shift, kHeight >> shift, 4 >> shift, 4 >> shift, x, y);
+        });
+        report(ok, "Area", src, dst, saturated ? "of 258 rows of 255" : "of 258 rows", __LINE__);
+    }
+}
+
+// Banded scaleRows, as a fan-out drives it, and a pooled scale() give the plain scale()'s result
+void testBandsAndPool() {
+    WorkerPool pool(3);
+    for (ScaleFilter filter : {ScaleFilter::Bilinear, ScaleFilter::Area}) {
+        Frame src(64, 48, true);
+        src.fillRandom();
+        YUVScaler scaler;
+        CHECK(scaler.configure(64, 48, 22, 16, filter, pixelWindow(4, 2, 56, 44)));
+        Frame plain(22, 16, false);
+        scaler.scale(src.view, plain.view);
+
+        Frame banded(22, 16, false);
+        int scaled[3] = {0, 0, 0};
+        for (int chromaRows = 3;; chromaRows += 3) {
+            bool last = chromaRows >= 24;
+            for (int plane = 0; plane < 3; plane++) {
+                int readRows = plane == 0 ? chromaRows * 2 : chromaRows;
+                int next = last ? scaler.planeRows(plane) : scaler.readyRows(plane, readRows);
+                scaler.scaleRows(src.view, banded.view, plane, scaled[plane], next);
+                scaled[plane] = next;
+            }
+            if (last) {
+                break;
+            }
+        }
+        CHECK(banded.luma == plain.luma && banded.chroma == plain.chroma);
+
+        Frame pooled(22, 16, false);
+        scaler.scale(src.view, pooled.view, &pool, 64);
+        CHECK(pooled.luma == plain.luma && pooled.chroma == plain.chroma);
+    }
+}
+
+void testRejectedSizes() {
+    YUVScaler scaler;
+    CHECK(!scaler.configure(64, 48, 21, 14, ScaleFilter::Area));
+    CHECK(!scaler.configure(64, 48, 2, 2, ScaleFilter::Area));
+    CHECK(!scaler.configure(64, 48, 32, 24, ScaleFilter::Bilinear, pixelWindow(40, 0, 32, 24)));
+    CHECK(!scaler.configure(64, 48, 32, 24, ScaleFilter::Bilinear, CropRect{0, 0, CropRect::kOne, 4096}));
+}
+
+}  // namespace
+
+int main() {
+    testRejectedSizes();
+    // Scalers pick up the backend when they are configured, so each one gets every case
+    for (const SimdKernels *const *kernels = availableSimdKernels(); *kernels != nullptr; kernels++) {
+        selectSimdKernels((*kernels)->name);
+        testBox();
+        testArea();
+        testBilinear();
+        testTallArea();
+        testBandsAndPool();
+    }
+    return checkResult();
+}